@@ -16,6 +16,12 @@
 #include <avr/io.h>
 #include <util/delay.h>
 
+#include "avrsensors.h"
+
+// filtered battery voltage in quarter millivolts, or 0 before the first reading
+static uint16_t batteryQuarterMillivolts = 0;
+static uint8_t batteryMinutesUntilSample = 0;
+
 long readVcc() 
 {   
 	PRR &= ~(1<<PRADC); // power ADC
@@ -51,6 +57,34 @@ long readVcc()
 	return result; 
 } 
 
+// call once per minute. Reads the battery voltage every BATTERY_SAMPLE_MINUTES, and
+// moves the filtered value a quarter of the way towards each new reading.
+void BatteryUpdate()
+{
+	if (batteryMinutesUntilSample == 0)
+	{
+		uint16_t reading = readVcc() << 2;
+		
+		if (batteryQuarterMillivolts == 0)
+		{
+			batteryQuarterMillivolts = reading;
+		}
+		else
+		{
+			batteryQuarterMillivolts += ((int16_t)(reading - batteryQuarterMillivolts)) >> 2;
+		}
+		
+		batteryMinutesUntilSample = BATTERY_SAMPLE_MINUTES;
+	}
+	
+	batteryMinutesUntilSample--;
+}
+
+uint16_t BatteryGetMillivolts()
+{
+	return (batteryQuarterMillivolts + 2) >> 2;
+}
+
 /*
 long readTemp() 
 {     
@@ -17,7 +17,15 @@
 #ifndef AVRSENSORS_H_
 #define AVRSENSORS_H_
 
+#include <inttypes.h>
+
+// minutes between battery voltage readings
+#define BATTERY_SAMPLE_MINUTES 10
+
 long readVcc();
 long readTemp();
 
+void BatteryUpdate();
+uint16_t BatteryGetMillivolts();
+
 #endif /* AVRSENSORS_H_ */
\ No newline at end of file
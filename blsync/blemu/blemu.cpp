@@ -0,0 +1,1549 @@
+/* 
+  Copyright (c) 2011 Steve Chamberlin
+  Permission is hereby granted, free of charge, to any person obtaining a copy of this hardware, software, and associated documentation 
+  files (the "Product"), to deal in the Product without restriction, including without limitation the rights to use, copy, modify, merge, 
+  publish, distribute, sublicense, and/or sell copies of the Product, and to permit persons to whom the Product is furnished to do so, 
+  subject to the following conditions: 
+
+  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Product. 
+
+  THE PRODUCT IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF 
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+  ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH 
+  THE PRODUCT OR THE USE OR OTHER DEALINGS IN THE PRODUCT.
+
+  blemu - Backwoods Logger emulator, for testing blsync without hardware.
+
+*/
+
+#include <iostream>
+#include <errno.h>
+#include <math.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <termios.h>
+#include <unistd.h>
+#ifdef __APPLE__
+#include <util.h>
+#else
+#include <pty.h>
+#endif
+#include "blemu.h"
+
+using namespace std;
+
+#ifdef __linux__
+// in transport_termios2.cpp
+unsigned long GetCustomBitRate(int fd);
+#endif
+
+// set when the emulator is interrupted or terminated
+volatile bool stopEmulator = false;
+
+void StopEmulatorHandler(int signal)
+{
+    stopEmulator = true;
+}
+
+/* 
+    GetMicroseconds
+    Returns a microsecond counter, for pacing the bytes sent.
+*/
+static double GetMicroseconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/* 
+    WaitUntil
+    Waits until the microsecond counter reaches the given time.
+*/
+static void WaitUntil(double due)
+{
+    double now = GetMicroseconds();
+    if (due <= now)
+        return;
+
+    struct timespec ts;
+    long wait = (long)(due - now);
+    ts.tv_sec = wait / 1000000;
+    ts.tv_nsec = (wait % 1000000) * 1000;
+    nanosleep(&ts, 0);
+}
+
+/* 
+    PackTime
+    Converts minutes since 2000 to the Logger's packed (((year*13 + month)*32 + day)*24 + hour)*60 + minute format.
+*/
+static unsigned int PackTime(long minutes)
+{
+    LoggerTime t;
+    MinutesToTime(minutes, t);
+    return ((((unsigned int)(t.year - 2000) * 13 + t.month) * 32 + t.day) * 24 + t.hour) * 60 + t.minute;
+}
+
+int main(int argc, char* argv[])
+{
+    EmulatorOptions options;
+    options.classic = false;
+    options.skew = 0;
+    options.byteOverhead = 0;
+    options.dropBackToBack = false;
+    options.dropRate = 0;
+    options.corruptRate = 0;
+    options.truncateRate = 0;
+    options.ignoreRate = 0;
+    options.seed = 1;
+    options.deviceId = 0;
+    bool hasDeviceId = false;
+    options.calibrate = true;
+    options.speed = 1;
+    options.numSnapshots = 5;
+    options.graphFilename = 0;
+    options.snapshotFilename = 0;
+    options.useStdio = false;
+    options.verbose = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        char* arg = argv[i];
+        if (strcmp(arg, "--stdio") == 0)
+        {
+            // talk on stdin and stdout, for blsync -p "pty:blemu --stdio"
+            options.useStdio = true;
+        }
+        else if (arg[0] == '-' && arg[1] != 0 && arg[2] == 0)
+        {
+            bool hasValue = (i+1 != argc);
+            if (arg[1] == 'c') 
+            {
+                options.classic = true;
+            }
+            else if (arg[1] == 'm') 
+            {
+                options.dropBackToBack = true;
+            }
+            else if (arg[1] == 'v') 
+            {
+                options.verbose = true;
+            }
+            else if (arg[1] == 'l') 
+            {
+                options.calibrate = false;
+            }
+            else if (arg[1] == 'k' && hasValue) 
+            {
+                options.skew = atof(argv[++i]);
+            }
+            else if (arg[1] == 'o' && hasValue) 
+            {
+                options.byteOverhead = atoi(argv[++i]);
+            }
+            else if (arg[1] == 'd' && hasValue) 
+            {
+                options.dropRate = atof(argv[++i]);
+            }
+            else if (arg[1] == 'x' && hasValue) 
+            {
+                options.corruptRate = atof(argv[++i]);
+            }
+            else if (arg[1] == 'u' && hasValue) 
+            {
+                options.truncateRate = atof(argv[++i]);
+            }
+            else if (arg[1] == 'z' && hasValue) 
+            {
+                options.ignoreRate = atof(argv[++i]);
+            }
+            else if (arg[1] == 'e' && hasValue) 
+            {
+                options.seed = strtoul(argv[++i], 0, 10);
+            }
+            else if (arg[1] == 'i' && hasValue) 
+            {
+                options.deviceId = strtoul(argv[++i], 0, 16);
+                hasDeviceId = true;
+            }
+            else if (arg[1] == 'a' && hasValue) 
+            {
+                options.speed = atoi(argv[++i]);
+            }
+            else if (arg[1] == 'n' && hasValue) 
+            {
+                options.numSnapshots = atoi(argv[++i]);
+            }
+            else if (arg[1] == 'g' && hasValue) 
+            {
+                options.graphFilename = argv[++i];
+            }
+            else if (arg[1] == 's' && hasValue) 
+            {
+                options.snapshotFilename = argv[++i];
+            }
+            else
+            {
+                cerr << "Unknown option " << arg << "." << endl << endl;
+                Usage();
+                return 1;
+            }
+        }
+        else
+        {
+            cerr << "Unknown option " << arg << "." << endl << endl;
+            Usage();
+            return 1;
+        }
+    }
+
+    if (options.speed < 1 || options.speed > 1000)
+    {
+        cerr << "Error: the speed must be between 1 and 1000." << endl;
+        return 1;
+    }
+
+    // without -i, each seed is a different Logger
+    if (!hasDeviceId)
+    {
+        options.deviceId = ((unsigned int)options.seed * 2654435761u) ^ 0xB0D5B0D5u;
+    }
+
+    EmulatedLogger logger(options);
+    if (options.graphFilename && !logger.LoadGraphs(options.graphFilename))
+        return 1;
+    if (options.snapshotFilename && !logger.LoadSnapshots(options.snapshotFilename))
+        return 1;
+
+    signal(SIGINT, StopEmulatorHandler);
+    signal(SIGTERM, StopEmulatorHandler);
+
+    if (options.useStdio)
+    {
+        logger.Run(STDIN_FILENO, STDOUT_FILENO, STDIN_FILENO);
+    }
+    else
+    {
+        int master, slave;
+        if (openpty(&master, &slave, 0, 0, 0) != 0)
+        {
+            cerr << "Error: " << strerror(errno) << endl;
+            return 1;
+        }
+
+        // keep the slave side open, so the emulator keeps running while blsync opens and closes the port
+        struct termios tio;
+        if (tcgetattr(slave, &tio) == 0)
+        {
+            cfmakeraw(&tio);
+            tcsetattr(slave, TCSANOW, &tio);
+        }
+
+        cout << "Logger emulator running on " << ttyname(slave) << ". Press Ctrl-C to stop." << endl;
+        logger.Run(master, master, slave);
+
+        close(slave);
+        close(master);
+    }
+
+    logger.PrintSummary();
+    return 0;
+}
+
+EmulatedLogger::EmulatedLogger(const EmulatorOptions& options) :
+    options(options),
+    inFd(-1),
+    outFd(-1),
+    rateFd(-1),
+    randomState(((unsigned int)options.seed ^ 0x5DEECE66u) * 2654435761u | 1),
+    eepromGeneration(1),
+    bootCount(1),
+    dataChangeCount(0),
+    tripAscent(0),
+    tripDescent(0),
+    tripMaxAltitude(-32768),
+    tripMinAltitude(32767),
+    tripElapsedMinutes(0),
+    tripAnchorAltitude(0),
+    tripDirection(0),
+    inputPos(0),
+    outputDue(0),
+    garbleChance(0),
+    truncateAfter(-1),
+    checksum(0),
+    framing(false),
+    frameLength(0),
+    frameIndex(0),
+    frameSelected(FRAME_ALL_BLOCKS),
+    streamInterval(0),
+    streamCountdown(0),
+    streamMinutesLeft(0),
+    streamSequence(0),
+    commandCount(0),
+    bytesSent(0),
+    bytesLost(0),
+    faultCount(0),
+    busyTime(0)
+{
+    // same graphs and snapshot space as the firmware
+    if (options.classic)
+    {
+        samplesPerGraph = 84;
+        minutesPerSample[0] = 1;
+        minutesPerSample[1] = 6;
+        minutesPerSample[2] = 30;
+    }
+    else
+    {
+        samplesPerGraph = 128;
+        minutesPerSample[0] = 1;
+        minutesPerSample[1] = 5;
+        minutesPerSample[2] = 30;
+    }
+    maxSnapshots = (1024 - 16 - samplesPerGraph * (int)sizeof(Sample) - TRIP_STATS_SIZE) / (int)sizeof(Snapshot);
+
+    // the Logger's clock starts at the host's local time
+    time_t now = time(0);
+    struct tm* pLocal = localtime(&now);
+    LoggerTime t;
+    t.year = pLocal->tm_year + 1900;
+    t.month = pLocal->tm_mon + 1;
+    t.day = pLocal->tm_mday;
+    t.hour = pLocal->tm_hour;
+    t.minute = pLocal->tm_min;
+    t.second = 0;
+    clockMinutes = TimeToMinutes(t);
+    clockSecond = pLocal->tm_sec;
+
+    // small seeds start the generator with small numbers, so skip those
+    for (int i=0; i<8; i++)
+    {
+        Random();
+    }
+
+    byteTime = BITS_PER_BYTE * 1e6 / (NOMINAL_BIT_RATE * (1 + options.skew / 100)) + options.byteOverhead;
+
+    FillRings();
+    FillSnapshots();
+}
+
+/* 
+    LoadGraphs
+    Replaces the synthetic sample rings with graph data saved by blsync -r -g.
+    Returns true if successful, false if an error occurred.
+*/
+bool EmulatedLogger::LoadGraphs(const char* filename)
+{
+    FILE* pFile = fopen(filename, "rb");
+    if (pFile == 0)
+    {
+        cerr << "Error: " << filename << ": " << strerror(errno) << endl;
+        return false;
+    }
+
+    std::vector<unsigned char> data;
+    unsigned char buf[4096];
+    size_t bytesRead;
+    while ((bytesRead = fread(buf, 1, sizeof(buf), pFile)) > 0)
+    {
+        data.insert(data.end(), buf, buf + bytesRead);
+    }
+    fclose(pFile);
+
+    if (data.size() < 9 || data[0] != 1 || data[1] != NUM_TIME_SCALES || data[2] == 0 ||
+        data.size() != 9 + NUM_TIME_SCALES * (2 + sizeof(Sample) * data[2]))
+    {
+        cerr << "Error: " << filename << " is not a raw binary graph file from blsync." << endl;
+        return false;
+    }
+
+    samplesPerGraph = data[2];
+
+    // the clock continues from the time the graphs were saved
+    LoggerTime t;
+    t.second = 0;
+    t.minute = data[4];
+    t.hour = data[5];
+    t.day = data[6];
+    t.month = data[7];
+    t.year = 2000 + data[8];
+    clockMinutes = TimeToMinutes(t);
+    clockSecond = data[3];
+
+    size_t pos = 9;
+    for (int g=0; g<NUM_TIME_SCALES; g++)
+    {
+        minutesPerSample[g] = data[pos] * 256 + data[pos+1];
+        if (minutesPerSample[g] == 0)
+        {
+            minutesPerSample[g] = 1;
+        }
+        pos += 2;
+
+        // oldest sample first
+        rings[g].resize(samplesPerGraph);
+        for (int s=0; s<samplesPerGraph; s++)
+        {
+            memcpy(&rings[g][s], &data[pos], sizeof(Sample));
+            pos += sizeof(Sample);
+        }
+        nextSampleIndex[g] = 0;
+        sampleSequence[g] = samplesPerGraph;
+    }
+
+    maxSnapshots = (1024 - 16 - samplesPerGraph * (int)sizeof(Sample) - TRIP_STATS_SIZE) / (int)sizeof(Snapshot);
+    if ((int)snapshots.size() > maxSnapshots)
+    {
+        snapshots.erase(snapshots.begin(), snapshots.end() - maxSnapshots);
+    }
+
+    return true;
+}
+
+/* 
+    LoadSnapshots
+    Replaces the synthetic snapshots with snapshot data saved by blsync -r -s.
+    Returns true if successful, false if an error occurred.
+*/
+bool EmulatedLogger::LoadSnapshots(const char* filename)
+{
+    FILE* pFile = fopen(filename, "rb");
+    if (pFile == 0)
+    {
+        cerr << "Error: " << filename << ": " << strerror(errno) << endl;
+        return false;
+    }
+
+    unsigned char header[2];
+    bool valid = (fread(header, 1, 2, pFile) == 2 && header[0] == 1);
+
+    snapshots.clear();
+    Snapshot snapshot;
+    while (valid && (int)snapshots.size() < header[1] && fread(&snapshot, sizeof(Snapshot), 1, pFile) == 1)
+    {
+        snapshots.push_back(snapshot);
+    }
+    fclose(pFile);
+
+    if (!valid || (int)snapshots.size() != header[1])
+    {
+        cerr << "Error: " << filename << " is not a raw binary snapshot file from blsync." << endl;
+        return false;
+    }
+
+    // keep only as many as the Logger has room for
+    if ((int)snapshots.size() > maxSnapshots)
+    {
+        snapshots.erase(snapshots.begin(), snapshots.end() - maxSnapshots);
+    }
+
+    return true;
+}
+
+/* 
+    SyntheticSample
+    Makes up a sample for the given time: a daily temperature cycle, and a hike that climbs and descends 
+    every few hours, with the matching air pressure. The same time and seed always give the same sample.
+*/
+Sample EmulatedLogger::SyntheticSample(long minute, int second)
+{
+    const double pi = 3.14159265358979;
+    double t = minute + second / 60.0;
+
+    unsigned int x = (unsigned int)(minute * 60 + second) * 2654435761u ^ (unsigned int)options.seed;
+    x ^= x >> 13;
+    x *= 1274126177u;
+    x ^= x >> 16;
+    double noise = (x & 0xFFFF) / 32768.0 - 1;
+
+    double temperature = 60 + 12 * sin(2 * pi * (t / 1440 - 0.375)) + noise; // degrees F
+    double altitude = 4000 + 1500 * sin(2 * pi * t / 360) + 200 * sin(2 * pi * t / 37); // feet
+    double pressure = 1013.25 * pow(1 - 6.8756e-6 * altitude, 5.2559) + 3 * sin(2 * pi * t / 4320); // millibars
+
+    long st = (long)floor((temperature * 10 - TEMPERATURE_MIN) / TEMPERATURE_SCALE + 0.5);
+    long sp = (long)floor((pressure * 100 - PRESSURE_MIN) / PRESSURE_SCALE + 0.5);
+    long sa = (long)floor((altitude - ALTITUDE_MIN) / ALTITUDE_SCALE + 0.5);
+
+    Sample sample;
+    sample.temperature = st < 0 ? 0 : st >= (1L<<TEMPERATURE_BITS) ? (1L<<TEMPERATURE_BITS)-1 : st;
+    sample.pressure = sp < 0 ? 0 : sp >= (1L<<PRESSURE_BITS) ? (1L<<PRESSURE_BITS)-1 : sp;
+    sample.altitude = sa < 0 ? 0 : sa >= (1L<<ALTITUDE_BITS) ? (1L<<ALTITUDE_BITS)-1 : sa;
+    return sample;
+}
+
+/* 
+    FillRings
+    Fills every graph with synthetic samples, as if the Logger had been running for a while.
+*/
+void EmulatedLogger::FillRings()
+{
+    for (int g=0; g<NUM_TIME_SCALES; g++)
+    {
+        // samples are taken when the minutes since midnight are a multiple of minutesPerSample
+        long newest = clockMinutes - clockMinutes % minutesPerSample[g];
+
+        rings[g].resize(samplesPerGraph);
+        for (int s=0; s<samplesPerGraph; s++)
+        {
+            rings[g][s] = SyntheticSample(newest - (long)(samplesPerGraph - 1 - s) * minutesPerSample[g], 0);
+        }
+        nextSampleIndex[g] = 0;
+        sampleSequence[g] = samplesPerGraph;
+    }
+}
+
+/* 
+    FillSnapshots
+    Makes up some snapshots, taken every hour and a half before now.
+*/
+void EmulatedLogger::FillSnapshots()
+{
+    int count = options.numSnapshots < maxSnapshots ? options.numSnapshots : maxSnapshots;
+
+    snapshots.clear();
+    for (int s=count; s>0; s--)
+    {
+        Snapshot snapshot;
+        long minute = clockMinutes - s * 90;
+        snapshot.packedYearMonthDayHourMin = PackTime(minute);
+        snapshot.sample = SyntheticSample(minute, 0);
+        snapshots.push_back(snapshot);
+    }
+}
+
+/* 
+    StoreSample
+    Stores a new sample at the start of each minute, in each graph whose sample interval has come around.
+*/
+void EmulatedLogger::StoreSample()
+{
+    Sample sample = SyntheticSample(clockMinutes, 0);
+    dataChangeCount++;
+
+    for (int g=0; g<NUM_TIME_SCALES; g++)
+    {
+        if (g == 0 || clockMinutes % minutesPerSample[g] == 0)
+        {
+            rings[g][nextSampleIndex[g]] = sample;
+            nextSampleIndex[g] = (nextSampleIndex[g] + 1) % samplesPerGraph;
+            sampleSequence[g]++;
+        }
+    }
+
+    UpdateTrip(sample);
+}
+
+/* 
+    UpdateTrip
+    Adds a new sample to the trip statistics, with the same hysteresis as the firmware. The emulated Logger has 
+    no shake sensor, so it never reports any moving time.
+*/
+void EmulatedLogger::UpdateTrip(const Sample& sample)
+{
+    int altitude = sample.altitude * ALTITUDE_SCALE + ALTITUDE_MIN;
+
+    if (tripElapsedMinutes < 0xFFFF)
+    {
+        tripElapsedMinutes++;
+    }
+
+    if (tripMaxAltitude < tripMinAltitude)
+    {
+        tripAnchorAltitude = altitude;
+    }
+    else if (altitude > tripAnchorAltitude)
+    {
+        if (tripDirection > 0 || altitude - tripAnchorAltitude > TRIP_HYSTERESIS)
+        {
+            tripAscent += altitude - tripAnchorAltitude;
+            tripAnchorAltitude = altitude;
+            tripDirection = 1;
+        }
+    }
+    else if (altitude < tripAnchorAltitude)
+    {
+        if (tripDirection < 0 || tripAnchorAltitude - altitude > TRIP_HYSTERESIS)
+        {
+            tripDescent += tripAnchorAltitude - altitude;
+            tripAnchorAltitude = altitude;
+            tripDirection = -1;
+        }
+    }
+
+    if (altitude > tripMaxAltitude)
+    {
+        tripMaxAltitude = altitude;
+    }
+    if (altitude < tripMinAltitude)
+    {
+        tripMinAltitude = altitude;
+    }
+}
+
+/* 
+    Tick
+    Advances the Logger's clock by one second.
+*/
+void EmulatedLogger::Tick()
+{
+    clockSecond++;
+    if (clockSecond == 60)
+    {
+        clockSecond = 0;
+        clockMinutes++;
+        StoreSample();
+    }
+
+    if (StreamTick())
+    {
+        SendStreamRecord();
+    }
+}
+
+/* 
+    Run
+    Answers commands and advances the clock until the emulator is stopped, or the host closes the connection.
+*/
+void EmulatedLogger::Run(int inFd, int outFd, int rateFd)
+{
+    this->inFd = inFd;
+    this->outFd = outFd;
+    this->rateFd = rateFd;
+
+    double tickTime = 1e6 / options.speed;
+    double nextTick = GetMicroseconds() + tickTime;
+
+    while (!stopEmulator)
+    {
+        double now = GetMicroseconds();
+        int timeout = nextTick > now ? (int)((nextTick - now) / 1000) + 1 : 0;
+
+        if (inputPos == input.size() && ReadInput(timeout) < 0)
+            break;
+
+        if (inputPos < input.size())
+        {
+            // the first byte only wakes the Logger- it's gone by the time the interrupt routine is ready to read
+            inputPos++;
+
+            double start = GetMicroseconds();
+            DoCommand();
+            busyTime += GetMicroseconds() - start;
+        }
+
+        while (GetMicroseconds() >= nextTick)
+        {
+            Tick();
+            nextTick += tickTime;
+        }
+    }
+
+    FlushOutput();
+}
+
+/* 
+    PrintSummary
+    Prints statistics about the emulator session.
+*/
+void EmulatedLogger::PrintSummary()
+{
+    cerr << "Handled " << commandCount << " commands, sent " << bytesSent << " bytes";
+    if (bytesLost)
+    {
+        cerr << ", lost " << bytesLost << " bytes";
+    }
+    cerr << ", injected " << faultCount << " faults, busy for " << (long)(busyTime / 1000) << " ms." << endl;
+}
+
+/* 
+    ReadInput
+    Waits up to timeout milliseconds for bytes from the host, and adds them to the input.
+    Returns the number of bytes read, 0 on timeout, or -1 if the host closed the connection.
+*/
+int EmulatedLogger::ReadInput(int timeout)
+{
+    if (inputPos == input.size())
+    {
+        input.clear();
+        inputBackToBack.clear();
+        inputPos = 0;
+    }
+
+    struct pollfd pfd;
+    pfd.fd = inFd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+
+    int result = poll(&pfd, 1, timeout);
+    if (result < 0)
+        return errno == EINTR ? 0 : -1;
+    if (result == 0)
+        return 0;
+
+    unsigned char buf[256];
+    ssize_t bytesRead = read(inFd, buf, sizeof(buf));
+    if (bytesRead < 0)
+        return (errno == EINTR || errno == EAGAIN) ? 0 : -1;
+    if (bytesRead == 0)
+        return -1;
+
+    // bytes that arrive together were sent without a gap between them
+    for (ssize_t i=0; i<bytesRead; i++)
+    {
+        input.push_back(buf[i]);
+        inputBackToBack.push_back(i > 0);
+    }
+
+    return (int)bytesRead;
+}
+
+/* 
+    ReceiveByte
+    Gets the next byte from the host, like SerialReceiveByte.
+    Returns the byte, or 0 if nothing arrives for RECEIVE_TIMEOUT milliseconds.
+*/
+int EmulatedLogger::ReceiveByte()
+{
+    while (true)
+    {
+        if (inputPos == input.size() && ReadInput(RECEIVE_TIMEOUT) <= 0)
+            return 0;
+
+        unsigned char c = input[inputPos];
+        bool backToBack = inputBackToBack[inputPos];
+        inputPos++;
+
+        // a slow Logger is still busy with the previous byte when the next start bit arrives
+        if (options.dropBackToBack && backToBack)
+        {
+            bytesLost++;
+            continue;
+        }
+
+        if (Chance(garbleChance))
+        {
+            c ^= 1 << (Random() % 8);
+        }
+
+        return c;
+    }
+}
+
+/* 
+    DoCommand
+    Waits for the "CMD" prefix and a command, like SerialDoCommand.
+*/
+void EmulatedLogger::DoCommand()
+{
+    commandCount++;
+
+    // a host bit rate that's too far from the Logger's garbles bytes in both directions
+    double mismatch = GetRateMismatch();
+    if (mismatch <= RATE_TOLERANCE_MIN)
+        garbleChance = 0;
+    else if (mismatch >= RATE_TOLERANCE_MAX)
+        garbleChance = 1;
+    else
+        garbleChance = (mismatch - RATE_TOLERANCE_MIN) / (RATE_TOLERANCE_MAX - RATE_TOLERANCE_MIN);
+
+    if (Chance(options.ignoreRate))
+    {
+        // the Logger missed the wake-up, and doesn't notice the rest of the command
+        faultCount++;
+        if (options.verbose)
+            cerr << "Fault: ignoring a command" << endl;
+
+        while (ReadInput(RECEIVE_TIMEOUT / 10) > 0)
+        {
+        }
+        inputPos = input.size();
+        return;
+    }
+
+    const char* commandPrefix = "CMD";
+    int index = 0;
+    int readCount = 0;
+
+    // wait for command prefix "CMD"
+    while (readCount < 5)
+    {
+        int c = ReceiveByte();
+        if (c == commandPrefix[index])
+        {
+            index++;
+            if (index == 3)
+            {
+                int cmd = ReceiveByte();
+                if (cmd != 0)
+                {
+                    DispatchCommand((unsigned char)cmd);
+                }
+                break;
+            }
+        }
+        else if (c == commandPrefix[0])
+        {
+            index = 1;
+        }
+        else
+        {
+            index = 0;
+        }
+
+        readCount++;
+    }
+}
+
+/* 
+    DispatchCommand
+    Receives any command arguments, and sends the result, like SerialDispatchCommand.
+*/
+void EmulatedLogger::DispatchCommand(unsigned char cmd)
+{
+    unsigned char framedCmd = cmd;
+    if (cmd == CMD_FRAMED || cmd == CMD_RETRANSMIT)
+    {
+        cmd = ReceiveByte();
+    }
+
+    // receive any command arguments before replying
+    unsigned char args[MAX_ARGS] = {0};
+    int numArgs = 0;
+    if (cmd == CMD_GETSAMPLESSINCE)
+    {
+        numArgs = 6;
+    }
+    else if (cmd == CMD_STREAM)
+    {
+        numArgs = 2;
+    }
+    else if (cmd == CMD_GETGRAPHS && framedCmd != cmd)
+    {
+        numArgs = 1;
+    }
+
+    for (int i=0; i<numArgs; i++)
+    {
+        args[i] = ReceiveByte();
+    }
+
+    // time the calibration bytes before replying, instead of receiving them
+    int calibrateCount = 0;
+    if (cmd == CMD_CALIBRATE && options.calibrate)
+    {
+        calibrateCount = ReceiveCalibration();
+    }
+
+    frameSelected = FRAME_ALL_BLOCKS;
+    if (framedCmd == CMD_RETRANSMIT)
+    {
+        frameSelected = ReceiveByte();
+        frameSelected |= ReceiveByte() << 8;
+    }
+
+    if (options.verbose)
+    {
+        cerr << "Command '" << cmd << "'";
+        if (framedCmd == CMD_FRAMED)
+            cerr << ", framed";
+        else if (framedCmd == CMD_RETRANSMIT)
+            cerr << ", retransmit block " << frameSelected;
+        cerr << endl;
+    }
+
+    BeginReply();
+
+    // send "LOG" prefix
+    SendByte('L');
+    SendByte('O');
+    SendByte('G');
+
+    if (framedCmd == CMD_FRAMED || framedCmd == CMD_RETRANSMIT)
+    {
+        unsigned int generation = ((unsigned int)bootCount << 8) | dataChangeCount;
+        TransmitByte(FRAME_VERSION);
+        TransmitByte(FRAME_BLOCK_SIZE);
+        TransmitByte(generation & 0xFF);
+        TransmitByte(generation >> 8);
+
+        framing = true;
+        frameIndex = 0;
+        frameLength = 0;
+    }
+
+    // send the result of the command
+    checksum = 0;
+    switch (cmd)
+    {
+        case CMD_VERSION:
+            for (const char* p = EMULATOR_VERSION; *p != 0; p++)
+            {
+                SendByte(*p);
+            }
+            SendByte(0);
+            break;
+
+        case CMD_GETGRAPHS:
+            SendGraphs(numArgs ? args[0] : 1);
+            break;
+
+        case CMD_GETSNAPSHOTS:
+            SendSnapshots();
+            break;
+
+        case CMD_GETSAMPLESSINCE:
+            SendSamplesSince(args[0], args[1], args[2] | (args[3] << 8) | (args[4] << 16) | ((unsigned int)args[5] << 24));
+            break;
+
+        case CMD_STREAM:
+            StartStream(args[0], args[1]);
+            break;
+
+        case CMD_GETID:
+            if (options.deviceId != 0)
+            {
+                SendDeviceId();
+            }
+            break;
+
+        case CMD_GETTRIP:
+            SendTripStats();
+            break;
+
+        case CMD_CALIBRATE:
+            if (options.calibrate)
+            {
+                SendCalibration(calibrateCount);
+            }
+            break;
+
+        default:
+            // unrecognized command- do nothing
+            break;
+    }
+
+    if (framing)
+    {
+        // send the last, partially filled block
+        FlushFrame();
+
+        // if a retransmitted block is past the end of the result, send it as an empty last block
+        if (frameSelected != FRAME_ALL_BLOCKS && frameSelected >= frameIndex)
+        {
+            frameIndex = frameSelected;
+            FlushFrame();
+        }
+
+        framing = false;
+    }
+    else
+    {
+        // send the checksum
+        SendByte(checksum);
+    }
+
+    EndReply();
+}
+
+/* 
+    BeginReply
+    Starts timing the bytes of a reply, and decides whether it will be cut short.
+*/
+void EmulatedLogger::BeginReply()
+{
+    double now = GetMicroseconds();
+    if (outputDue < now)
+    {
+        outputDue = now;
+    }
+
+    truncateAfter = -1;
+    if (Chance(options.truncateRate))
+    {
+        faultCount++;
+        truncateAfter = Random() % 64;
+        if (options.verbose)
+            cerr << "Fault: stopping the reply after " << truncateAfter << " bytes" << endl;
+    }
+}
+
+/* 
+    EndReply
+    Sends whatever is left of a reply, and waits until the last byte is due.
+*/
+void EmulatedLogger::EndReply()
+{
+    FlushOutput();
+}
+
+/* 
+    SendByte
+    Sends one byte of a command result, either directly or as part of a block, like SerialSendByte.
+*/
+void EmulatedLogger::SendByte(unsigned char c)
+{
+    if (framing)
+    {
+        frameBuffer[frameLength++] = c;
+        if (frameLength == FRAME_BLOCK_SIZE)
+        {
+            FlushFrame();
+        }
+    }
+    else
+    {
+        checksum ^= c;
+        TransmitByte(c);
+    }
+}
+
+/* 
+    TransmitByte
+    Sends one byte to the host, taking as long as the Logger would to send it, and applying any faults.
+*/
+void EmulatedLogger::TransmitByte(unsigned char c)
+{
+    bytesSent++;
+    outputDue += byteTime;
+
+    if (truncateAfter >= 0)
+    {
+        if (truncateAfter == 0)
+        {
+            bytesLost++;
+            return;
+        }
+        truncateAfter--;
+    }
+
+    if (Chance(options.dropRate))
+    {
+        faultCount++;
+        bytesLost++;
+        return;
+    }
+
+    if (Chance(options.corruptRate))
+    {
+        faultCount++;
+        c ^= 1 << (Random() % 8);
+    }
+
+    if (Chance(garbleChance))
+    {
+        c ^= 1 << (Random() % 8);
+    }
+
+    output.push_back(c);
+    if (output.size() * byteTime >= PACING_CHUNK)
+    {
+        FlushOutput();
+    }
+}
+
+/* 
+    FlushOutput
+    Writes the waiting bytes to the host, then waits until the last of them is due, so the host receives 
+    them no faster than the Logger could send them.
+*/
+void EmulatedLogger::FlushOutput()
+{
+    size_t pos = 0;
+    while (pos < output.size())
+    {
+        ssize_t bytesWritten = write(outFd, &output[pos], output.size() - pos);
+        if (bytesWritten < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            // the host went away
+            break;
+        }
+        pos += bytesWritten;
+    }
+    output.clear();
+
+    WaitUntil(outputDue);
+}
+
+/* 
+    FlushFrame
+    Sends the current block, if it's the one selected, like SerialFlushFrame.
+*/
+void EmulatedLogger::FlushFrame()
+{
+    if (frameSelected == FRAME_ALL_BLOCKS || frameSelected == frameIndex)
+    {
+        unsigned short crc = 0;
+        unsigned char header[3] = { (unsigned char)(frameIndex & 0xFF), (unsigned char)(frameIndex >> 8), (unsigned char)frameLength };
+
+        for (int i=0; i<3; i++)
+        {
+            crc = Crc16Update(crc, header[i]);
+            TransmitByte(header[i]);
+        }
+
+        for (int i=0; i<FRAME_BLOCK_SIZE; i++)
+        {
+            unsigned char c = (i < frameLength) ? frameBuffer[i] : 0;
+            crc = Crc16Update(crc, c);
+            TransmitByte(c);
+        }
+
+        TransmitByte(crc & 0xFF);
+        TransmitByte(crc >> 8);
+    }
+
+    frameIndex++;
+    frameLength = 0;
+}
+
+/* 
+    SendGraphs
+    Sends all the graphs, with raw (version 1) or delta encoded (version 2) samples, like SerialSendGraphs.
+*/
+void EmulatedLogger::SendGraphs(unsigned char version)
+{
+    if (version > 2)
+    {
+        version = 2;
+    }
+    else if (version < 1)
+    {
+        version = 1;
+    }
+    SendByte(version);
+
+    SendByte(NUM_TIME_SCALES);
+    SendByte(samplesPerGraph);
+
+    LoggerTime now;
+    MinutesToTime(clockMinutes, now);
+    SendByte(clockSecond);
+    SendByte(now.minute);
+    SendByte(now.hour);
+    SendByte(now.day);
+    SendByte(now.month);
+    SendByte(now.year - 2000);
+
+    for (int g=0; g<NUM_TIME_SCALES; g++)
+    {
+        SendByte(minutesPerSample[g] >> 8);
+        SendByte(minutesPerSample[g] & 0xFF);
+
+        if (version == 2)
+        {
+            SendEncodedGraph(g);
+            continue;
+        }
+
+        int index = nextSampleIndex[g];
+        for (int s=0; s<samplesPerGraph; s++)
+        {
+            Sample* pSample = &rings[g][index];
+            index = (index + 1) % samplesPerGraph;
+
+            for (size_t i=0; i<sizeof(Sample); i++)
+            {
+                SendByte(*((unsigned char*)pSample + i));
+            }
+        }
+    }
+}
+
+/* 
+    SendVarint
+    Sends a zigzag varint: 7 bits per byte LSB first, high bit set on all but the last byte.
+*/
+void EmulatedLogger::SendVarint(int value)
+{
+    unsigned short z = (unsigned short)(((unsigned short)value << 1) ^ (unsigned short)((short)value >> 15));
+    while (z >= 0x80)
+    {
+        SendByte(z | 0x80);
+        z >>= 7;
+    }
+    SendByte(z);
+}
+
+/* 
+    SendEncodedGraph
+    Sends one graph's samples in the version 2 delta encoding, like SerialSendEncodedGraph.
+*/
+void EmulatedLogger::SendEncodedGraph(int g)
+{
+    int index = nextSampleIndex[g];
+    Sample prev = { 0, 0, 0 };
+    int repeats = 0;
+
+    for (int s=0; s<samplesPerGraph; s++)
+    {
+        Sample* pSample = &rings[g][index];
+        index = (index + 1) % samplesPerGraph;
+
+        int dt = (int)pSample->temperature - (int)prev.temperature;
+        int dp = (int)pSample->pressure - (int)prev.pressure;
+        int da = (int)pSample->altitude - (int)prev.altitude;
+        prev = *pSample;
+
+        if (dt == 0 && dp == 0 && da == 0)
+        {
+            repeats++;
+            if (repeats == 64)
+            {
+                SendByte(0x80 | 63);
+                repeats = 0;
+            }
+            continue;
+        }
+
+        if (repeats)
+        {
+            SendByte(0x80 | (repeats-1));
+            repeats = 0;
+        }
+
+        if (dt >= -2 && dt <= 1 && dp >= -2 && dp <= 1 && da >= -4 && da <= 3)
+        {
+            SendByte(((dt & 0x3) << 5) | ((dp & 0x3) << 3) | (da & 0x7));
+        }
+        else
+        {
+            SendByte(0xC0);
+            SendVarint(dt);
+            SendVarint(dp);
+            SendVarint(da);
+        }
+    }
+
+    if (repeats)
+    {
+        SendByte(0x80 | (repeats-1));
+    }
+}
+
+/* 
+    SendSnapshots
+    Sends all the snapshots, oldest first, like SerialSendSnapshots.
+*/
+void EmulatedLogger::SendSnapshots()
+{
+    SendByte(1);
+    SendByte((unsigned char)snapshots.size());
+
+    for (size_t s=0; s<snapshots.size(); s++)
+    {
+        for (size_t i=0; i<sizeof(Snapshot); i++)
+        {
+            SendByte(*((unsigned char*)&snapshots[s] + i));
+        }
+    }
+}
+
+/* 
+    SendSamplesSince
+    Sends the samples in one graph newer than the host's sequence number, like SerialSendSamplesSince.
+*/
+void EmulatedLogger::SendSamplesSince(unsigned char timescale, unsigned char generation, unsigned int sequence)
+{
+    SendByte(1);
+
+    if (timescale >= NUM_TIME_SCALES)
+    {
+        timescale = 0;
+    }
+    SendByte(timescale);
+
+    // SRAM graphs restart at every boot, the EEPROM graph restarts when the EEPROM is cleared
+    unsigned char currentGeneration = (timescale < NUM_SRAM_TIME_SCALES) ? bootCount : eepromGeneration;
+    SendByte(currentGeneration);
+
+    LoggerTime now;
+    MinutesToTime(clockMinutes, now);
+    SendByte(clockSecond);
+    SendByte(now.minute);
+    SendByte(now.hour);
+    SendByte(now.day);
+    SendByte(now.month);
+    SendByte(now.year - 2000);
+
+    SendByte(minutesPerSample[timescale] >> 8);
+    SendByte(minutesPerSample[timescale] & 0xFF);
+
+    // send everything still in the graph if the host's sequence number is from another generation, or is too old
+    unsigned int nextSequence = sampleSequence[timescale];
+    unsigned int retained = nextSequence < (unsigned int)samplesPerGraph ? nextSequence : samplesPerGraph;
+    if (generation != currentGeneration || sequence > nextSequence || nextSequence - sequence > retained)
+    {
+        sequence = nextSequence - retained;
+    }
+    int count = nextSequence - sequence;
+
+    for (int i=0; i<4; i++)
+    {
+        SendByte((sequence >> (8*i)) & 0xFF);
+    }
+    SendByte(count);
+
+    int index = (nextSampleIndex[timescale] + samplesPerGraph - count) % samplesPerGraph;
+    for (int s=0; s<count; s++)
+    {
+        Sample* pSample = &rings[timescale][index];
+        index = (index + 1) % samplesPerGraph;
+
+        for (size_t i=0; i<sizeof(Sample); i++)
+        {
+            SendByte(*((unsigned char*)pSample + i));
+        }
+    }
+}
+
+/* 
+    SendDeviceId
+    Sends the device ID, like SerialSendDeviceId.
+*/
+void EmulatedLogger::SendDeviceId()
+{
+    SendByte(1);
+
+    unsigned long id = options.deviceId;
+    for (int i=0; i<4; i++)
+    {
+        SendByte(id & 0xFF);
+        id >>= 8;
+    }
+}
+
+/* 
+    SendTripStats
+    Sends the trip statistics, like SerialSendTripStats.
+*/
+void EmulatedLogger::SendTripStats()
+{
+    SendByte(1);
+
+    unsigned long values[6] = { tripAscent, tripDescent, (unsigned long)tripMaxAltitude, (unsigned long)tripMinAltitude, 
+        (unsigned long)tripElapsedMinutes, 0 };
+    for (int i=0; i<6; i++)
+    {
+        int size = (i < 2) ? 4 : 2;
+        for (int b=0; b<size; b++)
+        {
+            SendByte((values[i] >> (8 * b)) & 0xFF);
+        }
+    }
+}
+
+/* 
+    ReceiveCalibration
+    Receives the calibration pattern, like SerialMeasureBitTime.
+    Returns the number of calibration bytes that arrived.
+*/
+int EmulatedLogger::ReceiveCalibration()
+{
+    int count = 0;
+    while (count < CALIBRATE_BYTES && ReceiveByte() != 0)
+    {
+        count++;
+    }
+    return count;
+}
+
+/* 
+    SendCalibration
+    Sends the Logger's clock cycles that the calibration bytes took, like SerialSendCalibration. The 
+    host's bits last longer or shorter than the Logger's own by the ratio of the two bit rates.
+*/
+void EmulatedLogger::SendCalibration(int count)
+{
+    unsigned int bitCycles = options.classic ? BIT_CYCLES_CLASSIC : BIT_CYCLES_MINI;
+    double loggerRate = NOMINAL_BIT_RATE * (1 + options.skew / 100);
+    unsigned long hostRate = GetHostBitRate();
+    double hostBitCycles = bitCycles * (hostRate != 0 ? loggerRate / hostRate : 1);
+    unsigned long cycles = (unsigned long)(count * CALIBRATE_BITS * hostBitCycles + 0.5);
+
+    if (options.verbose)
+        cerr << "Calibration: " << count << " bytes took " << cycles << " cycles" << endl;
+
+    SendByte(1);
+    SendByte(count);
+    for (int i=0; i<4; i++)
+    {
+        SendByte(cycles & 0xFF);
+        cycles >>= 8;
+    }
+    SendByte(bitCycles & 0xFF);
+    SendByte(bitCycles >> 8);
+}
+
+/* 
+    StartStream
+    Starts or stops sending stream records, like SerialStartStream.
+*/
+void EmulatedLogger::StartStream(unsigned char interval, unsigned char minutes)
+{
+    if (minutes == 0)
+    {
+        interval = 0;
+    }
+
+    streamMinutesLeft = minutes;
+    streamCountdown = 1;
+    streamInterval = interval;
+
+    SendByte(1);
+    SendByte(interval);
+    SendByte(minutes);
+}
+
+/* 
+    StreamTick
+    Called once per second. Returns true when a stream record should be sent, like SerialStreamTick.
+*/
+bool EmulatedLogger::StreamTick()
+{
+    if (streamInterval == 0)
+        return false;
+
+    // stop streaming if the host hasn't renewed it in time
+    if (clockSecond == 0 && --streamMinutesLeft == 0)
+    {
+        streamInterval = 0;
+        return false;
+    }
+
+    if (--streamCountdown == 0)
+    {
+        streamCountdown = streamInterval;
+        return true;
+    }
+
+    return false;
+}
+
+/* 
+    SendStreamRecord
+    Sends a stream record with the current sample, like SerialSendStreamRecord.
+*/
+void EmulatedLogger::SendStreamRecord()
+{
+    unsigned char record[STREAM_RECORD_SIZE - 2];
+
+    record[0] = STREAM_SYNC;
+    record[1] = streamSequence & 0xFF;
+    record[2] = (streamSequence >> 8) & 0xFF;
+
+    unsigned int packedTime = PackTime(clockMinutes);
+    for (int i=0; i<4; i++)
+    {
+        record[3+i] = (packedTime >> (8*i)) & 0xFF;
+    }
+    record[7] = clockSecond;
+
+    Sample sample = SyntheticSample(clockMinutes, clockSecond);
+    memcpy(&record[8], &sample, sizeof(Sample));
+
+    unsigned short crc = 0;
+    for (size_t i=0; i<sizeof(record); i++)
+    {
+        crc = Crc16Update(crc, record[i]);
+    }
+
+    BeginReply();
+    for (size_t i=0; i<sizeof(record); i++)
+    {
+        TransmitByte(record[i]);
+    }
+    TransmitByte(crc & 0xFF);
+    TransmitByte(crc >> 8);
+    EndReply();
+
+    streamSequence++;
+}
+
+/* 
+    Random
+    Returns the next number from a xorshift generator, so runs with the same seed inject the same faults.
+*/
+unsigned int EmulatedLogger::Random()
+{
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 17;
+    randomState ^= randomState << 5;
+    return randomState;
+}
+
+/* 
+    Chance
+    Returns true with the given probability.
+*/
+bool EmulatedLogger::Chance(double probability)
+{
+    if (probability <= 0)
+        return false;
+
+    return Random() < probability * 4294967296.0;
+}
+
+/* 
+    GetHostBitRate
+    Returns the bit rate the host set on the pseudo-terminal, or 0 if it can't be determined.
+*/
+unsigned long EmulatedLogger::GetHostBitRate()
+{
+#ifdef __linux__
+    return GetCustomBitRate(rateFd);
+#else
+    return 0;
+#endif
+}
+
+/* 
+    GetRateMismatch
+    Returns the percent difference between the bit rate the host set on the pseudo-terminal and the Logger's 
+    actual bit rate, or 0 if the host's bit rate can't be determined.
+*/
+double EmulatedLogger::GetRateMismatch()
+{
+    unsigned long hostRate = GetHostBitRate();
+    if (hostRate == 0)
+        return 0;
+
+    double loggerRate = NOMINAL_BIT_RATE * (1 + options.skew / 100);
+    return fabs(hostRate - loggerRate) / loggerRate * 100;
+}
+
+/* 
+    Usage
+    Print program usage instructions to the console
+*/
+void Usage()
+{
+    cerr << "Backwoods Logger Emulator" << endl;
+    cerr << "Usage: blemu [--stdio] [-c] [-v] [-l] [-k percent] [-o usec] [-m] [-a speed] [-e seed] [-i id]" << endl;
+    cerr << "             [-n count] [-g filename] [-s filename] [-d probability] [-x probability] [-u probability] [-z probability]" << endl;
+    cerr << "    --stdio         Talk on standard input and output, for blsync -p \"pty:blemu --stdio\". Otherwise" << endl;
+    cerr << "                    a pseudo-terminal is created, and its name is printed." << endl;
+    cerr << "    -c              Emulate a Logger Classic instead of a Logger Mini." << endl;
+    cerr << "    -v              Print each command and fault." << endl;
+    cerr << "    -l              Ignore the calibration command, like older firmware." << endl;
+    cerr << "    -k percent      Percent that the Logger's bit rate differs from 38400. Default is 0." << endl;
+    cerr << "    -o usec         Extra microseconds the Logger spends on each byte it sends. Default is 0." << endl;
+    cerr << "    -m              Lose received bytes that arrive back to back, like a Logger that's too slow for them." << endl;
+    cerr << "    -a speed        Emulated seconds per real second, from 1 to 1000. Default is 1." << endl;
+    cerr << "    -e seed         Seed for the synthetic samples and faults. Default is 1." << endl;
+    cerr << "    -i id           Device ID in hex, or 0 to emulate firmware without device IDs. Default comes from" << endl;
+    cerr << "                    the seed." << endl;
+    cerr << "    -n count        Number of synthetic snapshots. Default is 5." << endl;
+    cerr << "    -g filename     Serve graph data saved by blsync -r -g instead of synthetic samples." << endl;
+    cerr << "    -s filename     Serve snapshot data saved by blsync -r -s instead of synthetic snapshots." << endl;
+    cerr << "    -d probability  Chance that each byte sent is lost." << endl;
+    cerr << "    -x probability  Chance that each byte sent is damaged." << endl;
+    cerr << "    -u probability  Chance that each reply stops partway." << endl;
+    cerr << "    -z probability  Chance that each command is ignored." << endl;
+}
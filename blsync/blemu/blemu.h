@@ -0,0 +1,199 @@
+/* 
+  Copyright (c) 2011 Steve Chamberlin
+  Permission is hereby granted, free of charge, to any person obtaining a copy of this hardware, software, and associated documentation 
+  files (the "Product"), to deal in the Product without restriction, including without limitation the rights to use, copy, modify, merge, 
+  publish, distribute, sublicense, and/or sell copies of the Product, and to permit persons to whom the Product is furnished to do so, 
+  subject to the following conditions: 
+
+  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Product. 
+
+  THE PRODUCT IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF 
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+  ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH 
+  THE PRODUCT OR THE USE OR OTHER DEALINGS IN THE PRODUCT.
+
+  blemu - Backwoods Logger emulator, for testing blsync without hardware.
+
+*/
+
+#ifndef BLEMU_H_
+#define BLEMU_H_
+
+#include <vector>
+#include "protocol.h"
+
+// version string reported to CMD_VERSION
+#define EMULATOR_VERSION "1.0.4"
+
+#define NUM_TIME_SCALES 3
+#define NUM_SRAM_TIME_SCALES 2
+#define FRAME_BLOCK_SIZE 32
+#define FRAME_ALL_BLOCKS 0xFFFF
+#define MAX_ARGS 6
+// bytes of EEPROM the firmware keeps the trip statistics in, after the snapshots
+#define TRIP_STATS_SIZE 18
+// feet the altitude must reverse by before the trip statistics count a descent after a climb, or the reverse
+#define TRIP_HYSTERESIS 15
+
+// the Logger's nominal serial bit rate
+#define NOMINAL_BIT_RATE 38400
+// clock cycles in each of the Logger's bits, BIT_TIME + 1 in the firmware
+#define BIT_CYCLES_MINI 208
+#define BIT_CYCLES_CLASSIC 25
+// SerialTransmitByte sends at least one mark bit, then the start bit, 8 data bits, and the stop bit
+#define BITS_PER_BYTE 11
+// SerialReceiveByte gives up after 19200 bit times
+#define RECEIVE_TIMEOUT 500
+// percent difference between the host's bit rate and the Logger's where bytes start to be garbled, and where 
+// all bytes are garbled
+#define RATE_TOLERANCE_MIN 2.5
+#define RATE_TOLERANCE_MAX 4.5
+// microseconds of output to send to the pseudo-terminal at once
+#define PACING_CHUNK 2000
+
+typedef struct
+{
+    // Logger Classic instead of Logger Mini: fewer samples per graph, more snapshots
+    bool classic;
+    // percent that the Logger's bit rate differs from nominal
+    double skew;
+    // extra microseconds the firmware spends on each byte it sends
+    int byteOverhead;
+    // received bytes that arrive back to back are lost, like a slow Logger that misses the next start bit
+    bool dropBackToBack;
+    // probability of each fault: a sent byte is lost, a sent byte is damaged, a reply stops partway, a 
+    // command is ignored
+    double dropRate;
+    double corruptRate;
+    double truncateRate;
+    double ignoreRate;
+    unsigned long seed;
+    // reported to CMD_GETID, or 0 to ignore CMD_GETID like older firmware
+    unsigned long deviceId;
+    // answer CMD_CALIBRATE, or ignore it like older firmware
+    bool calibrate;
+    // emulated seconds per real second
+    int speed;
+    int numSnapshots;
+    const char* graphFilename;
+    const char* snapshotFilename;
+    bool useStdio;
+    bool verbose;
+} EmulatorOptions;
+
+class EmulatedLogger
+{
+public:
+    EmulatedLogger(const EmulatorOptions& options);
+
+    bool LoadGraphs(const char* filename);
+    bool LoadSnapshots(const char* filename);
+    void Run(int inFd, int outFd, int rateFd);
+    void PrintSummary();
+
+private:
+    // sample rings and snapshots
+    Sample SyntheticSample(long minute, int second);
+    void FillRings();
+    void FillSnapshots();
+    void StoreSample();
+    void UpdateTrip(const Sample& sample);
+    void Tick();
+
+    // serial input
+    int ReadInput(int timeout);
+    int ReceiveByte();
+    void DoCommand();
+    void DispatchCommand(unsigned char cmd);
+
+    // serial output
+    void BeginReply();
+    void EndReply();
+    void SendByte(unsigned char c);
+    void TransmitByte(unsigned char c);
+    void FlushOutput();
+    void FlushFrame();
+    void SendGraphs(unsigned char version);
+    void SendVarint(int value);
+    void SendEncodedGraph(int g);
+    void SendSnapshots();
+    void SendSamplesSince(unsigned char timescale, unsigned char generation, unsigned int sequence);
+    void SendDeviceId();
+    void SendTripStats();
+    int ReceiveCalibration();
+    void SendCalibration(int count);
+    void StartStream(unsigned char interval, unsigned char minutes);
+    bool StreamTick();
+    void SendStreamRecord();
+
+    // faults
+    unsigned int Random();
+    bool Chance(double probability);
+    unsigned long GetHostBitRate();
+    double GetRateMismatch();
+
+    EmulatorOptions options;
+    int inFd;
+    int outFd;
+    int rateFd;
+    unsigned int randomState;
+
+    int samplesPerGraph;
+    int minutesPerSample[NUM_TIME_SCALES];
+    int maxSnapshots;
+    std::vector<Sample> rings[NUM_TIME_SCALES];
+    int nextSampleIndex[NUM_TIME_SCALES];
+    unsigned int sampleSequence[NUM_TIME_SCALES];
+    unsigned char eepromGeneration;
+    std::vector<Snapshot> snapshots;
+    unsigned char bootCount;
+    unsigned char dataChangeCount;
+
+    // trip statistics since the emulator started, in feet and minutes
+    unsigned long tripAscent;
+    unsigned long tripDescent;
+    int tripMaxAltitude;
+    int tripMinAltitude;
+    int tripElapsedMinutes;
+    int tripAnchorAltitude;
+    int tripDirection;
+
+    // the Logger's clock, as minutes since 2000 and seconds
+    long clockMinutes;
+    int clockSecond;
+
+    // bytes received but not processed yet, and whether each one arrived right behind the previous one
+    std::vector<unsigned char> input;
+    std::vector<bool> inputBackToBack;
+    size_t inputPos;
+
+    // bytes waiting to be sent, and the time in microseconds when the last of them is due
+    std::vector<unsigned char> output;
+    double outputDue;
+    double byteTime;
+    double garbleChance;
+    long truncateAfter;
+
+    unsigned char checksum;
+    bool framing;
+    unsigned char frameBuffer[FRAME_BLOCK_SIZE];
+    int frameLength;
+    unsigned int frameIndex;
+    unsigned int frameSelected;
+
+    int streamInterval;
+    int streamCountdown;
+    int streamMinutesLeft;
+    unsigned int streamSequence;
+
+    // statistics for the summary
+    unsigned long commandCount;
+    unsigned long bytesSent;
+    unsigned long bytesLost;
+    unsigned long faultCount;
+    double busyTime;
+};
+
+void Usage();
+
+#endif /* BLEMU_H_ */
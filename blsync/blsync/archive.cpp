@@ -0,0 +1,563 @@
+/* 
+  Copyright (c) 2011 Steve Chamberlin
+  Permission is hereby granted, free of charge, to any person obtaining a copy of this hardware, software, and associated documentation 
+  files (the "Product"), to deal in the Product without restriction, including without limitation the rights to use, copy, modify, merge, 
+  publish, distribute, sublicense, and/or sell copies of the Product, and to permit persons to whom the Product is furnished to do so, 
+  subject to the following conditions: 
+
+  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Product. 
+
+  THE PRODUCT IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF 
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+  ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH 
+  THE PRODUCT OR THE USE OR OTHER DEALINGS IN THE PRODUCT.
+
+  archive.cpp - An append-only archive of synced samples, kept separately for each Logger.
+
+*/
+
+#include <stdio.h>
+#include <algorithm>
+#include <iostream>
+#include "archive.h"
+#include "blsync.h"
+
+using namespace std;
+
+static void PutValue(vector<unsigned char>& buffer, unsigned long value, int size)
+{
+    for (int i=0; i<size; i++)
+    {
+        buffer.push_back((unsigned char)(value >> (8*i)));
+    }
+}
+
+static unsigned long GetValue(const unsigned char* p, int size)
+{
+    unsigned long value = 0;
+    for (int i=0; i<size; i++)
+    {
+        value |= (unsigned long)p[i] << (8*i);
+    }
+    return value;
+}
+
+static bool CompareRecordTimes(const ArchiveRecord& a, const ArchiveRecord& b)
+{
+    return a.time < b.time;
+}
+
+static bool SameRecordTime(const ArchiveRecord& a, const ArchiveRecord& b)
+{
+    return a.time == b.time;
+}
+
+/* 
+    GetArchivePath
+    Returns the directory where a Logger's samples are archived.
+*/
+tstring GetArchivePath(const _TCHAR* directory, const tstring& deviceKey)
+{
+    tstring path = directory;
+    path += _T("/");
+    path += deviceKey;
+    return path;
+}
+
+/* 
+    CreateArchive
+    Creates the archive directory and the Logger's directory in it, if they don't exist yet.
+    Returns true if successful, false if an error occurred.
+*/
+bool CreateArchive(const _TCHAR* directory, const tstring& deviceKey, wostream& log)
+{
+    if (!MakeDirectory(directory) || !MakeDirectory(GetArchivePath(directory, deviceKey).c_str()))
+    {
+        ReportFileError(log);
+        return false;
+    }
+
+    return true;
+}
+
+/* 
+    GetPartitionPath
+    Returns the path of the partition that holds a series' samples for the month of the given time, 
+    without the file extension.
+*/
+tstring GetPartitionPath(const tstring& archivePath, int series, long time)
+{
+    LoggerTime t;
+    MinutesToTime(time, t);
+
+    _TCHAR name[64];
+    if (series == ARCHIVE_SERIES_SNAPSHOTS)
+    {
+        _stprintf_s(name, 64, _T("/snapshots-%04d-%02d"), t.year, t.month);
+    }
+    else
+    {
+        _stprintf_s(name, 64, _T("/%dmin-%04d-%02d"), series, t.year, t.month);
+    }
+
+    return archivePath + name;
+}
+
+/* 
+    ParsePartitionNumber
+    Reads the decimal number at pos in a partition name, and moves pos past it.
+    Returns false if there isn't one.
+*/
+static bool ParsePartitionNumber(const tstring& name, size_t& pos, int& value)
+{
+    size_t start = pos;
+    value = 0;
+    while (pos < name.size() && name[pos] >= _T('0') && name[pos] <= _T('9') && pos - start < 6)
+    {
+        value = value * 10 + (name[pos] - _T('0'));
+        pos++;
+    }
+    return pos > start;
+}
+
+/* 
+    FindArchiveSeries
+    Finds every series in one Logger's archive, and the first and last months that have partitions.
+    Returns true if successful, false if the archive couldn't be read.
+*/
+bool FindArchiveSeries(const tstring& archivePath, vector<ArchiveSeriesInfo>& seriesList, wostream& log)
+{
+    vector<tstring> names;
+    if (!ListDirectory(archivePath.c_str(), names, false))
+    {
+        log << "Error: the archive in " << archivePath.c_str() << " could not be read." << endl;
+        return false;
+    }
+
+    const tstring snapshotsPrefix = _T("snapshots-");
+    const tstring dataExtension = _T(".bla");
+    for (size_t i=0; i<names.size(); i++)
+    {
+        // <series>-<year>-<month>.bla
+        const tstring& name = names[i];
+        size_t pos = 0;
+        int series, year, month;
+        if (name.compare(0, snapshotsPrefix.size(), snapshotsPrefix) == 0)
+        {
+            series = ARCHIVE_SERIES_SNAPSHOTS;
+            pos = snapshotsPrefix.size();
+        }
+        else if (!ParsePartitionNumber(name, pos, series) || series == 0 || name.compare(pos, 4, _T("min-")) != 0)
+        {
+            continue;
+        }
+        else
+        {
+            pos += 4;
+        }
+
+        if (!ParsePartitionNumber(name, pos, year) || pos >= name.size() || name[pos++] != _T('-') ||
+            !ParsePartitionNumber(name, pos, month) || name.compare(pos, tstring::npos, dataExtension) != 0 ||
+            month < 1 || month > 12)
+            continue;
+
+        LoggerTime t = { year, month, 1, 0, 0, 0 };
+        long monthStart = TimeToMinutes(t);
+
+        size_t s = 0;
+        while (s < seriesList.size() && seriesList[s].series != series)
+        {
+            s++;
+        }
+        if (s == seriesList.size())
+        {
+            ArchiveSeriesInfo info = { series, monthStart, monthStart };
+            seriesList.push_back(info);
+        }
+        else
+        {
+            seriesList[s].firstMonth = min(seriesList[s].firstMonth, monthStart);
+            seriesList[s].lastMonth = max(seriesList[s].lastMonth, monthStart);
+        }
+    }
+
+    return true;
+}
+
+/* 
+    ReadArchiveIndex
+    Reads the sparse index of a partition. A partition that doesn't exist yet has an empty index.
+    Returns true if successful, false if an error occurred.
+*/
+bool ReadArchiveIndex(const tstring& partitionPath, vector<ArchiveIndexEntry>& index, wostream& log)
+{
+    index.clear();
+
+    tstring indexPath = partitionPath + _T(".bli");
+    FILE* pFile = _tfopen(indexPath.c_str(), _T("rb"));
+    if (pFile == 0)
+        return true;
+
+    unsigned char buf[ARCHIVE_INDEX_ENTRY_SIZE];
+    while (fread(buf, 1, ARCHIVE_INDEX_ENTRY_SIZE, pFile) == ARCHIVE_INDEX_ENTRY_SIZE)
+    {
+        ArchiveIndexEntry entry;
+        entry.firstTime = (long)GetValue(&buf[0], 4);
+        entry.lastTime = (long)GetValue(&buf[4], 4);
+        entry.offset = GetValue(&buf[8], 4);
+        entry.count = GetValue(&buf[12], 4);
+        index.push_back(entry);
+    }
+
+    bool result = (ferror(pFile) == 0);
+    if (!result)
+    {
+        ReportFileError(log);
+    }
+
+    fclose(pFile);
+    return result;
+}
+
+/* 
+    ReadArchiveBlock
+    Reads the samples in one block of a partition's data file. If timesOnly is true, only the time column 
+    is read, which is all that's needed to check for samples that are already archived.
+    Returns true if successful, false if an error occurred.
+*/
+bool ReadArchiveBlock(FILE* pFile, const ArchiveIndexEntry& entry, bool timesOnly, vector<ArchiveRecord>& records, wostream& log)
+{
+    size_t columnsSize = entry.count * (timesOnly ? 4 : 9);
+    vector<unsigned char> block(ARCHIVE_BLOCK_HEADER_SIZE + columnsSize);
+
+    if (fseek(pFile, entry.offset, SEEK_SET) != 0 || fread(&block[0], 1, block.size(), pFile) != block.size())
+    {
+        log << "Error: the archive is damaged or incomplete." << endl;
+        return false;
+    }
+
+    if (block[0] != 'B' || block[1] != 'L' || block[2] != 'A' || block[3] != ARCHIVE_VERSION || 
+        GetValue(&block[4], 2) != entry.count)
+    {
+        log << "Error: the archive is damaged or incomplete." << endl;
+        return false;
+    }
+
+    const unsigned char* pTimes = &block[ARCHIVE_BLOCK_HEADER_SIZE];
+    const unsigned char* pTemperatures = pTimes + entry.count * 4;
+    const unsigned char* pPressures = pTemperatures + entry.count;
+    const unsigned char* pAltitudes = pPressures + entry.count * 2;
+
+    size_t first = records.size();
+    records.resize(first + entry.count);
+    for (unsigned long i=0; i<entry.count; i++)
+    {
+        ArchiveRecord& record = records[first + i];
+        record.time = (long)GetValue(pTimes + i*4, 4);
+        if (!timesOnly)
+        {
+            record.sample.temperature = pTemperatures[i];
+            record.sample.pressure = GetValue(pPressures + i*2, 2);
+            record.sample.altitude = GetValue(pAltitudes + i*2, 2);
+        }
+    }
+
+    return true;
+}
+
+/* 
+    MakeArchiveRecords
+    Gets each sample in a series and its time, ready to add to the archive.
+*/
+void MakeArchiveRecords(const SampleView& samples, vector<ArchiveRecord>& records)
+{
+    records.resize(samples.size());
+    size_t i = 0;
+    for (SampleView::const_iterator it = samples.begin(); it != samples.end(); ++it, ++i)
+    {
+        records[i].time = it.time();
+        records[i].sample = *it;
+    }
+}
+
+/* 
+    AddToPartition
+    Appends the given samples to a partition as a new block, leaving out any whose time is already in the 
+    partition. The samples must be in ascending time order. Only the blocks whose time range overlaps the 
+    new samples are read, so adding samples takes time in proportion to the sync, not the archive.
+    Returns true if successful, false if an error occurred.
+*/
+bool AddToPartition(const tstring& partitionPath, const ArchiveRecord* pRecords, size_t count, int& added, wostream& log)
+{
+    added = 0;
+    if (count == 0)
+        return true;
+
+    vector<ArchiveIndexEntry> index;
+    if (!ReadArchiveIndex(partitionPath, index, log))
+        return false;
+
+    tstring dataPath = partitionPath + _T(".bla");
+    tstring indexPath = partitionPath + _T(".bli");
+
+    // find the times that are already archived, in the blocks that overlap the new samples
+    long firstTime = pRecords[0].time;
+    long lastTime = pRecords[count-1].time;
+    vector<ArchiveRecord> existing;
+    FILE* pFile = 0;
+    for (size_t i=0; i<index.size(); i++)
+    {
+        if (index[i].lastTime < firstTime || index[i].firstTime > lastTime)
+            continue;
+
+        if (pFile == 0)
+        {
+            pFile = _tfopen(dataPath.c_str(), _T("rb"));
+            if (pFile == 0)
+            {
+                ReportFileError(log);
+                return false;
+            }
+        }
+
+        if (!ReadArchiveBlock(pFile, index[i], true, existing, log))
+        {
+            fclose(pFile);
+            return false;
+        }
+    }
+    if (pFile != 0)
+    {
+        fclose(pFile);
+    }
+    sort(existing.begin(), existing.end(), CompareRecordTimes);
+
+    vector<const ArchiveRecord*> newRecords;
+    for (size_t i=0; i<count; i++)
+    {
+        if (!binary_search(existing.begin(), existing.end(), pRecords[i], CompareRecordTimes))
+        {
+            newRecords.push_back(&pRecords[i]);
+        }
+    }
+
+    if (newRecords.empty())
+        return true;
+
+    // build the block, one column at a time
+    unsigned long newCount = (unsigned long)newRecords.size();
+    vector<unsigned char> block;
+    block.reserve(ARCHIVE_BLOCK_HEADER_SIZE + newCount * 9);
+    block.push_back('B');
+    block.push_back('L');
+    block.push_back('A');
+    block.push_back(ARCHIVE_VERSION);
+    PutValue(block, newCount, 2);
+    PutValue(block, 0, 2);
+    for (size_t i=0; i<newCount; i++)
+    {
+        PutValue(block, newRecords[i]->time, 4);
+    }
+    for (size_t i=0; i<newCount; i++)
+    {
+        PutValue(block, newRecords[i]->sample.temperature, 1);
+    }
+    for (size_t i=0; i<newCount; i++)
+    {
+        PutValue(block, newRecords[i]->sample.pressure, 2);
+    }
+    for (size_t i=0; i<newCount; i++)
+    {
+        PutValue(block, newRecords[i]->sample.altitude, 2);
+    }
+
+    // append the block, then its index entry, so the index never points past the end of the data
+    pFile = _tfopen(dataPath.c_str(), _T("ab"));
+    if (pFile == 0)
+    {
+        ReportFileError(log);
+        return false;
+    }
+
+    fseek(pFile, 0, SEEK_END);
+    unsigned long offset = (unsigned long)ftell(pFile);
+    bool result = WriteFileBytes(pFile, &block[0], block.size(), log);
+    if (fclose(pFile) != 0 && result)
+    {
+        ReportFileError(log);
+        result = false;
+    }
+    if (!result)
+        return false;
+
+    vector<unsigned char> entry;
+    PutValue(entry, newRecords[0]->time, 4);
+    PutValue(entry, newRecords[newCount-1]->time, 4);
+    PutValue(entry, offset, 4);
+    PutValue(entry, newCount, 4);
+
+    pFile = _tfopen(indexPath.c_str(), _T("ab"));
+    if (pFile == 0)
+    {
+        ReportFileError(log);
+        return false;
+    }
+
+    result = WriteFileBytes(pFile, &entry[0], entry.size(), log);
+    if (fclose(pFile) != 0 && result)
+    {
+        ReportFileError(log);
+        result = false;
+    }
+
+    if (result)
+    {
+        added = (int)newCount;
+    }
+    return result;
+}
+
+/* 
+    AddToArchive
+    Adds the samples from one sync to a series in a Logger's archive, splitting them into monthly partitions. 
+    Empty samples, which the Logger sends for times before it started recording, are left out.
+    Returns true if successful, false if an error occurred.
+*/
+bool AddToArchive(const tstring& archivePath, int series, const vector<ArchiveRecord>& records, int& added, wostream& log)
+{
+    added = 0;
+
+    vector<ArchiveRecord> samples;
+    samples.reserve(records.size());
+    for (size_t i=0; i<records.size(); i++)
+    {
+        const Sample& s = records[i].sample;
+        if (records[i].time >= 0 && (s.temperature != 0 || s.pressure != 0 || s.altitude != 0))
+        {
+            samples.push_back(records[i]);
+        }
+    }
+
+    sort(samples.begin(), samples.end(), CompareRecordTimes);
+    samples.erase(unique(samples.begin(), samples.end(), SameRecordTime), samples.end());
+
+    size_t start = 0;
+    while (start < samples.size())
+    {
+        // find the samples in the same month as the first one
+        LoggerTime t;
+        MinutesToTime(samples[start].time, t);
+        t.day = 1;
+        t.hour = 0;
+        t.minute = 0;
+        if (++t.month > 12)
+        {
+            t.month = 1;
+            t.year++;
+        }
+        long nextMonth = TimeToMinutes(t);
+
+        size_t end = start;
+        while (end < samples.size() && samples[end].time < nextMonth)
+        {
+            end++;
+        }
+
+        int partitionAdded;
+        if (!AddToPartition(GetPartitionPath(archivePath, series, samples[start].time), &samples[start], end - start, partitionAdded, log))
+            return false;
+
+        added += partitionAdded;
+        start = end;
+    }
+
+    return true;
+}
+
+/* 
+    ReadArchive
+    Finds the archived samples in a series from startTime up to and including endTime, using the sparse 
+    index to read only the blocks in that range. The records are returned in ascending time order.
+    Returns true if successful, false if an error occurred.
+*/
+bool ReadArchive(const tstring& archivePath, int series, long startTime, long endTime, vector<ArchiveRecord>& records, wostream& log)
+{
+    records.clear();
+    if (startTime < 0)
+    {
+        startTime = 0;
+    }
+
+    // the Logger's clock can't go past 2255
+    LoggerTime last = { 2256, 1, 1, 0, 0, 0 };
+    if (endTime >= TimeToMinutes(last))
+    {
+        endTime = TimeToMinutes(last) - 1;
+    }
+
+    LoggerTime t;
+    MinutesToTime(startTime, t);
+    t.day = 1;
+    t.hour = 0;
+    t.minute = 0;
+
+    for (long month = TimeToMinutes(t); month <= endTime; month = TimeToMinutes(t))
+    {
+        tstring partitionPath = GetPartitionPath(archivePath, series, month);
+
+        vector<ArchiveIndexEntry> index;
+        if (!ReadArchiveIndex(partitionPath, index, log))
+            return false;
+
+        FILE* pFile = 0;
+        for (size_t i=0; i<index.size(); i++)
+        {
+            if (index[i].lastTime < startTime || index[i].firstTime > endTime)
+                continue;
+
+            if (pFile == 0)
+            {
+                tstring dataPath = partitionPath + _T(".bla");
+                pFile = _tfopen(dataPath.c_str(), _T("rb"));
+                if (pFile == 0)
+                {
+                    ReportFileError(log);
+                    return false;
+                }
+            }
+
+            size_t first = records.size();
+            if (!ReadArchiveBlock(pFile, index[i], false, records, log))
+            {
+                fclose(pFile);
+                return false;
+            }
+
+            // keep only the part of the block that's in range
+            size_t keep = first;
+            for (size_t r=first; r<records.size(); r++)
+            {
+                if (records[r].time >= startTime && records[r].time <= endTime)
+                {
+                    records[keep++] = records[r];
+                }
+            }
+            records.resize(keep);
+        }
+
+        if (pFile != 0)
+        {
+            fclose(pFile);
+        }
+
+        if (++t.month > 12)
+        {
+            t.month = 1;
+            t.year++;
+        }
+    }
+
+    // blocks are in the order they were synced, which isn't always time order
+    stable_sort(records.begin(), records.end(), CompareRecordTimes);
+    return true;
+}
@@ -0,0 +1,91 @@
+/* 
+  Copyright (c) 2011 Steve Chamberlin
+  Permission is hereby granted, free of charge, to any person obtaining a copy of this hardware, software, and associated documentation 
+  files (the "Product"), to deal in the Product without restriction, including without limitation the rights to use, copy, modify, merge, 
+  publish, distribute, sublicense, and/or sell copies of the Product, and to permit persons to whom the Product is furnished to do so, 
+  subject to the following conditions: 
+
+  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Product. 
+
+  THE PRODUCT IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF 
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+  ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH 
+  THE PRODUCT OR THE USE OR OTHER DEALINGS IN THE PRODUCT.
+
+  archive.h - An append-only archive of synced samples, kept separately for each Logger.
+
+*/
+
+#ifndef ARCHIVE_H_
+#define ARCHIVE_H_
+
+#include <iostream>
+#include <vector>
+#include "platform.h"
+#include "protocol.h"
+#include "sampledata.h"
+
+/*
+    Each Logger has its own directory in the archive, named with its device key. Samples are kept in one
+    partition per series and month, so a lookup only opens the months it needs. The series is the number 
+    of minutes per sample, or 0 for snapshots, and is named like "5min" or "snapshots" in the filenames. 
+    A partition is two files:
+
+    <series>-<year>-<month>.bla holds the samples as a series of blocks, one for each sync that found new 
+    samples in that partition. Each block is:
+    0-3: "BLA" and the archive format version
+    4-5: number of samples in the block, LSB first
+    6-7: reserved
+    followed by each field as a separate column, all LSB first:
+    time of each sample in minutes since 1/1/2000, in ascending order (4 bytes each)
+    temperature (1 byte each), pressure (2 bytes each), and altitude (2 bytes each), in sample units
+
+    <series>-<year>-<month>.bli is the sparse index for the blocks, with one 16 byte entry per block:
+    0-3: time of the first sample
+    4-7: time of the last sample
+    8-11: offset of the block in the .bla file
+    12-15: number of samples in the block
+
+    Both files are only ever appended to. A sample is only added if the partition doesn't already have one 
+    with the same time, so syncs with overlapping samples don't store anything twice.
+*/
+#define ARCHIVE_VERSION 1
+#define ARCHIVE_BLOCK_HEADER_SIZE 8
+#define ARCHIVE_INDEX_ENTRY_SIZE 16
+#define ARCHIVE_SERIES_SNAPSHOTS 0
+
+// one sample and its time, in minutes since 1/1/2000
+typedef struct
+{
+    long time;
+    Sample sample;
+} ArchiveRecord;
+
+typedef struct
+{
+    long firstTime;
+    long lastTime;
+    unsigned long offset;
+    unsigned long count;
+} ArchiveIndexEntry;
+
+// a series in the archive, and the times of the first and last months it has partitions for
+typedef struct
+{
+    int series;
+    long firstMonth;
+    long lastMonth;
+} ArchiveSeriesInfo;
+
+tstring GetArchivePath(const _TCHAR* directory, const tstring& deviceKey);
+bool CreateArchive(const _TCHAR* directory, const tstring& deviceKey, std::wostream& log);
+tstring GetPartitionPath(const tstring& archivePath, int series, long time);
+bool FindArchiveSeries(const tstring& archivePath, std::vector<ArchiveSeriesInfo>& seriesList, std::wostream& log);
+bool ReadArchiveIndex(const tstring& partitionPath, std::vector<ArchiveIndexEntry>& index, std::wostream& log);
+bool ReadArchiveBlock(FILE* pFile, const ArchiveIndexEntry& entry, bool timesOnly, std::vector<ArchiveRecord>& records, std::wostream& log);
+void MakeArchiveRecords(const SampleView& samples, std::vector<ArchiveRecord>& records);
+bool AddToPartition(const tstring& partitionPath, const ArchiveRecord* pRecords, size_t count, int& added, std::wostream& log);
+bool AddToArchive(const tstring& archivePath, int series, const std::vector<ArchiveRecord>& records, int& added, std::wostream& log);
+bool ReadArchive(const tstring& archivePath, int series, long startTime, long endTime, std::vector<ArchiveRecord>& records, std::wostream& log);
+
+#endif /* ARCHIVE_H_ */
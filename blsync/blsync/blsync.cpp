@@ -16,27 +16,82 @@
 
 */
 
-#include <windows.h>
-#include <tchar.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <iomanip>
 #include <iostream>
+#include <sstream>
 #include <string>
+#include <vector>
+#include "platform.h"
+#include "protocol.h"
+#include "archive.h"
+#include "convert.h"
+#include "export.h"
+#include "query.h"
+#include "sampledata.h"
+#include "stitch.h"
 #include "blsync.h"
 
 using namespace std;
 
-#define CMD_VERSION '1'
-#define CMD_GETGRAPHS '2'
-#define CMD_GETSNAPSHOTS '3'
+#define STREAM_MINUTES 15
+#define STREAM_RENEW_MINUTES 5
+
+// retries for each Logger in a fleet sync, and the milliseconds to wait before the first one. Later retries
+// wait longer, in case the Logger is busy or was just plugged in.
+#define FLEET_RETRIES 2
+#define RETRY_DELAY 2000
+
+// most Loggers to sync at once
+#define FLEET_MAX_WORKERS 16
+
+// set when Ctrl-C is pressed during --follow
+volatile bool stopFollowing = false;
 
 int _tmain(int argc, _TCHAR* argv[])
 {
-    _TCHAR* portName = 0;
-    _TCHAR* graphFilename = 0;
-    _TCHAR* snapshotFilename = 0;
-    unsigned long baudRate = 38400;
-    bool userDefinedRate = false;
-    bool reportVersion = false;
-    bool saveAsCSV = true;
+    vector<tstring> portNames;
+    bool findPorts = false;
+    int numWorkers = 0;
+    int retries = -1;
+    const _TCHAR* exportFilename = 0;
+    vector<tstring> convertPaths;
+    vector<tstring> scanPaths;
+    vector<tstring> stitchPaths;
+    bool query = false;
+
+    QueryOptions queryOptions;
+    queryOptions.field = QUERY_ALTITUDE;
+    queryOptions.period = 1440;
+    queryOptions.startTime = 0;
+    queryOptions.endTime = 0x7FFFFFFF;
+    queryOptions.series = QUERY_SERIES_FINEST;
+    queryOptions.deviceKey = 0;
+
+    SyncOptions options;
+    options.graphFilename = 0;
+    options.snapshotFilename = 0;
+    options.newSamplesFilename = 0;
+    options.newSamplesGraph = 1;
+    options.followFilename = 0;
+    options.streamInterval = 60;
+    options.bitRate = 38400;
+    options.userDefinedRate = false;
+    options.reportVersion = false;
+    options.reportTrip = false;
+    options.format.type = EXPORT_CSV;
+    options.format.isoTime = false;
+    options.format.metric = false;
+    options.legacyProtocol = false;
+    options.retries = 0;
+    options.keyFilenames = false;
+    options.archiveDirectory = 0;
+    options.archiveOnly = false;
+    options.pRateCache = 0;
+    options.rateCacheFilename = 0;
     
     if (argc < 2)
     {
@@ -49,45 +104,197 @@ int _tmain(int argc, _TCHAR* argv[])
         _TCHAR* arg = argv[i];
         if (arg[0] == _T('-'))
         {
-            if (arg[1] == _T('p') && i+1 != argc) 
+            if (_tcscmp(arg, _T("--follow")) == 0 && i+1 != argc) 
+            {
+                // live stream filename
+                options.followFilename = argv[i + 1];
+                i++;
+            }
+            else if (_tcscmp(arg, _T("--export")) == 0 && i+1 != argc) 
+            {
+                // archive export filename
+                exportFilename = argv[i + 1];
+                i++;
+            }
+            else if (_tcscmp(arg, _T("--convert")) == 0 && i+1 != argc) 
+            {
+                // raw file or directory to convert, may be given more than once
+                convertPaths.push_back(argv[i + 1]);
+                i++;
+            }
+            else if (_tcscmp(arg, _T("--stitch")) == 0 && i+1 != argc) 
+            {
+                // raw graph file or directory to stitch, may be given more than once
+                stitchPaths.push_back(argv[i + 1]);
+                i++;
+            }
+            else if (_tcscmp(arg, _T("--query")) == 0 && i+1 != argc) 
+            {
+                // value to query
+                query = true;
+                if (!ParseQueryField(argv[i + 1], queryOptions.field))
+                {
+                    wcout << "Error: " << argv[i + 1] << " can't be queried. Use temperature, pressure, or altitude." << endl;
+                    return 0;
+                }
+                i++;
+            }
+            else if (_tcscmp(arg, _T("--by")) == 0 && i+1 != argc) 
+            {
+                // period to group a query by
+                if (!ParseQueryPeriod(argv[i + 1], queryOptions.period))
+                {
+                    wcout << "Error: " << argv[i + 1] << " isn't a period. Use hour, day, month, all, or a number of minutes." << endl;
+                    return 0;
+                }
+                i++;
+            }
+            else if ((_tcscmp(arg, _T("--from")) == 0 || _tcscmp(arg, _T("--to")) == 0) && i+1 != argc) 
+            {
+                // time range of a query
+                bool end = (arg[2] == _T('t'));
+                if (!ParseQueryTime(argv[i + 1], end, end ? queryOptions.endTime : queryOptions.startTime))
+                {
+                    wcout << "Error: " << argv[i + 1] << " isn't a valid time, like 2011-08-14 or 2011-08-14T16:05." << endl;
+                    return 0;
+                }
+                i++;
+            }
+            else if (_tcscmp(arg, _T("--interval")) == 0 && i+1 != argc) 
+            {
+                // series to query, in minutes per sample
+                queryOptions.series = _ttoi(argv[i + 1]);
+                i++;
+            }
+            else if (_tcscmp(arg, _T("--device")) == 0 && i+1 != argc) 
+            {
+                // Logger to query
+                queryOptions.deviceKey = argv[i + 1];
+                i++;
+            }
+            else if (_tcscmp(arg, _T("--scan")) == 0 && i+1 != argc) 
+            {
+                // raw file or directory to query, may be given more than once
+                scanPaths.push_back(argv[i + 1]);
+                i++;
+            }
+            else if (_tcscmp(arg, _T("--rates")) == 0 && i+1 != argc) 
+            {
+                // bit rate cache filename
+                options.rateCacheFilename = argv[i + 1];
+                i++;
+            }
+            else if (_tcscmp(arg, _T("--json")) == 0) 
+            {
+                // save as JSON Lines
+                options.format.type = EXPORT_JSON;
+            }
+            else if (_tcscmp(arg, _T("--iso")) == 0) 
+            {
+                // ISO-8601 times in CSV files
+                options.format.isoTime = true;
+            }
+            else if (_tcscmp(arg, _T("--trip")) == 0) 
+            {
+                // report trip statistics
+                options.reportTrip = true;
+            }
+            else if (_tcscmp(arg, _T("--metric")) == 0) 
             {
-                // port
-                portName = argv[i + 1];
+                // metric units
+                options.format.metric = true;
+            }
+            else if (arg[1] == _T('p') && i+1 != argc) 
+            {
+                // port, may be given more than once
+                portNames.push_back(argv[i + 1]);
+                i++;
+            } 
+            else if (arg[1] == _T('a')) 
+            {
+                // sync every Logger that's plugged in
+                findPorts = true;
+            } 
+            else if (arg[1] == _T('j') && i+1 != argc) 
+            {
+                // number of Loggers to sync at once
+                numWorkers = _ttoi(argv[i + 1]);
+                i++;
+            } 
+            else if (arg[1] == _T('e') && i+1 != argc) 
+            {
+                // retries after a failure
+                retries = _ttoi(argv[i + 1]);
                 i++;
             } 
             else if (arg[1] == _T('b') && i+1 != argc) 
             {
                 // baud rate override
-                userDefinedRate = true;
-                baudRate = _wtoi(argv[i + 1]);
+                options.userDefinedRate = true;
+                options.bitRate = _ttoi(argv[i + 1]);
                 i++;
             } 
             else if (arg[1] == _T('g') && i+1 != argc) 
             {
                 // graph filename
-                graphFilename = argv[i + 1];
+                options.graphFilename = argv[i + 1];
                 i++;
             } 
             else if (arg[1] == _T('s') && i+1 != argc) 
             {
                 // snapshot filename
-                snapshotFilename = argv[i + 1];
+                options.snapshotFilename = argv[i + 1];
+                i++;
+            }
+            else if (arg[1] == _T('i') && i+1 != argc) 
+            {
+                // incremental sync filename
+                options.newSamplesFilename = argv[i + 1];
+                i++;
+            }
+            else if (arg[1] == _T('d') && i+1 != argc) 
+            {
+                // archive directory
+                options.archiveDirectory = argv[i + 1];
+                i++;
+            }
+            else if (arg[1] == _T('t') && i+1 != argc) 
+            {
+                // graph to use for incremental sync
+                options.newSamplesGraph = _ttoi(argv[i + 1]);
+                i++;
+            }
+            else if (arg[1] == _T('f') && i+1 != argc) 
+            {
+                // live stream filename
+                options.followFilename = argv[i + 1];
+                i++;
+            }
+            else if (arg[1] == _T('n') && i+1 != argc) 
+            {
+                // seconds between live stream records
+                options.streamInterval = _ttoi(argv[i + 1]);
                 i++;
             }
             else if (arg[1] == _T('v')) 
             {
                 // report firmware version number
-                reportVersion = true;
+                options.reportVersion = true;
             } 
             else if (arg[1] == _T('c')) 
             {
                 // save as CSV
-                saveAsCSV = true;
+                options.format.type = EXPORT_CSV;
             } 
             else if (arg[1] == _T('r')) 
             {
                 // save as raw binary
-                saveAsCSV = false;
+                options.format.type = EXPORT_RAW;
+            } 
+            else if (arg[1] == _T('l')) 
+            {
+                // don't use the block framed protocol
+                options.legacyProtocol = true;
             } 
             else 
             {
@@ -104,714 +311,1156 @@ int _tmain(int argc, _TCHAR* argv[])
         }
     }
 
-    if (portName == 0)
+    if (exportFilename != 0)
     {
-        wcout << "Error: communication port was not specified." << endl << endl;
-        Usage();
+        if (options.archiveDirectory == 0)
+        {
+            wcout << "Error: --export needs the archive directory, given with -d." << endl;
+        }
+        else if (portNames.empty() && !findPorts)
+        {
+            ExportArchive(options.archiveDirectory, exportFilename, options.format);
+        }
+        else
+        {
+            wcout << "Error: the archive can't be exported while syncing." << endl;
+        }
+        return 0;
+    }
+
+    if (!stitchPaths.empty())
+    {
+        if (options.graphFilename == 0)
+        {
+            wcout << "Error: --stitch needs the filename to save the graph data to, given with -g." << endl;
+        }
+        else if (portNames.empty() && !findPorts)
+        {
+            StitchGraphs(stitchPaths, options.graphFilename, options.format);
+        }
+        else
+        {
+            wcout << "Error: graphs can't be stitched while syncing." << endl;
+        }
+        return 0;
+    }
+
+    if (query)
+    {
+        queryOptions.metric = options.format.metric;
+        if (options.archiveDirectory == 0 && scanPaths.empty())
+        {
+            wcout << "Error: --query needs the archive directory, given with -d, or raw files, given with --scan." << endl;
+        }
+        else if (portNames.empty() && !findPorts)
+        {
+            QueryData(options.archiveDirectory, scanPaths, queryOptions, numWorkers);
+        }
+        else
+        {
+            wcout << "Error: the archive can't be queried while syncing." << endl;
+        }
         return 0;
     }
 
-    HANDLE hSerial = InitSerialPort(portName, baudRate);
+    if (!convertPaths.empty())
+    {
+        if (portNames.empty() && !findPorts)
+        {
+            ConvertFiles(convertPaths, options.format, numWorkers);
+        }
+        else
+        {
+            wcout << "Error: files can't be converted while syncing." << endl;
+        }
+        return 0;
+    }
 
-    if (!userDefinedRate)
+    if (findPorts)
     {
-        if (!AdjustBitRate(hSerial, portName, baudRate))
+        FindSerialPorts(portNames);
+        if (portNames.empty())
+        {
+            wcout << "Error: no serial ports were found." << endl;
             return 0;
+        }
     }
-    if (reportVersion)
+
+    if (portNames.empty())
     {
-        GetFirmwareVersion(hSerial, true);
+        wcout << "Error: communication port was not specified." << endl << endl;
+        Usage();
+        return 0;
     }
 
-    if (graphFilename != 0)
+    bool fleet = (portNames.size() > 1 || findPorts);
+    if (fleet && options.followFilename != 0)
     {
-        GetGraphs(hSerial, graphFilename, saveAsCSV);
+        wcout << "Error: live streaming only works with one Logger at a time." << endl;
+        return 0;
     }
 
-    if (snapshotFilename != 0)
+    options.retries = (retries >= 0) ? retries : (fleet ? FLEET_RETRIES : 0);
+    options.keyFilenames = fleet;
+    options.archiveOnly = (options.archiveDirectory != 0 && options.graphFilename == 0 && 
+        options.snapshotFilename == 0 && options.newSamplesFilename == 0 && options.followFilename == 0);
+
+    // a bit rate given with -b is always used as is
+    RateCache rateCache;
+    tstring rateCacheFilename = options.rateCacheFilename ? options.rateCacheFilename : GetSettingsFilename(_T("blsync-rates"));
+    if (!options.userDefinedRate)
     {
-        GetSnapshots(hSerial, snapshotFilename, saveAsCSV);
+        LoadRateCache(rateCacheFilename.c_str(), rateCache);
+        options.pRateCache = &rateCache;
+        options.rateCacheFilename = rateCacheFilename.c_str();
     }
 
-    if (hSerial != INVALID_HANDLE_VALUE)
+    if (fleet)
+    {
+        SyncFleet(portNames, options, numWorkers);
+    }
+    else
     {
-        CloseHandle(hSerial);
+        DeviceResult result(portNames[0], options.bitRate);
+        UseCachedRate(result, options);
+        SyncLogger(result, options, wcout);
+        SaveCachedRates(vector<DeviceResult*>(1, &result), options);
     }
 
     return 0;
 }
 
+DeviceResult::DeviceResult(const tstring& portName, unsigned long bitRate) :
+    portName(portName),
+    success(false),
+    attempts(0),
+    bitRate(bitRate),
+    calibrate(true),
+    elapsed(0),
+    versionDone(false),
+    tripDone(false),
+    graphsDone(false),
+    snapshotsDone(false),
+    newSamplesDone(false)
+{
+}
+
 /* 
-    SendCommand
-    Sends the "CMD" prefix to the Logger, followed by the command ID.
-    A short delay is inserted between each byte sent, to give the Logger enough
-    time to process it before the next one arrives.
-    Two zeroes precede the "CMD" prefix, to give the Logger enough time to
-    enter the serial read interrupt routine.
-    Returns true if successful, false if an error occured.
+    ReportFileError
+    Print a descriptive error string for the most recent file error.
 */
-bool SendCommand(HANDLE hSerial, char cmd)
+void ReportFileError(wostream& log)
 {
-    char szBuff[7] = { 0, 0, 'C', 'M', 'D', 0, 0};
-    szBuff[5] = cmd; 
-    DWORD dwBytesSent = 0;
+    log << "Error: " << strerror(errno) << endl;
+}
 
-    for (int i=0; i<6; i++)
+/* 
+    OpenOutputFile
+    Opens a file for saving data, either replacing it or appending to it. newFile is set to true 
+    if the file was empty.
+    Returns the open file, or 0 if an error occurred.
+*/
+FILE* OpenOutputFile(const _TCHAR* filename, bool append, bool& newFile, wostream& log)
+{
+    FILE* pFile = _tfopen(filename, append ? _T("ab") : _T("wb"));
+    if (pFile == 0)
     {
-        if (!WriteFile(hSerial, &szBuff[i], 1, &dwBytesSent, NULL))
-        {
-            ReportError();
-            return false;
-        }
-        else if (dwBytesSent != 1)
-        {
-            wcout << "Error: failed to send the command to the Logger." << endl;
-            return false;
-        }
+        ReportFileError(log);
+        return 0;
+    }
 
-        Sleep(20);
+    fseek(pFile, 0, SEEK_END);
+    newFile = (ftell(pFile) == 0);
+    return pFile;
+}
+
+/* 
+    WriteFileBytes
+    Writes a user-defined number of bytes to the given file.
+    Returns true if successful, false if an error occurred.
+*/
+bool WriteFileBytes(FILE* pFile, const void* pData, size_t size, wostream& log)
+{
+    if (fwrite(pData, 1, size, pFile) != size)
+    {
+        ReportFileError(log);
+        return false;
     }
 
     return true;
 }
 
 /* 
-    GetBytes
-    Attempts to read a user-defined number of bytes into a user-supplied buffer.
-    Updates the checksum, which is passed by reference.
+    WriteFileString
+    Writes a null-terminated string to the given file.
     Returns true if successful, false if an error occurred.
 */
-bool GetBytes(HANDLE hSerial, char* pBuffer, int bytesToRead, unsigned char& checksum, bool showOutput)
+bool WriteFileString(FILE* pFile, const char* str, wostream& log)
 {
-    if (bytesToRead == 0)
-        return true;
+    return WriteFileBytes(pFile, str, strlen(str), log);
+}
+
+/* 
+    GetGraphs
+    Syncs the graph data from the Logger, and saves it to the specified file as CSV, JSON Lines, or raw binary. 
+    If an archive path is given, the samples are also added to the archive, and the filename may be 0.
+    Returns true if successful, false if an error occurred.
+*/
+bool GetGraphs(LoggerLink& link, const _TCHAR* filename, const ExportFormat& format, const _TCHAR* archivePath)
+{
+    // Loggers that support framing also support the compact version 2 graph format. Ask for it, and
+    // convert it back to version 1.
+    char requestedVersion = 2;
+    Payload payload;
+    if (!GetPayload(link, CMD_GETGRAPHS, &requestedVersion, link.useFraming ? 1 : 0, payload, true))
+        return false;
+
+    if (payload.size() > 0 && payload[0] == 2)
+    {
+        Payload encodedPayload;
+        encodedPayload.swap(payload);
+        if (!DecodeGraphs(encodedPayload, payload))
+        {
+            *link.log << "Error: an incorrect response was received from the Logger." << endl;
+            return false;
+        }
+    }
+
+    // get the graph data header
+    if (payload.size() < 9)
+    {
+        *link.log << "Error: an incomplete response was received from the Logger." << endl;
+        return false;
+    }
+    char* header = (char*)&payload[0];
 
-    DWORD dwBytesRead = 0;
-    if (!ReadFile(hSerial, pBuffer, bytesToRead, &dwBytesRead, NULL))
+    unsigned char versionNumber = (unsigned char)header[0];
+    if (versionNumber != 1)
     {
-        ReportError();
+        *link.log << "Error: Unsupported graph version number: " << versionNumber << endl;
+        return false;
     }
-    else if (dwBytesRead == 0)
+
+    GraphView graphs;
+    if (!graphs.Parse(&payload[0], payload.size()))
     {
-         if (showOutput)
-            wcout << "Error: no response was received from the Logger." << endl;
+        *link.log << "Error: an incomplete response was received from the Logger." << endl;
+        return false;
     }
-    else if (dwBytesRead != bytesToRead)
+
+    bool archived = true;
+    if (archivePath != 0)
     {
-         if (showOutput)
-             wcout << "Error: an incomplete response was received from the Logger." << endl;
-    }        
-    else
+        archived = ArchiveGraphs(link, archivePath, graphs);
+    }
+    if (filename == 0)
+        return archived;
+
+    // save the data to the file
+    bool saved = false;
+    bool newFile;
+    FILE* pFile = OpenOutputFile(filename, false, newFile, *link.log);
+    if (pFile != 0)
     {
-        for (int i=0; i<bytesToRead; i++)
+        if (format.type != EXPORT_RAW)
         {
-            checksum ^= (unsigned char)pBuffer[i];
+            SampleWriter writer(pFile, format, *link.log);
+            saved = WriteGraphs(writer, graphs) && writer.Flush();
+            if (saved)
+            {
+                *link.log << "Saved " << GetFormatName(format) << " format graph data to " << filename << endl;
+            }
         }
-        return true;
+        else
+        {
+            // save raw binary data      
+            if (WriteFileBytes(pFile, &payload[0], payload.size(), *link.log))
+            {
+                saved = true;
+                *link.log << "Saved binary format graph data to " << filename << endl;
+            }
+        }
+
+        fclose(pFile);
     }
 
-    return false;
+    return saved && archived;
 }
 
 /* 
-    GetResponseHeader
-    Gets up to 300 bytes from the Logger, and stopping after the first occurrence of the string "LOG".
+    GetSnapshots
+    Syncs the snapshot data from the Logger, and saves it to the specified file as CSV, JSON Lines, or raw 
+    binary. If an archive path is given, the snapshots are also added to the archive, and the filename may be 0.
     Returns true if successful, false if an error occurred.
 */
-bool GetResponseHeader(HANDLE hSerial, bool showOutput)
+bool GetSnapshots(LoggerLink& link, const _TCHAR* filename, const ExportFormat& format, const _TCHAR* archivePath)
 {
-    char* prefix = "LOG";
-    char index = 0;
-    char readCount = 0;
+    Payload payload;
+    if (!GetPayload(link, CMD_GETSNAPSHOTS, 0, 0, payload, true))
+        return false;
 
-    char szBuff[2] = {0};
-    unsigned char checksum = 0;
-    
-    while (readCount < 300)
+    // get the snapshot data header
+    if (payload.size() < 2)
+    {
+        *link.log << "Error: an incomplete response was received from the Logger." << endl;
+        return false;
+    }
+    char* header = (char*)&payload[0];
+
+    unsigned char versionNumber = (unsigned char)header[0];
+    if (versionNumber != 1)
+    {
+        *link.log << "Error: Unsupported snapshot version number: " << versionNumber << endl;
+        return false;
+    }
+
+    SnapshotView snapshots;
+    if (!snapshots.Parse(&payload[0], payload.size()))
+    {
+        *link.log << "Error: an incomplete response was received from the Logger." << endl;
+        return false;
+    }
+
+    bool archived = true;
+    if (archivePath != 0)
+    {
+        archived = ArchiveSnapshots(link, archivePath, snapshots);
+    }
+    if (filename == 0)
+        return archived;
+
+    // save the data to the file
+    bool saved = false;
+    bool newFile;
+    FILE* pFile = OpenOutputFile(filename, false, newFile, *link.log);
+    if (pFile != 0)
     {
-        if (GetBytes(hSerial, szBuff, 1, checksum, showOutput))
+        if (format.type != EXPORT_RAW)
         {
-            readCount++;
-           
-            if (szBuff[0] == prefix[index])
-            {
-                index++;
-                if (index == 3)
-                {
-                    return true;
-                }
-            }
-            else if (szBuff[0] == prefix[0])
+            SampleWriter writer(pFile, format, *link.log);
+            saved = writer.WriteHeader() && WriteSnapshots(writer, snapshots) && writer.Flush();
+            if (saved)
             {
-                index = 1;
+                *link.log << "Saved " << GetFormatName(format) << " format snapshot data to " << filename << endl;
             }
-            else
-            {
-                index = 0;
-            }   
         }
         else
         {
-            // GetBytes() failed
-            break;
+            // save raw binary data      
+            if (WriteFileBytes(pFile, &payload[0], payload.size(), *link.log))
+            {
+                saved = true;
+                *link.log << "Saved binary format snapshot data to " << filename << endl;
+            }
         }
-    }
 
-    if (readCount > 0)
-    {
-        if (showOutput)
-            wcout << "Error: an incorrect response was received from the Logger." << endl;
+        fclose(pFile);
     }
 
-    return false;
+    return saved && archived;
 }
 
 /* 
-    VerifyChecksum
-    Gets a checksum byte from the Logger, and verifies it matches the passed-in checksum value.
+    ArchiveGraphs
+    Adds the samples from each graph to the archive, as a separate series for each graph's sample interval.
     Returns true if successful, false if an error occurred.
 */
-bool VerifyChecksum(HANDLE hSerial, unsigned char checksum, bool showOutput)
+bool ArchiveGraphs(LoggerLink& link, const _TCHAR* archivePath, const GraphView& graphs)
 {
-    char szBuff[2] = {0};
-    unsigned char dummy = 0;
-    
-    // read the checksum byte
-    if (GetBytes(hSerial, szBuff, 1, dummy, showOutput))
+    int totalAdded = 0;
+    for (int g=0; g<graphs.GetGraphCount(); g++)
     {
-        return (unsigned char)szBuff[0] == checksum;
+        SampleView samples = graphs.GetGraph(g);
+        if (samples.empty())
+            continue;
+
+        vector<ArchiveRecord> records;
+        MakeArchiveRecords(samples, records);
+
+        int added;
+        if (!AddToArchive(archivePath, samples.GetMinutesPerSample(), records, added, *link.log))
+            return false;
+        totalAdded += added;
     }
 
-    return false;
+    *link.log << "Added " << totalAdded << " new graph samples to the archive in " << archivePath << endl;
+    return true;
 }
 
 /* 
-    GetFirmwareVersion
-    Get the firmware version number from the Logger, and optionally print it to the console
+    ArchiveSnapshots
+    Adds the snapshots to the archive.
     Returns true if successful, false if an error occurred.
 */
-bool GetFirmwareVersion(HANDLE hSerial, bool showOutput)
+bool ArchiveSnapshots(LoggerLink& link, const _TCHAR* archivePath, const SnapshotView& snapshots)
 {
-    if (!SendCommand(hSerial, CMD_VERSION))
-        return false;
-
-    if (!GetResponseHeader(hSerial, showOutput))
-        return false;
-
-    // get the version string
-    char szBuff[32] = {0};
-    unsigned char checksum = 0;
-    char* p = szBuff;
-
-    do
-    {
-        if (!GetBytes(hSerial, p, 1, checksum, showOutput))
-            return false;
-    } while (*p++ != 0);
-
-    if (VerifyChecksum(hSerial, checksum, showOutput))
+    vector<ArchiveRecord> records(snapshots.size());
+    for (size_t s=0; s<snapshots.size(); s++)
     {
-        if (showOutput)
-            wcout << "The Logger's firmware version number is " << szBuff << endl;
-        return true;
+        records[s].time = snapshots.GetTime(s);
+        records[s].sample = snapshots[s];
     }
 
-    return false;
+    int added;
+    if (!AddToArchive(archivePath, ARCHIVE_SERIES_SNAPSHOTS, records, added, *link.log))
+        return false;
+
+    *link.log << "Added " << added << " new snapshots to the archive in " << archivePath << endl;
+    return true;
 }
 
 /* 
-    AdjustBitRate
-    Silently attempts to retrieve the firmware version number using several different bit
-    rates. The bitRate parameter (passed by reference) is set to the selected bit rate.
+    ArchiveNewSamples
+    Adds the samples from an incremental sync to the archive.
     Returns true if successful, false if an error occurred.
 */
-bool AdjustBitRate(HANDLE& hSerial, _TCHAR* portName, unsigned long& bitRate)
+bool ArchiveNewSamples(LoggerLink& link, const _TCHAR* archivePath, const SampleView& samples)
 {
-    unsigned long defaultRate = bitRate;
-    
-    // try the default rate first
-    if (GetFirmwareVersion(hSerial, false))
+    if (samples.GetMinutesPerSample() == 0)
         return true;
 
-    CloseHandle(hSerial);
-
-    unsigned long alternateRates[6] = { 38000, 38800, 37600, 39200, 37200, 39600 };
-    for (int i=0; i<6; i++)
-    {
-        bitRate = alternateRates[i];
-        if (hSerial = InitSerialPort(portName, bitRate))
-        {
-            if (GetFirmwareVersion(hSerial, false))
-            {
-                wcout << "Adjusted the communication bit rate to  " << bitRate << endl;
-                return true;
-            }
-            else
-            {
-                CloseHandle(hSerial);
-            }
-        }
-    }
+    vector<ArchiveRecord> records;
+    MakeArchiveRecords(samples, records);
 
-    // try the default rate once more, with error messages enabled
-    bitRate = defaultRate;
-    hSerial = InitSerialPort(portName, bitRate);
-    if (GetFirmwareVersion(hSerial, true))
-        return true;
+    int added;
+    if (!AddToArchive(archivePath, samples.GetMinutesPerSample(), records, added, *link.log))
+        return false;
 
-    CloseHandle(hSerial);
-    return false;
+    *link.log << "Added " << added << " new samples to the archive in " << archivePath << endl;
+    return true;
 }
 
 /* 
-    AdjustTime
-    Adjusts the given SYSTEMTIME by adding or subtracting a user-defined number of minutes.
+    ReadSyncCursor
+    Reads the generation and sequence number saved by a previous incremental sync, and the ID of the Logger 
+    they came from. Cursors from Loggers without an ID, and from older versions of blsync, have no ID.
+    Returns false if there is no saved cursor, in which case everything on the Logger will be synced.
 */
-void AdjustTime(SYSTEMTIME& st, int minutesToSubtract)
+bool ReadSyncCursor(const _TCHAR* cursorFilename, unsigned char& generation, unsigned long& sequence, bool& hasId, unsigned long& id)
 {
-    // convert SYSTEMTIME to FILETIME to LARGE_INTEGER
-    FILETIME ft;
-    SystemTimeToFileTime(&st, &ft);
-
-    LARGE_INTEGER li;
-    li.LowPart = ft.dwLowDateTime;
-    li.HighPart = ft.dwHighDateTime;
-
-    // adjust the time
-    li.QuadPart += (LONGLONG)10000000 * 60 * minutesToSubtract;
+    FILE* pFile = _tfopen(cursorFilename, _T("rb"));
+    if (pFile == 0)
+        return false;
 
-    // convert LARGE_INTEGER to FILETIME to SYSTEMTIME
-    ft.dwLowDateTime = li.LowPart;
-    ft.dwHighDateTime = li.HighPart;
+    char buf[64] = {0};
+    bool result = false;
+    if (fread(buf, 1, sizeof(buf)-1, pFile) > 0)
+    {
+        unsigned int g = 0;
+        unsigned long seq = 0;
+        unsigned long cursorId = 0;
+        int fields = sscanf_s(buf, "%u %lu %lx", &g, &seq, &cursorId);
+        if (fields >= 2)
+        {
+            generation = (unsigned char)g;
+            sequence = seq;
+            hasId = (fields == 3);
+            id = cursorId;
+            result = true;
+        }
+    }
 
-    FileTimeToSystemTime(&ft, &st);
+    fclose(pFile);
+    return result;
 }
 
 /* 
-    WriteFileString
-    Writes a null-terminated string to file with the given handle.
+    WriteSyncCursor
+    Saves the generation and sequence number of the next sample to request, and the ID of the Logger if it 
+    has one.
     Returns true if successful, false if an error occurred.
 */
-bool WriteFileString(HANDLE hFile, char* str)
+bool WriteSyncCursor(const _TCHAR* cursorFilename, unsigned char generation, unsigned long sequence, bool hasId, unsigned long id, wostream& log)
 {
-    DWORD dwBytesSent = 0;
-    DWORD bytesToSend = strlen(str);
-
-    if (!WriteFile(hFile, str, bytesToSend, &dwBytesSent, NULL))
+    FILE* pFile = _tfopen(cursorFilename, _T("wb"));
+    if (pFile == 0)
     {
-        ReportError();
+        ReportFileError(log);
+        return false;
     }
-    else if (dwBytesSent != bytesToSend)
+
+    char buf[64];
+    if (hasId)
     {
-        wcout << "Error: Failed to save data to the file." << endl;
+        sprintf_s(buf, 64, "%u %lu %08lX\n", (unsigned int)generation, sequence, id);
     }
     else
     {
-        return true;
+        sprintf_s(buf, 64, "%u %lu\n", (unsigned int)generation, sequence);
     }
+    bool result = WriteFileString(pFile, buf, log);
 
-    return false;
+    if (fclose(pFile) != 0)
+    {
+        ReportFileError(log);
+        result = false;
+    }
+    return result;
 }
 
 /* 
-    GetGraphs
-    Syncs the graph data from the Logger, and saves it to the specified file as CSV or raw binary.
+    GetNewSamples
+    Syncs only the samples from one graph that are newer than those retrieved by the last incremental sync, 
+    and appends them to the specified file as CSV, JSON Lines, or raw binary. The position of the last sync is kept in 
+    a cursor file alongside the data file, with the Logger's ID. If an archive path is given, the samples are also added to the
+    archive.
+    Returns true if successful, false if an error occurred.
 */
-void GetGraphs(HANDLE hSerial, _TCHAR* filename, bool saveAsCSV)
+bool GetNewSamples(LoggerLink& link, const _TCHAR* filename, int graph, const ExportFormat& format, const _TCHAR* archivePath)
 {
-    if (!SendCommand(hSerial, CMD_GETGRAPHS))
-        return;
+    tstring cursorFilename = filename;
+    cursorFilename += _T(".cursor");
+
+    // the generation and sequence number are small counters that any Logger could match, so the cursor is only
+    // used with the Logger that wrote it
+    unsigned long id = 0;
+    bool hasId = GetDeviceId(link, id);
+
+    unsigned char generation = 0;
+    unsigned long sequence = 0;
+    bool cursorHasId = false;
+    unsigned long cursorId = 0;
+    bool useCursor = ReadSyncCursor(cursorFilename.c_str(), generation, sequence, cursorHasId, cursorId);
+    if (useCursor && (cursorHasId != hasId || cursorId != id))
+    {
+        if (cursorHasId)
+        {
+            *link.log << "The cursor in " << cursorFilename.c_str() << " is from a different Logger, so all samples will be synced." << endl;
+        }
+        else
+        {
+            *link.log << "The cursor in " << cursorFilename.c_str() << " doesn't say which Logger it's from, so all samples will be synced." << endl;
+        }
+        useCursor = false;
+    }
+    if (!useCursor)
+    {
+        // no cursor- request a generation that can't match, to get all the samples the Logger has
+        generation = 0;
+        sequence = 0xFFFFFFFF;
+    }
 
-    if (!GetResponseHeader(hSerial, true))
-        return;
+    // timescale, generation, sequence number LSB first
+    char args[6];
+    args[0] = (char)(graph - 1);
+    args[1] = (char)generation;
+    for (int i=0; i<4; i++)
+    {
+        args[2+i] = (char)(sequence >> (8*i));
+    }
 
-    // get the graph data header
-    char header[10] = {0};
-    unsigned char checksum = 0;
-    if (!GetBytes(hSerial, header, 9, checksum, true))
-        return;
+    Payload payload;
+    if (!GetPayload(link, CMD_GETSAMPLESSINCE, args, 6, payload, true))
+        return false;
+
+    // get the samples header
+    if (payload.size() < 16)
+    {
+        *link.log << "Error: an incomplete response was received from the Logger." << endl;
+        return false;
+    }
+    char* header = (char*)&payload[0];
 
     unsigned char versionNumber = (unsigned char)header[0];
     if (versionNumber != 1)
     {
-        wcout << "Error: Unsupported graph version number: " << versionNumber << endl;
-        return;
+        *link.log << "Error: Unsupported samples version number: " << (int)versionNumber << endl;
+        return false;
     }
 
-    unsigned char numberOfGraphs = (unsigned char)header[1];
-    unsigned char samplesPerGraph = (unsigned char)header[2];
+    NewSamplesView newSamples;
+    if (!newSamples.Parse(&payload[0], payload.size()) || newSamples.GetByteCount() != payload.size())
+    {
+        *link.log << "Error: an incomplete response was received from the Logger." << endl;
+        return false;
+    }
+    SampleView samples = newSamples.GetSamples();
 
-    // "now" time reference for the graphs
-    // graph g is series of samples from the "now" time back to now - samplesPerGraph * minutesPerSample[g]
-    unsigned char nowSecond = (unsigned char)header[3];
-    unsigned char nowMinute = (unsigned char)header[4];
-    unsigned char nowHour = (unsigned char)header[5];
-    unsigned char nowDay = (unsigned char)header[6];
-    unsigned char nowMonth = (unsigned char)header[7];
-    unsigned char nowYear = (unsigned char)header[8];
+    // the cursor only advances if the samples made it into the archive too
+    if (archivePath != 0 && !ArchiveNewSamples(link, archivePath, samples))
+        return false;
+
+    // append the data to the file
+    bool newFile;
+    FILE* pFile = OpenOutputFile(filename, true, newFile, *link.log);
+    if (pFile != 0)
+    {
+        bool saved = false;
+
+        if (format.type != EXPORT_RAW)
+        {
+            SampleWriter writer(pFile, format, *link.log);
+            saved = (!newFile || writer.WriteHeader()) && WriteSamples(writer, samples) && writer.Flush();
+        }
+        else
+        {
+            // append raw binary data, with the header for each sync      
+            saved = WriteFileBytes(pFile, &payload[0], payload.size(), *link.log);
+        }
 
-    int graphDataBytes = numberOfGraphs * (sizeof(Sample) * samplesPerGraph + 2);
+        if (fclose(pFile) != 0)
+        {
+            ReportFileError(*link.log);
+            saved = false;
+        }
 
-    unsigned char* pGraphData = (unsigned char*)malloc(graphDataBytes);
-    if (!pGraphData)
+        // only advance the cursor once the samples are safely in the file
+        if (saved && WriteSyncCursor(cursorFilename.c_str(), newSamples.GetGeneration(), newSamples.GetFirstSequence() + samples.size(), hasId, id, *link.log))
+        {
+            *link.log << "Appended " << samples.size() << " new samples to " << filename << endl;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* 
+    FollowStream
+    Streams live samples from the Logger, and appends each record to the specified file as CSV, JSON Lines, or 
+    raw binary as soon as it arrives. Runs until Ctrl-C is pressed. The stream is renewed periodically, so the Logger stops 
+    by itself if the connection is lost.
+*/
+void FollowStream(LoggerLink& link, const _TCHAR* filename, int interval, const ExportFormat& format)
+{
+    if (interval < 1 || interval > 255)
     {
-        wcout << "Error: Failed to allocate memory for the graph data buffer." << endl;
+        *link.log << "Error: The stream interval must be between 1 and 255 seconds." << endl;
         return;
     }
 
-    if (!GetBytes(hSerial, (char*)pGraphData, graphDataBytes, checksum, true))
+    bool newFile;
+    FILE* pFile = OpenOutputFile(filename, true, newFile, *link.log);
+    if (pFile == 0)
         return;
 
-    if (VerifyChecksum(hSerial, checksum, true))
+    SampleWriter writer(pFile, format, *link.log);
+    if (newFile)
     {
-        // save the data to the file
-        HANDLE hFile = CreateFile(filename,
-                GENERIC_WRITE,
-                FILE_SHARE_READ,
-                0,
-                CREATE_ALWAYS,
-                FILE_ATTRIBUTE_NORMAL,
-                0);
+        writer.WriteHeader();
+    }
 
-        if (hFile == INVALID_HANDLE_VALUE)
-        {
-            ReportError();
-        }
-        else
-        {
-            if (saveAsCSV)
-            {
-                // construct a system time for the "now" time reference
-                SYSTEMTIME timeRef;
-                GetSystemTime(&timeRef);
-                timeRef.wYear = 2000 + nowYear;
-                timeRef.wMonth = nowMonth;
-                timeRef.wDay = nowDay;
-                timeRef.wHour = nowHour;
-                timeRef.wMinute = nowMinute;
-                timeRef.wSecond = nowSecond;
+    if (!StartStream(link, interval, STREAM_MINUTES, true))
+    {
+        fclose(pFile);
+        return;
+    }
 
-                unsigned int graphSize = sizeof(Sample) * samplesPerGraph + 2;
+    *link.log << "Streaming to " << filename << ". Press Ctrl-C to stop." << endl;
+    CatchInterrupt(&stopFollowing);
 
-                char buf[512];
+    unsigned long lastRenewal = GetMilliseconds();
+    Payload pending;
+    unsigned long recordCount = 0;
+    unsigned long lostCount = 0;
+    long expectedSequence = -1;
+    bool fileError = false;
 
-                for (int g=0; g<numberOfGraphs; g++)
-                {
-                    sprintf_s(buf, 512, "Graph %d\n", g+1);
-                    if (!WriteFileString(hFile, buf))
-                    {
-                        break;
-                    }
-                    WriteFileString(hFile, "Time, Temperature (deg F), Altitude (ft), Pressure (in)\n");
-
-                    unsigned int sampleInterval = (unsigned int)pGraphData[graphSize * g]*256 + pGraphData[graphSize * g + 1];
-
-                    // Samples are taken when the number of minutes since midnight is a multiple of the sampleInterval.
-                    // Walk the reference time backwards to the first such occurrence to get the correct sample times.
-                    SYSTEMTIME st = timeRef;
-                    unsigned int minutesSinceMidnight = st.wHour * 60 + st.wMinute;
-                    int minutesToAdjust = minutesSinceMidnight % sampleInterval;
-                    AdjustTime(st, -minutesToAdjust);
-
-                    // Set time back to the first sample
-                    AdjustTime(st, -(int)sampleInterval * (samplesPerGraph-1));
-
-                    for (int s=0; s<samplesPerGraph; s++)
-                    {
-                        Sample* pSample = (Sample*)&pGraphData[graphSize * g + 2 + sizeof(Sample) * s];
-                        long temperature = SAMPLE_TO_TEMPERATURE(pSample->temperature); // degrees F * 2
-                        long pressure = SAMPLE_TO_PRESSURE(pSample->pressure); // millibars * 2
-                        long altitude = SAMPLE_TO_ALTITUDE(pSample->altitude); // feet / 2
-
-                        sprintf_s(buf, 512, "%d/%d/%d %d:%02d %s,%.1f,%d,%.2f\n",
-                                st.wMonth,
-                                st.wDay,
-                                st.wYear - 2000,
-                                (st.wHour % 12) == 0 ? 12 : (st.wHour % 12),
-                                st.wMinute,
-                                st.wHour > 11 ? "PM" : "AM",
-                                (float)temperature/2,
-                                altitude*2,
-                                (float)pressure/2*0.0295333727f);
-                        WriteFileString(hFile, buf);
-                        AdjustTime(st, sampleInterval);
-                    }
-
-                    WriteFileString(hFile, "\n");
-                }
+    while (!stopFollowing && !fileError)
+    {
+        char buf[256];
+        int bytesRead = ReadBytes(link, buf, sizeof(buf));
+        if (bytesRead < 0)
+            break;
+
+        pending.insert(pending.end(), buf, buf + bytesRead);
+
+        // find complete records, skipping anything that isn't one
+        bool gotRecord = false;
+        size_t pos = 0;
+        while (pending.size() - pos >= STREAM_RECORD_SIZE)
+        {
+            unsigned char* pRecord = &pending[pos];
+            if (!IsStreamRecord(pRecord))
+            {
+                pos++;
+                continue;
+            }
+
+            long sequence = pRecord[1] | (pRecord[2] << 8);
+            if (expectedSequence >= 0)
+            {
+                lostCount += (sequence - expectedSequence) & 0xFFFF;
+            }
+            expectedSequence = (sequence + 1) & 0xFFFF;
 
-                wcout << "Saved CSV format graph data to " << filename << endl;
+            if (format.type != EXPORT_RAW)
+            {
+                fileError = !WriteStreamRecord(writer, pRecord);
             }
             else
             {
-                // save raw binary data      
-                DWORD dwBytesSent = 0;
-                if (!WriteFile(hFile, header, 9, &dwBytesSent, NULL))
-                {
-                    ReportError();
-                }
-                else if (dwBytesSent != 9)
-                {
-                    wcout << "Error: Failed to save data to the file." << endl;
-                }
-                else
-                {
-                    if (!WriteFile(hFile, pGraphData, graphDataBytes, &dwBytesSent, NULL))
-                    {
-                        ReportError();
-                    }
-                    else if (dwBytesSent != graphDataBytes)
-                    {
-                        wcout << "Error: Failed to save data to the file." << endl;
-                    }
-                    else
-                    {
-                        wcout << "Saved binary format graph data to " << filename << endl;
-                    }
-                }
+                fileError = !WriteFileBytes(pFile, pRecord, STREAM_RECORD_SIZE, *link.log);
             }
 
-            CloseHandle(hFile);
+            recordCount++;
+            gotRecord = true;
+            pos += STREAM_RECORD_SIZE;
+        }
+
+        pending.erase(pending.begin(), pending.begin() + pos);
+
+        // make each record visible in the file as soon as it arrives
+        if (gotRecord && !fileError)
+        {
+            fileError = !writer.Flush();
+        }
+
+        // renew the stream right after a record, when the Logger won't be sending for a while
+        if (gotRecord && GetMilliseconds() - lastRenewal > STREAM_RENEW_MINUTES * 60000)
+        {
+            if (StartStream(link, interval, STREAM_MINUTES, false))
+            {
+                lastRenewal = GetMilliseconds();
+            }
         }
     }
 
-    free(pGraphData);
+    ReleaseInterrupt();
+    StartStream(link, 0, 0, false);
+    fclose(pFile);
+
+    *link.log << "Saved " << recordCount << " stream records to " << filename;
+    if (lostCount)
+    {
+        *link.log << ", " << lostCount << " records were lost";
+    }
+    *link.log << endl;
 }
 
+/* 
+    MakeDeviceKey
+    Makes the name that tells one Logger's files apart from another's in a fleet sync: the device ID in hex,
+    or for firmware without IDs, the last part of the port name.
+*/
+tstring MakeDeviceKey(const DeviceResult& result, bool hasId, unsigned long id)
+{
+    if (hasId)
+    {
+        basic_ostringstream<_TCHAR> key;
+        key << hex << setw(8) << setfill(_T('0')) << id;
+        return key.str();
+    }
+
+    size_t start = result.portName.find_last_of(_T("/\\:"));
+    tstring key = result.portName.substr(start == tstring::npos ? 0 : start + 1);
+
+    // replace anything that doesn't belong in a filename
+    for (size_t i=0; i<key.size(); i++)
+    {
+        _TCHAR c = key[i];
+        if (!(c >= _T('a') && c <= _T('z')) && !(c >= _T('A') && c <= _T('Z')) && !(c >= _T('0') && c <= _T('9')) && c != _T('-'))
+        {
+            key[i] = _T('_');
+        }
+    }
+
+    if (key.empty())
+    {
+        key = _T("logger");
+    }
+    return key;
+}
 
 /* 
-    GetSnapshots
-    Syncs the snapshot data from the Logger, and saves it to the specified file as CSV or raw binary.
+    MakeDeviceFilename
+    Makes the filename for one Logger's data in a fleet sync, by adding its device key, so graphs.csv 
+    becomes graphs-1a2b3c4d.csv. When syncing a single Logger, the filename is used as given.
 */
-void GetSnapshots(HANDLE hSerial, _TCHAR* filename, bool saveAsCSV)
+tstring MakeDeviceFilename(const _TCHAR* filename, const DeviceResult& result, const SyncOptions& options)
 {
-    if (!SendCommand(hSerial, CMD_GETSNAPSHOTS))
-        return;
+    if (filename == 0)
+        return tstring();
 
-    if (!GetResponseHeader(hSerial, true))
-        return;
+    tstring name = filename;
+    if (!options.keyFilenames)
+        return name;
 
-    // get the snapshot data header
-    char header[3] = {0};
-    unsigned char checksum = 0;
-    if (!GetBytes(hSerial, header, 2, checksum, true))
-        return;
+    return AddDeviceKey(filename, result.deviceKey);
+}
 
-    unsigned char versionNumber = (unsigned char)header[0];
-    if (versionNumber != 1)
+/* 
+    AddDeviceKey
+    Adds a device key to a filename. Every "{device}" in the filename is replaced with the key, or if there
+    are none, the key is added before the extension.
+*/
+tstring AddDeviceKey(const _TCHAR* filename, const tstring& deviceKey)
+{
+    tstring name = filename;
+    const tstring placeholder = _T("{device}");
+    size_t pos = name.find(placeholder);
+    if (pos != tstring::npos)
     {
-        wcout << "Error: Unsupported snapshot version number: " << versionNumber << endl;
-        return;
+        while (pos != tstring::npos)
+        {
+            name.replace(pos, placeholder.size(), deviceKey);
+            pos = name.find(placeholder, pos + deviceKey.size());
+        }
+        return name;
     }
 
-    unsigned char numberOfSnapshots = (unsigned char)header[1];
+    size_t dot = name.find_last_of(_T('.'));
+    size_t separator = name.find_last_of(_T("/\\"));
+    if (dot == tstring::npos || (separator != tstring::npos && dot < separator))
+    {
+        name += _T("-") + deviceKey;
+    }
+    else
+    {
+        name.insert(dot, _T("-") + deviceKey);
+    }
+    return name;
+}
 
-    int snapshotDataBytes = numberOfSnapshots * sizeof(Snapshot);
+/* 
+    SyncAttempt
+    Connects to a Logger and performs every requested task that isn't done yet. A failed task doesn't stop
+    the others, so a retry only needs to repeat the ones that failed.
+    Returns true if every task is done, false if any failed.
+*/
+bool SyncAttempt(DeviceResult& result, const SyncOptions& options, wostream& log)
+{
+    LoggerLink link;
+    if (!OpenLink(link, result.portName.c_str(), result.bitRate, log))
+        return false;
 
-    unsigned char* pSnapshotData = (unsigned char*)malloc(snapshotDataBytes);
-    if (!pSnapshotData)
+    if (!options.userDefinedRate)
     {
-        wcout << "Error: Failed to allocate memory for the snapshot data buffer." << endl;
-        return;
+        if (!AdjustBitRate(link, result.calibrate))
+        {
+            CloseLink(link);
+            return false;
+        }
     }
+    result.bitRate = link.bitRate;
 
-    if (!GetBytes(hSerial, (char*)pSnapshotData, snapshotDataBytes, checksum, true))
-        return;
+    if (!options.legacyProtocol)
+    {
+        link.useFraming = DetectFraming(link);
+    }
 
-    if (VerifyChecksum(hSerial, checksum, true))
+    if ((options.keyFilenames || options.archiveDirectory != 0 || options.pRateCache != 0) && result.deviceKey.empty())
     {
-        // save the data to the file
-        HANDLE hFile = CreateFile(filename,
-                GENERIC_WRITE,
-                FILE_SHARE_READ,
-                0,
-                CREATE_ALWAYS,
-                FILE_ATTRIBUTE_NORMAL,
-                0);
+        unsigned long id = 0;
+        bool hasId = GetDeviceId(link, id);
+        result.deviceKey = MakeDeviceKey(result, hasId, id);
+    }
 
-        if (hFile == INVALID_HANDLE_VALUE)
+    tstring archivePath;
+    if (options.archiveDirectory != 0)
+    {
+        if (!CreateArchive(options.archiveDirectory, result.deviceKey, log))
         {
-            ReportError();
+            CloseLink(link);
+            return false;
         }
-        else
-        {
-            if (saveAsCSV)
-            {
-                char buf[512];
+        archivePath = GetArchivePath(options.archiveDirectory, result.deviceKey);
+    }
+    const _TCHAR* pArchivePath = archivePath.empty() ? 0 : archivePath.c_str();
+    bool getGraphs = (options.graphFilename != 0 || options.archiveOnly);
+    bool getSnapshots = (options.snapshotFilename != 0 || options.archiveOnly);
 
-                WriteFileString(hFile, "Time, Temperature (deg F), Altitude (ft), Pressure (in)\n");
+    if (options.reportVersion && !result.versionDone)
+    {
+        result.versionDone = GetFirmwareVersion(link, true);
+    }
 
-                for (int s=0; s<numberOfSnapshots; s++)
-                {
-                    Snapshot* pSnapshot = (Snapshot*)&pSnapshotData[sizeof(Snapshot) * s];
-                    unsigned long packedTime = pSnapshot->packedYearMonthDayHourMin;
-
-                    unsigned char snap_minute = packedTime % 60;
-                    packedTime /= 60;
-                    unsigned char snap_hour = packedTime % 24;
-                    packedTime /= 24;
-                    unsigned char snap_day = packedTime % 32;
-                    packedTime /= 32;
-                    unsigned char snap_month = packedTime % 13;
-                    if (snap_month > 12)
-                        snap_month = 12;
-                    packedTime /= 13;
-                    unsigned char snap_year = (unsigned char)packedTime;
-
-                    Sample* pSample = &pSnapshot->sample;
-                    long temperature = SAMPLE_TO_TEMPERATURE(pSample->temperature); // degrees F * 2
-                    long pressure = SAMPLE_TO_PRESSURE(pSample->pressure); // millibars * 2
-                    long altitude = SAMPLE_TO_ALTITUDE(pSample->altitude); // feet / 2
-
-                    sprintf_s(buf, 512, "%d/%d/%d %d:%02d %s,%.1f,%d,%.2f\n",
-                            snap_month,
-                            snap_day,
-                            snap_year,
-                            (snap_hour % 12) == 0 ? 12 : (snap_hour % 12),
-                            snap_minute,
-                            snap_hour > 11 ? "PM" : "AM",
-                            (float)temperature/2,
-                            altitude*2,
-                            (float)pressure/2*0.0295333727f);
-                    WriteFileString(hFile, buf);
-                }                
-
-                wcout << "Saved CSV format snapshot data to " << filename << endl;
-            }
-            else
-            {
-                // save raw binary data      
-                DWORD dwBytesSent = 0;
-                if (!WriteFile(hFile, header, 2, &dwBytesSent, NULL))
-                {
-                    ReportError();
-                }
-                else if (dwBytesSent != 2)
-                {
-                    wcout << "Error: Failed to save data to the file." << endl;
-                }
-                else
-                {
-                    if (!WriteFile(hFile, pSnapshotData, snapshotDataBytes, &dwBytesSent, NULL))
-                    {
-                        ReportError();
-                    }
-                    else if (dwBytesSent != snapshotDataBytes)
-                    {
-                        wcout << "Error: Failed to save data to the file." << endl;
-                    }
-                    else
-                    {
-                        wcout << "Saved binary format snapshot data to " << filename << endl;
-                    }
-                }
-            }
+    if (options.reportTrip && !result.tripDone)
+    {
+        result.tripDone = ReportTripStats(link, options.format.metric);
+    }
+
+    if (getGraphs && !result.graphsDone)
+    {
+        tstring filename = MakeDeviceFilename(options.graphFilename, result, options);
+        result.graphsDone = GetGraphs(link, options.graphFilename ? filename.c_str() : 0, options.format, pArchivePath);
+    }
+
+    if (getSnapshots && !result.snapshotsDone)
+    {
+        tstring filename = MakeDeviceFilename(options.snapshotFilename, result, options);
+        result.snapshotsDone = GetSnapshots(link, options.snapshotFilename ? filename.c_str() : 0, options.format, pArchivePath);
+    }
 
-            CloseHandle(hFile);
+    if (options.newSamplesFilename != 0 && !result.newSamplesDone)
+    {
+        tstring filename = MakeDeviceFilename(options.newSamplesFilename, result, options);
+        result.newSamplesDone = GetNewSamples(link, filename.c_str(), options.newSamplesGraph, options.format, pArchivePath);
+    }
+
+    if (options.followFilename != 0)
+    {
+        FollowStream(link, options.followFilename, options.streamInterval, options.format);
+    }
+
+    CloseLink(link);
+
+    return (!options.reportVersion || result.versionDone) &&
+        (!options.reportTrip || result.tripDone) &&
+        (!getGraphs || result.graphsDone) &&
+        (!getSnapshots || result.snapshotsDone) &&
+        (options.newSamplesFilename == 0 || result.newSamplesDone);
+}
+
+/* 
+    SyncLogger
+    Syncs one Logger, reconnecting and trying again up to the number of retries in the options if anything 
+    fails. Each retry waits a little longer than the last.
+*/
+void SyncLogger(DeviceResult& result, const SyncOptions& options, wostream& log)
+{
+    unsigned long startTime = GetMilliseconds();
+
+    while (!result.success && result.attempts <= options.retries)
+    {
+        if (result.attempts > 0)
+        {
+            log << "Retrying, attempt " << result.attempts + 1 << " of " << options.retries + 1 << "." << endl;
+            SleepMilliseconds(RETRY_DELAY * result.attempts);
         }
+
+        result.attempts++;
+        result.success = SyncAttempt(result, options, log);
     }
 
-    free(pSnapshotData);
+    result.elapsed = GetMilliseconds() - startTime;
 }
 
 /* 
-    Usage
-    Print program usage instructions to the console
+    UseCachedRate
+    Starts a Logger's sync with the bit rate that worked the last time a Logger was synced on the same port.
 */
-void Usage()
+void UseCachedRate(DeviceResult& result, const SyncOptions& options)
 {
-    wcout << "Backwoods Logger Sync Utility" << endl;
-    wcout << "Usage: blsync -p port [-b speed] [-v] [-c] [-r] [-g filename] [-s filename]" << endl;
-    wcout << "    -p port       Port to use for Logger communication, such as COM1." << endl;
-    wcout << "    -b speed      Bit rate for communication. Default is 38400." << endl;
-    wcout << "    -v            Display the Logger firmware version number." << endl;
-    wcout << "    -c            Save files in CSV format. This is the default." << endl;
-    wcout << "    -r            Save files in raw binary format instead of CSV." << endl;
-    wcout << "    -g filename   Sync the graph data, and save it to the named file." << endl;
-    wcout << "    -s filename   Sync the snapshot data, and save it to the named file." << endl;
+    if (options.pRateCache == 0)
+        return;
+
+    const CachedRate* pRate = FindPortRate(*options.pRateCache, result.portName);
+    if (pRate)
+    {
+        result.bitRate = pRate->bitRate;
+        result.calibrate = pRate->calibrate;
+    }
 }
 
 /* 
-    InitSerialPort
-    Open the requested serial port, and set the speed and data/parity/stop bits
+    SaveCachedRates
+    Remembers the bit rate that worked for each Logger that was reached, and saves the cache file if 
+    anything changed.
 */
-HANDLE InitSerialPort(_TCHAR* portName, unsigned long speed)
+void SaveCachedRates(const vector<DeviceResult*>& results, const SyncOptions& options)
 {
-    HANDLE hSerial;
-    hSerial = CreateFile(portName,
-        GENERIC_READ | GENERIC_WRITE,
-        0,
-        0,
-        OPEN_EXISTING,
-        FILE_ATTRIBUTE_NORMAL,
-        0);
+    if (options.pRateCache == 0)
+        return;
 
-    if (hSerial == INVALID_HANDLE_VALUE)
+    bool changed = false;
+    for (size_t i=0; i<results.size(); i++)
     {
-        if (GetLastError() == ERROR_FILE_NOT_FOUND)
+        // the device key is only known after a working bit rate was found
+        const DeviceResult* pResult = results[i];
+        if (!pResult->deviceKey.empty() && 
+            UpdateRateCache(*options.pRateCache, pResult->deviceKey, pResult->portName, pResult->bitRate, pResult->calibrate))
         {
-            wcout << "Error: Serial port " << portName << " does not exist." << endl;
-        }
-        else
-        {
-            ReportError();
+            changed = true;
         }
     }
-    else
+
+    if (changed)
+    {
+        SaveRateCache(options.rateCacheFilename, *options.pRateCache, wcout);
+    }
+}
+
+/* 
+    FleetWorker
+    Thread function for a fleet sync. Takes the next Logger that hasn't been started, syncs it, and prints
+    its messages all together, until there are no Loggers left.
+*/
+void FleetWorker(void* pContext)
+{
+    FleetContext* pFleet = (FleetContext*)pContext;
+
+    while (true)
     {
-        DCB dcbSerialParams = {0};
-        dcbSerialParams.DCBlength = sizeof(dcbSerialParams);
-        
-        if (!GetCommState(hSerial, &dcbSerialParams)) 
+        LockMutex(pFleet->mutex);
+        size_t index = pFleet->nextDevice++;
+        UnlockMutex(pFleet->mutex);
+
+        if (index >= pFleet->results.size())
+            break;
+
+        DeviceResult* pResult = pFleet->results[index];
+        SyncLogger(*pResult, *pFleet->pOptions, pResult->log);
+
+        LockMutex(pFleet->mutex);
+        wcout << pResult->portName.c_str() << ":" << endl;
+        wistringstream lines(pResult->log.str());
+        wstring line;
+        while (getline(lines, line))
         {
-            ReportError();
+            wcout << "    " << line << endl;
         }
-        else
+        UnlockMutex(pFleet->mutex);
+    }
+}
+
+/* 
+    SyncFleet
+    Syncs several Loggers at once, each on its own connection with its own bit rate adjustment and retries,
+    so the whole batch takes about as long as the slowest Logger. Prints a summary when all are finished.
+*/
+void SyncFleet(const vector<tstring>& portNames, const SyncOptions& options, int numWorkers)
+{
+    FleetContext fleet;
+    fleet.pOptions = &options;
+    fleet.nextDevice = 0;
+    InitMutex(fleet.mutex);
+
+    for (size_t i=0; i<portNames.size(); i++)
+    {
+        fleet.results.push_back(new DeviceResult(portNames[i], options.bitRate));
+        UseCachedRate(*fleet.results.back(), options);
+    }
+
+    // by default, one thread for each Logger
+    if (numWorkers < 1 || numWorkers > (int)portNames.size())
+    {
+        numWorkers = (int)portNames.size();
+    }
+    if (numWorkers > FLEET_MAX_WORKERS)
+    {
+        numWorkers = FLEET_MAX_WORKERS;
+    }
+
+    wcout << "Syncing " << portNames.size() << " Loggers, " << numWorkers << " at a time." << endl;
+    unsigned long startTime = GetMilliseconds();
+
+    vector<ThreadHandle> threads(numWorkers);
+    int numStarted = 0;
+    while (numStarted < numWorkers && StartThread(threads[numStarted], FleetWorker, &fleet))
+    {
+        numStarted++;
+    }
+
+    // if no threads could be started, sync the Loggers one after another instead
+    if (numStarted == 0)
+    {
+        FleetWorker(&fleet);
+    }
+
+    for (int i=0; i<numStarted; i++)
+    {
+        JoinThread(threads[i]);
+    }
+
+    PrintFleetSummary(fleet.results, GetMilliseconds() - startTime);
+    SaveCachedRates(fleet.results, options);
+
+    for (size_t i=0; i<fleet.results.size(); i++)
+    {
+        delete fleet.results[i];
+    }
+    DestroyMutex(fleet.mutex);
+}
+
+/* 
+    PrintFleetSummary
+    Prints a table of the outcome for each Logger in a fleet sync.
+*/
+void PrintFleetSummary(const vector<DeviceResult*>& results, unsigned long elapsed)
+{
+    size_t portWidth = 4;
+    size_t keyWidth = 8;
+    for (size_t i=0; i<results.size(); i++)
+    {
+        portWidth = max(portWidth, results[i]->portName.size());
+        keyWidth = max(keyWidth, results[i]->deviceKey.size());
+    }
+
+    ios_base::fmtflags flags = wcout.flags();
+    wcout << endl << left << fixed << setprecision(1);
+    wcout << setw(portWidth + 2) << "Port" << setw(keyWidth + 2) << "Device" << setw(8) << "Result" 
+        << setw(7) << "Tries" << setw(10) << "Bit rate" << "Seconds" << endl;
+
+    int numSynced = 0;
+    for (size_t i=0; i<results.size(); i++)
+    {
+        const DeviceResult* pResult = results[i];
+        if (pResult->success)
         {
-            dcbSerialParams.BaudRate = speed;
-            dcbSerialParams.ByteSize = 8;
-            dcbSerialParams.Parity = NOPARITY;
-            dcbSerialParams.StopBits = ONESTOPBIT;
-            
-            if (!SetCommState(hSerial, &dcbSerialParams))
-            {
-                ReportError();
-            }
-            else
-            {
-                COMMTIMEOUTS timeouts={0};
-                timeouts.ReadIntervalTimeout=50;
-                timeouts.ReadTotalTimeoutConstant=50;
-                timeouts.ReadTotalTimeoutMultiplier=10;
-                timeouts.WriteTotalTimeoutConstant=50;
-                timeouts.WriteTotalTimeoutMultiplier=10;
-                
-                if (!SetCommTimeouts(hSerial, &timeouts))
-                {
-                    ReportError();
-                }
-            }
+            numSynced++;
         }
+
+        wcout << setw(portWidth + 2) << pResult->portName.c_str() 
+            << setw(keyWidth + 2) << (pResult->deviceKey.empty() ? _T("-") : pResult->deviceKey.c_str()) 
+            << setw(8) << (pResult->success ? "OK" : "Failed") 
+            << setw(7) << pResult->attempts 
+            << setw(10) << pResult->bitRate 
+            << pResult->elapsed / 1000.0 << endl;
     }
 
-    return hSerial;
+    wcout << endl << "Synced " << numSynced << " of " << results.size() << " Loggers in " << elapsed / 1000.0 << " seconds." << endl;
+    wcout.flags(flags);
 }
 
 /* 
-    ReportError
-    Print a descriptive error string for the most recent error.
+    Usage
+    Print program usage instructions to the console
 */
-void ReportError()
+void Usage()
 {
-    _TCHAR lastError[1024];
-    FormatMessage(
-        FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_IGNORE_INSERTS,
-        NULL,
-        GetLastError(),
-        MAKELANGID(LANG_NEUTRAL, SUBLANG_DEFAULT),
-        lastError,
-        1024,
-        NULL);
-
-    wcout << "Error: " << lastError << endl;
+    wcout << "Backwoods Logger Sync Utility" << endl;
+    wcout << "Usage: blsync -p port [-p port ...] [-a] [-j count] [-e count] [-b speed] [-v] [--trip] [-c] [-r] [--json] [-l]" << endl;
+    wcout << "              [-g filename] [-s filename] [-i filename [-t graph]] [-d directory]" << endl;
+    wcout << "              [-f filename [-n seconds]] [--rates filename] [--iso] [--metric]" << endl;
+    wcout << "       blsync -d directory --export filename [--json] [--iso] [--metric]" << endl;
+    wcout << "       blsync --convert path [--convert path ...] [-j count] [--json] [--iso] [--metric]" << endl;
+    wcout << "       blsync --stitch path [--stitch path ...] -g filename [--json] [--iso] [--metric]" << endl;
+    wcout << "       blsync --query field [-d directory] [--scan path ...] [--by period] [--from time] [--to time]" << endl;
+    wcout << "              [--interval minutes] [--device id] [-j count] [--metric]" << endl;
+    wcout << "    -p port       Port to use for Logger communication, such as COM1 or /dev/ttyUSB0." << endl;
+    wcout << "                  pty:command runs the command and talks to it through a pseudo-terminal, on Linux." << endl;
+    wcout << "                  Give -p more than once to sync several Loggers at the same time." << endl;
+    wcout << "    -a            Sync a Logger on every serial port that's found." << endl;
+    wcout << "    -j count      Number of Loggers to sync at the same time. Default is all of them, up to 16." << endl;
+    wcout << "    -e count      Times to try again after a failure. Default is 2 for several Loggers, 0 for one." << endl;
+    wcout << "    -b speed      Bit rate for communication. Default is 38400, adjusted to suit each Logger, starting with" << endl;
+    wcout << "                  the rate that worked last time." << endl;
+    wcout << "    -v            Display the Logger firmware version number." << endl;
+    wcout << "    --trip        Display the Logger's trip statistics: total ascent and descent, highest and lowest" << endl;
+    wcout << "                  altitude, and trip and moving time. --metric shows altitudes in meters." << endl;
+    wcout << "    -c            Save files in CSV format. This is the default." << endl;
+    wcout << "    -r            Save files in raw binary format instead of CSV." << endl;
+    wcout << "    --json        Save files in JSON Lines format, one sample per line, instead of CSV." << endl;
+    wcout << "    --iso         Use ISO-8601 times in CSV files, like 2011-10-19T16:05:00." << endl;
+    wcout << "    --metric      Save temperatures in degrees C, altitudes in meters, and pressures in hPa." << endl;
+    wcout << "    -l            Use the original protocol without error recovery, even if the Logger supports blocks." << endl;
+    wcout << "    -g filename   Sync the graph data, and save it to the named file." << endl;
+    wcout << "    -s filename   Sync the snapshot data, and save it to the named file." << endl;
+    wcout << "    -i filename   Sync only the samples added since the last -i sync, and append them to the named file." << endl;
+    wcout << "    -d directory  Add the synced samples to the archive in the named directory, skipping any already there." << endl;
+    wcout << "                  With no -g, -s, or -i, the graphs and snapshots are synced just for the archive." << endl;
+    wcout << "    -t graph      Graph to use for -i, from 1 (most detailed) to 3. Default is 1." << endl;
+    wcout << "    -f filename   Stream live samples, and append them to the named file until Ctrl-C is pressed." << endl;
+    wcout << "                  --follow filename is the same." << endl;
+    wcout << "    -n seconds    Seconds between streamed samples, from 1 to 255. Default is 60." << endl;
+    wcout << "    --rates filename   File that remembers the bit rate that works for each Logger. Default is .blsync-rates" << endl;
+    wcout << "                       in the home directory, or blsync-rates in the application data folder on Windows." << endl;
+    wcout << "    --export filename  Save everything in the -d archive to the named file, one file per Logger." << endl;
+    wcout << "    --convert path     Convert a file saved with -r to CSV, or every such file in a directory. Each is saved" << endl;
+    wcout << "                       with a .csv or .json extension. -j sets how many to convert at once." << endl;
+    wcout << "    --stitch path      Combine the graph data files saved with -r -g, or every such file in a directory, into" << endl;
+    wcout << "                       one series saved to the -g file. Overlapping times use the most detailed samples," << endl;
+    wcout << "                       and gaps with no samples are flagged." << endl;
+    wcout << "    --query field      Print the minimum, maximum, mean, and total rise and fall of temperature, pressure," << endl;
+    wcout << "                       or altitude for each period, across every Logger in the -d archive." << endl;
+    wcout << "    --scan path        Include a file saved with -r in a query, or every such file in a directory." << endl;
+    wcout << "    --by period        Period to group a query by: hour, day, month, all, or a number of minutes. Default is day." << endl;
+    wcout << "    --from time        Query only samples from this time on, like 2011-08-14 or 2011-08-14T16:05." << endl;
+    wcout << "    --to time          Query only samples up to and including this time. A date alone includes the whole day." << endl;
+    wcout << "    --interval minutes Query the samples taken this many minutes apart, or 0 for snapshots. Default is" << endl;
+    wcout << "                       the most detailed samples there are." << endl;
+    wcout << "    --device id        Query only the Logger with this device ID." << endl;
+    wcout << "When syncing several Loggers, each Logger's files are named with its device ID, such as graphs-1a2b3c4d.csv." << endl;
+    wcout << "Put {device} in a filename to choose where the ID goes." << endl;
 }
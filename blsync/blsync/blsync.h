@@ -13,49 +13,98 @@
   THE PRODUCT OR THE USE OR OTHER DEALINGS IN THE PRODUCT.
 */
 
-HANDLE InitSerialPort(_TCHAR* portName, unsigned long speed);
-bool SendCommand(HANDLE hSerial, char cmd);
-bool GetBytes(HANDLE hSerial, char* pBuffer, int bytesToRead, unsigned char& checksum, bool showOutput);
-bool GetResponseHeader(HANDLE hSerial, bool showOutput);
-bool VerifyChecksum(HANDLE hSerial, unsigned char checksum, bool showOutput);
-bool GetFirmwareVersion(HANDLE hSerial, bool showOutput);
-bool AdjustBitRate(HANDLE& hSerial, _TCHAR* portName, unsigned long& bitRate);
-void GetGraphs(HANDLE hSerial, _TCHAR* filename, bool saveAsCSV);
-void GetSnapshots(HANDLE hSerial, _TCHAR* filename, bool saveAsCSV);
-void AdjustTime(SYSTEMTIME& st, int minutesToSubtract);
-bool WriteFileString(HANDLE hFile, char* str);
-void ReportError();
-void Usage();
+#include <stdio.h>
+#include "platform.h"
+#include <sstream>
+#include <vector>
+#include "protocol.h"
+#include "ratecache.h"
+#include "export.h"
+#include "sampledata.h"
+
+// what to sync from each Logger
+typedef struct
+{
+    const _TCHAR* graphFilename;
+    const _TCHAR* snapshotFilename;
+    const _TCHAR* newSamplesFilename;
+    int newSamplesGraph;
+    const _TCHAR* followFilename;
+    int streamInterval;
+    unsigned long bitRate;
+    bool userDefinedRate;
+    bool reportVersion;
+    bool reportTrip;
+    ExportFormat format;
+    bool legacyProtocol;
+    // times to reconnect and try again after a failure
+    int retries;
+    // add each Logger's device key to the filenames, when syncing more than one
+    bool keyFilenames;
+    // directory to archive the synced samples in, or 0
+    const _TCHAR* archiveDirectory;
+    // sync the graphs and snapshots only for the archive, because no files were requested
+    bool archiveOnly;
+    // bit rates that worked for each Logger before, or 0 to always start with bitRate
+    RateCache* pRateCache;
+    const _TCHAR* rateCacheFilename;
+} SyncOptions;
 
-// temperature, in units of Farenheit * 10
-// can store -10 to 117.5F, in 0.5F steps
-#define TEMPERATURE_MIN -100
-#define TEMPERATURE_SCALE 5
-#define TEMPERATURE_BITS 8
-// absolute pressure, in units of millibars * 100
-// can store 200 to 1223 mb, in 0.5 mb steps
-#define PRESSURE_MIN 20000
-#define PRESSURE_SCALE 50
-#define PRESSURE_BITS 11
-// altitude, in units of ft * 100
-// can store -1384 to 14999 ft, in 2 ft steps
-#define ALTITUDE_MIN -1384
-#define ALTITUDE_SCALE 2
-#define ALTITUDE_BITS 13
-
-#define SAMPLE_TO_TEMPERATURE(st) ((((long)st*TEMPERATURE_SCALE)+TEMPERATURE_MIN)/TEMPERATURE_SCALE)
-#define SAMPLE_TO_PRESSURE(sp) ((((long)sp*PRESSURE_SCALE)+PRESSURE_MIN)/PRESSURE_SCALE)
-#define SAMPLE_TO_ALTITUDE(sa) ((((long)sa*ALTITUDE_SCALE)+ALTITUDE_MIN)/ALTITUDE_SCALE)
-
-typedef struct 
+// the progress and outcome of syncing one Logger
+struct DeviceResult
 {
-    unsigned int temperature:TEMPERATURE_BITS;
-    unsigned int pressure:PRESSURE_BITS;
-    unsigned int altitude:ALTITUDE_BITS;
-} Sample;
+    DeviceResult(const tstring& portName, unsigned long bitRate);
 
-typedef struct  
+    tstring portName;
+    // the Logger's device ID in hex, or the port name for firmware without IDs
+    tstring deviceKey;
+    bool success;
+    int attempts;
+    // the last bit rate that worked, so retries start with it
+    unsigned long bitRate;
+    // the Logger's firmware may support bit rate calibration
+    bool calibrate;
+    unsigned long elapsed;
+    // tasks that are finished, and don't need to be repeated by a retry
+    bool versionDone;
+    bool tripDone;
+    bool graphsDone;
+    bool snapshotsDone;
+    bool newSamplesDone;
+    // messages about this Logger, printed together when it's finished
+    std::wostringstream log;
+};
+
+// shared by the threads of a fleet sync
+typedef struct
 {
-    unsigned long packedYearMonthDayHourMin;
-    Sample sample;	
-} Snapshot;
+    const SyncOptions* pOptions;
+    std::vector<DeviceResult*> results;
+    size_t nextDevice;
+    Mutex mutex;
+} FleetContext;
+
+void ReportFileError(std::wostream& log);
+FILE* OpenOutputFile(const _TCHAR* filename, bool append, bool& newFile, std::wostream& log);
+bool WriteFileBytes(FILE* pFile, const void* pData, size_t size, std::wostream& log);
+bool WriteFileString(FILE* pFile, const char* str, std::wostream& log);
+bool GetGraphs(LoggerLink& link, const _TCHAR* filename, const ExportFormat& format, const _TCHAR* archivePath = 0);
+bool GetSnapshots(LoggerLink& link, const _TCHAR* filename, const ExportFormat& format, const _TCHAR* archivePath = 0);
+bool ArchiveGraphs(LoggerLink& link, const _TCHAR* archivePath, const GraphView& graphs);
+bool ArchiveSnapshots(LoggerLink& link, const _TCHAR* archivePath, const SnapshotView& snapshots);
+bool ArchiveNewSamples(LoggerLink& link, const _TCHAR* archivePath, const SampleView& samples);
+bool GetNewSamples(LoggerLink& link, const _TCHAR* filename, int graph, const ExportFormat& format, const _TCHAR* archivePath = 0);
+bool ReadSyncCursor(const _TCHAR* cursorFilename, unsigned char& generation, unsigned long& sequence, bool& hasId, unsigned long& id);
+bool WriteSyncCursor(const _TCHAR* cursorFilename, unsigned char generation, unsigned long sequence, bool hasId, unsigned long id, std::wostream& log);
+void FollowStream(LoggerLink& link, const _TCHAR* filename, int interval, const ExportFormat& format);
+tstring MakeDeviceKey(const DeviceResult& result, bool hasId, unsigned long id);
+tstring MakeDeviceFilename(const _TCHAR* filename, const DeviceResult& result, const SyncOptions& options);
+tstring AddDeviceKey(const _TCHAR* filename, const tstring& deviceKey);
+bool SyncAttempt(DeviceResult& result, const SyncOptions& options, std::wostream& log);
+void UseCachedRate(DeviceResult& result, const SyncOptions& options);
+void SaveCachedRates(const std::vector<DeviceResult*>& results, const SyncOptions& options);
+void SyncLogger(DeviceResult& result, const SyncOptions& options, std::wostream& log);
+void FleetWorker(void* pContext);
+void SyncFleet(const std::vector<tstring>& portNames, const SyncOptions& options, int numWorkers);
+void PrintFleetSummary(const std::vector<DeviceResult*>& results, unsigned long elapsed);
+void Usage();
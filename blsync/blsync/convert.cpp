@@ -0,0 +1,295 @@
+/* 
+  Copyright (c) 2011 Steve Chamberlin
+  Permission is hereby granted, free of charge, to any person obtaining a copy of this hardware, software, and associated documentation 
+  files (the "Product"), to deal in the Product without restriction, including without limitation the rights to use, copy, modify, merge, 
+  publish, distribute, sublicense, and/or sell copies of the Product, and to permit persons to whom the Product is furnished to do so, 
+  subject to the following conditions: 
+
+  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Product. 
+
+  THE PRODUCT IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF 
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+  ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH 
+  THE PRODUCT OR THE USE OR OTHER DEALINGS IN THE PRODUCT.
+
+  convert.cpp - Offline conversion of raw files saved by blsync -r to CSV or JSON Lines.
+
+*/
+
+#include <stdio.h>
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include "convert.h"
+#include "blsync.h"
+
+using namespace std;
+
+static const char* rawTypeNames[] = { "unknown data", "graph data", "snapshot data", "incremental samples", "stream records" };
+
+/* 
+    DetectRawType
+    Works out which kind of raw file some data is from, by checking that its headers and size agree. The 
+    sizes of the different kinds can never match by accident.
+    Returns the kind of file, or RAW_UNKNOWN if it isn't a raw file saved by blsync.
+*/
+int DetectRawType(const unsigned char* pData, size_t size)
+{
+    GraphView graphs;
+    if (graphs.Parse(pData, size) && graphs.GetGraphCount() > 0)
+        return RAW_GRAPHS;
+
+    SnapshotView snapshots;
+    if (snapshots.Parse(pData, size))
+        return RAW_SNAPSHOTS;
+
+    // incremental samples: a header and the samples for each sync, one after another
+    size_t pos = 0;
+    NewSamplesView newSamples;
+    while (pos < size && newSamples.Parse(&pData[pos], size - pos))
+    {
+        pos += newSamples.GetByteCount();
+    }
+    if (size > 0 && pos == size)
+        return RAW_SAMPLES;
+
+    // live stream records, each with its own CRC
+    if (size == 0 || size % STREAM_RECORD_SIZE != 0)
+        return RAW_UNKNOWN;
+    for (pos = 0; pos < size; pos += STREAM_RECORD_SIZE)
+    {
+        if (!IsStreamRecord(&pData[pos]))
+            return RAW_UNKNOWN;
+    }
+    return RAW_STREAM;
+}
+
+/* 
+    MakeConvertedFilename
+    Makes the name of the file to save a conversion to, by replacing the extension with .csv or .json. 
+*/
+tstring MakeConvertedFilename(const tstring& filename, const ExportFormat& format)
+{
+    const tstring extension = (format.type == EXPORT_JSON) ? _T(".json") : _T(".csv");
+
+    tstring name = filename;
+    size_t dot = name.find_last_of(_T('.'));
+    size_t separator = name.find_last_of(_T("/\\"));
+    if (dot != tstring::npos && (separator == tstring::npos || dot > separator) && name.compare(dot, tstring::npos, extension) != 0)
+    {
+        name.erase(dot);
+    }
+    return name + extension;
+}
+
+/* 
+    ConvertFile
+    Converts one raw file, using the same decoding as a sync. The file is mapped into memory rather than read.
+    A file that isn't a raw file is skipped, unless it was named on the command line.
+    Returns CONVERT_OK, CONVERT_SKIPPED, or CONVERT_FAILED.
+*/
+int ConvertFile(const tstring& filename, bool named, const ExportFormat& format, wostream& log)
+{
+    MappedFile file;
+    if (!MapFile(filename.c_str(), file))
+    {
+        log << "Error: " << filename.c_str() << " could not be read." << endl;
+        return CONVERT_FAILED;
+    }
+
+    const unsigned char* pData = file.pData;
+    int type = DetectRawType(pData, file.size);
+    if (type == RAW_UNKNOWN)
+    {
+        UnmapFile(file);
+        if (!named)
+            return CONVERT_SKIPPED;
+
+        log << "Error: " << filename.c_str() << " is not a raw file saved by blsync." << endl;
+        return CONVERT_FAILED;
+    }
+
+    tstring outputFilename = MakeConvertedFilename(filename, format);
+    bool saved = false;
+    bool newFile;
+    FILE* pFile = OpenOutputFile(outputFilename.c_str(), false, newFile, log);
+    if (pFile != 0)
+    {
+        SampleWriter writer(pFile, format, log);
+        if (type == RAW_GRAPHS)
+        {
+            GraphView graphs;
+            graphs.Parse(pData, file.size);
+            saved = WriteGraphs(writer, graphs);
+        }
+        else if (type == RAW_SNAPSHOTS)
+        {
+            SnapshotView snapshots;
+            snapshots.Parse(pData, file.size);
+            saved = writer.WriteHeader() && WriteSnapshots(writer, snapshots);
+        }
+        else if (type == RAW_SAMPLES)
+        {
+            saved = writer.WriteHeader();
+            NewSamplesView newSamples;
+            for (size_t pos = 0; pos < file.size && saved; pos += newSamples.GetByteCount())
+            {
+                newSamples.Parse(&pData[pos], file.size - pos);
+                saved = WriteSamples(writer, newSamples.GetSamples());
+            }
+        }
+        else
+        {
+            saved = writer.WriteHeader();
+            for (size_t pos = 0; pos < file.size && saved; pos += STREAM_RECORD_SIZE)
+            {
+                saved = WriteStreamRecord(writer, &pData[pos]);
+            }
+        }
+
+        saved = writer.Flush() && saved;
+        if (fclose(pFile) != 0 && saved)
+        {
+            ReportFileError(log);
+            saved = false;
+        }
+    }
+
+    UnmapFile(file);
+
+    if (!saved)
+        return CONVERT_FAILED;
+
+    log << "Converted " << rawTypeNames[type] << " in " << filename.c_str() << " to " << outputFilename.c_str() << endl;
+    return CONVERT_OK;
+}
+
+/* 
+    ConvertWorker
+    Thread function for a conversion. Takes the next file that hasn't been started, converts it, and prints
+    its messages, until there are no files left.
+*/
+void ConvertWorker(void* pContext)
+{
+    ConvertContext* pConvert = (ConvertContext*)pContext;
+
+    while (true)
+    {
+        LockMutex(pConvert->mutex);
+        size_t index = pConvert->nextJob++;
+        UnlockMutex(pConvert->mutex);
+
+        if (index >= pConvert->jobs.size())
+            break;
+
+        ConvertJob* pJob = pConvert->jobs[index];
+        pJob->result = ConvertFile(pJob->filename, pJob->named, *pConvert->pFormat, pJob->log);
+
+        LockMutex(pConvert->mutex);
+        wcout << pJob->log.str();
+        UnlockMutex(pConvert->mutex);
+    }
+}
+
+/* 
+    ConvertFiles
+    Converts raw files to CSV or JSON Lines, each to a file of the same name with a new extension. A directory 
+    means every raw file in it. The files are shared out between several threads, one per processor by default,
+    since each conversion is independent.
+    Returns true if every file was converted, false if any failed.
+*/
+bool ConvertFiles(const vector<tstring>& paths, const ExportFormat& format, int numWorkers)
+{
+    if (format.type == EXPORT_RAW)
+    {
+        wcout << "Error: raw files can only be converted to CSV or JSON Lines." << endl;
+        return false;
+    }
+
+    ConvertContext context;
+    context.pFormat = &format;
+    context.nextJob = 0;
+    InitMutex(context.mutex);
+
+    for (size_t i=0; i<paths.size(); i++)
+    {
+        vector<tstring> names;
+        bool directory = ListDirectory(paths[i].c_str(), names, false);
+        if (!directory)
+        {
+            names.push_back(tstring());
+        }
+        sort(names.begin(), names.end());
+
+        for (size_t n=0; n<names.size(); n++)
+        {
+            ConvertJob* pJob = new ConvertJob;
+            pJob->filename = directory ? paths[i] + _T("/") + names[n] : paths[i];
+            pJob->named = !directory;
+            pJob->result = CONVERT_FAILED;
+            context.jobs.push_back(pJob);
+        }
+    }
+
+    // by default, one thread for each processor
+    if (numWorkers < 1)
+    {
+        numWorkers = GetProcessorCount();
+    }
+    if (numWorkers > (int)context.jobs.size())
+    {
+        numWorkers = (int)context.jobs.size();
+    }
+    if (numWorkers > CONVERT_MAX_WORKERS)
+    {
+        numWorkers = CONVERT_MAX_WORKERS;
+    }
+
+    unsigned long startTime = GetMilliseconds();
+
+    vector<ThreadHandle> threads(numWorkers);
+    int numStarted = 0;
+    while (numStarted < numWorkers && StartThread(threads[numStarted], ConvertWorker, &context))
+    {
+        numStarted++;
+    }
+
+    // if no threads could be started, convert the files one after another instead
+    if (numStarted == 0)
+    {
+        ConvertWorker(&context);
+    }
+
+    for (int i=0; i<numStarted; i++)
+    {
+        JoinThread(threads[i]);
+    }
+
+    int numConverted = 0;
+    int numSkipped = 0;
+    for (size_t i=0; i<context.jobs.size(); i++)
+    {
+        if (context.jobs[i]->result == CONVERT_OK)
+            numConverted++;
+        else if (context.jobs[i]->result == CONVERT_SKIPPED)
+            numSkipped++;
+        delete context.jobs[i];
+    }
+    int numRawFiles = (int)context.jobs.size() - numSkipped;
+    DestroyMutex(context.mutex);
+
+    if (context.jobs.size() > 1 || numSkipped > 0)
+    {
+        ios_base::fmtflags flags = wcout.flags();
+        wcout << fixed << setprecision(1);
+        wcout << "Converted " << numConverted << " of " << numRawFiles << " raw files in " << (GetMilliseconds() - startTime) / 1000.0 << " seconds";
+        if (numSkipped > 0)
+        {
+            wcout << ", skipping " << numSkipped << " other files";
+        }
+        wcout << "." << endl;
+        wcout.flags(flags);
+    }
+
+    return numConverted == numRawFiles;
+}
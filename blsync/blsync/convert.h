@@ -0,0 +1,63 @@
+/* 
+  Copyright (c) 2011 Steve Chamberlin
+  Permission is hereby granted, free of charge, to any person obtaining a copy of this hardware, software, and associated documentation 
+  files (the "Product"), to deal in the Product without restriction, including without limitation the rights to use, copy, modify, merge, 
+  publish, distribute, sublicense, and/or sell copies of the Product, and to permit persons to whom the Product is furnished to do so, 
+  subject to the following conditions: 
+
+  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Product. 
+
+  THE PRODUCT IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF 
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+  ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH 
+  THE PRODUCT OR THE USE OR OTHER DEALINGS IN THE PRODUCT.
+
+  convert.h - Offline conversion of raw files saved by blsync -r.
+
+*/
+
+#ifndef CONVERT_H_
+#define CONVERT_H_
+
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include "platform.h"
+#include "export.h"
+
+// most files to convert at once
+#define CONVERT_MAX_WORKERS 64
+
+// kinds of raw file: graph data (-g), snapshot data (-s), incremental samples (-i), and live stream records (-f)
+enum { RAW_UNKNOWN, RAW_GRAPHS, RAW_SNAPSHOTS, RAW_SAMPLES, RAW_STREAM };
+
+// ConvertFile() results
+enum { CONVERT_OK, CONVERT_SKIPPED, CONVERT_FAILED };
+
+// one file to convert, and the outcome
+struct ConvertJob
+{
+    tstring filename;
+    // the file was named on the command line, rather than found in a directory, so it must be a raw file
+    bool named;
+    int result;
+    // messages about this file, printed together when it's finished
+    std::wostringstream log;
+};
+
+// shared by the threads of a conversion
+typedef struct
+{
+    const ExportFormat* pFormat;
+    std::vector<ConvertJob*> jobs;
+    size_t nextJob;
+    Mutex mutex;
+} ConvertContext;
+
+int DetectRawType(const unsigned char* pData, size_t size);
+tstring MakeConvertedFilename(const tstring& filename, const ExportFormat& format);
+int ConvertFile(const tstring& filename, bool named, const ExportFormat& format, std::wostream& log);
+void ConvertWorker(void* pContext);
+bool ConvertFiles(const std::vector<tstring>& paths, const ExportFormat& format, int numWorkers);
+
+#endif /* CONVERT_H_ */
@@ -0,0 +1,575 @@
+/* 
+  Copyright (c) 2011 Steve Chamberlin
+  Permission is hereby granted, free of charge, to any person obtaining a copy of this hardware, software, and associated documentation 
+  files (the "Product"), to deal in the Product without restriction, including without limitation the rights to use, copy, modify, merge, 
+  publish, distribute, sublicense, and/or sell copies of the Product, and to permit persons to whom the Product is furnished to do so, 
+  subject to the following conditions: 
+
+  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Product. 
+
+  THE PRODUCT IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF 
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+  ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH 
+  THE PRODUCT OR THE USE OR OTHER DEALINGS IN THE PRODUCT.
+
+  export.cpp - Fast, buffered conversion of samples to CSV or JSON Lines text.
+
+*/
+
+#include <limits.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <iostream>
+#include "export.h"
+#include "archive.h"
+#include "blsync.h"
+
+using namespace std;
+
+/*
+    PressureToInchesHg
+    Converts millibars * 2 to hundredths of an inch of mercury, rounded exactly the way printf("%.2f") rounded 
+    the single precision conversion blsync has always used, so exported files don't change. A float times 100 
+    is exact as a double, so ties can be detected and rounded to even.
+*/
+static long PressureToInchesHg(long pressure)
+{
+    float inches = (float)pressure/2*0.0295333727f;
+    double hundredths = (double)inches * 100;
+    double whole = floor(hundredths);
+    double fraction = hundredths - whole;
+    if (fraction > 0.5 || (fraction == 0.5 && fmod(whole, 2) != 0))
+    {
+        whole += 1;
+    }
+    return (long)whole;
+}
+
+/*
+    PressureTable
+    Hundredths of an inch of mercury for every possible sample pressure.
+*/
+class PressureTable
+{
+public:
+    PressureTable()
+    {
+        for (int p=0; p<(1 << PRESSURE_BITS); p++)
+        {
+            inchesHg[p] = (unsigned short)PressureToInchesHg(SAMPLE_TO_PRESSURE(p));
+        }
+    }
+
+    // millibars * 2, as from SAMPLE_TO_PRESSURE, to hundredths of an inch
+    long Lookup(long pressure) const
+    {
+        long index = pressure - SAMPLE_TO_PRESSURE(0);
+        if (index < 0 || index >= (1 << PRESSURE_BITS))
+            return PressureToInchesHg(pressure);
+        return inchesHg[index];
+    }
+
+private:
+    unsigned short inchesHg[1 << PRESSURE_BITS];
+};
+
+// built before main() runs, so sync threads never race to fill it
+static PressureTable pressureTable;
+
+SampleWriter::SampleWriter(FILE* pFile, const ExportFormat& format, wostream& log) :
+    pFile(pFile),
+    format(format),
+    log(log),
+    buffer(EXPORT_BUFFER_SIZE),
+    failed(false),
+    cachedDay(LONG_MIN)
+{
+    pEnd = &buffer[0];
+    label[0] = 0;
+    usDate[0] = 0;
+    isoDate[0] = 0;
+}
+
+/* 
+    SetLabel
+    Sets an extra field to add to each JSON record, like "graph":1. A name of 0 removes it.
+*/
+void SampleWriter::SetLabel(const char* name, int value)
+{
+    if (name == 0)
+    {
+        label[0] = 0;
+    }
+    else
+    {
+        sprintf_s(label, sizeof(label), "\"%s\":%d,", name, value);
+    }
+}
+
+/* 
+    AddLabel
+    Adds another field after the one set by SetLabel.
+*/
+void SampleWriter::AddLabel(const char* name, int value)
+{
+    size_t length = strlen(label);
+    sprintf_s(label + length, sizeof(label) - length, "\"%s\":%d,", name, value);
+}
+
+/* 
+    WriteHeader
+    Writes the column names, for CSV. JSON records name their own fields.
+    Returns true if successful, false if an error occurred.
+*/
+bool SampleWriter::WriteHeader()
+{
+    if (format.type != EXPORT_CSV)
+        return !failed;
+
+    if (format.metric)
+        return WriteText("Time, Temperature (deg C), Altitude (m), Pressure (hPa)\n");
+
+    return WriteText("Time, Temperature (deg F), Altitude (ft), Pressure (in)\n");
+}
+
+/* 
+    WriteText
+    Writes a short string, shorter than EXPORT_MAX_LINE.
+    Returns true if successful, false if an error occurred.
+*/
+bool SampleWriter::WriteText(const char* str)
+{
+    if (!MakeRoom())
+        return false;
+
+    AppendText(str);
+    return true;
+}
+
+/* 
+    WriteSample
+    Writes one sample and its time, in minutes since 1/1/2000 plus seconds. The seconds are only shown
+    in US style times if showSeconds is true.
+    Returns true if successful, false if an error occurred.
+*/
+bool SampleWriter::WriteSample(long time, int second, bool showSeconds, const Sample& sample)
+{
+    return WriteValues(time, second, showSeconds, SAMPLE_TO_TEMPERATURE(sample.temperature), 
+        SAMPLE_TO_PRESSURE(sample.pressure), SAMPLE_TO_ALTITUDE(sample.altitude));
+}
+
+/* 
+    WriteValues
+    Writes one sample that's already been decoded, in degrees F * 2, millibars * 2, and feet / 2, as from
+    SAMPLE_TO_TEMPERATURE, SAMPLE_TO_PRESSURE, and SAMPLE_TO_ALTITUDE.
+    Returns true if successful, false if an error occurred.
+*/
+bool SampleWriter::WriteValues(long time, int second, bool showSeconds, long temperature, long pressure, long altitude)
+{
+    if (!MakeRoom())
+        return false;
+
+    // scaled to whole numbers, with the number of decimal places to show
+    long temperatureValue, altitudeValue, pressureValue;
+    int pressureDecimals;
+    if (format.metric)
+    {
+        // tenths of a degree C, and whole meters, rounded to nearest
+        long n = (temperature - 64) * 25;
+        temperatureValue = (n >= 0 ? n + 4 : n - 4) / 9;
+        n = altitude * 6096;
+        altitudeValue = (n >= 0 ? n + 5000 : n - 5000) / 10000;
+        // tenths of a hPa
+        pressureValue = pressure * 5;
+        pressureDecimals = 1;
+    }
+    else
+    {
+        // tenths of a degree F, whole feet, and hundredths of an inch
+        temperatureValue = temperature * 5;
+        altitudeValue = altitude * 2;
+        pressureValue = pressureTable.Lookup(pressure);
+        pressureDecimals = 2;
+    }
+
+    if (format.type == EXPORT_JSON)
+    {
+        AppendText("{\"time\":\"");
+        AppendTime(time, second, true);
+        AppendText("\",");
+        AppendText(label);
+        AppendText(format.metric ? "\"temperature_c\":" : "\"temperature_f\":");
+        AppendNumber(temperatureValue, 1);
+        AppendText(format.metric ? ",\"altitude_m\":" : ",\"altitude_ft\":");
+        AppendNumber(altitudeValue, 0);
+        AppendText(format.metric ? ",\"pressure_hpa\":" : ",\"pressure_inhg\":");
+        AppendNumber(pressureValue, pressureDecimals);
+        AppendText("}\n");
+    }
+    else
+    {
+        AppendTime(time, second, showSeconds);
+        *pEnd++ = ',';
+        AppendNumber(temperatureValue, 1);
+        *pEnd++ = ',';
+        AppendNumber(altitudeValue, 0);
+        *pEnd++ = ',';
+        AppendNumber(pressureValue, pressureDecimals);
+        *pEnd++ = '\n';
+    }
+
+    return true;
+}
+
+/* 
+    Flush
+    Writes everything that's buffered to the file.
+    Returns true if successful, false if this or any earlier write failed.
+*/
+bool SampleWriter::Flush()
+{
+    if (failed)
+        return false;
+
+    size_t size = pEnd - &buffer[0];
+    pEnd = &buffer[0];
+    if (size > 0 && !WriteFileBytes(pFile, &buffer[0], size, log))
+    {
+        failed = true;
+        return false;
+    }
+
+    if (fflush(pFile) != 0)
+    {
+        ReportFileError(log);
+        failed = true;
+        return false;
+    }
+
+    return true;
+}
+
+/* 
+    MakeRoom
+    Writes the buffer to the file if there might not be room for another line.
+    Returns true if successful, false if an error occurred.
+*/
+bool SampleWriter::MakeRoom()
+{
+    if (failed)
+        return false;
+
+    if (&buffer[0] + buffer.size() - pEnd < EXPORT_MAX_LINE)
+        return Flush();
+
+    return true;
+}
+
+void SampleWriter::AppendText(const char* str)
+{
+    while (*str)
+    {
+        *pEnd++ = *str++;
+    }
+}
+
+/* 
+    AppendNumber
+    Appends a number that's scaled by 10 to the power of decimals, like printf("%.*f"), with at least 
+    minDigits digits before the decimal point.
+*/
+void SampleWriter::AppendNumber(long value, int decimals, int minDigits)
+{
+    unsigned long magnitude = (value < 0) ? -(unsigned long)value : value;
+    if (value < 0)
+    {
+        *pEnd++ = '-';
+    }
+
+    char digits[24];
+    int count = 0;
+    do
+    {
+        digits[count++] = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude != 0 || count < decimals + minDigits);
+
+    while (count > 0)
+    {
+        *pEnd++ = digits[--count];
+        if (count == decimals && decimals > 0)
+        {
+            *pEnd++ = '.';
+        }
+    }
+}
+
+/* 
+    AppendTime
+    Appends a time as ISO-8601, or like 10/19/11 4:05 PM. The date strings are cached, since consecutive 
+    samples are nearly always on the same day.
+*/
+void SampleWriter::AppendTime(long time, int second, bool showSeconds)
+{
+    long day = (time >= 0) ? time / 1440 : -((1439 - time) / 1440);
+    int minuteOfDay = (int)(time - day * 1440);
+    if (day != cachedDay)
+    {
+        LoggerTime t;
+        MinutesToTime(day * 1440, t);
+        sprintf_s(usDate, sizeof(usDate), "%d/%d/%d", t.month, t.day, t.year - 2000);
+        sprintf_s(isoDate, sizeof(isoDate), "%04d-%02d-%02d", t.year, t.month, t.day);
+        cachedDay = day;
+    }
+
+    int hour = minuteOfDay / 60;
+    int minute = minuteOfDay % 60;
+
+    if (format.isoTime || format.type == EXPORT_JSON)
+    {
+        AppendText(isoDate);
+        *pEnd++ = 'T';
+        AppendNumber(hour, 0, 2);
+        *pEnd++ = ':';
+        AppendNumber(minute, 0, 2);
+        *pEnd++ = ':';
+        AppendNumber(second, 0, 2);
+    }
+    else
+    {
+        AppendText(usDate);
+        *pEnd++ = ' ';
+        AppendNumber((hour % 12) == 0 ? 12 : (hour % 12), 0);
+        *pEnd++ = ':';
+        AppendNumber(minute, 0, 2);
+        if (showSeconds)
+        {
+            *pEnd++ = ':';
+            AppendNumber(second, 0, 2);
+        }
+        AppendText(hour > 11 ? " PM" : " AM");
+    }
+}
+
+/* 
+    WriteSamples
+    Writes a series of samples, decoding them in batches.
+    Returns true if successful, false if an error occurred.
+*/
+bool WriteSamples(SampleWriter& writer, const SampleView& samples)
+{
+    short temperature[DECODE_BATCH_SIZE];
+    short pressure[DECODE_BATCH_SIZE];
+    short altitude[DECODE_BATCH_SIZE];
+
+    for (size_t start = 0; start < samples.size(); start += DECODE_BATCH_SIZE)
+    {
+        size_t count = min(samples.size() - start, (size_t)DECODE_BATCH_SIZE);
+        DecodeSamples(samples.GetData() + SAMPLE_BYTES * start, count, temperature, pressure, altitude);
+
+        for (size_t i=0; i<count; i++)
+        {
+            if (!writer.WriteValues(samples.GetTime(start + i), 0, false, temperature[i], pressure[i], altitude[i]))
+                return false;
+        }
+    }
+
+    return true;
+}
+
+/* 
+    WriteGraphs
+    Writes the samples from every graph in a graph data response.
+    Returns true if successful, false if an error occurred.
+*/
+bool WriteGraphs(SampleWriter& writer, const GraphView& graphs)
+{
+    bool csv = (writer.GetFormat().type == EXPORT_CSV);
+
+    for (int g=0; g<graphs.GetGraphCount(); g++)
+    {
+        if (csv)
+        {
+            char buf[64];
+            sprintf_s(buf, 64, "Graph %d\n", g+1);
+            if (!writer.WriteText(buf) || !writer.WriteHeader())
+                return false;
+        }
+        writer.SetLabel("graph", g+1);
+
+        if (!WriteSamples(writer, graphs.GetGraph(g)))
+            return false;
+
+        if (csv && !writer.WriteText("\n"))
+            return false;
+    }
+
+    writer.SetLabel(0, 0);
+    return true;
+}
+
+/* 
+    WriteSnapshots
+    Writes the snapshots from a snapshot data response.
+    Returns true if successful, false if an error occurred.
+*/
+bool WriteSnapshots(SampleWriter& writer, const SnapshotView& snapshots)
+{
+    for (size_t s=0; s<snapshots.size(); s++)
+    {
+        if (!writer.WriteSample(snapshots.GetTime(s), 0, false, snapshots[s]))
+            return false;
+    }
+
+    return true;
+}
+
+/* 
+    WriteStreamRecord
+    Writes the sample from one live stream record, with its time to the second.
+    Returns true if successful, false if an error occurred.
+*/
+bool WriteStreamRecord(SampleWriter& writer, const unsigned char* pRecord)
+{
+    LoggerTime t;
+    UnpackTime(GetWord32(&pRecord[3]), t);
+
+    return writer.WriteSample(TimeToMinutes(t), pRecord[7], true, UnpackSample(&pRecord[8]));
+}
+
+/* 
+    GetFormatName
+    Returns the name of an output file type, for messages.
+*/
+const char* GetFormatName(const ExportFormat& format)
+{
+    if (format.type == EXPORT_JSON)
+        return "JSON Lines";
+    if (format.type == EXPORT_CSV)
+        return "CSV";
+    return "binary";
+}
+
+static bool CompareSeries(const ArchiveSeriesInfo& a, const ArchiveSeriesInfo& b)
+{
+    // finest samples first, then snapshots
+    if ((a.series == ARCHIVE_SERIES_SNAPSHOTS) != (b.series == ARCHIVE_SERIES_SNAPSHOTS))
+        return b.series == ARCHIVE_SERIES_SNAPSHOTS;
+    return a.series < b.series;
+}
+
+/* 
+    ExportArchive
+    Converts everything in the archive to CSV or JSON Lines, with a separate file for each Logger. The
+    filename is given the device key the same way as in a fleet sync. Each month is read and written in 
+    turn, so memory use doesn't grow with the size of the archive.
+    Returns true if successful, false if an error occurred.
+*/
+bool ExportArchive(const _TCHAR* directory, const _TCHAR* filename, const ExportFormat& format)
+{
+    if (format.type == EXPORT_RAW)
+    {
+        wcout << "Error: the archive can only be exported as CSV or JSON Lines." << endl;
+        return false;
+    }
+
+    vector<tstring> deviceKeys;
+    if (!ListDirectory(directory, deviceKeys, true))
+    {
+        wcout << "Error: the archive in " << directory << " could not be read." << endl;
+        return false;
+    }
+    sort(deviceKeys.begin(), deviceKeys.end());
+
+    bool result = true;
+    for (size_t d=0; d<deviceKeys.size(); d++)
+    {
+        tstring archivePath = GetArchivePath(directory, deviceKeys[d]);
+        vector<ArchiveSeriesInfo> seriesList;
+        if (!FindArchiveSeries(archivePath, seriesList, wcout))
+        {
+            result = false;
+            continue;
+        }
+        if (seriesList.empty())
+            continue;
+        sort(seriesList.begin(), seriesList.end(), CompareSeries);
+
+        tstring outputFilename = AddDeviceKey(filename, deviceKeys[d]);
+        bool newFile;
+        FILE* pFile = OpenOutputFile(outputFilename.c_str(), false, newFile, wcout);
+        if (pFile == 0)
+        {
+            result = false;
+            continue;
+        }
+
+        SampleWriter writer(pFile, format, wcout);
+        unsigned long count = 0;
+        bool saved = true;
+        for (size_t i=0; i<seriesList.size() && saved; i++)
+        {
+            int series = seriesList[i].series;
+            if (format.type == EXPORT_CSV)
+            {
+                char buf[64];
+                if (series == ARCHIVE_SERIES_SNAPSHOTS)
+                {
+                    sprintf_s(buf, 64, "Snapshots\n");
+                }
+                else
+                {
+                    sprintf_s(buf, 64, "Samples every %d minutes\n", series);
+                }
+                saved = writer.WriteText(buf) && writer.WriteHeader();
+            }
+            writer.SetLabel("interval", series);
+
+            LoggerTime t;
+            MinutesToTime(seriesList[i].firstMonth, t);
+            for (long month = seriesList[i].firstMonth; month <= seriesList[i].lastMonth && saved; month = TimeToMinutes(t))
+            {
+                if (++t.month > 12)
+                {
+                    t.month = 1;
+                    t.year++;
+                }
+
+                vector<ArchiveRecord> records;
+                if (!ReadArchive(archivePath, series, month, TimeToMinutes(t) - 1, records, wcout))
+                {
+                    saved = false;
+                    break;
+                }
+
+                for (size_t r=0; r<records.size() && saved; r++)
+                {
+                    saved = writer.WriteSample(records[r].time, 0, false, records[r].sample);
+                }
+                count += (unsigned long)records.size();
+            }
+
+            if (format.type == EXPORT_CSV && saved)
+            {
+                saved = writer.WriteText("\n");
+            }
+        }
+
+        saved = writer.Flush() && saved;
+        if (fclose(pFile) != 0 && saved)
+        {
+            ReportFileError(wcout);
+            saved = false;
+        }
+
+        if (saved)
+        {
+            wcout << "Exported " << count << " samples from " << deviceKeys[d].c_str() << " to " << outputFilename.c_str() 
+                << " in " << GetFormatName(format) << " format" << endl;
+        }
+        result = result && saved;
+    }
+
+    return result;
+}
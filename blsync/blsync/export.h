@@ -0,0 +1,93 @@
+/* 
+  Copyright (c) 2011 Steve Chamberlin
+  Permission is hereby granted, free of charge, to any person obtaining a copy of this hardware, software, and associated documentation 
+  files (the "Product"), to deal in the Product without restriction, including without limitation the rights to use, copy, modify, merge, 
+  publish, distribute, sublicense, and/or sell copies of the Product, and to permit persons to whom the Product is furnished to do so, 
+  subject to the following conditions: 
+
+  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Product. 
+
+  THE PRODUCT IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF 
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+  ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH 
+  THE PRODUCT OR THE USE OR OTHER DEALINGS IN THE PRODUCT.
+
+  export.h - Fast, buffered conversion of samples to CSV or JSON Lines text.
+
+*/
+
+#ifndef EXPORT_H_
+#define EXPORT_H_
+
+#include <stdio.h>
+#include <iostream>
+#include <vector>
+#include "platform.h"
+#include "protocol.h"
+#include "sampledata.h"
+
+// bytes collected before each write to the file
+#define EXPORT_BUFFER_SIZE 65536
+// longest line a single sample can produce
+#define EXPORT_MAX_LINE 256
+
+// output file types
+enum { EXPORT_RAW, EXPORT_CSV, EXPORT_JSON };
+
+typedef struct
+{
+    int type;
+    // ISO-8601 times like 2011-10-19T16:05:00, instead of 10/19/11 4:05 PM. JSON always uses ISO-8601.
+    bool isoTime;
+    // degrees C, meters, and hPa, instead of degrees F, feet, and inches of mercury
+    bool metric;
+} ExportFormat;
+
+/*
+    SampleWriter
+    Formats samples as CSV or JSON Lines text, and writes them to a file in large blocks. Times are minutes 
+    since 1/1/2000, and the date is only worked out again when the day changes. Numbers are formatted with 
+    integer arithmetic, matching what the original printf formatting produced.
+*/
+class SampleWriter
+{
+public:
+    SampleWriter(FILE* pFile, const ExportFormat& format, std::wostream& log);
+
+    void SetLabel(const char* name, int value);
+    void AddLabel(const char* name, int value);
+    bool WriteHeader();
+    bool WriteText(const char* str);
+    bool WriteSample(long time, int second, bool showSeconds, const Sample& sample);
+    bool WriteValues(long time, int second, bool showSeconds, long temperature, long pressure, long altitude);
+    bool Flush();
+    const ExportFormat& GetFormat() const { return format; }
+
+private:
+    void AppendText(const char* str);
+    void AppendNumber(long value, int decimals, int minDigits = 1);
+    void AppendTime(long time, int second, bool showSeconds);
+    bool MakeRoom();
+
+    FILE* pFile;
+    ExportFormat format;
+    std::wostream& log;
+    std::vector<char> buffer;
+    char* pEnd;
+    bool failed;
+    // extra JSON fields, such as "graph":1,
+    char label[64];
+    // the day that the cached date strings are for
+    long cachedDay;
+    char usDate[16];
+    char isoDate[16];
+};
+
+bool WriteSamples(SampleWriter& writer, const SampleView& samples);
+bool WriteGraphs(SampleWriter& writer, const GraphView& graphs);
+bool WriteSnapshots(SampleWriter& writer, const SnapshotView& snapshots);
+bool WriteStreamRecord(SampleWriter& writer, const unsigned char* pRecord);
+const char* GetFormatName(const ExportFormat& format);
+bool ExportArchive(const _TCHAR* directory, const _TCHAR* filename, const ExportFormat& format);
+
+#endif /* EXPORT_H_ */
@@ -0,0 +1,463 @@
+/* 
+  Copyright (c) 2011 Steve Chamberlin
+  Permission is hereby granted, free of charge, to any person obtaining a copy of this hardware, software, and associated documentation 
+  files (the "Product"), to deal in the Product without restriction, including without limitation the rights to use, copy, modify, merge, 
+  publish, distribute, sublicense, and/or sell copies of the Product, and to permit persons to whom the Product is furnished to do so, 
+  subject to the following conditions: 
+
+  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Product. 
+
+  THE PRODUCT IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF 
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+  ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH 
+  THE PRODUCT OR THE USE OR OTHER DEALINGS IN THE PRODUCT.
+
+  platform.cpp - Portability functions.
+
+*/
+
+#include "platform.h"
+
+#ifndef _WIN32
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#endif
+
+volatile bool* pInterruptFlag = 0;
+
+// what a new thread should run, passed through the system's thread start routine
+typedef struct
+{
+    ThreadFunction function;
+    void* pContext;
+} ThreadStart;
+
+#ifdef _WIN32
+
+/* 
+    SleepMilliseconds
+    Waits for the given number of milliseconds.
+*/
+void SleepMilliseconds(int milliseconds)
+{
+    Sleep(milliseconds);
+}
+
+/* 
+    GetMilliseconds
+    Returns a millisecond counter, for measuring elapsed time.
+*/
+unsigned long GetMilliseconds()
+{
+    return GetTickCount();
+}
+
+/* 
+    InterruptHandler
+    Console control handler, sets the interrupt flag when Ctrl-C is pressed.
+*/
+BOOL WINAPI InterruptHandler(DWORD ctrlType)
+{
+    if (pInterruptFlag)
+    {
+        *pInterruptFlag = true;
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+/* 
+    CatchInterrupt
+    Sets the given flag instead of exiting when Ctrl-C is pressed.
+*/
+void CatchInterrupt(volatile bool* pInterrupted)
+{
+    pInterruptFlag = pInterrupted;
+    SetConsoleCtrlHandler(InterruptHandler, TRUE);
+}
+
+/* 
+    ReleaseInterrupt
+    Restores the normal Ctrl-C behavior.
+*/
+void ReleaseInterrupt()
+{
+    SetConsoleCtrlHandler(InterruptHandler, FALSE);
+    pInterruptFlag = 0;
+}
+
+/* 
+    MakeDirectory
+    Creates a directory, unless it already exists.
+    Returns true if the directory exists, false if it couldn't be created.
+*/
+bool MakeDirectory(const _TCHAR* path)
+{
+    return CreateDirectory(path, NULL) || GetLastError() == ERROR_ALREADY_EXISTS;
+}
+
+/* 
+    ListDirectory
+    Gets the names of the files in a directory, or of its subdirectories if directories is true.
+    Returns true if successful, false if the directory couldn't be read.
+*/
+bool ListDirectory(const _TCHAR* path, std::vector<tstring>& names, bool directories)
+{
+    tstring pattern = path;
+    pattern += _T("\\*");
+
+    WIN32_FIND_DATA data;
+    HANDLE hFind = FindFirstFile(pattern.c_str(), &data);
+    if (hFind == INVALID_HANDLE_VALUE)
+        return false;
+
+    do
+    {
+        bool isDirectory = (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+        if (isDirectory == directories && _tcscmp(data.cFileName, _T(".")) != 0 && _tcscmp(data.cFileName, _T("..")) != 0)
+        {
+            names.push_back(data.cFileName);
+        }
+    } while (FindNextFile(hFind, &data));
+
+    FindClose(hFind);
+    return true;
+}
+
+/* 
+    MapFile
+    Maps a whole file into memory for reading. An empty file has no data.
+    Returns true if successful, false if the file couldn't be opened or mapped.
+*/
+bool MapFile(const _TCHAR* path, MappedFile& file)
+{
+    file.pData = 0;
+    file.size = 0;
+    file.hMapping = NULL;
+    file.hFile = CreateFile(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file.hFile == INVALID_HANDLE_VALUE)
+        return false;
+
+    file.size = GetFileSize(file.hFile, NULL);
+    if (file.size == 0)
+        return true;
+
+    file.hMapping = CreateFileMapping(file.hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (file.hMapping != NULL)
+    {
+        file.pData = (const unsigned char*)MapViewOfFile(file.hMapping, FILE_MAP_READ, 0, 0, 0);
+    }
+    if (file.pData == 0)
+    {
+        UnmapFile(file);
+        return false;
+    }
+
+    return true;
+}
+
+/* 
+    UnmapFile
+    Releases a file mapped by MapFile.
+*/
+void UnmapFile(MappedFile& file)
+{
+    if (file.pData != 0)
+    {
+        UnmapViewOfFile(file.pData);
+    }
+    if (file.hMapping != NULL)
+    {
+        CloseHandle(file.hMapping);
+    }
+    if (file.hFile != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(file.hFile);
+    }
+    file.pData = 0;
+    file.size = 0;
+    file.hMapping = NULL;
+    file.hFile = INVALID_HANDLE_VALUE;
+}
+
+/* 
+    GetProcessorCount
+    Returns the number of processors that can run threads.
+*/
+int GetProcessorCount()
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+}
+
+/* 
+    GetSettingsFilename
+    Returns the path of a settings file with the given name in the user's application data folder, or in the 
+    working directory if the folder isn't known.
+*/
+tstring GetSettingsFilename(const _TCHAR* name)
+{
+    tstring filename;
+    const _TCHAR* folder = _tgetenv(_T("APPDATA"));
+    if (folder && folder[0] != 0)
+    {
+        filename = folder;
+        filename += _T("\\");
+    }
+    filename += name;
+    return filename;
+}
+
+/* 
+    ThreadProc
+    Start routine for threads created by StartThread.
+*/
+DWORD WINAPI ThreadProc(LPVOID pParameter)
+{
+    ThreadStart start = *(ThreadStart*)pParameter;
+    delete (ThreadStart*)pParameter;
+    start.function(start.pContext);
+    return 0;
+}
+
+/* 
+    StartThread
+    Runs a function on a new thread.
+    Returns true if successful, false if the thread couldn't be created.
+*/
+bool StartThread(ThreadHandle& thread, ThreadFunction function, void* pContext)
+{
+    ThreadStart* pStart = new ThreadStart;
+    pStart->function = function;
+    pStart->pContext = pContext;
+
+    thread = CreateThread(NULL, 0, ThreadProc, pStart, 0, NULL);
+    if (thread == NULL)
+    {
+        delete pStart;
+        return false;
+    }
+
+    return true;
+}
+
+/* 
+    JoinThread
+    Waits for a thread started by StartThread to finish.
+*/
+void JoinThread(ThreadHandle& thread)
+{
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+}
+
+void InitMutex(Mutex& mutex)
+{
+    InitializeCriticalSection(&mutex);
+}
+
+void DestroyMutex(Mutex& mutex)
+{
+    DeleteCriticalSection(&mutex);
+}
+
+void LockMutex(Mutex& mutex)
+{
+    EnterCriticalSection(&mutex);
+}
+
+void UnlockMutex(Mutex& mutex)
+{
+    LeaveCriticalSection(&mutex);
+}
+
+#else
+
+void SleepMilliseconds(int milliseconds)
+{
+    struct timespec ts;
+    ts.tv_sec = milliseconds / 1000;
+    ts.tv_nsec = (long)(milliseconds % 1000) * 1000000;
+    while (nanosleep(&ts, &ts) != 0)
+    {
+        // interrupted by a signal- sleep for the remaining time
+    }
+}
+
+unsigned long GetMilliseconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void InterruptHandler(int signal)
+{
+    if (pInterruptFlag)
+    {
+        *pInterruptFlag = true;
+    }
+}
+
+void CatchInterrupt(volatile bool* pInterrupted)
+{
+    pInterruptFlag = pInterrupted;
+    signal(SIGINT, InterruptHandler);
+}
+
+void ReleaseInterrupt()
+{
+    signal(SIGINT, SIG_DFL);
+    pInterruptFlag = 0;
+}
+
+bool MakeDirectory(const _TCHAR* path)
+{
+    return mkdir(path, 0777) == 0 || errno == EEXIST;
+}
+
+bool ListDirectory(const _TCHAR* path, std::vector<tstring>& names, bool directories)
+{
+    DIR* pDir = opendir(path);
+    if (pDir == 0)
+        return false;
+
+    struct dirent* pEntry;
+    while ((pEntry = readdir(pDir)) != 0)
+    {
+        if (strcmp(pEntry->d_name, ".") == 0 || strcmp(pEntry->d_name, "..") == 0)
+            continue;
+
+        tstring entryPath = path;
+        entryPath += "/";
+        entryPath += pEntry->d_name;
+        struct stat info;
+        if (stat(entryPath.c_str(), &info) == 0 && S_ISDIR(info.st_mode) == directories)
+        {
+            names.push_back(pEntry->d_name);
+        }
+    }
+
+    closedir(pDir);
+    return true;
+}
+
+bool MapFile(const _TCHAR* path, MappedFile& file)
+{
+    file.pData = 0;
+    file.size = 0;
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+
+    struct stat info;
+    bool result = (fstat(fd, &info) == 0);
+    if (result && info.st_size > 0)
+    {
+        void* p = mmap(0, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED)
+        {
+            result = false;
+        }
+        else
+        {
+            file.pData = (const unsigned char*)p;
+            file.size = info.st_size;
+        }
+    }
+
+    // the mapping stays valid after the file is closed
+    close(fd);
+    return result;
+}
+
+void UnmapFile(MappedFile& file)
+{
+    if (file.pData != 0)
+    {
+        munmap((void*)file.pData, file.size);
+    }
+    file.pData = 0;
+    file.size = 0;
+}
+
+int GetProcessorCount()
+{
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return (count > 0) ? (int)count : 1;
+}
+
+tstring GetSettingsFilename(const _TCHAR* name)
+{
+    // a hidden file in the home directory
+    tstring filename;
+    const char* folder = getenv("HOME");
+    if (folder && folder[0] != 0)
+    {
+        filename = folder;
+        filename += '/';
+    }
+    filename += '.';
+    filename += name;
+    return filename;
+}
+
+void* ThreadProc(void* pParameter)
+{
+    ThreadStart start = *(ThreadStart*)pParameter;
+    delete (ThreadStart*)pParameter;
+    start.function(start.pContext);
+    return 0;
+}
+
+bool StartThread(ThreadHandle& thread, ThreadFunction function, void* pContext)
+{
+    ThreadStart* pStart = new ThreadStart;
+    pStart->function = function;
+    pStart->pContext = pContext;
+
+    if (pthread_create(&thread, 0, ThreadProc, pStart) != 0)
+    {
+        delete pStart;
+        return false;
+    }
+
+    return true;
+}
+
+void JoinThread(ThreadHandle& thread)
+{
+    pthread_join(thread, 0);
+}
+
+void InitMutex(Mutex& mutex)
+{
+    pthread_mutex_init(&mutex, 0);
+}
+
+void DestroyMutex(Mutex& mutex)
+{
+    pthread_mutex_destroy(&mutex);
+}
+
+void LockMutex(Mutex& mutex)
+{
+    pthread_mutex_lock(&mutex);
+}
+
+void UnlockMutex(Mutex& mutex)
+{
+    pthread_mutex_unlock(&mutex);
+}
+
+#endif
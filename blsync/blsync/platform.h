@@ -0,0 +1,93 @@
+/* 
+  Copyright (c) 2011 Steve Chamberlin
+  Permission is hereby granted, free of charge, to any person obtaining a copy of this hardware, software, and associated documentation 
+  files (the "Product"), to deal in the Product without restriction, including without limitation the rights to use, copy, modify, merge, 
+  publish, distribute, sublicense, and/or sell copies of the Product, and to permit persons to whom the Product is furnished to do so, 
+  subject to the following conditions: 
+
+  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Product. 
+
+  THE PRODUCT IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF 
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+  ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH 
+  THE PRODUCT OR THE USE OR OTHER DEALINGS IN THE PRODUCT.
+
+  platform.h - Portability definitions, so blsync builds with Visual C++ on Windows and with g++ on POSIX systems.
+
+*/
+
+#ifndef PLATFORM_H_
+#define PLATFORM_H_
+
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+
+#include <windows.h>
+#include <tchar.h>
+
+#else
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// POSIX builds use narrow strings where Windows uses wide ones
+typedef char _TCHAR;
+#define _T(x) x
+#define _tmain main
+#define _tcscmp strcmp
+#define _tcsncmp strncmp
+#define _tcslen strlen
+#define _ttoi atoi
+#define _tfopen fopen
+#define sprintf_s snprintf
+#define _stprintf_s snprintf
+#define sscanf_s sscanf
+
+#include <pthread.h>
+
+#endif
+
+typedef std::basic_string<_TCHAR> tstring;
+
+#ifdef _WIN32
+typedef HANDLE ThreadHandle;
+typedef CRITICAL_SECTION Mutex;
+#else
+typedef pthread_t ThreadHandle;
+typedef pthread_mutex_t Mutex;
+#endif
+
+typedef void (*ThreadFunction)(void* pContext);
+
+// a file mapped into memory for reading
+typedef struct
+{
+    const unsigned char* pData;
+    size_t size;
+#ifdef _WIN32
+    HANDLE hFile;
+    HANDLE hMapping;
+#endif
+} MappedFile;
+
+void SleepMilliseconds(int milliseconds);
+unsigned long GetMilliseconds();
+void CatchInterrupt(volatile bool* pInterrupted);
+void ReleaseInterrupt();
+bool MakeDirectory(const _TCHAR* path);
+bool ListDirectory(const _TCHAR* path, std::vector<tstring>& names, bool directories);
+bool MapFile(const _TCHAR* path, MappedFile& file);
+void UnmapFile(MappedFile& file);
+int GetProcessorCount();
+tstring GetSettingsFilename(const _TCHAR* name);
+bool StartThread(ThreadHandle& thread, ThreadFunction function, void* pContext);
+void JoinThread(ThreadHandle& thread);
+void InitMutex(Mutex& mutex);
+void DestroyMutex(Mutex& mutex);
+void LockMutex(Mutex& mutex);
+void UnlockMutex(Mutex& mutex);
+
+#endif /* PLATFORM_H_ */
@@ -0,0 +1,919 @@
+/* 
+  Copyright (c) 2011 Steve Chamberlin
+  Permission is hereby granted, free of charge, to any person obtaining a copy of this hardware, software, and associated documentation 
+  files (the "Product"), to deal in the Product without restriction, including without limitation the rights to use, copy, modify, merge, 
+  publish, distribute, sublicense, and/or sell copies of the Product, and to permit persons to whom the Product is furnished to do so, 
+  subject to the following conditions: 
+
+  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Product. 
+
+  THE PRODUCT IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF 
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+  ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH 
+  THE PRODUCT OR THE USE OR OTHER DEALINGS IN THE PRODUCT.
+
+  protocol.cpp - Commands and responses for the Logger's serial protocol.
+
+*/
+
+#include <iostream>
+#include <math.h>
+#include "protocol.h"
+#include "sampledata.h"
+
+using namespace std;
+
+/* 
+    OpenLink
+    Opens the connection to a Logger on the given port. Messages about the connection are printed to log.
+    Returns true if successful, false if an error occurred.
+*/
+bool OpenLink(LoggerLink& link, const _TCHAR* portName, unsigned long bitRate, wostream& log)
+{
+    link.portName = portName;
+    link.bitRate = bitRate;
+    link.useFraming = false;
+    link.log = &log;
+    link.port = OpenTransport(portName, bitRate, log);
+    return link.port != 0;
+}
+
+/* 
+    CloseLink
+    Closes the connection to a Logger.
+*/
+void CloseLink(LoggerLink& link)
+{
+    delete link.port;
+    link.port = 0;
+}
+
+/* 
+    SendCommand
+    Sends the "CMD" prefix to the Logger, followed by the command ID and any command arguments.
+    A zero precedes the "CMD" prefix, to wake the Logger and give it enough time to enter the serial 
+    read interrupt routine. After that, a short delay is inserted between each byte sent, to give the 
+    Logger enough time to process it before the next one arrives.
+    Returns true if successful, false if an error occured.
+*/
+bool SendCommand(LoggerLink& link, char cmd, const char* args, int numArgs)
+{
+    char szBuff[16] = { 0, 0, 'C', 'M', 'D', 0, 0};
+    szBuff[5] = cmd; 
+
+    if (numArgs > 10)
+        return false;
+
+    for (int i=0; i<numArgs; i++)
+    {
+        szBuff[6+i] = args[i];
+    }
+
+    for (int i=0; i<6+numArgs; i++)
+    {
+        if (!link.port->Write(&szBuff[i], 1))
+            return false;
+
+        SleepMilliseconds(i == 0 ? COMMAND_WAKE_DELAY : COMMAND_BYTE_DELAY);
+    }
+
+    return true;
+}
+
+/* 
+    GetResponseHeader
+    Gets up to 300 bytes from the Logger, and stopping after the first occurrence of the string "LOG".
+    Returns true if successful, false if an error occurred.
+*/
+bool GetResponseHeader(LoggerLink& link, bool showOutput)
+{
+    const char* prefix = "LOG";
+    int index = 0;
+    int readCount = 0;
+    int result = 0;
+    char c;
+
+    while (readCount < 300 && (result = link.port->Read(&c, 1, READ_TIMEOUT)) == 1)
+    {
+        readCount++;
+       
+        if (c == prefix[index])
+        {
+            index++;
+            if (index == 3)
+            {
+                return true;
+            }
+        }
+        else if (c == prefix[0])
+        {
+            index = 1;
+        }
+        else
+        {
+            index = 0;
+        }   
+    }
+
+    if (result == 0 && showOutput)
+    {
+        if (readCount == 0)
+            *link.log << "Error: no response was received from the Logger." << endl;
+        else
+            *link.log << "Error: an incorrect response was received from the Logger." << endl;
+    }
+    else if (readCount == 300 && showOutput)
+    {
+        *link.log << "Error: an incorrect response was received from the Logger." << endl;
+    }
+
+    return false;
+}
+
+/* 
+    ReadBytes
+    Reads up to a user-defined number of bytes, stopping early if the Logger stops sending.
+    Returns the number of bytes read, or -1 if an error occurred.
+*/
+int ReadBytes(LoggerLink& link, char* pBuffer, int bytesToRead)
+{
+    return link.port->Read(pBuffer, bytesToRead, READ_TIMEOUT);
+}
+
+/* 
+    Crc16Update
+    Updates a CRC16 with one more byte, using the same XMODEM polynomial (0x1021) as the Logger.
+*/
+unsigned short Crc16Update(unsigned short crc, unsigned char c)
+{
+    crc ^= (unsigned short)c << 8;
+    for (int i=0; i<8; i++)
+    {
+        if (crc & 0x8000)
+            crc = (crc << 1) ^ 0x1021;
+        else
+            crc <<= 1;
+    }
+
+    return crc;
+}
+
+/* 
+    IsStreamRecord
+    Checks whether the bytes at pRecord are a complete live stream record with the correct CRC.
+*/
+bool IsStreamRecord(const unsigned char* pRecord)
+{
+    unsigned short crc = 0;
+    for (int i=0; i<STREAM_RECORD_SIZE-2; i++)
+    {
+        crc = Crc16Update(crc, pRecord[i]);
+    }
+
+    return pRecord[0] == STREAM_SYNC && crc == (pRecord[STREAM_RECORD_SIZE-2] | (pRecord[STREAM_RECORD_SIZE-1] << 8));
+}
+
+/* 
+    GetLegacyPayload
+    Sends a command and gets the whole response, which ends with an XOR checksum byte.
+    Returns true if successful, false if an error occurred.
+*/
+bool GetLegacyPayload(LoggerLink& link, char cmd, const char* args, int numArgs, Payload& payload, bool showOutput)
+{
+    payload.clear();
+
+    if (!SendCommand(link, cmd, args, numArgs))
+        return false;
+
+    if (!GetResponseHeader(link, showOutput))
+        return false;
+
+    // the response length isn't known in advance, so read until the Logger stops sending
+    char buf[256];
+    int bytesRead;
+    while ((bytesRead = ReadBytes(link, buf, sizeof(buf))) > 0)
+    {
+        payload.insert(payload.end(), buf, buf + bytesRead);
+    }
+
+    if (bytesRead < 0)
+        return false;
+
+    if (payload.empty())
+    {
+        if (showOutput)
+            *link.log << "Error: an incomplete response was received from the Logger." << endl;
+        return false;
+    }
+
+    unsigned char checksum = 0;
+    for (size_t i=0; i<payload.size(); i++)
+    {
+        checksum ^= payload[i];
+    }
+
+    // the checksum byte is included in the XOR, so a correct response XORs to zero
+    payload.pop_back();
+    if (checksum != 0)
+    {
+        if (showOutput)
+            *link.log << "Error: the response from the Logger had an incorrect checksum." << endl;
+        return false;
+    }
+
+    return true;
+}
+
+/* 
+    GetFrameHeader
+    Gets the "LOG" prefix and the header of a framed response.
+    Returns true if successful, false if an error occurred or the Logger doesn't support framing.
+*/
+bool GetFrameHeader(LoggerLink& link, FrameHeader& header, bool showOutput)
+{
+    if (!GetResponseHeader(link, showOutput))
+        return false;
+
+    unsigned char buf[4];
+    if (ReadBytes(link, (char*)buf, 4) != 4 || buf[0] != FRAME_VERSION || buf[1] == 0)
+    {
+        if (showOutput)
+            *link.log << "Error: an incorrect response was received from the Logger." << endl;
+        return false;
+    }
+
+    header.blockSize = buf[1];
+    header.generation = buf[2] | (buf[3] << 8);
+    return true;
+}
+
+/* 
+    IsFrame
+    Checks whether the bytes at pFrame are a whole block with an index from minIndex to maxIndex, a length 
+    that fits the block size, and the correct CRC.
+*/
+bool IsFrame(const unsigned char* pFrame, int blockSize, int minIndex, int maxIndex)
+{
+    int index = pFrame[0] | (pFrame[1] << 8);
+    if (index < minIndex || index > maxIndex || pFrame[2] > blockSize)
+        return false;
+
+    int frameSize = 3 + blockSize + 2;
+    unsigned short crc = 0;
+    for (int i=0; i<frameSize-2; i++)
+    {
+        crc = Crc16Update(crc, pFrame[i]);
+    }
+
+    return crc == (pFrame[frameSize-2] | (pFrame[frameSize-1] << 8));
+}
+
+/* 
+    GetFrame
+    Gets one block of a framed response: block index, length, data padded to the block size, and CRC16.
+    If a byte was lost or damaged, the bytes are scanned one at a time for the start of the next good block, 
+    so one lost byte costs only the block it was in instead of every block after it. Bytes received but not 
+    used yet are kept in pending, which must start out empty for each response.
+    Returns FRAME_OK if a good block was received, FRAME_BAD if the Logger stopped sending partway through a 
+    damaged block, or FRAME_NONE if the Logger stopped sending.
+*/
+int GetFrame(LoggerLink& link, int blockSize, int minIndex, int maxIndex, Payload& pending, int& index, Payload& data)
+{
+    int frameSize = 3 + blockSize + 2;
+    unsigned char buf[3 + 255 + 2];
+    size_t start = 0;
+
+    while (true)
+    {
+        if ((int)(pending.size() - start) < frameSize)
+        {
+            int bytesRead = ReadBytes(link, (char*)buf, frameSize - (int)(pending.size() - start));
+            if (bytesRead > 0)
+            {
+                pending.insert(pending.end(), buf, buf + bytesRead);
+            }
+
+            if ((int)(pending.size() - start) < frameSize)
+            {
+                // the Logger stopped sending before a whole block arrived
+                bool anyBytes = !pending.empty();
+                pending.clear();
+                return anyBytes ? FRAME_BAD : FRAME_NONE;
+            }
+        }
+
+        if (IsFrame(&pending[start], blockSize, minIndex, maxIndex))
+            break;
+
+        start++;
+    }
+
+    index = pending[start] | (pending[start+1] << 8);
+    data.assign(pending.begin() + start + 3, pending.begin() + start + 3 + pending[start+2]);
+    pending.erase(pending.begin(), pending.begin() + start + frameSize);
+    return FRAME_OK;
+}
+
+/* 
+    GetFramedPayload
+    Sends a command and gets the response as a series of blocks. Blocks that were damaged or lost are 
+    requested again individually. If the Logger's data changes in the meantime, the whole transfer is restarted.
+    Returns true if successful, false if an error occurred.
+*/
+bool GetFramedPayload(LoggerLink& link, char cmd, const char* args, int numArgs, Payload& payload, bool showOutput)
+{
+    // the framed command is followed by the original command and its arguments, then by the block index 
+    // when retransmitting
+    char request[16];
+    request[0] = cmd;
+    for (int i=0; i<numArgs; i++)
+    {
+        request[1+i] = args[i];
+    }
+
+    for (int restart=0; restart<FRAME_MAX_RESTARTS; restart++)
+    {
+        // a lost or damaged header can't be skipped like a block, so send the command again
+        FrameHeader header;
+        bool gotHeader = false;
+        for (int attempt=0; attempt<FRAME_HEADER_ATTEMPTS && !gotHeader; attempt++)
+        {
+            if (!SendCommand(link, CMD_FRAMED, request, numArgs+1))
+                return false;
+
+            gotHeader = GetFrameHeader(link, header, showOutput && attempt == FRAME_HEADER_ATTEMPTS-1);
+        }
+
+        if (!gotHeader)
+            return false;
+
+        vector<Payload> blocks;
+        vector<bool> received;
+        int lastBlock = -1;
+
+        // get blocks until the last one arrives or the Logger stops sending
+        int index;
+        Payload data;
+        Payload pending;
+        int result;
+        while ((result = GetFrame(link, header.blockSize, 0, (int)blocks.size() + FRAME_MAX_SKIP, pending, index, data)) != FRAME_NONE)
+        {
+            if (result == FRAME_OK)
+            {
+                if (index >= (int)blocks.size())
+                {
+                    blocks.resize(index + 1);
+                    received.resize(index + 1, false);
+                }
+                blocks[index] = data;
+                received[index] = true;
+
+                if ((int)data.size() < header.blockSize)
+                {
+                    lastBlock = index;
+                    break;
+                }
+            }
+        }
+
+        // request any missing blocks again
+        bool dataChanged = false;
+        int retransmits = 0;
+        while (true)
+        {
+            int missing = 0;
+            while (missing < (int)received.size() && received[missing])
+            {
+                missing++;
+            }
+
+            if (lastBlock >= 0 && missing > lastBlock)
+                break;
+
+            if (retransmits++ == FRAME_MAX_RETRANSMITS)
+            {
+                if (showOutput)
+                    *link.log << "Error: too many damaged blocks were received from the Logger." << endl;
+                return false;
+            }
+
+            request[1+numArgs] = (char)(missing & 0xFF);
+            request[2+numArgs] = (char)(missing >> 8);
+            if (!SendCommand(link, CMD_RETRANSMIT, request, numArgs+3))
+                return false;
+
+            // a damaged header just counts as one more retransmit
+            FrameHeader retransmitHeader;
+            if (!GetFrameHeader(link, retransmitHeader, false))
+                continue;
+
+            if (retransmitHeader.generation != header.generation || retransmitHeader.blockSize != header.blockSize)
+            {
+                dataChanged = true;
+                break;
+            }
+
+            pending.clear();
+            if (GetFrame(link, header.blockSize, missing, missing, pending, index, data) == FRAME_OK)
+            {
+                if (index >= (int)blocks.size())
+                {
+                    blocks.resize(index + 1);
+                    received.resize(index + 1, false);
+                }
+                blocks[index] = data;
+                received[index] = true;
+
+                if ((int)data.size() < header.blockSize)
+                {
+                    lastBlock = index;
+                }
+            }
+        }
+
+        if (dataChanged)
+            continue;
+
+        payload.clear();
+        for (int i=0; i<=lastBlock; i++)
+        {
+            payload.insert(payload.end(), blocks[i].begin(), blocks[i].end());
+        }
+
+        if (retransmits > 0 && showOutput)
+            *link.log << "Recovered " << retransmits << " damaged blocks." << endl;
+        return true;
+    }
+
+    if (showOutput)
+        *link.log << "Error: the Logger's data kept changing during the transfer." << endl;
+    return false;
+}
+
+/* 
+    GetPayload
+    Sends a command and gets the response, using the block framed protocol if the Logger supports it.
+    Returns true if successful, false if an error occurred.
+*/
+bool GetPayload(LoggerLink& link, char cmd, const char* args, int numArgs, Payload& payload, bool showOutput)
+{
+    if (link.useFraming)
+        return GetFramedPayload(link, cmd, args, numArgs, payload, showOutput);
+    else
+        return GetLegacyPayload(link, cmd, args, numArgs, payload, showOutput);
+}
+
+/* 
+    DetectFraming
+    Checks whether the Logger supports the block framed protocol, by requesting the firmware version with it.
+    Returns true if framing is supported.
+*/
+bool DetectFraming(LoggerLink& link)
+{
+    Payload payload;
+    if (GetFramedPayload(link, CMD_VERSION, 0, 0, payload, false))
+        return true;
+
+    // older firmware treats the extra command byte as the start of a new command, and waits for the 
+    // rest of it. Give it time to give up before sending anything else.
+    SleepMilliseconds(3000);
+    return false;
+}
+
+/* 
+    GetFirmwareVersion
+    Get the firmware version number from the Logger, and optionally print it to the console
+    Returns true if successful, false if an error occurred.
+*/
+bool GetFirmwareVersion(LoggerLink& link, bool showOutput)
+{
+    Payload payload;
+    if (!GetPayload(link, CMD_VERSION, 0, 0, payload, showOutput))
+        return false;
+
+    // get the version string
+    if (payload.empty() || payload.back() != 0)
+    {
+        if (showOutput)
+            *link.log << "Error: an incorrect response was received from the Logger." << endl;
+        return false;
+    }
+
+    if (showOutput)
+        *link.log << "The Logger's firmware version number is " << (char*)&payload[0] << endl;
+    return true;
+}
+
+/* 
+    GetDeviceId
+    Gets the ID that tells this Logger apart from others. Firmware without device IDs doesn't answer, and 
+    no error is printed for it.
+    Returns true if successful, false if the Logger has no ID or an error occurred.
+*/
+bool GetDeviceId(LoggerLink& link, unsigned long& id)
+{
+    Payload payload;
+    if (!GetPayload(link, CMD_GETID, 0, 0, payload, false))
+        return false;
+
+    if (payload.size() != 5 || payload[0] != 1)
+        return false;
+
+    id = payload[1] | (payload[2] << 8) | (payload[3] << 16) | ((unsigned long)payload[4] << 24);
+    return true;
+}
+
+/* 
+    ReportTripStats
+    Gets the Logger's trip statistics and prints them: total ascent and descent, highest and lowest altitude, 
+    and elapsed and moving time since the trip was reset on the Logger.
+    Returns true if successful, false if an error occurred.
+*/
+bool ReportTripStats(LoggerLink& link, bool metric)
+{
+    Payload payload;
+    if (!GetPayload(link, CMD_GETTRIP, 0, 0, payload, true))
+        return false;
+
+    // older firmware replies to an unknown command with no data
+    if (payload.empty())
+    {
+        *link.log << "The Logger's firmware doesn't keep trip statistics." << endl;
+        return true;
+    }
+
+    if (payload.size() != 17 || payload[0] != 1)
+    {
+        *link.log << "Error: an incorrect response was received from the Logger." << endl;
+        return false;
+    }
+
+    long values[4];
+    values[0] = payload[1] | (payload[2] << 8) | (payload[3] << 16) | ((unsigned long)payload[4] << 24);
+    values[1] = payload[5] | (payload[6] << 8) | (payload[7] << 16) | ((unsigned long)payload[8] << 24);
+    values[2] = (short)(payload[9] | (payload[10] << 8));
+    values[3] = (short)(payload[11] | (payload[12] << 8));
+    int elapsedMinutes = payload[13] | (payload[14] << 8);
+    int movingMinutes = payload[15] | (payload[16] << 8);
+
+    if (metric)
+    {
+        // whole meters, rounded to nearest
+        for (int i = 0; i < 4; i++)
+        {
+            long n = values[i] * 3048;
+            values[i] = (n >= 0 ? n + 5000 : n - 5000) / 10000;
+        }
+    }
+    const wchar_t* units = metric ? L" m" : L" ft";
+
+    *link.log << "Trip ascent " << values[0] << units << ", descent " << values[1] << units << endl;
+    if (values[2] >= values[3])
+    {
+        *link.log << "Trip highest altitude " << values[2] << units << ", lowest " << values[3] << units << endl;
+    }
+    *link.log << "Trip time " << elapsedMinutes / 60 << ":" << (elapsedMinutes % 60 < 10 ? "0" : "") << elapsedMinutes % 60 
+        << ", moving " << movingMinutes / 60 << ":" << (movingMinutes % 60 < 10 ? "0" : "") << movingMinutes % 60 << endl;
+    return true;
+}
+
+/* 
+    CalibrateBitRate
+    Asks the Logger to time a calibration pattern with its own clock. Since the host's bit rate is accurate, 
+    that gives the Logger's actual bit rate, rounded to the nearest 100.
+    Returns CALIBRATE_OK, CALIBRATE_UNSUPPORTED if the Logger's firmware doesn't know the command, or 
+    CALIBRATE_FAILED if no correct response was received.
+*/
+int CalibrateBitRate(LoggerLink& link, unsigned long& bitRate)
+{
+    char pattern[CALIBRATE_BYTES];
+    memset(pattern, CALIBRATE_PATTERN, sizeof(pattern));
+
+    Payload payload;
+    if (!GetLegacyPayload(link, CMD_CALIBRATE, pattern, CALIBRATE_BYTES, payload, false))
+        return CALIBRATE_FAILED;
+
+    // older firmware replies to an unknown command with no data
+    if (payload.empty())
+        return CALIBRATE_UNSUPPORTED;
+
+    if (payload.size() != 8 || payload[0] != 1 || payload[1] == 0)
+        return CALIBRATE_FAILED;
+
+    unsigned long cycles = payload[2] | (payload[3] << 8) | (payload[4] << 16) | ((unsigned long)payload[5] << 24);
+    unsigned int cyclesPerBit = payload[6] | (payload[7] << 8);
+    if (cyclesPerBit == 0)
+        return CALIBRATE_FAILED;
+
+    // the Logger's clock cycles in one of the host's bits, compared to the cycles in one of its own
+    double hostBitCycles = (double)cycles / (payload[1] * CALIBRATE_BITS);
+    double measuredRate = link.bitRate * hostBitCycles / cyclesPerBit;
+
+    // a UART can't receive anything this far off, so the measurement must be wrong
+    if (measuredRate < link.bitRate * 0.8 || measuredRate > link.bitRate * 1.25)
+        return CALIBRATE_FAILED;
+
+    bitRate = (unsigned long)(measuredRate / 100 + 0.5) * 100;
+    return CALIBRATE_OK;
+}
+
+/* 
+    CheckBitRate
+    Checks whether the link's bit rate works for the Logger. If calibrate is true, the Logger is asked to 
+    measure its own bit rate, and the link is reopened with that rate if it's closer. calibrate is set to 
+    false if the firmware doesn't support that. Otherwise, it retrieves the firmware version number.
+    Returns true if the bit rate works, false if it doesn't.
+*/
+bool CheckBitRate(LoggerLink& link, bool& calibrate)
+{
+    if (!calibrate)
+        return GetFirmwareVersion(link, false);
+
+    unsigned long measuredRate;
+    int result = CalibrateBitRate(link, measuredRate);
+    if (result == CALIBRATE_FAILED)
+        return false;
+
+    if (result == CALIBRATE_UNSUPPORTED)
+    {
+        // the reply got through, so this bit rate works. Older firmware takes the calibration bytes
+        // for the start of another command, and needs time to give up on it.
+        calibrate = false;
+        SleepMilliseconds(CALIBRATE_UNSUPPORTED_DELAY);
+        return true;
+    }
+
+    double difference = fabs((double)measuredRate - link.bitRate) * 100 / measuredRate;
+    if (difference <= CALIBRATE_TOLERANCE)
+        return true;
+
+    unsigned long workingRate = link.bitRate;
+    CloseLink(link);
+    link.bitRate = measuredRate;
+    link.port = OpenTransport(link.portName.c_str(), link.bitRate, *link.log);
+    if (link.port)
+    {
+        *link.log << "Adjusted the communication bit rate to " << link.bitRate << endl;
+        return true;
+    }
+
+    // the system doesn't support that bit rate, so stay with the one that worked
+    link.bitRate = workingRate;
+    link.port = OpenTransport(link.portName.c_str(), link.bitRate, *link.log);
+    return link.port != 0;
+}
+
+/* 
+    AdjustBitRate
+    Silently checks several different bit rates, until one works well enough for the Logger to reply. With 
+    calibration, the Logger then measures the exact bit rate to use, so only one exchange is needed when the 
+    first rate works. The link's bit rate is set to the selected bit rate.
+    Returns true if successful, false if an error occurred.
+*/
+bool AdjustBitRate(LoggerLink& link, bool& calibrate)
+{
+    unsigned long defaultRate = link.bitRate;
+    
+    // try the default rate first
+    if (CheckBitRate(link, calibrate))
+        return true;
+
+    unsigned long alternateRates[6] = { 38000, 38800, 37600, 39200, 37200, 39600 };
+    for (int i=0; i<6; i++)
+    {
+        CloseLink(link);
+        link.bitRate = alternateRates[i];
+        link.port = OpenTransport(link.portName.c_str(), link.bitRate, *link.log);
+        if (link.port && CheckBitRate(link, calibrate))
+        {
+            if (link.bitRate == alternateRates[i])
+            {
+                *link.log << "Adjusted the communication bit rate to  " << link.bitRate << endl;
+            }
+            return true;
+        }
+    }
+
+    // try the default rate once more, with error messages enabled
+    CloseLink(link);
+    link.bitRate = defaultRate;
+    link.port = OpenTransport(link.portName.c_str(), link.bitRate, *link.log);
+    if (link.port && GetFirmwareVersion(link, true))
+        return true;
+
+    return false;
+}
+
+/* 
+    StartStream
+    Asks the Logger to send a stream record every interval seconds, for the given number of minutes. 
+    An interval of 0 stops streaming.
+    Returns true if successful, false if an error occurred.
+*/
+bool StartStream(LoggerLink& link, int interval, int minutes, bool showOutput)
+{
+    char args[2];
+    args[0] = (char)interval;
+    args[1] = (char)minutes;
+
+    Payload payload;
+    if (!GetPayload(link, CMD_STREAM, args, 2, payload, showOutput))
+        return false;
+
+    if (payload.size() != 3 || payload[0] != 1)
+    {
+        if (showOutput)
+            *link.log << "Error: The Logger's firmware does not support streaming." << endl;
+        return false;
+    }
+
+    return true;
+}
+
+/* 
+    GetVarint
+    Reads a zigzag encoded varint from a payload, and advances the position past it.
+    Returns true if successful, false if the payload ended first.
+*/
+bool GetVarint(const Payload& payload, size_t& pos, long& value)
+{
+    unsigned long z = 0;
+    for (int shift=0; shift<32; shift+=7)
+    {
+        if (pos >= payload.size())
+            return false;
+
+        unsigned char c = payload[pos++];
+        z |= (unsigned long)(c & 0x7F) << shift;
+        if ((c & 0x80) == 0)
+        {
+            value = (long)(z >> 1) ^ -(long)(z & 1);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* 
+    DecodeGraphs
+    Converts a version 2 graph payload with delta encoded samples into a version 1 payload with raw samples.
+    Each sample is encoded as its difference from the previous sample, starting from an all-zero sample:
+        0ttppaaa    small differences t in -2..1, p in -2..1, a in -4..3
+        10nnnnnn    the previous sample repeated n+1 times
+        11000000    followed by zigzag varints for the temperature, pressure, and altitude differences
+    Returns true if successful, false if the encoded data was malformed.
+*/
+bool DecodeGraphs(const Payload& encoded, Payload& decoded)
+{
+    if (encoded.size() < 9)
+        return false;
+
+    // same header, but version 1
+    decoded.assign(encoded.begin(), encoded.begin() + 9);
+    decoded[0] = 1;
+
+    int numberOfGraphs = encoded[1];
+    int samplesPerGraph = encoded[2];
+    size_t pos = 9;
+
+    for (int g=0; g<numberOfGraphs; g++)
+    {
+        // minutes per sample
+        if (pos + 2 > encoded.size())
+            return false;
+        decoded.push_back(encoded[pos++]);
+        decoded.push_back(encoded[pos++]);
+
+        long temperature = 0, pressure = 0, altitude = 0;
+        int s = 0;
+        while (s < samplesPerGraph)
+        {
+            if (pos >= encoded.size())
+                return false;
+
+            unsigned char token = encoded[pos++];
+            int count = 1;
+            if ((token & 0x80) == 0)
+            {
+                // sign extend each bit field
+                temperature += ((token >> 5) & 0x3) - ((token & 0x40) ? 4 : 0);
+                pressure += ((token >> 3) & 0x3) - ((token & 0x10) ? 4 : 0);
+                altitude += (token & 0x7) - ((token & 0x4) ? 8 : 0);
+            }
+            else if ((token & 0xC0) == 0x80)
+            {
+                count = (token & 0x3F) + 1;
+            }
+            else if (token == 0xC0)
+            {
+                long dt, dp, da;
+                if (!GetVarint(encoded, pos, dt) || !GetVarint(encoded, pos, dp) || !GetVarint(encoded, pos, da))
+                    return false;
+                temperature += dt;
+                pressure += dp;
+                altitude += da;
+            }
+            else
+            {
+                return false;
+            }
+
+            if (s + count > samplesPerGraph ||
+                temperature < 0 || temperature >= (1L<<TEMPERATURE_BITS) ||
+                pressure < 0 || pressure >= (1L<<PRESSURE_BITS) ||
+                altitude < 0 || altitude >= (1L<<ALTITUDE_BITS))
+                return false;
+
+            Sample sample;
+            sample.temperature = temperature;
+            sample.pressure = pressure;
+            sample.altitude = altitude;
+            unsigned char packed[SAMPLE_BYTES];
+            PackSample(sample, packed);
+            for (int i=0; i<count; i++)
+            {
+                decoded.insert(decoded.end(), packed, packed + SAMPLE_BYTES);
+            }
+            s += count;
+        }
+    }
+
+    return pos == encoded.size();
+}
+
+/* 
+    UnpackTime
+    Converts a packed (((year*13 + month)*32 + day)*24 + hour)*60 + minute time from the Logger to a LoggerTime.
+*/
+void UnpackTime(unsigned long packedTime, LoggerTime& t)
+{
+    t.minute = (int)(packedTime % 60);
+    packedTime /= 60;
+    t.hour = (int)(packedTime % 24);
+    packedTime /= 24;
+    t.day = (int)(packedTime % 32);
+    packedTime /= 32;
+    t.month = (int)(packedTime % 13);
+    if (t.month > 12)
+        t.month = 12;
+    packedTime /= 13;
+    t.year = (int)(2000 + packedTime);
+    t.second = 0;
+}
+
+/* 
+    TimeToMinutes
+    Converts a time to the number of minutes since midnight on January 1, 2000. Seconds are ignored.
+*/
+long TimeToMinutes(const LoggerTime& t)
+{
+    // count years from March, so the leap day is at the end of the year
+    long y = t.year - (t.month <= 2 ? 1 : 0);
+    long m = t.month > 2 ? t.month - 3 : t.month + 9;
+    long era = (y >= 0 ? y : y - 399) / 400;
+    long yearOfEra = y - era * 400;
+    long dayOfYear = (153 * m + 2) / 5 + t.day - 1;
+    long dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+
+    // 730425 is the day number of 1/1/2000
+    long days = era * 146097 + dayOfEra - 730425;
+    return (days * 24 + t.hour) * 60 + t.minute;
+}
+
+/* 
+    MinutesToTime
+    Converts a number of minutes since midnight on January 1, 2000 to a time. Seconds are left unchanged.
+*/
+void MinutesToTime(long minutes, LoggerTime& t)
+{
+    long days = minutes / 1440;
+    minutes %= 1440;
+    if (minutes < 0)
+    {
+        minutes += 1440;
+        days--;
+    }
+    t.hour = (int)(minutes / 60);
+    t.minute = (int)(minutes % 60);
+
+    days += 730425;
+    long era = (days >= 0 ? days : days - 146096) / 146097;
+    long dayOfEra = days - era * 146097;
+    long yearOfEra = (dayOfEra - dayOfEra/1460 + dayOfEra/36524 - dayOfEra/146096) / 365;
+    long dayOfYear = dayOfEra - (365*yearOfEra + yearOfEra/4 - yearOfEra/100);
+    long m = (5*dayOfYear + 2) / 153;
+
+    t.day = (int)(dayOfYear - (153*m + 2)/5 + 1);
+    t.month = (int)(m < 10 ? m + 3 : m - 9);
+    t.year = (int)(yearOfEra + era * 400 + (t.month <= 2 ? 1 : 0));
+}
+
+/* 
+    AdjustTime
+    Adjusts the given time by adding or subtracting a user-defined number of minutes.
+*/
+void AdjustTime(LoggerTime& t, int minutesToAdd)
+{
+    MinutesToTime(TimeToMinutes(t) + minutesToAdd, t);
+}
@@ -0,0 +1,169 @@
+/* 
+  Copyright (c) 2011 Steve Chamberlin
+  Permission is hereby granted, free of charge, to any person obtaining a copy of this hardware, software, and associated documentation 
+  files (the "Product"), to deal in the Product without restriction, including without limitation the rights to use, copy, modify, merge, 
+  publish, distribute, sublicense, and/or sell copies of the Product, and to permit persons to whom the Product is furnished to do so, 
+  subject to the following conditions: 
+
+  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Product. 
+
+  THE PRODUCT IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF 
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+  ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH 
+  THE PRODUCT OR THE USE OR OTHER DEALINGS IN THE PRODUCT.
+
+  protocol.h - The Logger's serial protocol and data formats, independent of the connection type.
+
+*/
+
+#ifndef PROTOCOL_H_
+#define PROTOCOL_H_
+
+#include <iostream>
+#include <vector>
+#include "platform.h"
+#include "transport.h"
+
+#define CMD_VERSION '1'
+#define CMD_GETGRAPHS '2'
+#define CMD_GETSNAPSHOTS '3'
+#define CMD_GETSAMPLESSINCE '4'
+#define CMD_GETID '5'
+#define CMD_GETTRIP '6'
+#define CMD_FRAMED 'F'
+#define CMD_RETRANSMIT 'R'
+#define CMD_STREAM 'S'
+#define CMD_CALIBRATE 'C'
+
+#define FRAME_VERSION 1
+#define FRAME_MAX_RESTARTS 3
+#define FRAME_MAX_RETRANSMITS 64
+// times to send a framed command when its response header is lost or damaged
+#define FRAME_HEADER_ATTEMPTS 2
+// how far past the next expected block a block index can be, and still be taken for a real block when 
+// resyncing after lost bytes
+#define FRAME_MAX_SKIP 64
+
+// CMD_CALIBRATE is followed by bytes of CALIBRATE_PATTERN, which the Logger times with its own clock. Each has 
+// falling edges CALIBRATE_BITS bit times apart.
+#define CALIBRATE_BYTES 8
+#define CALIBRATE_PATTERN 0x7F
+#define CALIBRATE_BITS 8
+// percent difference from the Logger's measured bit rate that's close enough to keep using
+#define CALIBRATE_TOLERANCE 0.5
+// milliseconds for firmware without calibration to give up on the calibration bytes, which it takes for another command
+#define CALIBRATE_UNSUPPORTED_DELAY 3000
+
+#define STREAM_SYNC 0xA5
+#define STREAM_RECORD_SIZE 14
+
+// milliseconds to wait after the first byte of a command, for the Logger to wake up and enter the serial read 
+// interrupt routine, and between the remaining bytes, for the Logger to process each one
+#define COMMAND_WAKE_DELAY 20
+#define COMMAND_BYTE_DELAY 2
+
+// milliseconds of silence that mean the Logger has stopped sending
+#define READ_TIMEOUT 100
+
+// temperature, in units of Farenheit * 10
+// can store -10 to 117.5F, in 0.5F steps
+#define TEMPERATURE_MIN -100
+#define TEMPERATURE_SCALE 5
+#define TEMPERATURE_BITS 8
+// absolute pressure, in units of millibars * 100
+// can store 200 to 1223 mb, in 0.5 mb steps
+#define PRESSURE_MIN 20000
+#define PRESSURE_SCALE 50
+#define PRESSURE_BITS 11
+// altitude, in units of ft * 100
+// can store -1384 to 14999 ft, in 2 ft steps
+#define ALTITUDE_MIN -1384
+#define ALTITUDE_SCALE 2
+#define ALTITUDE_BITS 13
+
+#define SAMPLE_TO_TEMPERATURE(st) ((((long)st*TEMPERATURE_SCALE)+TEMPERATURE_MIN)/TEMPERATURE_SCALE)
+#define SAMPLE_TO_PRESSURE(sp) ((((long)sp*PRESSURE_SCALE)+PRESSURE_MIN)/PRESSURE_SCALE)
+#define SAMPLE_TO_ALTITUDE(sa) ((((long)sa*ALTITUDE_SCALE)+ALTITUDE_MIN)/ALTITUDE_SCALE)
+
+typedef struct 
+{
+    unsigned int temperature:TEMPERATURE_BITS;
+    unsigned int pressure:PRESSURE_BITS;
+    unsigned int altitude:ALTITUDE_BITS;
+} Sample;
+
+typedef struct  
+{
+    // 32 bits, on both Windows and 64-bit POSIX systems
+    unsigned int packedYearMonthDayHourMin;
+    Sample sample;	
+} Snapshot;
+
+// a time from the Logger's clock
+typedef struct
+{
+    int year;
+    int month;
+    int day;
+    int hour;
+    int minute;
+    int second;
+} LoggerTime;
+
+// a command response, without the "LOG" prefix and checksum or framing
+typedef std::vector<unsigned char> Payload;
+
+// header of a block framed response
+typedef struct
+{
+    int blockSize;
+    unsigned short generation;
+} FrameHeader;
+
+// GetFrame() results
+enum { FRAME_OK, FRAME_BAD, FRAME_NONE };
+
+// CalibrateBitRate() results
+enum { CALIBRATE_OK, CALIBRATE_UNSUPPORTED, CALIBRATE_FAILED };
+
+// the connection to one Logger
+typedef struct
+{
+    Transport* port;
+    tstring portName;
+    unsigned long bitRate;
+    // use the block framed protocol, if the Logger supports it
+    bool useFraming;
+    // where messages about this Logger are printed
+    std::wostream* log;
+} LoggerLink;
+
+bool OpenLink(LoggerLink& link, const _TCHAR* portName, unsigned long bitRate, std::wostream& log = std::wcout);
+void CloseLink(LoggerLink& link);
+bool SendCommand(LoggerLink& link, char cmd, const char* args = 0, int numArgs = 0);
+bool GetResponseHeader(LoggerLink& link, bool showOutput);
+int ReadBytes(LoggerLink& link, char* pBuffer, int bytesToRead);
+unsigned short Crc16Update(unsigned short crc, unsigned char c);
+bool IsStreamRecord(const unsigned char* pRecord);
+bool GetLegacyPayload(LoggerLink& link, char cmd, const char* args, int numArgs, Payload& payload, bool showOutput);
+bool GetFrameHeader(LoggerLink& link, FrameHeader& header, bool showOutput);
+bool IsFrame(const unsigned char* pFrame, int blockSize, int minIndex, int maxIndex);
+int GetFrame(LoggerLink& link, int blockSize, int minIndex, int maxIndex, Payload& pending, int& index, Payload& data);
+bool GetFramedPayload(LoggerLink& link, char cmd, const char* args, int numArgs, Payload& payload, bool showOutput);
+bool GetPayload(LoggerLink& link, char cmd, const char* args, int numArgs, Payload& payload, bool showOutput);
+bool DetectFraming(LoggerLink& link);
+bool GetFirmwareVersion(LoggerLink& link, bool showOutput);
+bool GetDeviceId(LoggerLink& link, unsigned long& id);
+bool ReportTripStats(LoggerLink& link, bool metric);
+int CalibrateBitRate(LoggerLink& link, unsigned long& bitRate);
+bool CheckBitRate(LoggerLink& link, bool& calibrate);
+bool AdjustBitRate(LoggerLink& link, bool& calibrate);
+bool StartStream(LoggerLink& link, int interval, int minutes, bool showOutput);
+bool GetVarint(const Payload& payload, size_t& pos, long& value);
+bool DecodeGraphs(const Payload& encoded, Payload& decoded);
+void UnpackTime(unsigned long packedTime, LoggerTime& t);
+long TimeToMinutes(const LoggerTime& t);
+void MinutesToTime(long minutes, LoggerTime& t);
+void AdjustTime(LoggerTime& t, int minutesToAdd);
+
+#endif /* PROTOCOL_H_ */
@@ -0,0 +1,675 @@
+/* 
+  Copyright (c) 2011 Steve Chamberlin
+  Permission is hereby granted, free of charge, to any person obtaining a copy of this hardware, software, and associated documentation 
+  files (the "Product"), to deal in the Product without restriction, including without limitation the rights to use, copy, modify, merge, 
+  publish, distribute, sublicense, and/or sell copies of the Product, and to permit persons to whom the Product is furnished to do so, 
+  subject to the following conditions: 
+
+  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Product. 
+
+  THE PRODUCT IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF 
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+  ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH 
+  THE PRODUCT OR THE USE OR OTHER DEALINGS IN THE PRODUCT.
+
+  query.cpp - Aggregate queries over the archive and raw files.
+
+*/
+
+#include <stdio.h>
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include "query.h"
+#include "convert.h"
+#include "sampledata.h"
+#include "workpool.h"
+#include "blsync.h"
+
+using namespace std;
+
+static const char* fieldNames[] = { "Temperature", "Pressure", "Altitude" };
+
+static bool CompareRecordTimes(const ArchiveRecord& a, const ArchiveRecord& b)
+{
+    return a.time < b.time;
+}
+
+static bool SameRecordTime(const ArchiveRecord& a, const ArchiveRecord& b)
+{
+    return a.time == b.time;
+}
+
+/* 
+    ParseQueryField
+    Reads the name of the value to query: temperature, pressure, or altitude.
+    Returns false if it isn't one of those.
+*/
+bool ParseQueryField(const _TCHAR* str, int& field)
+{
+    if (_tcscmp(str, _T("temperature")) == 0)
+        field = QUERY_TEMPERATURE;
+    else if (_tcscmp(str, _T("pressure")) == 0)
+        field = QUERY_PRESSURE;
+    else if (_tcscmp(str, _T("altitude")) == 0)
+        field = QUERY_ALTITUDE;
+    else
+        return false;
+    return true;
+}
+
+/* 
+    ParseQueryPeriod
+    Reads the period to group samples by: hour, day, month, all, or a number of minutes.
+    Returns false if it isn't one of those.
+*/
+bool ParseQueryPeriod(const _TCHAR* str, long& period)
+{
+    if (_tcscmp(str, _T("hour")) == 0)
+        period = 60;
+    else if (_tcscmp(str, _T("day")) == 0)
+        period = 1440;
+    else if (_tcscmp(str, _T("month")) == 0)
+        period = QUERY_PERIOD_MONTH;
+    else if (_tcscmp(str, _T("all")) == 0)
+        period = QUERY_PERIOD_ALL;
+    else
+    {
+        period = _ttoi(str);
+        if (period <= 0)
+            return false;
+    }
+    return true;
+}
+
+/* 
+    ParseNumber
+    Reads a decimal number with the given number of digits, and moves str past it.
+    Returns false if there aren't that many digits.
+*/
+static bool ParseNumber(const _TCHAR*& str, int digits, int& value)
+{
+    value = 0;
+    for (int i=0; i<digits; i++)
+    {
+        if (*str < _T('0') || *str > _T('9'))
+            return false;
+        value = value * 10 + (*str++ - _T('0'));
+    }
+    return true;
+}
+
+/* 
+    ParseQueryTime
+    Reads a time like 2011-08-14 or 2011-08-14T16:05. A date alone means the start of that day, or the end 
+    of it if the time ends a range, so a range from one date to another includes both days.
+    Returns false if the time isn't valid.
+*/
+bool ParseQueryTime(const _TCHAR* str, bool end, long& time)
+{
+    LoggerTime t = { 0, 0, 0, 0, 0, 0 };
+    if (!ParseNumber(str, 4, t.year) || *str++ != _T('-') || !ParseNumber(str, 2, t.month) || 
+        *str++ != _T('-') || !ParseNumber(str, 2, t.day))
+        return false;
+
+    bool hasTime = (*str == _T('T') || *str == _T(' '));
+    if (hasTime)
+    {
+        str++;
+        if (!ParseNumber(str, 2, t.hour) || *str++ != _T(':') || !ParseNumber(str, 2, t.minute))
+            return false;
+    }
+
+    if (*str != 0 || t.year < 2000 || t.year > 2255 || t.month < 1 || t.month > 12 || t.day < 1 || t.day > 31 || 
+        t.hour > 23 || t.minute > 59)
+        return false;
+
+    time = TimeToMinutes(t);
+    if (end && !hasTime)
+    {
+        time += 1439;
+    }
+    return true;
+}
+
+static long GetFieldValue(const Sample& sample, int field)
+{
+    if (field == QUERY_TEMPERATURE)
+        return SAMPLE_TO_TEMPERATURE(sample.temperature);
+    if (field == QUERY_PRESSURE)
+        return SAMPLE_TO_PRESSURE(sample.pressure);
+    return SAMPLE_TO_ALTITUDE(sample.altitude);
+}
+
+/* 
+    GetPeriodStart
+    Returns the time of the start of the period a sample falls in. Months vary in length, so the bounds of 
+    the last month found are kept in monthStart and monthEnd, and only worked out again for a new month.
+*/
+static long GetPeriodStart(long time, long period, long& monthStart, long& monthEnd)
+{
+    if (period == QUERY_PERIOD_ALL)
+        return 0;
+    if (period != QUERY_PERIOD_MONTH)
+        return time - time % period;
+
+    if (time < monthStart || time >= monthEnd)
+    {
+        LoggerTime t;
+        MinutesToTime(time, t);
+        t.day = 1;
+        t.hour = 0;
+        t.minute = 0;
+        monthStart = TimeToMinutes(t);
+        if (++t.month > 12)
+        {
+            t.month = 1;
+            t.year++;
+        }
+        monthEnd = TimeToMinutes(t);
+    }
+    return monthStart;
+}
+
+static QueryTotals& FindTotals(QueryBuckets& buckets, long periodStart)
+{
+    QueryBuckets::iterator it = buckets.find(periodStart);
+    if (it == buckets.end())
+    {
+        QueryTotals totals = { 0, 0, 0, 0.0, 0, 0 };
+        it = buckets.insert(make_pair(periodStart, totals)).first;
+    }
+    return it->second;
+}
+
+static void AddStep(QueryTotals& totals, long change)
+{
+    if (change > 0)
+        totals.rise += change;
+    else
+        totals.fall -= change;
+}
+
+static void MergeTotals(QueryTotals& totals, const QueryTotals& other)
+{
+    if (totals.count == 0 || other.min < totals.min)
+        totals.min = other.min;
+    if (totals.count == 0 || other.max > totals.max)
+        totals.max = other.max;
+    totals.count += other.count;
+    totals.sum += other.sum;
+    totals.rise += other.rise;
+    totals.fall += other.fall;
+}
+
+/* 
+    AggregateRecords
+    Adds samples in ascending time order to the totals for their periods. The rise and fall only count the
+    change between samples that are one series interval apart, so a gap in the data isn't counted as a climb.
+*/
+void AggregateRecords(const ArchiveRecord* pRecords, size_t count, int series, const QueryOptions& options, QueryBuckets& buckets)
+{
+    long monthStart = 0;
+    long monthEnd = 0;
+    long currentPeriod = 0;
+    QueryTotals* pTotals = 0;
+
+    for (size_t i=0; i<count; i++)
+    {
+        long value = GetFieldValue(pRecords[i].sample, options.field);
+        long periodStart = GetPeriodStart(pRecords[i].time, options.period, monthStart, monthEnd);
+        if (pTotals == 0 || periodStart != currentPeriod)
+        {
+            pTotals = &FindTotals(buckets, periodStart);
+            currentPeriod = periodStart;
+        }
+
+        if (pTotals->count == 0 || value < pTotals->min)
+            pTotals->min = value;
+        if (pTotals->count == 0 || value > pTotals->max)
+            pTotals->max = value;
+        pTotals->count++;
+        pTotals->sum += value;
+
+        if (i > 0 && series > 0 && pRecords[i].time - pRecords[i-1].time == series)
+        {
+            AddStep(*pTotals, value - GetFieldValue(pRecords[i-1].sample, options.field));
+        }
+    }
+}
+
+/* 
+    AddRawSamples
+    Keeps the samples from a raw file that are in the query's time range.
+*/
+static void AddRawSamples(const SampleView& samples, long startTime, long endTime, vector<ArchiveRecord>& records)
+{
+    for (SampleView::const_iterator it = samples.begin(); it != samples.end(); ++it)
+    {
+        if (it.time() >= startTime && it.time() <= endTime)
+        {
+            ArchiveRecord record;
+            record.time = it.time();
+            record.sample = *it;
+            records.push_back(record);
+        }
+    }
+}
+
+/* 
+    ScanRawFile
+    Finds the samples in a raw file saved by blsync -r that are in the query's time range, for each series. 
+    The file is mapped into memory rather than read. A file that isn't a raw file is skipped, unless it was 
+    named on the command line. Live stream records aren't on the sample schedule, so they're left out.
+    Returns true if successful, false if an error occurred.
+*/
+static bool ScanRawFile(QueryTask& task)
+{
+    MappedFile file;
+    if (!MapFile(task.path.c_str(), file))
+    {
+        task.log << "Error: " << task.path.c_str() << " could not be read." << endl;
+        return false;
+    }
+
+    const unsigned char* pData = file.pData;
+    int type = DetectRawType(pData, file.size);
+    bool result = true;
+    if (type == RAW_GRAPHS)
+    {
+        GraphView graphs;
+        graphs.Parse(pData, file.size);
+        for (int g=0; g<graphs.GetGraphCount(); g++)
+        {
+            SampleView samples = graphs.GetGraph(g);
+            AddRawSamples(samples, task.startTime, task.endTime, task.rawRecords[samples.GetMinutesPerSample()]);
+        }
+    }
+    else if (type == RAW_SNAPSHOTS)
+    {
+        SnapshotView snapshots;
+        snapshots.Parse(pData, file.size);
+        vector<ArchiveRecord>& records = task.rawRecords[ARCHIVE_SERIES_SNAPSHOTS];
+        for (size_t i=0; i<snapshots.size(); i++)
+        {
+            ArchiveRecord record;
+            record.time = snapshots.GetTime(i);
+            record.sample = snapshots[i];
+            if (record.time >= task.startTime && record.time <= task.endTime)
+            {
+                records.push_back(record);
+            }
+        }
+    }
+    else if (type == RAW_SAMPLES)
+    {
+        NewSamplesView newSamples;
+        for (size_t pos = 0; pos < file.size; pos += newSamples.GetByteCount())
+        {
+            newSamples.Parse(&pData[pos], file.size - pos);
+            SampleView samples = newSamples.GetSamples();
+            AddRawSamples(samples, task.startTime, task.endTime, task.rawRecords[samples.GetMinutesPerSample()]);
+        }
+    }
+    else if (task.named)
+    {
+        if (type == RAW_STREAM)
+        {
+            task.log << "Skipping " << task.path.c_str() << ", since live stream records can't be queried." << endl;
+        }
+        else
+        {
+            task.log << "Error: " << task.path.c_str() << " is not a raw file saved by blsync." << endl;
+            result = false;
+        }
+    }
+
+    UnmapFile(file);
+    return result;
+}
+
+/* 
+    QueryWorker
+    Task function for a query. Reads one month of a series from the archive and adds up its totals, or finds
+    the samples in one raw file.
+*/
+void QueryWorker(void* pContext, size_t index, int worker)
+{
+    QueryContext* pQuery = (QueryContext*)pContext;
+    QueryTask* pTask = pQuery->tasks[index];
+
+    if (pTask->raw)
+    {
+        pTask->ok = ScanRawFile(*pTask);
+        return;
+    }
+
+    vector<ArchiveRecord>& records = pQuery->records[worker];
+    pTask->ok = ReadArchive(pTask->path, pTask->series, pTask->startTime, pTask->endTime, records, pTask->log);
+    if (!pTask->ok || records.empty())
+        return;
+
+    AggregateRecords(&records[0], records.size(), pTask->series, *pQuery->pOptions, pTask->buckets);
+    pTask->count = (unsigned long)records.size();
+    pTask->firstTime = records.front().time;
+    pTask->firstValue = GetFieldValue(records.front().sample, pQuery->pOptions->field);
+    pTask->lastTime = records.back().time;
+    pTask->lastValue = GetFieldValue(records.back().sample, pQuery->pOptions->field);
+}
+
+static QueryTask* NewQueryTask(const tstring& path, bool raw, bool named, int series, long startTime, long endTime)
+{
+    QueryTask* pTask = new QueryTask;
+    pTask->path = path;
+    pTask->raw = raw;
+    pTask->named = named;
+    pTask->series = series;
+    pTask->startTime = startTime;
+    pTask->endTime = endTime;
+    pTask->ok = false;
+    pTask->count = 0;
+    pTask->firstTime = pTask->firstValue = pTask->lastTime = pTask->lastValue = 0;
+    return pTask;
+}
+
+/* 
+    AddArchiveTasks
+    Makes a task for each month of each Logger's archive that overlaps the query's time range, in the series 
+    the query asks for, or the most detailed one if it doesn't say.
+    Returns the number of Loggers found, or -1 if an error occurred.
+*/
+static int AddArchiveTasks(const _TCHAR* directory, const QueryOptions& options, vector<QueryTask*>& tasks)
+{
+    vector<tstring> deviceKeys;
+    if (!ListDirectory(directory, deviceKeys, true))
+    {
+        wcout << "Error: the archive in " << directory << " could not be read." << endl;
+        return -1;
+    }
+    sort(deviceKeys.begin(), deviceKeys.end());
+
+    int numDevices = 0;
+    for (size_t d=0; d<deviceKeys.size(); d++)
+    {
+        if (options.deviceKey != 0 && deviceKeys[d] != options.deviceKey)
+            continue;
+
+        tstring archivePath = GetArchivePath(directory, deviceKeys[d]);
+        vector<ArchiveSeriesInfo> seriesList;
+        if (!FindArchiveSeries(archivePath, seriesList, wcout))
+            return -1;
+
+        const ArchiveSeriesInfo* pInfo = 0;
+        for (size_t i=0; i<seriesList.size(); i++)
+        {
+            if (options.series == QUERY_SERIES_FINEST ? 
+                (seriesList[i].series != ARCHIVE_SERIES_SNAPSHOTS && (pInfo == 0 || seriesList[i].series < pInfo->series)) :
+                seriesList[i].series == options.series)
+            {
+                pInfo = &seriesList[i];
+            }
+        }
+        if (pInfo == 0)
+            continue;
+        numDevices++;
+
+        LoggerTime t;
+        MinutesToTime(pInfo->firstMonth, t);
+        for (long month = pInfo->firstMonth; month <= pInfo->lastMonth && month <= options.endTime; month = TimeToMinutes(t))
+        {
+            if (++t.month > 12)
+            {
+                t.month = 1;
+                t.year++;
+            }
+
+            long monthEnd = TimeToMinutes(t) - 1;
+            if (monthEnd < options.startTime)
+                continue;
+
+            tasks.push_back(NewQueryTask(archivePath, false, true, pInfo->series, max(month, options.startTime), min(monthEnd, options.endTime)));
+        }
+    }
+
+    if (options.deviceKey != 0 && numDevices == 0)
+    {
+        wcout << "Error: the archive has no samples from " << options.deviceKey << " in that series." << endl;
+        return -1;
+    }
+
+    return numDevices;
+}
+
+/* 
+    MergeRawRecords
+    Puts together the samples found in all the raw files, in the series the query asks for, or the most 
+    detailed one if it doesn't say. Files often overlap, so samples with the same time are only kept once.
+    Returns the series.
+*/
+static int MergeRawRecords(const vector<QueryTask*>& tasks, const QueryOptions& options, vector<ArchiveRecord>& records)
+{
+    int series = options.series;
+    if (series == QUERY_SERIES_FINEST)
+    {
+        for (size_t i=0; i<tasks.size(); i++)
+        {
+            map<int, vector<ArchiveRecord> >::const_iterator it = tasks[i]->rawRecords.begin();
+            for (; it != tasks[i]->rawRecords.end(); ++it)
+            {
+                if (it->first != ARCHIVE_SERIES_SNAPSHOTS && !it->second.empty() && (series == QUERY_SERIES_FINEST || it->first < series))
+                {
+                    series = it->first;
+                }
+            }
+        }
+    }
+
+    for (size_t i=0; i<tasks.size(); i++)
+    {
+        map<int, vector<ArchiveRecord> >::const_iterator it = tasks[i]->rawRecords.find(series);
+        if (it != tasks[i]->rawRecords.end())
+        {
+            records.insert(records.end(), it->second.begin(), it->second.end());
+        }
+    }
+
+    stable_sort(records.begin(), records.end(), CompareRecordTimes);
+    records.erase(unique(records.begin(), records.end(), SameRecordTime), records.end());
+    return series;
+}
+
+/* 
+    PrintQueryResults
+    Prints the totals for each period, converted to the units blsync saves files in.
+*/
+static void PrintQueryResults(const QueryBuckets& buckets, const QueryOptions& options)
+{
+    // display value = value * scale + offset, and the rise and fall are just scaled
+    double scale, offset = 0;
+    int decimals;
+    const char* units;
+    if (options.field == QUERY_TEMPERATURE)
+    {
+        scale = options.metric ? 5.0/18 : 0.5;
+        offset = options.metric ? -160.0/9 : 0;
+        decimals = 1;
+        units = options.metric ? "degrees C" : "degrees F";
+    }
+    else if (options.field == QUERY_PRESSURE)
+    {
+        scale = options.metric ? 0.5 : 0.5*0.0295333727;
+        decimals = options.metric ? 1 : 2;
+        units = options.metric ? "hPa" : "inches of mercury";
+    }
+    else
+    {
+        scale = options.metric ? 2*0.3048 : 2;
+        decimals = 0;
+        units = options.metric ? "meters" : "feet";
+    }
+
+    char buf[256];
+    if (options.period == QUERY_PERIOD_ALL)
+        sprintf_s(buf, 256, "%s in %s, for all samples\n", fieldNames[options.field], units);
+    else if (options.period == QUERY_PERIOD_MONTH)
+        sprintf_s(buf, 256, "%s in %s, by month\n", fieldNames[options.field], units);
+    else if (options.period == 60)
+        sprintf_s(buf, 256, "%s in %s, by hour\n", fieldNames[options.field], units);
+    else if (options.period == 1440)
+        sprintf_s(buf, 256, "%s in %s, by day\n", fieldNames[options.field], units);
+    else
+        sprintf_s(buf, 256, "%s in %s, every %ld minutes\n", fieldNames[options.field], units, options.period);
+    wcout << buf;
+
+    sprintf_s(buf, 256, "%-16s %9s %10s %10s %10s %10s %10s\n", "Period", "Samples", "Min", "Max", "Mean", "Rise", "Fall");
+    wcout << buf;
+
+    for (QueryBuckets::const_iterator it = buckets.begin(); it != buckets.end(); ++it)
+    {
+        LoggerTime t;
+        MinutesToTime(it->first, t);
+        char period[32];
+        if (options.period == QUERY_PERIOD_ALL)
+            sprintf_s(period, 32, "all");
+        else if (options.period == QUERY_PERIOD_MONTH)
+            sprintf_s(period, 32, "%04d-%02d", t.year, t.month);
+        else if (options.period % 1440 == 0)
+            sprintf_s(period, 32, "%04d-%02d-%02d", t.year, t.month, t.day);
+        else
+            sprintf_s(period, 32, "%04d-%02d-%02d %02d:%02d", t.year, t.month, t.day, t.hour, t.minute);
+
+        const QueryTotals& totals = it->second;
+        sprintf_s(buf, 256, "%-16s %9lu %10.*f %10.*f %10.*f %10.*f %10.*f\n", period, totals.count, 
+            decimals, totals.min * scale + offset, decimals, totals.max * scale + offset, 
+            decimals, totals.sum / totals.count * scale + offset, decimals, totals.rise * scale, decimals, totals.fall * scale);
+        wcout << buf;
+    }
+}
+
+/* 
+    QueryData
+    Adds up the minimum, maximum, mean, and total rise and fall of a value for each period, across every 
+    Logger in the archive and every raw file given. Only the archive months in the time range are read, and
+    within them only the blocks the index says overlap it. Each month or file is a separate task for a 
+    work-stealing thread pool, one thread per processor by default, and the totals are merged at the end.
+    Returns true if successful, false if an error occurred.
+*/
+bool QueryData(const _TCHAR* directory, const vector<tstring>& rawPaths, const QueryOptions& options, int numWorkers)
+{
+    QueryContext context;
+    context.pOptions = &options;
+    context.records.resize(WORKPOOL_MAX_WORKERS);
+
+    unsigned long startTime = GetMilliseconds();
+
+    int numDevices = 0;
+    if (directory != 0)
+    {
+        numDevices = AddArchiveTasks(directory, options, context.tasks);
+        if (numDevices < 0)
+        {
+            for (size_t i=0; i<context.tasks.size(); i++)
+            {
+                delete context.tasks[i];
+            }
+            return false;
+        }
+    }
+
+    size_t firstRawTask = context.tasks.size();
+    for (size_t i=0; i<rawPaths.size(); i++)
+    {
+        vector<tstring> names;
+        bool isDirectory = ListDirectory(rawPaths[i].c_str(), names, false);
+        if (!isDirectory)
+        {
+            names.push_back(tstring());
+        }
+        sort(names.begin(), names.end());
+
+        for (size_t n=0; n<names.size(); n++)
+        {
+            tstring path = isDirectory ? rawPaths[i] + _T("/") + names[n] : rawPaths[i];
+            context.tasks.push_back(NewQueryTask(path, true, !isDirectory, ARCHIVE_SERIES_SNAPSHOTS, options.startTime, options.endTime));
+        }
+    }
+
+    RunTasks(context.tasks.size(), numWorkers, QueryWorker, &context);
+
+    bool result = true;
+    unsigned long count = 0;
+    QueryBuckets buckets;
+    const QueryTask* pPrevious = 0;
+    for (size_t i=0; i<firstRawTask; i++)
+    {
+        QueryTask* pTask = context.tasks[i];
+        wcout << pTask->log.str();
+        result = result && pTask->ok;
+        if (pTask->count == 0)
+            continue;
+
+        for (QueryBuckets::const_iterator it = pTask->buckets.begin(); it != pTask->buckets.end(); ++it)
+        {
+            MergeTotals(FindTotals(buckets, it->first), it->second);
+        }
+        count += pTask->count;
+
+        // the step from the end of the last month to the start of this one
+        if (pPrevious != 0 && pPrevious->path == pTask->path && pPrevious->series == pTask->series && 
+            pTask->firstTime - pPrevious->lastTime == pTask->series)
+        {
+            long monthStart = 0;
+            long monthEnd = 0;
+            AddStep(FindTotals(buckets, GetPeriodStart(pTask->firstTime, options.period, monthStart, monthEnd)), 
+                pTask->firstValue - pPrevious->lastValue);
+        }
+        pPrevious = pTask;
+    }
+
+    if (firstRawTask < context.tasks.size())
+    {
+        vector<QueryTask*> rawTasks(context.tasks.begin() + firstRawTask, context.tasks.end());
+        for (size_t i=0; i<rawTasks.size(); i++)
+        {
+            wcout << rawTasks[i]->log.str();
+            result = result && rawTasks[i]->ok;
+        }
+
+        vector<ArchiveRecord> records;
+        int series = MergeRawRecords(rawTasks, options, records);
+        if (!records.empty())
+        {
+            AggregateRecords(&records[0], records.size(), series, options, buckets);
+        }
+        count += (unsigned long)records.size();
+    }
+
+    for (size_t i=0; i<context.tasks.size(); i++)
+    {
+        delete context.tasks[i];
+    }
+
+    if (count == 0)
+    {
+        wcout << "No samples were found." << endl;
+        return result;
+    }
+
+    PrintQueryResults(buckets, options);
+
+    ios_base::fmtflags flags = wcout.flags();
+    wcout << fixed << setprecision(1);
+    wcout << "Queried " << count << " samples";
+    if (numDevices > 0)
+    {
+        wcout << " from " << numDevices << (numDevices == 1 ? " Logger" : " Loggers");
+    }
+    if (!rawPaths.empty())
+    {
+        wcout << (numDevices > 0 ? " and raw files" : " from raw files");
+    }
+    wcout << " in " << (GetMilliseconds() - startTime) / 1000.0 << " seconds." << endl;
+    wcout.flags(flags);
+
+    return result;
+}
@@ -0,0 +1,109 @@
+/* 
+  Copyright (c) 2011 Steve Chamberlin
+  Permission is hereby granted, free of charge, to any person obtaining a copy of this hardware, software, and associated documentation 
+  files (the "Product"), to deal in the Product without restriction, including without limitation the rights to use, copy, modify, merge, 
+  publish, distribute, sublicense, and/or sell copies of the Product, and to permit persons to whom the Product is furnished to do so, 
+  subject to the following conditions: 
+
+  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Product. 
+
+  THE PRODUCT IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF 
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+  ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH 
+  THE PRODUCT OR THE USE OR OTHER DEALINGS IN THE PRODUCT.
+
+  query.h - Aggregate queries over the archive and raw files.
+
+*/
+
+#ifndef QUERY_H_
+#define QUERY_H_
+
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <vector>
+#include "platform.h"
+#include "archive.h"
+
+// the value a query looks at
+enum { QUERY_TEMPERATURE, QUERY_PRESSURE, QUERY_ALTITUDE };
+
+// periods to group samples by that aren't a fixed number of minutes
+#define QUERY_PERIOD_ALL 0
+#define QUERY_PERIOD_MONTH -1
+
+// query the most detailed series each Logger has
+#define QUERY_SERIES_FINEST -1
+
+typedef struct
+{
+    int field;
+    // minutes in each period, or QUERY_PERIOD_ALL or QUERY_PERIOD_MONTH
+    long period;
+    // times of the first and last samples to include
+    long startTime;
+    long endTime;
+    // minutes per sample, ARCHIVE_SERIES_SNAPSHOTS, or QUERY_SERIES_FINEST
+    int series;
+    // only query the Logger with this device key, if not 0
+    const _TCHAR* deviceKey;
+    bool metric;
+} QueryOptions;
+
+// the totals for one period, in the units of SAMPLE_TO_TEMPERATURE, SAMPLE_TO_PRESSURE, or SAMPLE_TO_ALTITUDE
+typedef struct
+{
+    unsigned long count;
+    long min;
+    long max;
+    double sum;
+    // total of the increases and decreases between samples in a row, like the total ascent and descent
+    long rise;
+    long fall;
+} QueryTotals;
+
+// totals for each period, by the time the period starts
+typedef std::map<long, QueryTotals> QueryBuckets;
+
+// one month of one series in a Logger's archive, or one raw file, and what was found in it
+struct QueryTask
+{
+    tstring path;
+    bool raw;
+    // the raw file was named on the command line, rather than found in a directory, so it must be a raw file
+    bool named;
+    int series;
+    long startTime;
+    long endTime;
+    bool ok;
+    QueryBuckets buckets;
+    // the first and last samples found, to join up the rise and fall with the next month
+    unsigned long count;
+    long firstTime;
+    long firstValue;
+    long lastTime;
+    long lastValue;
+    // samples found in a raw file, for each series
+    std::map<int, std::vector<ArchiveRecord> > rawRecords;
+    // messages about this task, printed in order when the query is finished
+    std::wostringstream log;
+};
+
+// shared by the threads of a query
+typedef struct
+{
+    const QueryOptions* pOptions;
+    std::vector<QueryTask*> tasks;
+    // a buffer for each worker to read samples into
+    std::vector<std::vector<ArchiveRecord> > records;
+} QueryContext;
+
+bool ParseQueryField(const _TCHAR* str, int& field);
+bool ParseQueryPeriod(const _TCHAR* str, long& period);
+bool ParseQueryTime(const _TCHAR* str, bool end, long& time);
+void AggregateRecords(const ArchiveRecord* pRecords, size_t count, int series, const QueryOptions& options, QueryBuckets& buckets);
+void QueryWorker(void* pContext, size_t task, int worker);
+bool QueryData(const _TCHAR* directory, const std::vector<tstring>& rawPaths, const QueryOptions& options, int numWorkers);
+
+#endif /* QUERY_H_ */
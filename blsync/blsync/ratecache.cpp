@@ -0,0 +1,155 @@
+/* 
+  Copyright (c) 2011 Steve Chamberlin
+  Permission is hereby granted, free of charge, to any person obtaining a copy of this hardware, software, and associated documentation 
+  files (the "Product"), to deal in the Product without restriction, including without limitation the rights to use, copy, modify, merge, 
+  publish, distribute, sublicense, and/or sell copies of the Product, and to permit persons to whom the Product is furnished to do so, 
+  subject to the following conditions: 
+
+  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Product. 
+
+  THE PRODUCT IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF 
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+  ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH 
+  THE PRODUCT OR THE USE OR OTHER DEALINGS IN THE PRODUCT.
+
+  ratecache.cpp - Remembers the bit rate that works for each Logger between syncs.
+
+*/
+
+#include <stdio.h>
+#include <string>
+#include "ratecache.h"
+#include "blsync.h"
+
+using namespace std;
+
+// longest line in the cache file
+#define RATE_CACHE_LINE 512
+
+/* 
+    LoadRateCache
+    Reads the cached bit rates from a file, one Logger per line with its device key, bit rate, whether it 
+    supports calibration, and the port it was last synced on. Lines that can't be read are skipped.
+    Returns true if successful, false if the file couldn't be opened.
+*/
+bool LoadRateCache(const _TCHAR* filename, RateCache& cache)
+{
+    FILE* pFile = _tfopen(filename, _T("rb"));
+    if (pFile == 0)
+        return false;
+
+    char line[RATE_CACHE_LINE];
+    while (fgets(line, sizeof(line), pFile))
+    {
+        char* pFields = strchr(line, ' ');
+        if (pFields == 0 || pFields == line)
+            continue;
+        string key(line, pFields);
+
+        unsigned long bitRate;
+        int calibrate;
+        int portStart = 0;
+        if (sscanf_s(pFields, "%lu %d %n", &bitRate, &calibrate, &portStart) != 2 || portStart == 0 || bitRate == 0)
+            continue;
+
+        // the port name is the rest of the line, which may include spaces
+        string port = pFields + portStart;
+        while (!port.empty() && (port[port.size()-1] == '\n' || port[port.size()-1] == '\r'))
+        {
+            port.erase(port.size()-1);
+        }
+
+        CachedRate rate;
+        rate.bitRate = bitRate;
+        rate.calibrate = (calibrate != 0);
+        rate.portName.assign(port.begin(), port.end());
+        cache[tstring(key.begin(), key.end())] = rate;
+    }
+
+    fclose(pFile);
+    return true;
+}
+
+/* 
+    SaveRateCache
+    Writes the cached bit rates to a file, replacing it.
+    Returns true if successful, false if an error occurred.
+*/
+bool SaveRateCache(const _TCHAR* filename, const RateCache& cache, wostream& log)
+{
+    FILE* pFile = _tfopen(filename, _T("wb"));
+    if (pFile == 0)
+    {
+        ReportFileError(log);
+        return false;
+    }
+
+    bool result = true;
+    for (RateCache::const_iterator it = cache.begin(); it != cache.end() && result; ++it)
+    {
+        // device keys and port names are plain ASCII
+        string key(it->first.begin(), it->first.end());
+        string port(it->second.portName.begin(), it->second.portName.end());
+
+        char buf[64];
+        sprintf_s(buf, 64, " %lu %d ", it->second.bitRate, it->second.calibrate ? 1 : 0);
+        string line = key + buf + port + "\n";
+        result = WriteFileString(pFile, line.c_str(), log);
+    }
+
+    if (fclose(pFile) != 0)
+    {
+        ReportFileError(log);
+        result = false;
+    }
+    return result;
+}
+
+/* 
+    FindPortRate
+    Finds the cached bit rate of the Logger that was last synced on the given port.
+    Returns the cached rate, or 0 if there isn't one.
+*/
+const CachedRate* FindPortRate(const RateCache& cache, const tstring& portName)
+{
+    for (RateCache::const_iterator it = cache.begin(); it != cache.end(); ++it)
+    {
+        if (it->second.portName == portName)
+            return &it->second;
+    }
+    return 0;
+}
+
+/* 
+    UpdateRateCache
+    Remembers the bit rate that worked for a Logger. Any other Logger last synced on the same port is 
+    forgotten, since it's no longer there.
+    Returns true if the cache changed, false if it was already up to date.
+*/
+bool UpdateRateCache(RateCache& cache, const tstring& deviceKey, const tstring& portName, unsigned long bitRate, bool calibrate)
+{
+    bool changed = false;
+    RateCache::iterator it = cache.begin();
+    while (it != cache.end())
+    {
+        if (it->first != deviceKey && it->second.portName == portName)
+        {
+            cache.erase(it++);
+            changed = true;
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    CachedRate& rate = cache[deviceKey];
+    if (rate.bitRate != bitRate || rate.calibrate != calibrate || rate.portName != portName)
+    {
+        rate.bitRate = bitRate;
+        rate.calibrate = calibrate;
+        rate.portName = portName;
+        changed = true;
+    }
+    return changed;
+}
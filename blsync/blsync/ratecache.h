@@ -0,0 +1,44 @@
+/* 
+  Copyright (c) 2011 Steve Chamberlin
+  Permission is hereby granted, free of charge, to any person obtaining a copy of this hardware, software, and associated documentation 
+  files (the "Product"), to deal in the Product without restriction, including without limitation the rights to use, copy, modify, merge, 
+  publish, distribute, sublicense, and/or sell copies of the Product, and to permit persons to whom the Product is furnished to do so, 
+  subject to the following conditions: 
+
+  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Product. 
+
+  THE PRODUCT IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF 
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+  ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH 
+  THE PRODUCT OR THE USE OR OTHER DEALINGS IN THE PRODUCT.
+
+  ratecache.h - Remembers the bit rate that works for each Logger between syncs.
+
+*/
+
+#ifndef RATECACHE_H_
+#define RATECACHE_H_
+
+#include <iostream>
+#include <map>
+#include "platform.h"
+
+// the bit rate that last worked for one Logger
+typedef struct
+{
+    unsigned long bitRate;
+    // the Logger's firmware supports calibration
+    bool calibrate;
+    // the port the Logger was last synced on
+    tstring portName;
+} CachedRate;
+
+// cached rates by device key
+typedef std::map<tstring, CachedRate> RateCache;
+
+bool LoadRateCache(const _TCHAR* filename, RateCache& cache);
+bool SaveRateCache(const _TCHAR* filename, const RateCache& cache, std::wostream& log);
+const CachedRate* FindPortRate(const RateCache& cache, const tstring& portName);
+bool UpdateRateCache(RateCache& cache, const tstring& deviceKey, const tstring& portName, unsigned long bitRate, bool calibrate);
+
+#endif /* RATECACHE_H_ */
@@ -0,0 +1,272 @@
+/* 
+  Copyright (c) 2011 Steve Chamberlin
+  Permission is hereby granted, free of charge, to any person obtaining a copy of this hardware, software, and associated documentation 
+  files (the "Product"), to deal in the Product without restriction, including without limitation the rights to use, copy, modify, merge, 
+  publish, distribute, sublicense, and/or sell copies of the Product, and to permit persons to whom the Product is furnished to do so, 
+  subject to the following conditions: 
+
+  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Product. 
+
+  THE PRODUCT IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF 
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+  ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH 
+  THE PRODUCT OR THE USE OR OTHER DEALINGS IN THE PRODUCT.
+
+  sampledata.cpp - Portable decoding of the sample data the Logger sends, without copying it.
+
+*/
+
+#include "sampledata.h"
+
+// SIMD versions of DecodeSamples, for x86 processors. SSE2 is always there on x64, and AVX2 is used if the
+// compiler is told to target it, with -mavx2 or /arch:AVX2. Other processors use the scalar version, as do
+// builds with DECODE_SCALAR_ONLY defined, which the tests use to check the versions against each other.
+#ifndef DECODE_SCALAR_ONLY
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define DECODE_AVX2
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define DECODE_SSE2
+#endif
+#endif
+
+/* 
+    DecodeSamples
+    Unpacks a series of packed samples into separate arrays for each field, in the units of SAMPLE_TO_TEMPERATURE, 
+    SAMPLE_TO_PRESSURE, and SAMPLE_TO_ALTITUDE: degrees F * 2, millibars * 2, and feet / 2. Each of those only
+    adds an offset, since the fields are whole steps of the scale. Decodes 8 or 16 samples at a time with SSE2 
+    or AVX2, and the rest one at a time.
+*/
+void DecodeSamples(const unsigned char* pData, size_t count, short* pTemperature, short* pPressure, short* pAltitude)
+{
+    size_t i = 0;
+
+#ifdef DECODE_AVX2
+    {
+        const __m256i temperatureMask = _mm256_set1_epi32((1 << TEMPERATURE_BITS) - 1);
+        const __m256i pressureMask = _mm256_set1_epi32((1 << PRESSURE_BITS) - 1);
+        const __m256i temperatureOffset = _mm256_set1_epi32(SAMPLE_TO_TEMPERATURE(0));
+        const __m256i pressureOffset = _mm256_set1_epi32(SAMPLE_TO_PRESSURE(0));
+        const __m256i altitudeOffset = _mm256_set1_epi32(SAMPLE_TO_ALTITUDE(0));
+
+        for (; i + 16 <= count; i += 16)
+        {
+            __m256i w0 = _mm256_loadu_si256((const __m256i*)(pData + SAMPLE_BYTES * i));
+            __m256i w1 = _mm256_loadu_si256((const __m256i*)(pData + SAMPLE_BYTES * (i + 8)));
+
+            __m256i t0 = _mm256_add_epi32(_mm256_and_si256(_mm256_srli_epi32(w0, TEMPERATURE_SHIFT), temperatureMask), temperatureOffset);
+            __m256i t1 = _mm256_add_epi32(_mm256_and_si256(_mm256_srli_epi32(w1, TEMPERATURE_SHIFT), temperatureMask), temperatureOffset);
+            __m256i p0 = _mm256_add_epi32(_mm256_and_si256(_mm256_srli_epi32(w0, PRESSURE_SHIFT), pressureMask), pressureOffset);
+            __m256i p1 = _mm256_add_epi32(_mm256_and_si256(_mm256_srli_epi32(w1, PRESSURE_SHIFT), pressureMask), pressureOffset);
+            __m256i a0 = _mm256_add_epi32(_mm256_srli_epi32(w0, ALTITUDE_SHIFT), altitudeOffset);
+            __m256i a1 = _mm256_add_epi32(_mm256_srli_epi32(w1, ALTITUDE_SHIFT), altitudeOffset);
+
+            // packing works within each 128 bit half, so put the 64 bit quarters back in order afterwards
+            _mm256_storeu_si256((__m256i*)(pTemperature + i), _mm256_permute4x64_epi64(_mm256_packs_epi32(t0, t1), 0xD8));
+            _mm256_storeu_si256((__m256i*)(pPressure + i), _mm256_permute4x64_epi64(_mm256_packs_epi32(p0, p1), 0xD8));
+            _mm256_storeu_si256((__m256i*)(pAltitude + i), _mm256_permute4x64_epi64(_mm256_packs_epi32(a0, a1), 0xD8));
+        }
+    }
+#endif
+
+#ifdef DECODE_SSE2
+    {
+        const __m128i temperatureMask = _mm_set1_epi32((1 << TEMPERATURE_BITS) - 1);
+        const __m128i pressureMask = _mm_set1_epi32((1 << PRESSURE_BITS) - 1);
+        const __m128i temperatureOffset = _mm_set1_epi32(SAMPLE_TO_TEMPERATURE(0));
+        const __m128i pressureOffset = _mm_set1_epi32(SAMPLE_TO_PRESSURE(0));
+        const __m128i altitudeOffset = _mm_set1_epi32(SAMPLE_TO_ALTITUDE(0));
+
+        for (; i + 8 <= count; i += 8)
+        {
+            __m128i w0 = _mm_loadu_si128((const __m128i*)(pData + SAMPLE_BYTES * i));
+            __m128i w1 = _mm_loadu_si128((const __m128i*)(pData + SAMPLE_BYTES * (i + 4)));
+
+            __m128i t0 = _mm_add_epi32(_mm_and_si128(_mm_srli_epi32(w0, TEMPERATURE_SHIFT), temperatureMask), temperatureOffset);
+            __m128i t1 = _mm_add_epi32(_mm_and_si128(_mm_srli_epi32(w1, TEMPERATURE_SHIFT), temperatureMask), temperatureOffset);
+            __m128i p0 = _mm_add_epi32(_mm_and_si128(_mm_srli_epi32(w0, PRESSURE_SHIFT), pressureMask), pressureOffset);
+            __m128i p1 = _mm_add_epi32(_mm_and_si128(_mm_srli_epi32(w1, PRESSURE_SHIFT), pressureMask), pressureOffset);
+            __m128i a0 = _mm_add_epi32(_mm_srli_epi32(w0, ALTITUDE_SHIFT), altitudeOffset);
+            __m128i a1 = _mm_add_epi32(_mm_srli_epi32(w1, ALTITUDE_SHIFT), altitudeOffset);
+
+            _mm_storeu_si128((__m128i*)(pTemperature + i), _mm_packs_epi32(t0, t1));
+            _mm_storeu_si128((__m128i*)(pPressure + i), _mm_packs_epi32(p0, p1));
+            _mm_storeu_si128((__m128i*)(pAltitude + i), _mm_packs_epi32(a0, a1));
+        }
+    }
+#endif
+
+    for (; i < count; i++)
+    {
+        Sample sample = UnpackSample(pData + SAMPLE_BYTES * i);
+        pTemperature[i] = (short)SAMPLE_TO_TEMPERATURE(sample.temperature);
+        pPressure[i] = (short)SAMPLE_TO_PRESSURE(sample.pressure);
+        pAltitude[i] = (short)SAMPLE_TO_ALTITUDE(sample.altitude);
+    }
+}
+
+/* 
+    DecodeSampleValues
+    Unpacks a series of packed samples into degrees F, inches of mercury, and feet, computed the same way as
+    the CSV files always have been. Decodes in batches with DecodeSamples, and the loops that scale each batch
+    are simple enough for the compiler to vectorize.
+*/
+void DecodeSampleValues(const unsigned char* pData, size_t count, float* pTemperature, float* pPressure, float* pAltitude)
+{
+    short temperature[DECODE_BATCH_SIZE];
+    short pressure[DECODE_BATCH_SIZE];
+    short altitude[DECODE_BATCH_SIZE];
+
+    for (size_t start = 0; start < count; start += DECODE_BATCH_SIZE)
+    {
+        size_t n = count - start;
+        if (n > DECODE_BATCH_SIZE)
+        {
+            n = DECODE_BATCH_SIZE;
+        }
+        DecodeSamples(pData + SAMPLE_BYTES * start, n, temperature, pressure, altitude);
+
+        for (size_t i=0; i<n; i++)
+        {
+            pTemperature[start + i] = (float)temperature[i]/2;
+        }
+        for (size_t i=0; i<n; i++)
+        {
+            pPressure[start + i] = (float)pressure[i]/2*0.0295333727f;
+        }
+        for (size_t i=0; i<n; i++)
+        {
+            pAltitude[start + i] = (float)altitude[i]*2;
+        }
+    }
+}
+
+/* 
+    GetHeaderTime
+    Reads a time from a response header, stored as second, minute, hour, day, month, and year since 2000.
+*/
+void GetHeaderTime(const unsigned char* pTime, LoggerTime& t)
+{
+    t.second = pTime[0];
+    t.minute = pTime[1];
+    t.hour = pTime[2];
+    t.day = pTime[3];
+    t.month = pTime[4];
+    t.year = 2000 + pTime[5];
+}
+
+/* 
+    GetNewestSampleTime
+    Samples are taken when the number of minutes since midnight is a multiple of the minutes per sample.
+    Returns the time of the last sample taken at or before the given time.
+*/
+long GetNewestSampleTime(long nowTime, unsigned int minutesPerSample)
+{
+    if (minutesPerSample == 0)
+        return nowTime;
+
+    long minutesSinceMidnight = nowTime % 1440;
+    if (minutesSinceMidnight < 0)
+    {
+        minutesSinceMidnight += 1440;
+    }
+    return nowTime - minutesSinceMidnight % minutesPerSample;
+}
+
+/* 
+    GraphView::Parse
+    Checks that the data is a complete version 1 graph data response, and sets up the view of it.
+    Returns true if successful, false if the data is the wrong size or version.
+*/
+bool GraphView::Parse(const unsigned char* pData, size_t size)
+{
+    if (size < GRAPH_HEADER_BYTES || pData[0] != 1 ||
+        size != GRAPH_HEADER_BYTES + pData[1] * (SAMPLE_BYTES * (size_t)pData[2] + 2))
+        return false;
+
+    this->pData = pData;
+    numberOfGraphs = pData[1];
+    samplesPerGraph = pData[2];
+
+    LoggerTime t;
+    GetHeaderTime(&pData[3], t);
+    nowTime = TimeToMinutes(t);
+    return true;
+}
+
+/* 
+    GraphView::GetGraph
+    Returns the samples of one graph, from 0, ending with the newest sample before the "now" time. A graph 
+    with no sample interval has no samples.
+*/
+SampleView GraphView::GetGraph(int graph) const
+{
+    const unsigned char* pGraph = pData + GRAPH_HEADER_BYTES + graph * (SAMPLE_BYTES * samplesPerGraph + 2);
+    unsigned int minutesPerSample = (unsigned int)pGraph[0]*256 + pGraph[1];
+    if (minutesPerSample == 0)
+        return SampleView();
+
+    long firstTime = GetNewestSampleTime(nowTime, minutesPerSample) - (long)minutesPerSample * (samplesPerGraph-1);
+    return SampleView(pGraph + 2, samplesPerGraph, firstTime, minutesPerSample);
+}
+
+/* 
+    SnapshotView::Parse
+    Checks that the data is a complete version 1 snapshot data response, and sets up the view of it.
+    Returns true if successful, false if the data is the wrong size or version.
+*/
+bool SnapshotView::Parse(const unsigned char* pData, size_t size)
+{
+    if (size < SNAPSHOT_HEADER_BYTES || pData[0] != 1 || size != SNAPSHOT_HEADER_BYTES + SNAPSHOT_BYTES * (size_t)pData[1])
+        return false;
+
+    this->pData = pData + SNAPSHOT_HEADER_BYTES;
+    count = pData[1];
+    return true;
+}
+
+/* 
+    SnapshotView::GetTime
+    Returns the time of a snapshot, in minutes since 1/1/2000.
+*/
+long SnapshotView::GetTime(size_t i) const
+{
+    LoggerTime t;
+    UnpackTime(GetWord32(pData + SNAPSHOT_BYTES * i), t);
+    return TimeToMinutes(t);
+}
+
+/* 
+    NewSamplesView::Parse
+    Checks that the data starts with a complete version 1 samples response, and sets up the view of it.
+    Returns true if successful, false if the data is too short or the wrong version.
+*/
+bool NewSamplesView::Parse(const unsigned char* pData, size_t size)
+{
+    if (size < SAMPLES_HEADER_BYTES || pData[0] != 1 || size < SAMPLES_HEADER_BYTES + SAMPLE_BYTES * (size_t)pData[15])
+        return false;
+
+    this->pData = pData;
+    return true;
+}
+
+/* 
+    NewSamplesView::GetSamples
+    Returns the samples, ending with the newest sample before the "now" time in the header.
+*/
+SampleView NewSamplesView::GetSamples() const
+{
+    LoggerTime now;
+    GetHeaderTime(&pData[3], now);
+    unsigned int minutesPerSample = (unsigned int)pData[9]*256 + pData[10];
+    unsigned char count = pData[15];
+
+    long firstTime = GetNewestSampleTime(TimeToMinutes(now), minutesPerSample);
+    if (count > 0)
+    {
+        firstTime -= (long)minutesPerSample * (count-1);
+    }
+    return SampleView(pData + SAMPLES_HEADER_BYTES, count, firstTime, minutesPerSample);
+}
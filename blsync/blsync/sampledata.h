@@ -0,0 +1,193 @@
+/* 
+  Copyright (c) 2011 Steve Chamberlin
+  Permission is hereby granted, free of charge, to any person obtaining a copy of this hardware, software, and associated documentation 
+  files (the "Product"), to deal in the Product without restriction, including without limitation the rights to use, copy, modify, merge, 
+  publish, distribute, sublicense, and/or sell copies of the Product, and to permit persons to whom the Product is furnished to do so, 
+  subject to the following conditions: 
+
+  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Product. 
+
+  THE PRODUCT IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF 
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+  ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH 
+  THE PRODUCT OR THE USE OR OTHER DEALINGS IN THE PRODUCT.
+
+  sampledata.h - Portable decoding of the sample data the Logger sends, without copying it.
+
+*/
+
+#ifndef SAMPLEDATA_H_
+#define SAMPLEDATA_H_
+
+#include <stddef.h>
+#include <iterator>
+#include "protocol.h"
+
+/*
+    The Logger stores each sample as a 32 bit word, sent LSB first:
+    bits 0-7: temperature
+    bits 8-18: pressure
+    bits 19-31: altitude
+    A snapshot is a 32 bit packed time, LSB first, followed by its sample. These functions read the bytes 
+    directly, rather than casting them to the Sample bitfield struct, whose layout is up to the compiler.
+*/
+#define SAMPLE_BYTES 4
+#define SNAPSHOT_BYTES 8
+
+#define GRAPH_HEADER_BYTES 9
+#define SNAPSHOT_HEADER_BYTES 2
+#define SAMPLES_HEADER_BYTES 16
+
+// samples decoded at once by DecodeSampleValues
+#define DECODE_BATCH_SIZE 256
+
+#define TEMPERATURE_SHIFT 0
+#define PRESSURE_SHIFT (TEMPERATURE_SHIFT + TEMPERATURE_BITS)
+#define ALTITUDE_SHIFT (PRESSURE_SHIFT + PRESSURE_BITS)
+
+inline unsigned long GetWord32(const unsigned char* p)
+{
+    return p[0] | (p[1] << 8) | ((unsigned long)p[2] << 16) | ((unsigned long)p[3] << 24);
+}
+
+inline Sample UnpackSample(const unsigned char* p)
+{
+    unsigned long word = GetWord32(p);
+    Sample sample;
+    sample.temperature = (word >> TEMPERATURE_SHIFT) & ((1UL << TEMPERATURE_BITS) - 1);
+    sample.pressure = (word >> PRESSURE_SHIFT) & ((1UL << PRESSURE_BITS) - 1);
+    sample.altitude = (word >> ALTITUDE_SHIFT) & ((1UL << ALTITUDE_BITS) - 1);
+    return sample;
+}
+
+inline void PackSample(const Sample& sample, unsigned char* p)
+{
+    unsigned long word = ((unsigned long)sample.temperature << TEMPERATURE_SHIFT) | 
+        ((unsigned long)sample.pressure << PRESSURE_SHIFT) | 
+        ((unsigned long)sample.altitude << ALTITUDE_SHIFT);
+    for (int i=0; i<4; i++)
+    {
+        p[i] = (unsigned char)(word >> (8*i));
+    }
+}
+
+/*
+    SampleView
+    A series of packed samples in a buffer, taken at a fixed interval, and the time of each one in minutes 
+    since 1/1/2000. The buffer must outlive the view.
+*/
+class SampleView
+{
+public:
+    class const_iterator
+    {
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef Sample value_type;
+        typedef ptrdiff_t difference_type;
+        typedef const Sample* pointer;
+        typedef Sample reference;
+
+        const_iterator(const unsigned char* p, long time, long minutesPerSample) : p(p), t(time), minutesPerSample(minutesPerSample) {}
+        Sample operator*() const { return UnpackSample(p); }
+        long time() const { return t; }
+        const_iterator& operator++() { p += SAMPLE_BYTES; t += minutesPerSample; return *this; }
+        const_iterator operator++(int) { const_iterator old = *this; ++*this; return old; }
+        bool operator==(const const_iterator& other) const { return p == other.p; }
+        bool operator!=(const const_iterator& other) const { return p != other.p; }
+
+    private:
+        const unsigned char* p;
+        long t;
+        long minutesPerSample;
+    };
+
+    SampleView() : pData(0), count(0), firstTime(0), minutesPerSample(0) {}
+    SampleView(const unsigned char* pData, size_t count, long firstTime, unsigned int minutesPerSample) :
+        pData(pData), count(count), firstTime(firstTime), minutesPerSample(minutesPerSample) {}
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    Sample operator[](size_t i) const { return UnpackSample(pData + SAMPLE_BYTES * i); }
+    long GetTime(size_t i) const { return firstTime + (long)minutesPerSample * (long)i; }
+    unsigned int GetMinutesPerSample() const { return minutesPerSample; }
+    const_iterator begin() const { return const_iterator(pData, firstTime, minutesPerSample); }
+    const_iterator end() const { return const_iterator(pData + SAMPLE_BYTES * count, GetTime(count), minutesPerSample); }
+    const unsigned char* GetData() const { return pData; }
+
+private:
+    const unsigned char* pData;
+    size_t count;
+    long firstTime;
+    unsigned int minutesPerSample;
+};
+
+/*
+    GraphView
+    The graphs in a graph data response: the 9 byte header, then each graph's minutes per sample (MSB 
+    first) and samples, oldest first.
+*/
+class GraphView
+{
+public:
+    GraphView() : pData(0), numberOfGraphs(0), samplesPerGraph(0), nowTime(0) {}
+
+    bool Parse(const unsigned char* pData, size_t size);
+    int GetGraphCount() const { return numberOfGraphs; }
+    int GetSamplesPerGraph() const { return samplesPerGraph; }
+    long GetNowTime() const { return nowTime; }
+    SampleView GetGraph(int graph) const;
+
+private:
+    const unsigned char* pData;
+    int numberOfGraphs;
+    int samplesPerGraph;
+    long nowTime;
+};
+
+/*
+    SnapshotView
+    The snapshots in a snapshot data response: the 2 byte header, then the snapshots.
+*/
+class SnapshotView
+{
+public:
+    SnapshotView() : pData(0), count(0) {}
+
+    bool Parse(const unsigned char* pData, size_t size);
+    size_t size() const { return count; }
+    Sample operator[](size_t i) const { return UnpackSample(pData + SNAPSHOT_BYTES * i + 4); }
+    long GetTime(size_t i) const;
+
+private:
+    const unsigned char* pData;
+    size_t count;
+};
+
+/*
+    NewSamplesView
+    The samples in an incremental sync response: the 16 byte header, then the samples. Raw -i files hold 
+    one of these for each sync, so Parse allows more data after the samples, and GetByteCount says where 
+    the next one starts.
+*/
+class NewSamplesView
+{
+public:
+    NewSamplesView() : pData(0) {}
+
+    bool Parse(const unsigned char* pData, size_t size);
+    size_t GetByteCount() const { return SAMPLES_HEADER_BYTES + SAMPLE_BYTES * (size_t)pData[15]; }
+    unsigned char GetGeneration() const { return pData[2]; }
+    unsigned long GetFirstSequence() const { return GetWord32(pData + 11); }
+    SampleView GetSamples() const;
+
+private:
+    const unsigned char* pData;
+};
+
+void DecodeSamples(const unsigned char* pData, size_t count, short* pTemperature, short* pPressure, short* pAltitude);
+void DecodeSampleValues(const unsigned char* pData, size_t count, float* pTemperature, float* pPressure, float* pAltitude);
+void GetHeaderTime(const unsigned char* pTime, LoggerTime& t);
+long GetNewestSampleTime(long nowTime, unsigned int minutesPerSample);
+
+#endif /* SAMPLEDATA_H_ */
@@ -0,0 +1,503 @@
+/* 
+  Copyright (c) 2011 Steve Chamberlin
+  Permission is hereby granted, free of charge, to any person obtaining a copy of this hardware, software, and associated documentation 
+  files (the "Product"), to deal in the Product without restriction, including without limitation the rights to use, copy, modify, merge, 
+  publish, distribute, sublicense, and/or sell copies of the Product, and to permit persons to whom the Product is furnished to do so, 
+  subject to the following conditions: 
+
+  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Product. 
+
+  THE PRODUCT IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF 
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+  ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH 
+  THE PRODUCT OR THE USE OR OTHER DEALINGS IN THE PRODUCT.
+
+  sampledata_test.cpp - Checks the sample layout, the response parsers, and the sample decoding in libblsync. 
+  Run with "make test", or "make bench" to time the decoding.
+
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include "sampledata.h"
+#include "platform.h"
+
+// the version of DecodeSamples this was built with, chosen the same way as in sampledata.cpp
+#if defined(DECODE_SCALAR_ONLY)
+#define DECODE_VERSION "scalar"
+#elif defined(__AVX2__)
+#define DECODE_VERSION "AVX2"
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DECODE_VERSION "SSE2"
+#else
+#define DECODE_VERSION "scalar"
+#endif
+
+// written past the end of the decoded samples, to catch the SIMD loops writing too far
+#define GUARD_VALUE ((short)0x7A5A)
+#define GUARD_COUNT 16
+
+static int failures = 0;
+
+#define CHECK(cond) \
+    do { if (!(cond)) { printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); failures++; } } while (0)
+
+/* 
+    SetWord32
+    Stores a 32 bit word LSB first, the way the Logger sends it.
+*/
+static void SetWord32(unsigned char* p, unsigned long word)
+{
+    for (int i=0; i<4; i++)
+    {
+        p[i] = (unsigned char)(word >> (8*i));
+    }
+}
+
+/* 
+    SetHeaderTime
+    Stores 6/15/2011 12:30:00 in a response header, which is 6024270 minutes since 1/1/2000.
+*/
+#define HEADER_TIME_MINUTES 6024270L
+
+static void SetHeaderTime(unsigned char* pTime)
+{
+    pTime[0] = 0;
+    pTime[1] = 30;
+    pTime[2] = 12;
+    pTime[3] = 15;
+    pTime[4] = 6;
+    pTime[5] = 11;
+}
+
+/* 
+    TestSampleLayout
+    Unpacks known words, with each field at its limits, and packs them again.
+*/
+static void TestSampleLayout()
+{
+    static const struct
+    {
+        unsigned long word;
+        unsigned int temperature;
+        unsigned int pressure;
+        unsigned int altitude;
+    } cases[] = {
+        { 0x00000000UL, 0, 0, 0 },
+        { 0x000000FFUL, 255, 0, 0 },
+        { 0x0007FF00UL, 0, 2047, 0 },
+        { 0xFFF80000UL, 0, 0, 8191 },
+        { 0x00000100UL, 0, 1, 0 },
+        { 0x00080000UL, 0, 0, 1 },
+        { 0x80000000UL, 0, 0, 4096 },
+        { 0xFFFFFFFFUL, 255, 2047, 8191 },
+        // 0x5A3 << 8 | 0xA5, and 0x1234 << 19
+        { 0x91A5A3A5UL, 0xA5, 0x5A3, 0x1234 },
+    };
+
+    for (size_t c=0; c<sizeof(cases)/sizeof(cases[0]); c++)
+    {
+        unsigned char bytes[4];
+        SetWord32(bytes, cases[c].word);
+        CHECK(GetWord32(bytes) == cases[c].word);
+
+        Sample sample = UnpackSample(bytes);
+        CHECK(sample.temperature == cases[c].temperature);
+        CHECK(sample.pressure == cases[c].pressure);
+        CHECK(sample.altitude == cases[c].altitude);
+
+        unsigned char packed[4];
+        PackSample(sample, packed);
+        CHECK(memcmp(packed, bytes, 4) == 0);
+    }
+
+    // each bit of the word lands in exactly one field
+    for (int bit=0; bit<32; bit++)
+    {
+        unsigned char bytes[4];
+        SetWord32(bytes, 1UL << bit);
+        Sample sample = UnpackSample(bytes);
+        unsigned long fields = (unsigned long)sample.temperature | ((unsigned long)sample.pressure << 8) | ((unsigned long)sample.altitude << 19);
+        CHECK(fields == 1UL << bit);
+    }
+}
+
+/* 
+    TestGraphView
+    Builds a graph data response with 2 graphs of 3 samples, and checks it is parsed, and that damaged 
+    copies of it are not.
+*/
+static void TestGraphView()
+{
+    unsigned char data[GRAPH_HEADER_BYTES + 2 * (2 + 3 * SAMPLE_BYTES) + 1];
+    size_t size = sizeof(data) - 1;
+    memset(data, 0, sizeof(data));
+
+    data[0] = 1;
+    data[1] = 2;
+    data[2] = 3;
+    SetHeaderTime(&data[3]);
+
+    // 15 and 300 minutes per sample, MSB first
+    unsigned char* pGraph = data + GRAPH_HEADER_BYTES;
+    pGraph[0] = 0;
+    pGraph[1] = 15;
+    for (int i=0; i<3; i++)
+    {
+        SetWord32(pGraph + 2 + SAMPLE_BYTES * i, 0x00000100UL * (i + 1));
+    }
+    pGraph += 2 + 3 * SAMPLE_BYTES;
+    pGraph[0] = 1;
+    pGraph[1] = 44;
+    for (int i=0; i<3; i++)
+    {
+        SetWord32(pGraph + 2 + SAMPLE_BYTES * i, 0x00080000UL * (i + 1));
+    }
+
+    GraphView view;
+    CHECK(view.Parse(data, size));
+    CHECK(view.GetGraphCount() == 2);
+    CHECK(view.GetSamplesPerGraph() == 3);
+    CHECK(view.GetNowTime() == HEADER_TIME_MINUTES);
+
+    SampleView graph = view.GetGraph(0);
+    CHECK(graph.size() == 3);
+    CHECK(graph.GetMinutesPerSample() == 15);
+    CHECK(graph.GetTime(2) == HEADER_TIME_MINUTES);
+    CHECK(graph.GetTime(0) == HEADER_TIME_MINUTES - 30);
+    CHECK(graph[0].pressure == 1 && graph[2].pressure == 3 && graph[2].altitude == 0);
+
+    // 12:30 is 150 minutes past the last multiple of 300 minutes since midnight
+    graph = view.GetGraph(1);
+    CHECK(graph.size() == 3);
+    CHECK(graph.GetMinutesPerSample() == 300);
+    CHECK(graph.GetTime(2) == HEADER_TIME_MINUTES - 150);
+    CHECK(graph[0].altitude == 1 && graph[2].altitude == 3 && graph[2].pressure == 0);
+
+    GraphView bad;
+    CHECK(!bad.Parse(data, size - 1));
+    CHECK(!bad.Parse(data, size + 1));
+    CHECK(!bad.Parse(data, GRAPH_HEADER_BYTES - 1));
+    CHECK(!bad.Parse(data, 0));
+    data[0] = 2;
+    CHECK(!bad.Parse(data, size));
+    data[0] = 0;
+    CHECK(!bad.Parse(data, size));
+    data[0] = 1;
+
+    // a header claiming more graphs than were sent
+    data[1] = 3;
+    CHECK(!bad.Parse(data, size));
+    data[1] = 2;
+    CHECK(bad.Parse(data, size));
+
+    // no graphs at all is still a valid response
+    unsigned char empty[GRAPH_HEADER_BYTES] = { 1, 0, 0 };
+    CHECK(bad.Parse(empty, sizeof(empty)));
+    CHECK(bad.GetGraphCount() == 0);
+}
+
+/* 
+    TestSnapshotView
+    Builds a snapshot data response with 2 snapshots, and checks it is parsed, and that damaged copies of 
+    it are not.
+*/
+static void TestSnapshotView()
+{
+    unsigned char data[SNAPSHOT_HEADER_BYTES + 2 * SNAPSHOT_BYTES + 1];
+    size_t size = sizeof(data) - 1;
+    memset(data, 0, sizeof(data));
+
+    data[0] = 1;
+    data[1] = 2;
+
+    // packed times are minute + 60 * (hour + 24 * (day + 32 * (month + 13 * year)))
+    unsigned long packedTime = 30 + 60 * (12 + 24 * (15 + 32 * (6 + 13 * 11UL)));
+    SetWord32(data + SNAPSHOT_HEADER_BYTES, packedTime);
+    SetWord32(data + SNAPSHOT_HEADER_BYTES + 4, 0x000000FFUL);
+    SetWord32(data + SNAPSHOT_HEADER_BYTES + SNAPSHOT_BYTES, packedTime + 1);
+    SetWord32(data + SNAPSHOT_HEADER_BYTES + SNAPSHOT_BYTES + 4, 0xFFF80000UL);
+
+    SnapshotView view;
+    CHECK(view.Parse(data, size));
+    CHECK(view.size() == 2);
+    CHECK(view.GetTime(0) == HEADER_TIME_MINUTES);
+    CHECK(view.GetTime(1) == HEADER_TIME_MINUTES + 1);
+    CHECK(view[0].temperature == 255 && view[0].altitude == 0);
+    CHECK(view[1].altitude == 8191 && view[1].temperature == 0);
+
+    SnapshotView bad;
+    CHECK(!bad.Parse(data, size - 1));
+    CHECK(!bad.Parse(data, size - SNAPSHOT_BYTES));
+    CHECK(!bad.Parse(data, size + 1));
+    CHECK(!bad.Parse(data, 1));
+    CHECK(!bad.Parse(data, 0));
+    data[0] = 2;
+    CHECK(!bad.Parse(data, size));
+    data[0] = 1;
+    data[1] = 3;
+    CHECK(!bad.Parse(data, size));
+    data[1] = 2;
+    CHECK(bad.Parse(data, size));
+}
+
+/* 
+    TestNewSamplesView
+    Builds a samples response with 4 samples, and checks it is parsed, and that damaged copies of it are 
+    not. More data may follow the samples, as in raw -i files.
+*/
+static void TestNewSamplesView()
+{
+    unsigned char data[SAMPLES_HEADER_BYTES + 4 * SAMPLE_BYTES + 8];
+    size_t size = sizeof(data) - 8;
+    memset(data, 0, sizeof(data));
+
+    data[0] = 1;
+    data[2] = 7;
+    SetHeaderTime(&data[3]);
+    data[9] = 0;
+    data[10] = 20;
+    SetWord32(&data[11], 0x01020304UL);
+    data[15] = 4;
+    for (int i=0; i<4; i++)
+    {
+        SetWord32(data + SAMPLES_HEADER_BYTES + SAMPLE_BYTES * i, (unsigned long)(i + 1));
+    }
+
+    NewSamplesView view;
+    CHECK(view.Parse(data, size));
+    CHECK(view.GetByteCount() == size);
+    CHECK(view.GetGeneration() == 7);
+    CHECK(view.GetFirstSequence() == 0x01020304UL);
+
+    // 12:30 is 10 minutes past the last multiple of 20 minutes since midnight
+    SampleView samples = view.GetSamples();
+    CHECK(samples.size() == 4);
+    CHECK(samples.GetMinutesPerSample() == 20);
+    CHECK(samples.GetTime(3) == HEADER_TIME_MINUTES - 10);
+    CHECK(samples.GetTime(0) == HEADER_TIME_MINUTES - 70);
+    CHECK(samples[0].temperature == 1 && samples[3].temperature == 4);
+
+    NewSamplesView next;
+    CHECK(next.Parse(data, sizeof(data)));
+    CHECK(next.GetByteCount() == size);
+
+    NewSamplesView bad;
+    CHECK(!bad.Parse(data, size - 1));
+    CHECK(!bad.Parse(data, SAMPLES_HEADER_BYTES - 1));
+    CHECK(!bad.Parse(data, 0));
+    data[0] = 2;
+    CHECK(!bad.Parse(data, size));
+    data[0] = 1;
+    data[15] = 5;
+    CHECK(!bad.Parse(data, size));
+    CHECK(bad.Parse(data, size + SAMPLE_BYTES));
+    data[15] = 0;
+    CHECK(bad.Parse(data, SAMPLES_HEADER_BYTES));
+    CHECK(bad.GetSamples().empty());
+}
+
+/* 
+    RandomWord
+    A repeatable series of 32 bit words, from a linear congruential generator.
+*/
+static unsigned long RandomWord(unsigned long& state)
+{
+    state = state * 1664525UL + 1013904223UL;
+    unsigned long high = (state >> 16) & 0xFFFF;
+    state = state * 1664525UL + 1013904223UL;
+    return ((high << 16) | ((state >> 16) & 0xFFFF)) & 0xFFFFFFFFUL;
+}
+
+/* 
+    MakeRandomSamples
+    Fills a buffer with packed samples, starting at the given byte offset so the SIMD loads aren't aligned. 
+    The first few are all zeros and all ones, to check the extremes of each field.
+*/
+static void MakeRandomSamples(std::vector<unsigned char>& buffer, size_t offset, size_t count, unsigned long& state)
+{
+    buffer.assign(offset + SAMPLE_BYTES * count, 0);
+    for (size_t i=0; i<count; i++)
+    {
+        unsigned long word = i == 0 ? 0 : i == 1 ? 0xFFFFFFFFUL : RandomWord(state);
+        SetWord32(&buffer[offset + SAMPLE_BYTES * i], word);
+    }
+}
+
+/* 
+    CheckDecodedField
+    Checks that one decoded array matches the scalar arithmetic, and that nothing was written after it.
+*/
+static bool CheckDecodedField(const std::vector<short>& decoded, size_t offset, const std::vector<short>& expected)
+{
+    size_t count = expected.size();
+    for (size_t i=0; i<count; i++)
+    {
+        if (decoded[offset + i] != expected[i])
+        {
+            printf("  sample %u of %u: decoded %d, expected %d\n", (unsigned int)i, (unsigned int)count, decoded[offset + i], expected[i]);
+            return false;
+        }
+    }
+    for (size_t i=0; i<GUARD_COUNT; i++)
+    {
+        if (decoded[offset + count + i] != GUARD_VALUE)
+        {
+            printf("  wrote past sample %u of %u\n", (unsigned int)(count + i), (unsigned int)count);
+            return false;
+        }
+    }
+    return true;
+}
+
+/* 
+    TestDecodeSamples
+    Decodes random samples with DecodeSamples, and checks each field against UnpackSample and the SAMPLE_TO 
+    macros, one sample at a time. The counts cover every leftover after the 8 and 16 sample SIMD loops, and 
+    the buffers start at every byte offset.
+*/
+static void TestDecodeSamples()
+{
+    std::vector<size_t> counts;
+    for (size_t count=0; count<=40; count++)
+    {
+        counts.push_back(count);
+    }
+    counts.push_back(DECODE_BATCH_SIZE - 1);
+    counts.push_back(DECODE_BATCH_SIZE);
+    counts.push_back(DECODE_BATCH_SIZE + 1);
+    counts.push_back(1000);
+    counts.push_back(1007);
+
+    unsigned long state = 12345;
+    std::vector<unsigned char> buffer;
+    for (size_t c=0; c<counts.size(); c++)
+    {
+        size_t count = counts[c];
+        for (size_t offset=0; offset<SAMPLE_BYTES; offset++)
+        {
+            MakeRandomSamples(buffer, offset, count, state);
+            const unsigned char* pData = buffer.empty() ? 0 : &buffer[offset];
+
+            std::vector<short> expectedTemperature(count), expectedPressure(count), expectedAltitude(count);
+            for (size_t i=0; i<count; i++)
+            {
+                Sample sample = UnpackSample(pData + SAMPLE_BYTES * i);
+                expectedTemperature[i] = (short)SAMPLE_TO_TEMPERATURE(sample.temperature);
+                expectedPressure[i] = (short)SAMPLE_TO_PRESSURE(sample.pressure);
+                expectedAltitude[i] = (short)SAMPLE_TO_ALTITUDE(sample.altitude);
+            }
+
+            // the outputs are misaligned by the same offset, in shorts
+            std::vector<short> temperature(offset + count + GUARD_COUNT, GUARD_VALUE);
+            std::vector<short> pressure(offset + count + GUARD_COUNT, GUARD_VALUE);
+            std::vector<short> altitude(offset + count + GUARD_COUNT, GUARD_VALUE);
+            DecodeSamples(pData, count, &temperature[offset], &pressure[offset], &altitude[offset]);
+
+            if (!CheckDecodedField(temperature, offset, expectedTemperature) ||
+                !CheckDecodedField(pressure, offset, expectedPressure) ||
+                !CheckDecodedField(altitude, offset, expectedAltitude))
+            {
+                printf("%s DecodeSamples failed for %u samples at offset %u\n", DECODE_VERSION, (unsigned int)count, (unsigned int)offset);
+                failures++;
+            }
+        }
+    }
+}
+
+/* 
+    TestDecodeSampleValues
+    Decodes enough random samples to take several batches, and checks them against the float arithmetic the 
+    CSV files have always used.
+*/
+static void TestDecodeSampleValues()
+{
+    const size_t count = DECODE_BATCH_SIZE * 3 + 5;
+    unsigned long state = 54321;
+    std::vector<unsigned char> buffer;
+    MakeRandomSamples(buffer, 0, count, state);
+
+    std::vector<float> temperature(count), pressure(count), altitude(count);
+    DecodeSampleValues(&buffer[0], count, &temperature[0], &pressure[0], &altitude[0]);
+
+    for (size_t i=0; i<count; i++)
+    {
+        Sample sample = UnpackSample(&buffer[SAMPLE_BYTES * i]);
+        if (temperature[i] != (float)SAMPLE_TO_TEMPERATURE(sample.temperature)/2 ||
+            pressure[i] != (float)SAMPLE_TO_PRESSURE(sample.pressure)/2*0.0295333727f ||
+            altitude[i] != (float)SAMPLE_TO_ALTITUDE(sample.altitude)*2)
+        {
+            printf("%s DecodeSampleValues failed at sample %u\n", DECODE_VERSION, (unsigned int)i);
+            failures++;
+            return;
+        }
+    }
+}
+
+/* 
+    Benchmark
+    Times decoding a million random samples, with DecodeSamples and with UnpackSample one at a time.
+*/
+static void Benchmark()
+{
+    const size_t count = 1000000;
+    const int passes = 100;
+    unsigned long state = 1;
+    std::vector<unsigned char> buffer;
+    MakeRandomSamples(buffer, 0, count, state);
+    std::vector<short> temperature(count), pressure(count), altitude(count);
+
+    // the checksums keep the compiler from skipping the work
+    long checksum = 0;
+    unsigned long start = GetMilliseconds();
+    for (int pass=0; pass<passes; pass++)
+    {
+        DecodeSamples(&buffer[0], count, &temperature[0], &pressure[0], &altitude[0]);
+        checksum += temperature[pass] + pressure[pass] + altitude[pass];
+    }
+    unsigned long batchTime = GetMilliseconds() - start;
+
+    long singleChecksum = 0;
+    start = GetMilliseconds();
+    for (int pass=0; pass<passes; pass++)
+    {
+        for (size_t i=0; i<count; i++)
+        {
+            Sample sample = UnpackSample(&buffer[SAMPLE_BYTES * i]);
+            temperature[i] = (short)SAMPLE_TO_TEMPERATURE(sample.temperature);
+            pressure[i] = (short)SAMPLE_TO_PRESSURE(sample.pressure);
+            altitude[i] = (short)SAMPLE_TO_ALTITUDE(sample.altitude);
+        }
+        singleChecksum += temperature[pass] + pressure[pass] + altitude[pass];
+    }
+    unsigned long singleTime = GetMilliseconds() - start;
+
+    printf("%s DecodeSamples: %.2f ns per sample, one at a time: %.2f ns per sample%s\n", DECODE_VERSION,
+        batchTime * 1e6 / ((double)count * passes), singleTime * 1e6 / ((double)count * passes),
+        checksum == singleChecksum ? "" : " (results differ!)");
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0)
+    {
+        Benchmark();
+        return 0;
+    }
+
+    TestSampleLayout();
+    TestGraphView();
+    TestSnapshotView();
+    TestNewSamplesView();
+    TestDecodeSamples();
+    TestDecodeSampleValues();
+
+    if (failures)
+    {
+        printf("%s: %d checks failed\n", DECODE_VERSION, failures);
+        return 1;
+    }
+    printf("%s: all checks passed\n", DECODE_VERSION);
+    return 0;
+}
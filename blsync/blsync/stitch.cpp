@@ -0,0 +1,421 @@
+/* 
+  Copyright (c) 2011 Steve Chamberlin
+  Permission is hereby granted, free of charge, to any person obtaining a copy of this hardware, software, and associated documentation 
+  files (the "Product"), to deal in the Product without restriction, including without limitation the rights to use, copy, modify, merge, 
+  publish, distribute, sublicense, and/or sell copies of the Product, and to permit persons to whom the Product is furnished to do so, 
+  subject to the following conditions: 
+
+  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Product. 
+
+  THE PRODUCT IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF 
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+  ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH 
+  THE PRODUCT OR THE USE OR OTHER DEALINGS IN THE PRODUCT.
+
+  stitch.cpp - Stitching repeated graph downloads into one continuous series.
+
+*/
+
+#include <stdio.h>
+#include <algorithm>
+#include <iostream>
+#include "stitch.h"
+#include "sampledata.h"
+#include "blsync.h"
+
+using namespace std;
+
+// a raw file that's mapped into memory, and when it was last used
+typedef struct
+{
+    size_t file;
+    MappedFile mapped;
+    unsigned long lastUse;
+} StitchFile;
+
+static bool CompareWindowTimes(const StitchWindow& a, const StitchWindow& b)
+{
+    return a.firstTime < b.firstTime;
+}
+
+static bool ComparePieceTimes(const StitchPiece& a, const StitchPiece& b)
+{
+    return a.startTime < b.startTime;
+}
+
+static bool RangeEndsBefore(const StitchRange& range, long time)
+{
+    return range.second < time;
+}
+
+/* 
+    GetGraphDownloadSize
+    Returns the size of the graph download at the start of some data, from its header, or 0 if there isn't 
+    a whole header.
+*/
+static size_t GetGraphDownloadSize(const unsigned char* pData, size_t size)
+{
+    if (size < GRAPH_HEADER_BYTES)
+        return 0;
+    return GRAPH_HEADER_BYTES + pData[1] * (SAMPLE_BYTES * (size_t)pData[2] + 2);
+}
+
+/* 
+    FindGraphWindows
+    Finds each graph in a raw graph file saved by blsync -r -g, and works out the times of its samples from 
+    the download's "now" time. A file can hold several downloads one after another. A file that isn't a 
+    raw graph file is skipped, unless it was named on the command line.
+    Returns true if successful, false if an error occurred.
+*/
+bool FindGraphWindows(const tstring& filename, size_t file, bool named, vector<StitchWindow>& windows, int& numDownloads, wostream& log)
+{
+    MappedFile mapped;
+    if (!MapFile(filename.c_str(), mapped))
+    {
+        log << "Error: " << filename.c_str() << " could not be read." << endl;
+        return false;
+    }
+
+    size_t firstWindow = windows.size();
+    int downloads = 0;
+    size_t pos = 0;
+    bool valid = (mapped.size > 0);
+    while (pos < mapped.size && valid)
+    {
+        size_t size = GetGraphDownloadSize(&mapped.pData[pos], mapped.size - pos);
+        GraphView graphs;
+        valid = (size > 0 && size <= mapped.size - pos && graphs.Parse(&mapped.pData[pos], size));
+        if (!valid)
+            break;
+
+        for (int g=0; g<graphs.GetGraphCount(); g++)
+        {
+            SampleView samples = graphs.GetGraph(g);
+            if (samples.empty())
+                continue;
+
+            StitchWindow window;
+            window.file = file;
+            window.offset = pos;
+            window.graph = g;
+            window.minutesPerSample = samples.GetMinutesPerSample();
+            window.firstTime = samples.GetTime(0);
+            window.lastTime = samples.GetTime(samples.size() - 1);
+            windows.push_back(window);
+        }
+
+        downloads++;
+        pos += size;
+    }
+
+    UnmapFile(mapped);
+
+    if (!valid)
+    {
+        windows.resize(firstWindow);
+        if (!named)
+            return true;
+
+        log << "Error: " << filename.c_str() << " is not a raw graph file saved by blsync." << endl;
+        return false;
+    }
+
+    numDownloads += downloads;
+    return true;
+}
+
+/* 
+    AddUncoveredPiece
+    Adds the samples of a window from start to end, leaving out any already covered by more detailed samples.
+    The pieces are trimmed to the times the window has samples for.
+*/
+static void AddUncoveredPiece(size_t window, const StitchWindow& w, long start, long end, const vector<StitchRange>& covered, vector<StitchPiece>& pieces)
+{
+    long m = w.minutesPerSample;
+    vector<StitchRange> uncovered;
+
+    // the covered ranges are in time order and don't overlap, so they're also in order of their ends
+    vector<StitchRange>::const_iterator it = lower_bound(covered.begin(), covered.end(), start, RangeEndsBefore);
+    long from = start;
+    for (; it != covered.end() && it->first <= end; ++it)
+    {
+        if (it->first > from)
+        {
+            uncovered.push_back(StitchRange(from, it->first - 1));
+        }
+        from = max(from, it->second + 1);
+    }
+    if (from <= end)
+    {
+        uncovered.push_back(StitchRange(from, end));
+    }
+
+    for (size_t i=0; i<uncovered.size(); i++)
+    {
+        StitchPiece piece;
+        piece.window = window;
+        piece.minutesPerSample = w.minutesPerSample;
+        piece.startTime = w.firstTime + (uncovered[i].first - w.firstTime + m - 1) / m * m;
+        piece.endTime = w.firstTime + (uncovered[i].second - w.firstTime) / m * m;
+        if (piece.startTime <= piece.endTime)
+        {
+            pieces.push_back(piece);
+        }
+    }
+}
+
+/* 
+    MakeStitchPieces
+    Chooses which samples to use from the windows with the given minutes per sample. Where windows overlap,
+    each time is only taken from the earliest window that has it, and times already covered by more detailed
+    samples are left out. windows must be sorted by the time of their first sample.
+*/
+void MakeStitchPieces(const vector<StitchWindow>& windows, unsigned int minutesPerSample, const vector<StitchRange>& covered, vector<StitchPiece>& pieces)
+{
+    long m = minutesPerSample;
+    bool started = false;
+    long nextTime = 0;
+
+    for (size_t i=0; i<windows.size(); i++)
+    {
+        const StitchWindow& w = windows[i];
+        if (w.minutesPerSample != minutesPerSample || (started && w.lastTime < nextTime))
+            continue;
+
+        long start = w.firstTime;
+        if (started && nextTime > start)
+        {
+            start = nextTime;
+        }
+
+        AddUncoveredPiece(i, w, start, w.lastTime, covered, pieces);
+        nextTime = w.lastTime + m;
+        started = true;
+    }
+}
+
+/* 
+    GetStitchFile
+    Returns the data of one of the files being stitched, mapping it into memory if it isn't already. Only a 
+    few files are kept mapped, and the one used longest ago is unmapped to make room.
+    Returns 0 if the file couldn't be read.
+*/
+static const MappedFile* GetStitchFile(const vector<tstring>& filenames, size_t file, vector<StitchFile>& cache, unsigned long& useCount, wostream& log)
+{
+    useCount++;
+    for (size_t i=0; i<cache.size(); i++)
+    {
+        if (cache[i].file == file)
+        {
+            cache[i].lastUse = useCount;
+            return &cache[i].mapped;
+        }
+    }
+
+    size_t slot = cache.size();
+    if (slot == STITCH_MAPPED_FILES)
+    {
+        slot = 0;
+        for (size_t i=1; i<cache.size(); i++)
+        {
+            if (cache[i].lastUse < cache[slot].lastUse)
+            {
+                slot = i;
+            }
+        }
+        UnmapFile(cache[slot].mapped);
+        cache.erase(cache.begin() + slot);
+    }
+
+    StitchFile entry;
+    entry.file = file;
+    entry.lastUse = useCount;
+    if (!MapFile(filenames[file].c_str(), entry.mapped))
+    {
+        log << "Error: " << filenames[file].c_str() << " could not be read." << endl;
+        return 0;
+    }
+    cache.push_back(entry);
+    return &cache.back().mapped;
+}
+
+/* 
+    StitchGraphs
+    Combines many graph downloads into one continuous series, saved as CSV or JSON Lines. Every download 
+    has the same few graphs at different sample intervals, and downloads overlap each other, so each time is 
+    taken from the most detailed graph that has it, and from the earliest download if several do. Coarser 
+    samples only fill in where no finer ones exist. Where there are no samples at all, the gap is flagged.
+    Only the times covered by each graph are kept while working this out, and the samples are read from the
+    raw files as they're written, so memory use doesn't grow with the number of samples.
+    Returns true if successful, false if an error occurred.
+*/
+bool StitchGraphs(const vector<tstring>& paths, const _TCHAR* filename, const ExportFormat& format)
+{
+    if (format.type == EXPORT_RAW)
+    {
+        wcout << "Error: stitched graphs can only be saved as CSV or JSON Lines." << endl;
+        return false;
+    }
+
+    vector<tstring> filenames;
+    vector<StitchWindow> windows;
+    int numDownloads = 0;
+    for (size_t i=0; i<paths.size(); i++)
+    {
+        vector<tstring> names;
+        bool directory = ListDirectory(paths[i].c_str(), names, false);
+        if (!directory)
+        {
+            names.push_back(tstring());
+        }
+        sort(names.begin(), names.end());
+
+        for (size_t n=0; n<names.size(); n++)
+        {
+            filenames.push_back(directory ? paths[i] + _T("/") + names[n] : paths[i]);
+            if (!FindGraphWindows(filenames.back(), filenames.size() - 1, !directory, windows, numDownloads, wcout))
+                return false;
+        }
+    }
+
+    if (windows.empty())
+    {
+        wcout << "Error: no graph downloads were found." << endl;
+        return false;
+    }
+
+    // choose the samples to use, finest first, so each coarser series only fills what's still uncovered
+    stable_sort(windows.begin(), windows.end(), CompareWindowTimes);
+    vector<unsigned int> intervals;
+    for (size_t i=0; i<windows.size(); i++)
+    {
+        intervals.push_back(windows[i].minutesPerSample);
+    }
+    sort(intervals.begin(), intervals.end());
+    intervals.erase(unique(intervals.begin(), intervals.end()), intervals.end());
+
+    vector<StitchPiece> pieces;
+    vector<StitchRange> covered;
+    for (size_t i=0; i<intervals.size(); i++)
+    {
+        MakeStitchPieces(windows, intervals[i], covered, pieces);
+
+        for (size_t w=0; w<windows.size(); w++)
+        {
+            if (windows[w].minutesPerSample == intervals[i])
+            {
+                covered.push_back(StitchRange(windows[w].firstTime, windows[w].lastTime));
+            }
+        }
+        sort(covered.begin(), covered.end());
+
+        // merge ranges that overlap or touch
+        size_t merged = 0;
+        for (size_t r=1; r<covered.size(); r++)
+        {
+            if (covered[r].first <= covered[merged].second + 1)
+            {
+                covered[merged].second = max(covered[merged].second, covered[r].second);
+            }
+            else
+            {
+                covered[++merged] = covered[r];
+            }
+        }
+        covered.resize(covered.empty() ? 0 : merged + 1);
+    }
+    sort(pieces.begin(), pieces.end(), ComparePieceTimes);
+
+    bool newFile;
+    FILE* pFile = OpenOutputFile(filename, false, newFile, wcout);
+    if (pFile == 0)
+        return false;
+
+    SampleWriter writer(pFile, format, wcout);
+    bool csv = (format.type == EXPORT_CSV);
+    vector<StitchFile> cache;
+    unsigned long useCount = 0;
+    unsigned long count = 0;
+    int numGaps = 0;
+    bool saved = true;
+    for (size_t p=0; p<pieces.size() && saved; p++)
+    {
+        const StitchPiece& piece = pieces[p];
+        const StitchWindow& w = windows[piece.window];
+        const MappedFile* pMapped = GetStitchFile(filenames, w.file, cache, useCount, wcout);
+        GraphView graphs;
+        if (pMapped == 0 || !graphs.Parse(&pMapped->pData[w.offset], GetGraphDownloadSize(&pMapped->pData[w.offset], pMapped->size - w.offset)))
+        {
+            saved = false;
+            break;
+        }
+
+        long m = piece.minutesPerSample;
+        SampleView graph = graphs.GetGraph(w.graph);
+        size_t first = (size_t)((piece.startTime - graph.GetTime(0)) / m);
+        SampleView samples(graph.GetData() + SAMPLE_BYTES * first, (size_t)((piece.endTime - piece.startTime) / m + 1), piece.startTime, m);
+
+        // it's only a gap if the time since the last sample is longer than the interval on either side of it
+        long gap = 0;
+        bool newSection = (p == 0);
+        if (p > 0)
+        {
+            long previousInterval = pieces[p-1].minutesPerSample;
+            if (piece.startTime - pieces[p-1].endTime > max(m, previousInterval))
+            {
+                gap = piece.startTime - pieces[p-1].endTime;
+                numGaps++;
+            }
+            newSection = (gap > 0 || m != previousInterval);
+        }
+
+        if (csv && newSection)
+        {
+            char buf[96];
+            if (p > 0)
+            {
+                saved = writer.WriteText("\n");
+            }
+            if (gap > 0)
+            {
+                sprintf_s(buf, 96, "Gap of %ld minutes since the previous sample\n", gap);
+                saved = saved && writer.WriteText(buf);
+            }
+            sprintf_s(buf, 96, "Samples every %ld minutes\n", m);
+            saved = saved && writer.WriteText(buf) && writer.WriteHeader();
+        }
+
+        writer.SetLabel("interval", m);
+        if (!csv && gap > 0)
+        {
+            // flag the first sample after the gap, with the minutes since the previous one
+            writer.AddLabel("gap_minutes", gap);
+            saved = saved && writer.WriteSample(samples.GetTime(0), 0, false, samples[0]);
+            writer.SetLabel("interval", m);
+            samples = SampleView(samples.GetData() + SAMPLE_BYTES, samples.size() - 1, samples.GetTime(1), m);
+            count++;
+        }
+
+        saved = saved && WriteSamples(writer, samples);
+        count += (unsigned long)samples.size();
+    }
+
+    for (size_t i=0; i<cache.size(); i++)
+    {
+        UnmapFile(cache[i].mapped);
+    }
+
+    saved = writer.Flush() && saved;
+    if (fclose(pFile) != 0 && saved)
+    {
+        ReportFileError(wcout);
+        saved = false;
+    }
+
+    if (saved)
+    {
+        wcout << "Stitched " << count << " samples from " << numDownloads << (numDownloads == 1 ? " graph download" : " graph downloads") << " into " << filename 
+            << " in " << GetFormatName(format) << " format, with " << numGaps << (numGaps == 1 ? " gap" : " gaps") << "." << endl;
+    }
+    return saved;
+}
@@ -0,0 +1,60 @@
+/* 
+  Copyright (c) 2011 Steve Chamberlin
+  Permission is hereby granted, free of charge, to any person obtaining a copy of this hardware, software, and associated documentation 
+  files (the "Product"), to deal in the Product without restriction, including without limitation the rights to use, copy, modify, merge, 
+  publish, distribute, sublicense, and/or sell copies of the Product, and to permit persons to whom the Product is furnished to do so, 
+  subject to the following conditions: 
+
+  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Product. 
+
+  THE PRODUCT IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF 
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+  ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH 
+  THE PRODUCT OR THE USE OR OTHER DEALINGS IN THE PRODUCT.
+
+  stitch.h - Stitching repeated graph downloads into one continuous series.
+
+*/
+
+#ifndef STITCH_H_
+#define STITCH_H_
+
+#include <iostream>
+#include <vector>
+#include "platform.h"
+#include "export.h"
+
+// most raw files kept mapped into memory at once while writing the stitched series
+#define STITCH_MAPPED_FILES 8
+
+// one graph in one graph download, found in a raw graph file
+typedef struct
+{
+    // the file, as an index into the list of files being stitched
+    size_t file;
+    // where the download starts in the file
+    size_t offset;
+    int graph;
+    unsigned int minutesPerSample;
+    // times of the first and last samples
+    long firstTime;
+    long lastTime;
+} StitchWindow;
+
+// a run of samples from one window that's used in the stitched series, from startTime to endTime inclusive
+typedef struct
+{
+    size_t window;
+    unsigned int minutesPerSample;
+    long startTime;
+    long endTime;
+} StitchPiece;
+
+// a time range that's already covered by more detailed samples
+typedef std::pair<long, long> StitchRange;
+
+bool FindGraphWindows(const tstring& filename, size_t file, bool named, std::vector<StitchWindow>& windows, int& numDownloads, std::wostream& log);
+void MakeStitchPieces(const std::vector<StitchWindow>& windows, unsigned int minutesPerSample, const std::vector<StitchRange>& covered, std::vector<StitchPiece>& pieces);
+bool StitchGraphs(const std::vector<tstring>& paths, const _TCHAR* filename, const ExportFormat& format);
+
+#endif /* STITCH_H_ */
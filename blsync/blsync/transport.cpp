@@ -0,0 +1,90 @@
+/* 
+  Copyright (c) 2011 Steve Chamberlin
+  Permission is hereby granted, free of charge, to any person obtaining a copy of this hardware, software, and associated documentation 
+  files (the "Product"), to deal in the Product without restriction, including without limitation the rights to use, copy, modify, merge, 
+  publish, distribute, sublicense, and/or sell copies of the Product, and to permit persons to whom the Product is furnished to do so, 
+  subject to the following conditions: 
+
+  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Product. 
+
+  THE PRODUCT IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF 
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+  ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH 
+  THE PRODUCT OR THE USE OR OTHER DEALINGS IN THE PRODUCT.
+
+  transport.cpp - Buffering common to all the transports.
+
+*/
+
+#include <string.h>
+#include "transport.h"
+
+Transport::Transport(std::wostream& log) :
+    log(log),
+    bufferStart(0),
+    bufferEnd(0)
+{
+}
+
+Transport::~Transport()
+{
+}
+
+/* 
+    Read
+    Reads up to a user-defined number of bytes, stopping early if nothing more arrives within timeout milliseconds.
+    Returns the number of bytes read, or -1 if an error occurred.
+*/
+int Transport::Read(void* pBuffer, int bytesToRead, int timeout)
+{
+    char* pDest = (char*)pBuffer;
+    int bytesRead = 0;
+
+    while (bytesRead < bytesToRead)
+    {
+        if (bufferStart == bufferEnd)
+        {
+            int result = ReadSome(buffer, TRANSPORT_BUFFER_SIZE, timeout);
+            if (result < 0)
+                return -1;
+            if (result == 0)
+                break;
+
+            bufferStart = 0;
+            bufferEnd = result;
+        }
+
+        int count = bufferEnd - bufferStart;
+        if (count > bytesToRead - bytesRead)
+        {
+            count = bytesToRead - bytesRead;
+        }
+
+        memcpy(pDest + bytesRead, buffer + bufferStart, count);
+        bufferStart += count;
+        bytesRead += count;
+    }
+
+    return bytesRead;
+}
+
+/* 
+    Write
+    Sends a user-defined number of bytes.
+    Returns true if successful, false if an error occurred.
+*/
+bool Transport::Write(const void* pBuffer, int bytesToWrite)
+{
+    return WriteAll((const char*)pBuffer, bytesToWrite);
+}
+
+/* 
+    Discard
+    Throws away any bytes that were received but not read yet.
+*/
+void Transport::Discard()
+{
+    bufferStart = 0;
+    bufferEnd = 0;
+    DiscardInput();
+}
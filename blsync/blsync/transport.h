@@ -0,0 +1,66 @@
+/* 
+  Copyright (c) 2011 Steve Chamberlin
+  Permission is hereby granted, free of charge, to any person obtaining a copy of this hardware, software, and associated documentation 
+  files (the "Product"), to deal in the Product without restriction, including without limitation the rights to use, copy, modify, merge, 
+  publish, distribute, sublicense, and/or sell copies of the Product, and to permit persons to whom the Product is furnished to do so, 
+  subject to the following conditions: 
+
+  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Product. 
+
+  THE PRODUCT IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF 
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+  ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH 
+  THE PRODUCT OR THE USE OR OTHER DEALINGS IN THE PRODUCT.
+
+  transport.h - Byte stream connections to the Logger: serial ports, and pseudo-terminals for testing.
+
+*/
+
+#ifndef TRANSPORT_H_
+#define TRANSPORT_H_
+
+#include <iostream>
+#include <vector>
+#include "platform.h"
+
+#define TRANSPORT_BUFFER_SIZE 4096
+
+// port name prefix that runs a command connected through a pseudo-terminal, instead of opening a serial port
+#define PTY_PORT_PREFIX _T("pty:")
+
+/*
+    Transport
+    A connection to the Logger. Incoming bytes are buffered, so callers can read them one at a time 
+    cheaply. Each backend only needs to supply the raw reads and writes. Errors are printed to the log
+    stream given when the connection was opened.
+*/
+class Transport
+{
+public:
+    Transport(std::wostream& log);
+    virtual ~Transport();
+
+    int Read(void* pBuffer, int bytesToRead, int timeout);
+    bool Write(const void* pBuffer, int bytesToWrite);
+    void Discard();
+
+protected:
+    // Waits up to timeout milliseconds for incoming bytes, then returns as many as are available without 
+    // waiting further. Returns the number of bytes read, 0 on timeout, or -1 if an error occurred.
+    virtual int ReadSome(char* pBuffer, int bufferSize, int timeout) = 0;
+    // Returns true if all the bytes were sent, false if an error occurred.
+    virtual bool WriteAll(const char* pBuffer, int bytesToWrite) = 0;
+    virtual void DiscardInput() = 0;
+
+    std::wostream& log;
+
+private:
+    char buffer[TRANSPORT_BUFFER_SIZE];
+    int bufferStart;
+    int bufferEnd;
+};
+
+Transport* OpenTransport(const _TCHAR* portName, unsigned long bitRate, std::wostream& log);
+void FindSerialPorts(std::vector<tstring>& portNames);
+
+#endif /* TRANSPORT_H_ */
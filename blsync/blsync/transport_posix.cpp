@@ -0,0 +1,372 @@
+/* 
+  Copyright (c) 2011 Steve Chamberlin
+  Permission is hereby granted, free of charge, to any person obtaining a copy of this hardware, software, and associated documentation 
+  files (the "Product"), to deal in the Product without restriction, including without limitation the rights to use, copy, modify, merge, 
+  publish, distribute, sublicense, and/or sell copies of the Product, and to permit persons to whom the Product is furnished to do so, 
+  subject to the following conditions: 
+
+  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Product. 
+
+  THE PRODUCT IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF 
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+  ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH 
+  THE PRODUCT OR THE USE OR OTHER DEALINGS IN THE PRODUCT.
+
+  transport_posix.cpp - Serial port and pseudo-terminal transports for Linux and other POSIX systems.
+
+*/
+
+#ifndef _WIN32
+
+#include <iostream>
+#include <errno.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <poll.h>
+#include <signal.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#ifdef __APPLE__
+#include <util.h>
+#else
+#include <pty.h>
+#endif
+#include "transport.h"
+
+using namespace std;
+
+#ifdef __linux__
+// in transport_termios2.cpp, since the kernel's termios definitions conflict with the C library's
+bool SetCustomBitRate(int fd, unsigned long bitRate);
+#endif
+
+class PosixTransport : public Transport
+{
+public:
+    PosixTransport(int fd, pid_t child, wostream& log);
+    virtual ~PosixTransport();
+
+protected:
+    virtual int ReadSome(char* pBuffer, int bufferSize, int timeout);
+    virtual bool WriteAll(const char* pBuffer, int bytesToWrite);
+    virtual void DiscardInput();
+
+private:
+    int fd;
+    // process on the other side of a pseudo-terminal, or -1 for a serial port
+    pid_t child;
+};
+
+/* 
+    ReportError
+    Print a descriptive error string for the most recent error.
+*/
+static void ReportError(wostream& log)
+{
+    log << "Error: " << strerror(errno) << endl;
+}
+
+PosixTransport::PosixTransport(int fd, pid_t child, wostream& log) :
+    Transport(log),
+    fd(fd),
+    child(child)
+{
+}
+
+PosixTransport::~PosixTransport()
+{
+    close(fd);
+
+    if (child > 0)
+    {
+        kill(child, SIGTERM);
+        waitpid(child, 0, 0);
+    }
+}
+
+int PosixTransport::ReadSome(char* pBuffer, int bufferSize, int timeout)
+{
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+
+    int result = poll(&pfd, 1, timeout);
+    if (result < 0)
+    {
+        // Ctrl-C during --follow interrupts the wait, which is just a timeout to the caller
+        if (errno == EINTR)
+            return 0;
+
+        ReportError(log);
+        return -1;
+    }
+    else if (result == 0)
+    {
+        return 0;
+    }
+
+    ssize_t bytesRead = read(fd, pBuffer, bufferSize);
+    if (bytesRead < 0)
+    {
+        if (errno == EINTR || errno == EAGAIN)
+            return 0;
+
+        // the pseudo-terminal reports EIO once the other side exits
+        if (child > 0 && errno == EIO)
+        {
+            log << "Error: the Logger emulator exited." << endl;
+            return -1;
+        }
+
+        ReportError(log);
+        return -1;
+    }
+    else if (bytesRead == 0)
+    {
+        log << "Error: the connection to the Logger was closed." << endl;
+        return -1;
+    }
+
+    return (int)bytesRead;
+}
+
+bool PosixTransport::WriteAll(const char* pBuffer, int bytesToWrite)
+{
+    while (bytesToWrite > 0)
+    {
+        ssize_t bytesSent = write(fd, pBuffer, bytesToWrite);
+        if (bytesSent < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            ReportError(log);
+            return false;
+        }
+
+        pBuffer += bytesSent;
+        bytesToWrite -= (int)bytesSent;
+    }
+
+    // wait until the bytes are on the wire, so the caller's pacing between writes holds
+    if (child < 0)
+    {
+        tcdrain(fd);
+    }
+
+    return true;
+}
+
+void PosixTransport::DiscardInput()
+{
+    tcflush(fd, TCIFLUSH);
+}
+
+/* 
+    GetSpeedConstant
+    Finds the termios speed constant for a standard bit rate.
+    Returns true if found, false if the bit rate isn't a standard one.
+*/
+static bool GetSpeedConstant(unsigned long bitRate, speed_t& speed)
+{
+    static const struct { unsigned long bitRate; speed_t speed; } speeds[] = 
+    {
+        { 1200, B1200 },
+        { 2400, B2400 },
+        { 4800, B4800 },
+        { 9600, B9600 },
+        { 19200, B19200 },
+        { 38400, B38400 },
+        { 57600, B57600 },
+        { 115200, B115200 },
+    };
+
+    for (size_t i=0; i<sizeof(speeds)/sizeof(speeds[0]); i++)
+    {
+        if (speeds[i].bitRate == bitRate)
+        {
+            speed = speeds[i].speed;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* 
+    SetPortAttributes
+    Puts a serial port or pseudo-terminal in raw mode, and sets the speed and data/parity/stop bits.
+    Returns true if successful, false if an error occurred.
+*/
+static bool SetPortAttributes(int fd, unsigned long bitRate, wostream& log)
+{
+    struct termios tio;
+    if (tcgetattr(fd, &tio) != 0)
+    {
+        ReportError(log);
+        return false;
+    }
+
+    // 8 data bits, no parity, one stop bit, no flow control, no character translation
+    cfmakeraw(&tio);
+    tio.c_cflag &= ~(CSTOPB | CRTSCTS);
+    tio.c_cflag |= CLOCAL | CREAD;
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = 0;
+
+    speed_t speed;
+    bool standardRate = GetSpeedConstant(bitRate, speed);
+    if (standardRate)
+    {
+        cfsetispeed(&tio, speed);
+        cfsetospeed(&tio, speed);
+    }
+
+    if (tcsetattr(fd, TCSANOW, &tio) != 0)
+    {
+        ReportError(log);
+        return false;
+    }
+
+    if (!standardRate)
+    {
+#ifdef __linux__
+        if (!SetCustomBitRate(fd, bitRate))
+        {
+            ReportError(log);
+            return false;
+        }
+#else
+        log << "Error: the bit rate " << bitRate << " is not supported on this system." << endl;
+        return false;
+#endif
+    }
+
+    return true;
+}
+
+/* 
+    OpenSerialPort
+    Open the requested serial port in raw mode, and set the speed and data/parity/stop bits.
+    Returns the new transport, or 0 if an error occurred.
+*/
+static Transport* OpenSerialPort(const char* portName, unsigned long bitRate, wostream& log)
+{
+    // open without waiting for carrier detect, then switch back to blocking mode
+    int fd = open(portName, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0)
+    {
+        if (errno == ENOENT)
+        {
+            log << "Error: Serial port " << portName << " does not exist." << endl;
+        }
+        else
+        {
+            ReportError(log);
+        }
+        return 0;
+    }
+
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+
+    if (!SetPortAttributes(fd, bitRate, log))
+    {
+        close(fd);
+        return 0;
+    }
+
+    tcflush(fd, TCIOFLUSH);
+    return new PosixTransport(fd, -1, log);
+}
+
+/* 
+    OpenPseudoTerminal
+    Runs a command with its standard input and output connected to a pseudo-terminal, for talking to
+    a Logger emulator instead of real hardware. The bit rate is set on the emulator's side, so it can
+    tell whether the host is using the rate it expects.
+    Returns the new transport, or 0 if an error occurred.
+*/
+static Transport* OpenPseudoTerminal(const char* command, unsigned long bitRate, wostream& log)
+{
+    int master, slave;
+    if (openpty(&master, &slave, 0, 0, 0) != 0)
+    {
+        ReportError(log);
+        return 0;
+    }
+
+    // keep emulators started by other sync threads from inheriting this one's terminal
+    fcntl(master, F_SETFD, FD_CLOEXEC);
+    fcntl(slave, F_SETFD, FD_CLOEXEC);
+
+    // the emulator sees raw bytes, just like the Logger's serial pins
+    if (!SetPortAttributes(slave, bitRate, log))
+    {
+        close(master);
+        close(slave);
+        return 0;
+    }
+
+    pid_t child = fork();
+    if (child < 0)
+    {
+        ReportError(log);
+        close(master);
+        close(slave);
+        return 0;
+    }
+
+    if (child == 0)
+    {
+        setsid();
+        dup2(slave, STDIN_FILENO);
+        dup2(slave, STDOUT_FILENO);
+        close(master);
+        close(slave);
+        execl("/bin/sh", "sh", "-c", command, (char*)0);
+        _exit(127);
+    }
+
+    close(slave);
+    return new PosixTransport(master, child, log);
+}
+
+/* 
+    OpenTransport
+    Open the requested serial port, or run the command following "pty:" with a pseudo-terminal.
+    Returns the new transport, or 0 if an error occurred.
+*/
+Transport* OpenTransport(const _TCHAR* portName, unsigned long bitRate, wostream& log)
+{
+    if (strncmp(portName, PTY_PORT_PREFIX, strlen(PTY_PORT_PREFIX)) == 0)
+        return OpenPseudoTerminal(portName + strlen(PTY_PORT_PREFIX), bitRate, log);
+
+    return OpenSerialPort(portName, bitRate, log);
+}
+
+/* 
+    FindSerialPorts
+    Adds the names of the USB serial ports that are present to the list. Built-in serial ports are left out,
+    since nearly every system has some whether or not anything is connected to them.
+*/
+void FindSerialPorts(vector<tstring>& portNames)
+{
+    static const char* patterns[] = { "/dev/ttyUSB*", "/dev/ttyACM*", "/dev/cu.usbserial*" };
+
+    for (size_t i=0; i<sizeof(patterns)/sizeof(patterns[0]); i++)
+    {
+        glob_t matches;
+        if (glob(patterns[i], 0, 0, &matches) == 0)
+        {
+            for (size_t m=0; m<matches.gl_pathc; m++)
+            {
+                portNames.push_back(matches.gl_pathv[m]);
+            }
+        }
+        globfree(&matches);
+    }
+}
+
+#endif /* _WIN32 */
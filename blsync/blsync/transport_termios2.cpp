@@ -0,0 +1,59 @@
+/* 
+  Copyright (c) 2011 Steve Chamberlin
+  Permission is hereby granted, free of charge, to any person obtaining a copy of this hardware, software, and associated documentation 
+  files (the "Product"), to deal in the Product without restriction, including without limitation the rights to use, copy, modify, merge, 
+  publish, distribute, sublicense, and/or sell copies of the Product, and to permit persons to whom the Product is furnished to do so, 
+  subject to the following conditions: 
+
+  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Product. 
+
+  THE PRODUCT IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF 
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+  ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH 
+  THE PRODUCT OR THE USE OR OTHER DEALINGS IN THE PRODUCT.
+
+  transport_termios2.cpp - Non-standard serial bit rates for Linux.
+
+*/
+
+#ifdef __linux__
+
+#include <sys/ioctl.h>
+#include <asm/termbits.h>
+
+/* 
+    SetCustomBitRate
+    Sets a bit rate that has no termios speed constant, such as the slightly-off rates tried when the 
+    Logger's clock is fast or slow. This uses the kernel's termios2 interface directly, because the 
+    C library's termios only supports the standard rates.
+    Returns true if successful, false if an error occurred.
+*/
+bool SetCustomBitRate(int fd, unsigned long bitRate)
+{
+    struct termios2 tio;
+    if (ioctl(fd, TCGETS2, &tio) != 0)
+        return false;
+
+    tio.c_cflag &= ~(CBAUD | (CBAUD << IBSHIFT));
+    tio.c_cflag |= BOTHER | (BOTHER << IBSHIFT);
+    tio.c_ispeed = bitRate;
+    tio.c_ospeed = bitRate;
+
+    return ioctl(fd, TCSETS2, &tio) == 0;
+}
+
+/* 
+    GetCustomBitRate
+    Gets the bit rate of a serial port or pseudo-terminal, including non-standard rates.
+    Returns the bit rate, or 0 if an error occurred.
+*/
+unsigned long GetCustomBitRate(int fd)
+{
+    struct termios2 tio;
+    if (ioctl(fd, TCGETS2, &tio) != 0)
+        return 0;
+
+    return tio.c_ospeed;
+}
+
+#endif /* __linux__ */
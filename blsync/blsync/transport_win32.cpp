@@ -0,0 +1,213 @@
+/* 
+  Copyright (c) 2011 Steve Chamberlin
+  Permission is hereby granted, free of charge, to any person obtaining a copy of this hardware, software, and associated documentation 
+  files (the "Product"), to deal in the Product without restriction, including without limitation the rights to use, copy, modify, merge, 
+  publish, distribute, sublicense, and/or sell copies of the Product, and to permit persons to whom the Product is furnished to do so, 
+  subject to the following conditions: 
+
+  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Product. 
+
+  THE PRODUCT IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF 
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+  ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH 
+  THE PRODUCT OR THE USE OR OTHER DEALINGS IN THE PRODUCT.
+
+  transport_win32.cpp - Serial port transport for Windows.
+
+*/
+
+#ifdef _WIN32
+
+#include <iostream>
+#include "transport.h"
+
+using namespace std;
+
+class Win32SerialTransport : public Transport
+{
+public:
+    Win32SerialTransport(HANDLE hSerial, wostream& log);
+    virtual ~Win32SerialTransport();
+
+protected:
+    virtual int ReadSome(char* pBuffer, int bufferSize, int timeout);
+    virtual bool WriteAll(const char* pBuffer, int bytesToWrite);
+    virtual void DiscardInput();
+
+private:
+    HANDLE hSerial;
+    DWORD currentTimeout;
+};
+
+/* 
+    ReportError
+    Print a descriptive error string for the most recent error.
+*/
+static void ReportError(wostream& log)
+{
+    _TCHAR lastError[1024];
+    FormatMessage(
+        FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_IGNORE_INSERTS,
+        NULL,
+        GetLastError(),
+        MAKELANGID(LANG_NEUTRAL, SUBLANG_DEFAULT),
+        lastError,
+        1024,
+        NULL);
+
+    log << "Error: " << lastError << endl;
+}
+
+Win32SerialTransport::Win32SerialTransport(HANDLE hSerial, wostream& log) :
+    Transport(log),
+    hSerial(hSerial),
+    currentTimeout(0)
+{
+}
+
+Win32SerialTransport::~Win32SerialTransport()
+{
+    CloseHandle(hSerial);
+}
+
+int Win32SerialTransport::ReadSome(char* pBuffer, int bufferSize, int timeout)
+{
+    if (timeout < 1)
+    {
+        timeout = 1;
+    }
+
+    // Return as soon as any bytes are available, or after the timeout if none arrive. The timeouts
+    // only need to be changed when a different timeout is requested.
+    if ((DWORD)timeout != currentTimeout)
+    {
+        COMMTIMEOUTS timeouts={0};
+        timeouts.ReadIntervalTimeout=MAXDWORD;
+        timeouts.ReadTotalTimeoutMultiplier=MAXDWORD;
+        timeouts.ReadTotalTimeoutConstant=timeout;
+        timeouts.WriteTotalTimeoutConstant=50;
+        timeouts.WriteTotalTimeoutMultiplier=10;
+
+        if (!SetCommTimeouts(hSerial, &timeouts))
+        {
+            ReportError(log);
+            return -1;
+        }
+
+        currentTimeout = timeout;
+    }
+
+    DWORD dwBytesRead = 0;
+    if (!ReadFile(hSerial, pBuffer, bufferSize, &dwBytesRead, NULL))
+    {
+        ReportError(log);
+        return -1;
+    }
+
+    return (int)dwBytesRead;
+}
+
+bool Win32SerialTransport::WriteAll(const char* pBuffer, int bytesToWrite)
+{
+    DWORD dwBytesSent = 0;
+    if (!WriteFile(hSerial, pBuffer, bytesToWrite, &dwBytesSent, NULL))
+    {
+        ReportError(log);
+        return false;
+    }
+    else if (dwBytesSent != bytesToWrite)
+    {
+        log << "Error: failed to send the command to the Logger." << endl;
+        return false;
+    }
+
+    return true;
+}
+
+void Win32SerialTransport::DiscardInput()
+{
+    PurgeComm(hSerial, PURGE_RXCLEAR);
+}
+
+/* 
+    OpenTransport
+    Open the requested serial port, and set the speed and data/parity/stop bits.
+    Returns the new transport, or 0 if an error occurred.
+*/
+Transport* OpenTransport(const _TCHAR* portName, unsigned long bitRate, wostream& log)
+{
+    if (_tcsncmp(portName, PTY_PORT_PREFIX, _tcslen(PTY_PORT_PREFIX)) == 0)
+    {
+        log << "Error: pseudo-terminal ports are not supported on Windows." << endl;
+        return 0;
+    }
+
+    HANDLE hSerial;
+    hSerial = CreateFile(portName,
+        GENERIC_READ | GENERIC_WRITE,
+        0,
+        0,
+        OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL,
+        0);
+
+    if (hSerial == INVALID_HANDLE_VALUE)
+    {
+        if (GetLastError() == ERROR_FILE_NOT_FOUND)
+        {
+            log << "Error: Serial port " << portName << " does not exist." << endl;
+        }
+        else
+        {
+            ReportError(log);
+        }
+        return 0;
+    }
+
+    DCB dcbSerialParams = {0};
+    dcbSerialParams.DCBlength = sizeof(dcbSerialParams);
+    
+    if (!GetCommState(hSerial, &dcbSerialParams)) 
+    {
+        ReportError(log);
+        CloseHandle(hSerial);
+        return 0;
+    }
+
+    dcbSerialParams.BaudRate = bitRate;
+    dcbSerialParams.ByteSize = 8;
+    dcbSerialParams.Parity = NOPARITY;
+    dcbSerialParams.StopBits = ONESTOPBIT;
+    
+    if (!SetCommState(hSerial, &dcbSerialParams))
+    {
+        ReportError(log);
+        CloseHandle(hSerial);
+        return 0;
+    }
+
+    return new Win32SerialTransport(hSerial, log);
+}
+
+/* 
+    FindSerialPorts
+    Adds the names of the COM ports that are present to the list.
+*/
+void FindSerialPorts(vector<tstring>& portNames)
+{
+    for (int i=1; i<=255; i++)
+    {
+        _TCHAR deviceName[16];
+        _TCHAR target[MAX_PATH];
+        _stprintf_s(deviceName, 16, _T("COM%d"), i);
+        if (QueryDosDevice(deviceName, target, MAX_PATH) == 0)
+            continue;
+
+        // ports above COM9 can only be opened with the device namespace prefix
+        tstring portName = (i > 9) ? _T("\\\\.\\") : _T("");
+        portName += deviceName;
+        portNames.push_back(portName);
+    }
+}
+
+#endif /* _WIN32 */
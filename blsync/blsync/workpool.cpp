@@ -0,0 +1,162 @@
+/* 
+  Copyright (c) 2011 Steve Chamberlin
+  Permission is hereby granted, free of charge, to any person obtaining a copy of this hardware, software, and associated documentation 
+  files (the "Product"), to deal in the Product without restriction, including without limitation the rights to use, copy, modify, merge, 
+  publish, distribute, sublicense, and/or sell copies of the Product, and to permit persons to whom the Product is furnished to do so, 
+  subject to the following conditions: 
+
+  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Product. 
+
+  THE PRODUCT IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF 
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+  ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH 
+  THE PRODUCT OR THE USE OR OTHER DEALINGS IN THE PRODUCT.
+
+  workpool.cpp - A work-stealing thread pool for independent tasks.
+
+*/
+
+#include "workpool.h"
+
+using namespace std;
+
+/* 
+    TakeTask
+    Takes the next task from a worker's own queue. 
+    Returns true if there was one, false if the queue is empty.
+*/
+static bool TakeTask(WorkQueue& queue, size_t& task)
+{
+    LockMutex(queue.mutex);
+    bool found = (queue.next < queue.end);
+    if (found)
+    {
+        task = queue.next++;
+    }
+    UnlockMutex(queue.mutex);
+    return found;
+}
+
+/* 
+    StealTasks
+    Moves the back half of another worker's remaining tasks to an empty queue. Stealing from the back 
+    leaves the victim the tasks it was about to start, and taking half means steals are rare.
+    Returns true if any tasks were stolen.
+*/
+static bool StealTasks(WorkQueue& victim, WorkQueue& thief)
+{
+    LockMutex(victim.mutex);
+    size_t remaining = victim.end - victim.next;
+    size_t stolen = remaining - remaining / 2;
+    size_t end = victim.end;
+    victim.end -= stolen;
+    UnlockMutex(victim.mutex);
+
+    if (stolen == 0)
+        return false;
+
+    LockMutex(thief.mutex);
+    thief.next = end - stolen;
+    thief.end = end;
+    UnlockMutex(thief.mutex);
+    return true;
+}
+
+/* 
+    PoolWorker
+    Thread function for a work pool. Runs the tasks in its own queue, and when that's empty, steals from
+    the others in turn, until there's nothing left anywhere.
+*/
+static void PoolWorker(void* pContext)
+{
+    WorkPool* pPool = (WorkPool*)pContext;
+    int numWorkers = (int)pPool->queues.size();
+
+    LockMutex(pPool->startMutex);
+    int worker = pPool->nextWorker++;
+    UnlockMutex(pPool->startMutex);
+
+    WorkQueue& queue = pPool->queues[worker];
+    while (true)
+    {
+        size_t task;
+        if (TakeTask(queue, task))
+        {
+            pPool->function(pPool->pContext, task, worker);
+            continue;
+        }
+
+        // a queue only grows when its own worker steals, so once every queue is seen empty, the work is done
+        bool stolen = false;
+        for (int i=1; i<numWorkers && !stolen; i++)
+        {
+            stolen = StealTasks(pPool->queues[(worker + i) % numWorkers], queue);
+        }
+        if (!stolen)
+            break;
+    }
+}
+
+/* 
+    RunTasks
+    Runs numbered tasks on several threads and waits for them all to finish. Each worker starts with an 
+    equal share of the tasks, in order, and steals from the others when it runs out, so uneven tasks still 
+    keep every thread busy. numWorkers less than 1 means one per processor.
+    Returns the number of workers used, which tells the task function how many worker numbers there are.
+*/
+int RunTasks(size_t numTasks, int numWorkers, TaskFunction function, void* pContext)
+{
+    if (numWorkers < 1)
+    {
+        numWorkers = GetProcessorCount();
+    }
+    if (numWorkers > WORKPOOL_MAX_WORKERS)
+    {
+        numWorkers = WORKPOOL_MAX_WORKERS;
+    }
+    if ((size_t)numWorkers > numTasks)
+    {
+        numWorkers = (numTasks > 0) ? (int)numTasks : 1;
+    }
+
+    WorkPool pool;
+    pool.function = function;
+    pool.pContext = pContext;
+    pool.queues.resize(numWorkers);
+    pool.nextWorker = 0;
+    InitMutex(pool.startMutex);
+
+    for (int i=0; i<numWorkers; i++)
+    {
+        pool.queues[i].next = numTasks * i / numWorkers;
+        pool.queues[i].end = numTasks * (i + 1) / numWorkers;
+        InitMutex(pool.queues[i].mutex);
+    }
+
+    vector<ThreadHandle> threads(numWorkers);
+    int numStarted = 0;
+    while (numStarted < numWorkers && StartThread(threads[numStarted], PoolWorker, &pool))
+    {
+        numStarted++;
+    }
+
+    // any worker that couldn't be started has its tasks stolen by the others, or if none started, they're 
+    // run here instead
+    if (numStarted == 0)
+    {
+        PoolWorker(&pool);
+    }
+
+    for (int i=0; i<numStarted; i++)
+    {
+        JoinThread(threads[i]);
+    }
+
+    for (int i=0; i<numWorkers; i++)
+    {
+        DestroyMutex(pool.queues[i].mutex);
+    }
+    DestroyMutex(pool.startMutex);
+
+    return numWorkers;
+}
@@ -0,0 +1,51 @@
+/* 
+  Copyright (c) 2011 Steve Chamberlin
+  Permission is hereby granted, free of charge, to any person obtaining a copy of this hardware, software, and associated documentation 
+  files (the "Product"), to deal in the Product without restriction, including without limitation the rights to use, copy, modify, merge, 
+  publish, distribute, sublicense, and/or sell copies of the Product, and to permit persons to whom the Product is furnished to do so, 
+  subject to the following conditions: 
+
+  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Product. 
+
+  THE PRODUCT IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF 
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+  ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH 
+  THE PRODUCT OR THE USE OR OTHER DEALINGS IN THE PRODUCT.
+
+  workpool.h - A work-stealing thread pool for independent tasks.
+
+*/
+
+#ifndef WORKPOOL_H_
+#define WORKPOOL_H_
+
+#include <stddef.h>
+#include <vector>
+#include "platform.h"
+
+// most threads in a pool
+#define WORKPOOL_MAX_WORKERS 64
+
+// runs one task, numbered from 0, on the given worker thread, numbered from 0
+typedef void (*TaskFunction)(void* pContext, size_t task, int worker);
+
+// the tasks one worker has left, from next up to but not including end
+typedef struct
+{
+    size_t next;
+    size_t end;
+    Mutex mutex;
+} WorkQueue;
+
+typedef struct
+{
+    TaskFunction function;
+    void* pContext;
+    std::vector<WorkQueue> queues;
+    Mutex startMutex;
+    int nextWorker;
+} WorkPool;
+
+int RunTasks(size_t numTasks, int numWorkers, TaskFunction function, void* pContext);
+
+#endif /* WORKPOOL_H_ */
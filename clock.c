@@ -184,6 +184,23 @@ char* MakePastTimeString(char* str, uint16_t timeAgo)
 	return str;
 }
 	
+// the current time as ((((year*13 + month)*32 + day)*24 + hour)*60 + minute), the format used for snapshots
+uint32_t ClockGetPackedTime()
+{
+	uint32_t packedYearMonthDayHourMin;
+	
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		packedYearMonthDayHourMin = clock_year;
+		packedYearMonthDayHourMin = packedYearMonthDayHourMin*13 + clock_month;
+		packedYearMonthDayHourMin = packedYearMonthDayHourMin*32 + clock_day;
+		packedYearMonthDayHourMin = packedYearMonthDayHourMin*24 + clock_hour;
+		packedYearMonthDayHourMin = packedYearMonthDayHourMin*60 + clock_minute;
+	}
+	
+	return packedYearMonthDayHourMin;
+}
+	
 void ClockInit()
 {
 	clock_year = 0;
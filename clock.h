@@ -33,6 +33,7 @@ char* MakeDateString(char* str, uint8_t day, uint8_t month);
 char* MakeShortTimeString(char* str, uint8_t hour, uint8_t minute);
 char* MakeTimeString(char* str, uint8_t hour, uint8_t minute, uint8_t second);
 char* MakePastTimeString(char* str, uint16_t timeAgo);
+uint32_t ClockGetPackedTime();
 void ClockInit();
 void ClockTick();
 
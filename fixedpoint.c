@@ -0,0 +1,60 @@
+/* 
+  Copyright (c) 2011 Steve Chamberlin
+  Permission is hereby granted, free of charge, to any person obtaining a copy of this hardware, software, and associated documentation 
+  files (the "Product"), to deal in the Product without restriction, including without limitation the rights to use, copy, modify, merge, 
+  publish, distribute, sublicense, and/or sell copies of the Product, and to permit persons to whom the Product is furnished to do so, 
+  subject to the following conditions: 
+
+  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Product. 
+
+  THE PRODUCT IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF 
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+  ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH 
+  THE PRODUCT OR THE USE OR OTHER DEALINGS IN THE PRODUCT.
+*/
+
+// Number formatting with integer math, so the floating point formatting code isn't needed.
+
+#include <stdlib.h>
+
+#include "fixedpoint.h"
+
+static const uint16_t powersOfTen[] = { 1, 10, 100, 1000 };
+
+// writes numerator / denominator with the given number of decimal places (up to 3), rounded half away from zero.
+// The string matches dtostrf(numerator / denominator, 1, places, str), including the minus sign of a negative
+// value that rounds to zero. numerator * 2 * 10^places must fit in 32 bits. Returns the end of the string.
+char* MakeFixedPointString(char* str, int32_t numerator, uint16_t denominator, uint8_t places)
+{
+	if (numerator < 0)
+	{
+		*str++ = '-';
+		numerator = -numerator;
+	}
+	
+	uint16_t scale = powersOfTen[places];
+	uint32_t scaled = ((uint32_t)numerator * scale * 2 + denominator) / (2 * (uint32_t)denominator);
+	
+	ultoa(scaled / scale, str, 10);
+	while (*str)
+	{
+		str++;
+	}
+	
+	if (places != 0)
+	{
+		*str++ = '.';
+		
+		// the fraction's digits, with leading zeros
+		uint16_t fraction = scaled % scale;
+		for (uint8_t i=places; i>0; i--)
+		{
+			str[i-1] = '0' + fraction % 10;
+			fraction /= 10;
+		}
+		str += places;
+		*str = 0;
+	}
+	
+	return str;
+}
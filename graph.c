@@ -0,0 +1,369 @@
+/* 
+  Copyright (c) 2011 Steve Chamberlin
+  Permission is hereby granted, free of charge, to any person obtaining a copy of this hardware, software, and associated documentation 
+  files (the "Product"), to deal in the Product without restriction, including without limitation the rights to use, copy, modify, merge, 
+  publish, distribute, sublicense, and/or sell copies of the Product, and to permit persons to whom the Product is furnished to do so, 
+  subject to the following conditions: 
+
+  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Product. 
+
+  THE PRODUCT IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF 
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+  ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH 
+  THE PRODUCT OR THE USE OR OTHER DEALINGS IN THE PRODUCT.
+*/
+
+// Graph rendering shared by the display drivers. The graph is drawn one column at a time, as page bytes that
+// the driver writes with vertical addressing.
+//
+// While exploring, the columns are spaced by the timescale being explored, but each column's sample comes
+// from the finest timescale that still holds a sample for that time. The view can be panned back past the
+// start of its own timescale, as far as the longest timescale reaches.
+
+#include <avr/pgmspace.h>
+#include <util/atomic.h>
+
+#include "graph.h"
+#include "clock.h"
+
+volatile int16_t graphCurrentYMin;
+volatile int16_t graphCurrentYMax;
+volatile int16_t graphYMin[GRAPH_COUNT];
+volatile int16_t graphYMax[GRAPH_COUNT];
+volatile uint8_t graphDrawPoints[GRAPH_COUNT];
+
+// pixels of a page from the given row to the bottom, and from the top to the given row. Bit 0 is the top row.
+static const prog_uint8_t graphSpanFrom[8] = { 0xFF, 0xFE, 0xFC, 0xF8, 0xF0, 0xE0, 0xC0, 0x80 };
+static const prog_uint8_t graphSpanTo[8] = { 0x01, 0x03, 0x07, 0x0F, 0x1F, 0x3F, 0x7F, 0xFF };
+
+static uint16_t GraphRawValue(Sample* pSample, uint8_t type)
+{
+	if (type == GRAPH_TEMPERATURE)
+		return pSample->temperature;
+	else if (type == GRAPH_PRESSURE)
+		return pSample->pressure;
+	else
+		return pSample->altitude;
+}
+
+static uint8_t SampleIsFilled(Sample* pSample)
+{
+	return pSample->temperature != 0 || pSample->pressure != 0 || pSample->altitude != 0;
+}
+
+// minutes since the newest sample of the timescale was taken. Samples are taken when the minute of the day is
+// a multiple of the timescale's minutes per sample.
+static uint8_t NewestSampleAge(uint8_t timescaleNumber)
+{
+	uint16_t minutesOfDay;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		minutesOfDay = clock_hour * 60 + clock_minute;
+	}
+	
+	return minutesOfDay % minutesPerSample[timescaleNumber];
+}
+
+// the furthest the explorer's right-most column can be moved back, so the left-most column reaches the oldest
+// sample of the longest timescale
+static uint16_t MaxMinutesAgo(uint8_t timescaleNumber)
+{
+	return (SAMPLES_PER_GRAPH - 1) * (minutesPerSample[NUM_TIME_SCALES-1] - minutesPerSample[timescaleNumber]);
+}
+
+// minutes between now and the time shown in column x
+uint16_t GraphColumnMinutesAgo(const Graph* pGraph, uint8_t x)
+{
+	uint8_t timescaleNumber = pGraph->timescaleNumber;
+	return pGraph->newestSampleAge[timescaleNumber] + pGraph->minutesAgo + (SAMPLES_PER_GRAPH - 1 - x) * minutesPerSample[timescaleNumber];
+}
+
+// the sample drawn in column x. Only the columns on screen are ever looked up.
+static Sample* GraphColumnSample(const Graph* pGraph, uint8_t x)
+{
+	static Sample emptySample;
+	uint8_t index;
+	
+	if (!pGraph->showCursor)
+	{
+		// the whole timescale, oldest sample on the left
+		index = pGraph->nextSampleIndex[pGraph->timescaleNumber] + x;
+		if (index >= SAMPLES_PER_GRAPH)
+			index -= SAMPLES_PER_GRAPH;
+		return GetSample(pGraph->timescaleNumber, index);
+	}
+	
+	uint16_t age = GraphColumnMinutesAgo(pGraph, x);
+	
+	for (uint8_t i=0; i<NUM_TIME_SCALES; i++)
+	{
+		uint8_t newestAge = pGraph->newestSampleAge[i];
+		if (age < newestAge)
+			continue;
+			
+		uint16_t samplesAgo = (age - newestAge) / minutesPerSample[i];
+		if (samplesAgo >= SAMPLES_PER_GRAPH)
+			continue;
+			
+		index = pGraph->nextSampleIndex[i] + (SAMPLES_PER_GRAPH - 1) - samplesAgo;
+		if (index >= SAMPLES_PER_GRAPH)
+			index -= SAMPLES_PER_GRAPH;
+			
+		Sample* pSample = GetSample(i, index);
+		if (SampleIsFilled(pSample))
+			return pSample;
+	}
+	
+	return &emptySample;
+}
+
+// find the graph's vertical range, from the user's axis limits or the min and max samples, and the value at the cursor
+void GraphFindRange(Graph* pGraph)
+{
+	uint8_t type = pGraph->type;
+	
+	for (uint8_t i=0; i<NUM_TIME_SCALES; i++)
+	{
+		pGraph->nextSampleIndex[i] = GetTimescaleNextSampleIndex(i);
+		pGraph->newestSampleAge[i] = NewestSampleAge(i);
+	}
+	
+	if (!pGraph->showCursor)
+	{
+		pGraph->minutesAgo = 0;
+	}
+	
+	uint16_t rawValue;
+	uint16_t minRawValue = INVALID_RAW_VALUE;
+	uint16_t maxRawValue = 0;
+	uint16_t rawCursorValue = INVALID_RAW_VALUE;
+	short minValue;
+	short maxValue;
+	
+	for (uint8_t x=0; x<SAMPLES_PER_GRAPH; x++)
+	{
+		Sample* pSample = GraphColumnSample(pGraph, x);
+		
+		// ignore unfilled samples
+		if (!SampleIsFilled(pSample))
+			continue;
+			
+		rawValue = GraphRawValue(pSample, type);
+		
+		if (rawValue > maxRawValue)
+			maxRawValue = rawValue;
+		if (rawValue < minRawValue)
+			minRawValue = rawValue;
+			
+		if (x == pGraph->cursorPos)
+		{
+			rawCursorValue = rawValue;
+		}
+	}
+	
+	if (type == GRAPH_TEMPERATURE)
+	{
+		pGraph->cursorValue = SAMPLE_TO_TEMPERATURE(rawCursorValue);
+		minValue = graphYMin[GRAPH_TEMPERATURE] == INVALID_SAMPLE ? SAMPLE_TO_TEMPERATURE(minRawValue) : graphYMin[GRAPH_TEMPERATURE];
+		maxValue = graphYMax[GRAPH_TEMPERATURE] == INVALID_SAMPLE ? SAMPLE_TO_TEMPERATURE(maxRawValue) : graphYMax[GRAPH_TEMPERATURE];
+		graphCurrentYMin = minValue / 2;
+		graphCurrentYMax = maxValue / 2;
+	}
+	else if (type == GRAPH_PRESSURE)
+	{
+		pGraph->cursorValue = SAMPLE_TO_PRESSURE(rawCursorValue);
+		minValue = graphYMin[GRAPH_PRESSURE] == INVALID_SAMPLE ? SAMPLE_TO_PRESSURE(minRawValue) : graphYMin[GRAPH_PRESSURE];  
+		maxValue = graphYMax[GRAPH_PRESSURE] == INVALID_SAMPLE ? SAMPLE_TO_PRESSURE(maxRawValue) : graphYMax[GRAPH_PRESSURE];
+		graphCurrentYMin = minValue / (2*33.86389f);
+		graphCurrentYMax = maxValue / (2*33.86389f);
+	}
+	else
+	{
+		pGraph->cursorValue = SAMPLE_TO_ALTITUDE(rawCursorValue);
+		minValue = graphYMin[GRAPH_ALTITUDE] == INVALID_SAMPLE ? SAMPLE_TO_ALTITUDE(minRawValue) : graphYMin[GRAPH_ALTITUDE]/2;
+		maxValue = graphYMax[GRAPH_ALTITUDE] == INVALID_SAMPLE ? SAMPLE_TO_ALTITUDE(maxRawValue) : graphYMax[GRAPH_ALTITUDE]/2;
+		graphCurrentYMin = minValue * 2;
+		graphCurrentYMax = maxValue * 2;
+	}
+	
+	if (rawCursorValue == INVALID_RAW_VALUE)
+	{
+		pGraph->cursorValue = INVALID_SAMPLE;
+	}
+
+	const int graphLastPixel = pGraph->numPages * 8 - 1; // graphHeight - 1
+	const int minGraphSampleRange = (graphLastPixel+1)/2; // don't allow very small vertical ranges, to prevent super-jaggies
+		
+	if (minRawValue == INVALID_RAW_VALUE)
+	{
+		// no filled samples
+		minValue = INVALID_SAMPLE_MIN;
+		maxValue = INVALID_SAMPLE;
+		graphCurrentYMin = graphCurrentYMax = 0;
+	}	
+	else if (maxValue == minValue)
+	{
+		maxValue = minValue + 1;
+	}	
+	else if (maxValue - minValue < minGraphSampleRange)
+	{
+		// require at least 1 sample step per 2 Y pixels
+		short avgValue = (minValue + maxValue) / 2;
+		minValue = avgValue - minGraphSampleRange/2;
+		maxValue = avgValue + minGraphSampleRange/2;
+	}
+	
+	pGraph->minValue = minValue;
+	pGraph->maxValue = maxValue;
+}
+
+// draw every column of the graph from right to left, passing each one's page bytes to writeColumn
+void GraphDrawColumns(const Graph* pGraph, GraphColumnWriter writeColumn)
+{
+	uint8_t type = pGraph->type;
+	uint8_t lastPage = pGraph->numPages - 1;
+	uint8_t graphLastPixel = pGraph->numPages * 8 - 1;
+	short minValue = pGraph->minValue;
+	short maxValue = pGraph->maxValue;
+	uint8_t drawLines = !graphDrawPoints[type];
+	
+	uint8_t prevysample = 0xFF;
+	uint8_t pages[GRAPH_MAX_PAGES];
+	
+	// start at the right side of the graph	
+	for (uint8_t x=SAMPLES_PER_GRAPH-1; x<SAMPLES_PER_GRAPH; x--)
+	{
+		Sample* pSample = GraphColumnSample(pGraph, x);
+		
+		short sampleValue;
+		if (type == GRAPH_TEMPERATURE)
+		{
+			sampleValue = SAMPLE_TO_TEMPERATURE(pSample->temperature);
+		}
+		else if (type == GRAPH_PRESSURE)
+		{
+			sampleValue = SAMPLE_TO_PRESSURE(pSample->pressure);
+		}
+		else
+		{
+			sampleValue = SAMPLE_TO_ALTITUDE(pSample->altitude);
+		}
+		
+		// the rows to fill in this column, from top to bottom. An empty span has top > bottom.
+		uint8_t top = 0xFF;
+		uint8_t bottom = 0;
+		
+		if (sampleValue < minValue || sampleValue > maxValue || !SampleIsFilled(pSample))
+		{
+			// sample is out of range or unfilled
+			prevysample = 0xFF;		
+		}
+		else
+		{
+			uint8_t ysample = graphLastPixel - (long) graphLastPixel * (sampleValue - minValue) / (maxValue - minValue);
+			top = bottom = ysample;
+			
+			if (prevysample != 0xFF && drawLines)
+			{
+				// extend a line to the previous sample's row
+				if (prevysample < top)
+					top = prevysample;
+				else
+					bottom = prevysample;
+			}
+			
+			prevysample = ysample;
+		}	
+		
+		// each page is all filled, all empty, or cut off at the top or bottom of the span
+		uint8_t topPage = top >> 3;
+		uint8_t bottomPage = bottom >> 3;
+		uint8_t topMask = pgm_read_byte(&graphSpanFrom[top & 0x7]);
+		uint8_t bottomMask = pgm_read_byte(&graphSpanTo[bottom & 0x7]);
+		uint8_t cursor = (pGraph->showCursor && (x == pGraph->cursorPos)) ? 0x55 : 0;
+		
+		for (uint8_t y=0; y<=lastPage; y++)
+		{
+			uint8_t pixels = 0;
+			if (y >= topPage && y <= bottomPage)
+			{
+				pixels = 0xFF;
+				if (y == topPage)
+					pixels &= topMask;
+				if (y == bottomPage)
+					pixels &= bottomMask;
+			}
+			pages[y] = pixels | cursor;
+		}
+		
+		if (!pGraph->showCursor)
+		{
+			if (x < pGraph->yMaxSize)
+			{
+				pages[0] = (pages[0] & 0xC0) | pGraph->pYMaxLabel[x];
+			}
+			if (x < pGraph->yMinSize)
+			{		
+				pages[lastPage] = (pages[lastPage] & 0x03) | pGraph->pYMinLabel[x];
+			}
+		}
+		
+		writeColumn(x, pages);
+	}	
+}
+
+// move the explorer's cursor by step columns (0xFF is -1), scrolling the view when the cursor would leave the screen
+void GraphExplorerPan(uint8_t timescaleNumber, uint16_t* pMinutesAgo, uint8_t* pCursorPos, uint8_t step)
+{
+	int16_t pos = *pCursorPos + (int8_t)step;
+	uint16_t minutes = minutesPerSample[timescaleNumber];
+	
+	if (pos < 0)
+	{
+		*pMinutesAgo += -pos * minutes;
+		if (*pMinutesAgo > MaxMinutesAgo(timescaleNumber))
+			*pMinutesAgo = MaxMinutesAgo(timescaleNumber);
+		pos = 0;
+	}
+	else if (pos > SAMPLES_PER_GRAPH - 1)
+	{
+		uint16_t scroll = (pos - (SAMPLES_PER_GRAPH - 1)) * minutes;
+		*pMinutesAgo = *pMinutesAgo > scroll ? *pMinutesAgo - scroll : 0;
+		pos = SAMPLES_PER_GRAPH - 1;
+	}
+	
+	*pCursorPos = pos;
+}
+
+// switch the explorer to another timescale, keeping the time under the cursor where it was if the view allows
+void GraphExplorerZoom(uint8_t fromTimescale, uint8_t toTimescale, uint16_t* pMinutesAgo, uint8_t* pCursorPos)
+{
+	uint8_t columnsRight = SAMPLES_PER_GRAPH - 1 - *pCursorPos;
+	uint16_t cursorAge = NewestSampleAge(fromTimescale) + *pMinutesAgo + columnsRight * minutesPerSample[fromTimescale];
+	uint8_t newestAge = NewestSampleAge(toTimescale);
+	uint16_t minutes = minutesPerSample[toTimescale];
+	
+	// the nearest column of the new timescale
+	uint16_t columnsAgo = 0;
+	if (cursorAge > newestAge)
+	{
+		columnsAgo = (cursorAge - newestAge + minutes / 2) / minutes;
+	}
+	
+	if (columnsAgo <= columnsRight)
+	{
+		// near the present, so move the cursor instead of the view
+		*pMinutesAgo = 0;
+		*pCursorPos = SAMPLES_PER_GRAPH - 1 - columnsAgo;
+		return;
+	}
+	
+	*pMinutesAgo = (columnsAgo - columnsRight) * minutes;
+	if (*pMinutesAgo > MaxMinutesAgo(toTimescale))
+	{
+		// near the end of the longest timescale, so move the cursor instead of the view
+		*pMinutesAgo = MaxMinutesAgo(toTimescale);
+		columnsAgo -= *pMinutesAgo / minutes;
+		*pCursorPos = columnsAgo < SAMPLES_PER_GRAPH ? SAMPLES_PER_GRAPH - 1 - columnsAgo : 0;
+	}
+}
@@ -0,0 +1,63 @@
+/* 
+  Copyright (c) 2011 Steve Chamberlin
+  Permission is hereby granted, free of charge, to any person obtaining a copy of this hardware, software, and associated documentation 
+  files (the "Product"), to deal in the Product without restriction, including without limitation the rights to use, copy, modify, merge, 
+  publish, distribute, sublicense, and/or sell copies of the Product, and to permit persons to whom the Product is furnished to do so, 
+  subject to the following conditions: 
+
+  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Product. 
+
+  THE PRODUCT IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF 
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+  ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH 
+  THE PRODUCT OR THE USE OR OTHER DEALINGS IN THE PRODUCT.
+*/
+
+#ifndef GRAPH_H_
+#define GRAPH_H_
+
+#include <inttypes.h>
+#include "sampling.h"
+
+// the Logger Mini's graph is 7 pages of 8 pixels tall, the Logger Classic's is 5
+#define GRAPH_MAX_PAGES 7
+
+// writes one column of the graph, with one byte per page from top to bottom
+typedef void (*GraphColumnWriter)(uint8_t x, const uint8_t* pPages);
+
+typedef struct
+{
+	uint8_t timescaleNumber;
+	uint8_t type;
+	uint8_t cursorPos;
+	uint8_t showCursor;
+	uint8_t numPages;
+	// explorer only: minutes between the newest sample of the timescale and the right-most column
+	uint16_t minutesAgo;
+	// set by GraphFindRange: the next sample index of each timescale, and the age in minutes of its newest sample
+	uint8_t nextSampleIndex[NUM_TIME_SCALES];
+	uint8_t newestSampleAge[NUM_TIME_SCALES];
+	// set by GraphFindRange
+	short minValue;
+	short maxValue;
+	short cursorValue;
+	// y axis labels, drawn in the top left and bottom left corners when the cursor isn't shown
+	const uint8_t* pYMaxLabel;
+	const uint8_t* pYMinLabel;
+	uint8_t yMaxSize;
+	uint8_t yMinSize;
+} Graph;
+
+extern volatile int16_t graphCurrentYMin;
+extern volatile int16_t graphCurrentYMax;
+extern volatile int16_t graphYMin[GRAPH_COUNT];
+extern volatile int16_t graphYMax[GRAPH_COUNT];
+extern volatile uint8_t graphDrawPoints[GRAPH_COUNT];
+
+void GraphFindRange(Graph* pGraph);
+void GraphDrawColumns(const Graph* pGraph, GraphColumnWriter writeColumn);
+uint16_t GraphColumnMinutesAgo(const Graph* pGraph, uint8_t x);
+void GraphExplorerPan(uint8_t timescaleNumber, uint16_t* pMinutesAgo, uint8_t* pCursorPos, uint8_t step);
+void GraphExplorerZoom(uint8_t fromTimescale, uint8_t toTimescale, uint16_t* pMinutesAgo, uint8_t* pCursorPos);
+
+#endif /* GRAPH_H_ */
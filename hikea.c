@@ -18,11 +18,11 @@
 #include <avr/sleep.h>
 #include <util/atomic.h>
 #include <util/delay.h>
+#include <util/crc16.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "hikea.h"
-#include "avrsensors.h"
 #include "config.h"
 
 
@@ -45,6 +45,9 @@
 #include "clock.h"
 #include "speaker.h"
 #include "serial.h"
+#include "fixedpoint.h"
+#include "trend.h"
+#include "trip.h"
 
 #define BUTTON_NEXT PB0
 #define BUTTON_SELECT PB1
@@ -81,9 +84,15 @@ enum {
 
 volatile uint8_t newSampleNeeded = 1;
 volatile uint8_t screenUpdateNeeded = 1;
+volatile uint8_t clockUpdateNeeded = 0;
 volatile uint8_t screenClearNeeded = 0;
 volatile uint8_t graphClearNeeded = 0;
+volatile uint8_t tripResetNeeded = 0;
+volatile uint8_t altitudeFilterResetNeeded = 0;
+volatile uint8_t tripShiftNeeded = 0;
+volatile int16_t tripShiftFeet = 0;
 volatile uint8_t snapshotNeeded = 0;
+volatile uint8_t streamRecordNeeded = 0;
 volatile uint8_t lcdResetNeeded = 0;
 
 volatile uint8_t mode = MODE_CURRENT_DATA;
@@ -95,10 +104,27 @@ volatile uint8_t subMenuItemIndex = 0;
 volatile uint8_t topMenuItemIndex = 0;
 volatile uint8_t exploringGraph = 0;
 volatile uint8_t graphCursor = 0;
+volatile uint8_t graphZoom = 0; // the timescale whose sample spacing the graph explorer uses
+volatile uint16_t graphMinutesAgo = 0; // how far the graph explorer is scrolled into the past
+volatile uint8_t selectPending = 0; // SELECT is down while exploring, and will leave the explorer when released
 volatile uint8_t hibernating = 0;
 volatile uint8_t unlockState = 0;
 
 // main screen
+#define SCREEN_LINE_COUNT 6
+
+// a CRC of the text last drawn on each main screen line, so lines that haven't changed aren't sent again. Only
+// the CRC is kept, not the text, because SRAM is nearly full on the Logger Mini.
+typedef struct
+{
+	uint16_t crc;
+	uint8_t len;
+	uint8_t x;
+	uint8_t tiny;
+} ScreenLine;
+
+ScreenLine screenLines[SCREEN_LINE_COUNT];
+uint8_t screenLinesValid = 0; // one bit per line, cleared when anything else is drawn over the lines
 
 // system screen	
 const char versionStr[] PROGMEM = "1.0.4";
@@ -141,15 +167,17 @@ const char* mainMenu[] PROGMEM = {
 enum {
 	MENU_ALTITUDE_EXIT_MENU = 0,
 	MENU_ALTITUDE_CALIBRATE,
-	MENU_ALTITUDE_SET_GOAL
+	MENU_ALTITUDE_SET_GOAL,
+	MENU_ALTITUDE_RESET_TRIP
 };
 
 const char altitude1[] PROGMEM = "Calibrate";
 const char altitude2[] PROGMEM = "Set Destination";
 const char altitude2a[] PROGMEM = "Reset Destination";
+const char altitude3[] PROGMEM = "Reset Trip Stats";
 
 const char* altitudeMenu[] PROGMEM = { 
-	exitMenu, altitude1, altitude2, NULL 
+	exitMenu, altitude1, altitude2, altitude3, NULL 
 };
 
 // system menu
@@ -212,8 +240,13 @@ enum {
 	MENU_DATA_TEMP_TREND,
 	MENU_DATA_PRESSURE_TREND,
 	MENU_DATA_FORECAST,
+	MENU_DATA_TRIP_ASCENT,
+	MENU_DATA_TRIP_DESCENT,
+	MENU_DATA_TRIP_HIGHLOW,
+	MENU_DATA_TRIP_AVERAGE_ASCENT,
 #ifdef SHAKE_SENSOR
 	MENU_DATA_TRIP_TIME,
+	MENU_DATA_TRIP_MOVING_TIME,
 #endif	
 #ifdef TRACK_DAILYHIGHLOW
 	MENU_DATA_TEMP_DAILYHIGHLOW,
@@ -244,12 +277,20 @@ const char data14[] PROGMEM = "Temp Daily High/Low";
 const char data15[] PROGMEM = "Press Daily High/Low";
 const char data16[] PROGMEM = "Alt Daily High/Low";
 #endif
+const char data17[] PROGMEM = "Total Ascent";
+const char data18[] PROGMEM = "Total Descent";
+const char data19[] PROGMEM = "Trip High/Low";
+const char data20[] PROGMEM = "Average Ascent Rate";
+#ifdef SHAKE_SENSOR
+const char data21[] PROGMEM = "Moving Time";
+#endif
 
 
 const char* dataMenu[] PROGMEM = { 
 	exitMenu, data1, data2, data3, data4, data5, data6, data7, data8, data9, data10, data11, 
+	data17, data18, data19, data20,
 #ifdef SHAKE_SENSOR
-	data13,
+	data13, data21,
 #endif	
 #ifdef TRACK_DAILYHIGHLOW
 	data14, data15, data16,
@@ -341,6 +382,7 @@ char* choice2;
 
 void LcdUtil_ClearLine( uint8_t row, uint8_t ch );
 void LcdUtil_ShowMainScreenData( uint8_t row, uint8_t type, uint8_t line_len, uint8_t half_char, uint8_t tiny );
+void LcdUtil_DrawText( char* str, uint8_t tiny );
 
 
 
@@ -516,11 +558,18 @@ void HandleEnterNumberSelect()
 		switch (selectedMenuItemIndex)
 		{
 			case MENU_ALTITUDE_CALIBRATE:
+			{
+				int16_t oldAltitude = last_altitude + 0.5f;
 				expectedSeaLevelPressure = bmp085GetSeaLevelPressure((float)last_pressure, 0.3048f * enterNumberValue);
 				last_altitude = 3.28f * bmp085GetAltitude((float)last_pressure);		
-				// last_altitude should now equal enterNumberValue
+				// last_altitude should now equal enterNumberValue. The filter and trip statistics belong to the
+				// main loop, so they're adjusted there.
+				altitudeFilterResetNeeded = 1;
+				tripShiftFeet += (int16_t)(last_altitude + 0.5f) - oldAltitude;
+				tripShiftNeeded = 1;
 				last_calibration_altitude = enterNumberValue;
 				break;						
+			}
 				
 			case MENU_ALTITUDE_SET_GOAL:		
 				altitudeDestination = enterNumberValue;
@@ -707,6 +756,13 @@ void HandleChoiceSelect()
 				break;	
 		}
 	}
+	else if (parentMode == MODE_ALTITUDE_INFO)
+	{
+		if (selectedMenuItemIndex == MENU_ALTITUDE_RESET_TRIP && subMenuItemIndex == 1)
+		{
+			tripResetNeeded = 1;
+		}
+	}
 	else if (grandparentMode == MODE_ALTITUDE_GRAPH)
 	{
 		graphDrawPoints[GRAPH_ALTITUDE] = subMenuItemIndex;
@@ -831,6 +887,10 @@ void HandleMenuItem()
 					StartEnterNumber(minDataValues[useImperialUnits + GRAPH_ALTITUDE], maxDataValues[useImperialUnits + GRAPH_ALTITUDE], refAltitude, &unitStrings[useImperialUnits + GRAPH_ALTITUDE][1]);
 				}
 				break;
+				
+			case MENU_ALTITUDE_RESET_TRIP:
+				Start2Choice("Are you sure?", "No", "Yes");
+				break;
 		}					
 	}
 	else if (mode == MODE_CURRENT_DATA)
@@ -893,6 +953,8 @@ void HandleMenuItem()
 		{
 			case MENU_GRAPH_EXPLORE:
 				exploringGraph = 1;
+				graphZoom = submode;
+				graphMinutesAgo = 0;
 				mode = parentMode;
 				menuLevel = 0;
 				screenClearNeeded = 1;
@@ -1168,6 +1230,7 @@ int main(void)
 			LcdReset();
 			LcdClear();
 			LcdPowerSave(0);
+			screenLinesValid = 0;
 			screenUpdateNeeded = 1;
 		}
 		
@@ -1176,9 +1239,35 @@ int main(void)
 			graphClearNeeded = 0;
 			LcdGoto(0,0);
 			LcdClear();
+			screenLinesValid = 0;
 			SamplingInit(1);
 		}
 		
+		if (tripResetNeeded)
+		{
+			tripResetNeeded = 0;
+			TripReset();
+			screenUpdateNeeded = 1;
+		}
+		
+		if (altitudeFilterResetNeeded)
+		{
+			altitudeFilterResetNeeded = 0;
+			TrendAltitudeReset();
+		}
+		
+		if (tripShiftNeeded)
+		{
+			int16_t shift;
+			ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+			{
+				tripShiftNeeded = 0;
+				shift = tripShiftFeet;
+				tripShiftFeet = 0;
+			}
+			TripAltitudeShifted(shift);
+		}
+		
 #ifdef SHAKE_SENSOR		
 		// update the shake state once per minute, using the newSampleNeeded flag. 
 		// must be done during the main loop, and not interrupt, this the ugly re-use of flag.
@@ -1188,6 +1277,12 @@ int main(void)
 		}
 #endif	
 
+		// the battery voltage is read on a slow schedule, piggybacking on the once per minute sample
+		if (newSampleNeeded)
+		{
+			BatteryUpdate();
+		}
+
 #if TRACK_DAILYHIGHLOW
 		// Check for a new day once per minute so we can reset the daily high/low
 		{
@@ -1203,7 +1298,7 @@ int main(void)
 
 		
 		// take new sample
-		if (newSampleNeeded || snapshotNeeded)
+		if (newSampleNeeded || snapshotNeeded || streamRecordNeeded)
 		{		
 			short tempc;
 			long pressure;
@@ -1224,21 +1319,19 @@ int main(void)
 						
 			if (snapshotNeeded)
 			{
-				uint32_t packedYearMonthDayHourMin;
-				ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
-				{
-					packedYearMonthDayHourMin = clock_year;
-					packedYearMonthDayHourMin = packedYearMonthDayHourMin*13 + clock_month;
-					packedYearMonthDayHourMin = packedYearMonthDayHourMin*32 + clock_day;
-					packedYearMonthDayHourMin = packedYearMonthDayHourMin*24 + clock_hour;
-					packedYearMonthDayHourMin = packedYearMonthDayHourMin*60 + clock_minute;
-				}
-				
-				StoreSnapshot(tempc, pressure, packedYearMonthDayHourMin);
+				StoreSnapshot(tempc, pressure, ClockGetPackedTime());
+			}
+			
+			if (streamRecordNeeded)
+			{
+				Sample streamSample;
+				FillSample(&streamSample, tempc, pressure);
+				SerialSendStreamRecord(&streamSample);
 			}
 			
 			newSampleNeeded = 0;
 			snapshotNeeded = 0;
+			streamRecordNeeded = 0;
 		}
 		
 		// clear display
@@ -1246,17 +1339,29 @@ int main(void)
 		{
 			screenClearNeeded = 0;
 			LcdClear();
+			screenLinesValid = 0;
 		}
 		
 		// update display
 		if (screenUpdateNeeded)
 		{	
 			screenUpdateNeeded = 0;
+			clockUpdateNeeded = 0;
 			DrawModeScreen();
 		}
 		
+		// update just the clock on the system screen
+		if (clockUpdateNeeded)
+		{
+			clockUpdateNeeded = 0;
+			if (mode == MODE_SYSTEM && menuLevel == 0 && unlockState == 0)
+			{
+				DrawSystemClock();
+			}
+		}
+		
 		// keep sleeping until a redraw is required or a new sample is needed
-		while (!newSampleNeeded && !screenUpdateNeeded && !snapshotNeeded)
+		while (!newSampleNeeded && !screenUpdateNeeded && !clockUpdateNeeded && !snapshotNeeded && !streamRecordNeeded)
 		{
 			if (!speaker_in_use)
 			{
@@ -1267,113 +1372,56 @@ int main(void)
 	}
 }
 
+// round a rate to the nearest whole unit
+static long RoundRate(float rate)
+{
+	return (long)(rate >= 0 ? rate + 0.5f : rate - 0.5f);
+}
+
+// the rate of ascent follows the altitude filter, and the other rates are least-squares slopes over the recent
+// samples. Both are kept up to date by the trend service as measurements come in.
+
 long GetRateOfAscent()
 {
-	// get altitude 10 minutes ago
-	const uint8_t ascentRateWindow = 10; // max window size is SAMPLES_PER_GRAPH-1
-	uint8_t index = GetTimescaleNextSampleIndex(0); // get next sample index from the 1-minute timescale
-	index--; // index of most recent sample
-	index -= ascentRateWindow;
-	if (index > SAMPLES_PER_GRAPH)
-		index += SAMPLES_PER_GRAPH;
-	Sample* pPastSample = GetSample(0, index);
-			
-	long ratePerMinute = 0;
-	if (pPastSample->altitude)
-	{	
-		long pastAltitude = 200L * SAMPLE_TO_ALTITUDE(pPastSample->altitude);
-				
-		// compute rate of ascent
-		ratePerMinute = ((long)(last_altitude*100) - pastAltitude) / ascentRateWindow;
-		ratePerMinute = (ratePerMinute + 50) / 100;
-				
-		return ratePerMinute;
-	}
-	else
-	{
+	// vertical speed in 1/16 ft per minute
+	int32_t velocity;
+	if (!TrendGetVerticalSpeed(&velocity))
 		return INVALID_RATE;
-	}	
+	
+	// ft per minute
+	return (velocity >= 0 ? velocity + 8 : velocity - 8) / 16;
 }
 
 long GetTemperatureTrend()
 {
-	// get temp 60 minutes ago
-	const uint8_t window = 60; // max window size is SAMPLES_PER_GRAPH-1
-	uint8_t index = GetTimescaleNextSampleIndex(0); // get next sample index from the 1-minute timescale
-	index--; // index of most recent sample
-	index -= window;
-	if (index > SAMPLES_PER_GRAPH)
-		index += SAMPLES_PER_GRAPH;
-	Sample* pPastSample = GetSample(0, index);
-			
-	long ratePerHour = 0;
-	if (pPastSample->temperature)
-	{	
-		long pastTemperature = SAMPLE_TO_TEMPERATURE(pPastSample->temperature);
-				
-		// compute rate of change 
-		ratePerHour = 60 * (last_temperature - pastTemperature) / window;
-		return ratePerHour;
-	}
-	else
-	{
+	// slope of the temperature over the last hour, in units of half degrees F per hour
+	float slope;
+	if (!TrendGetSlope(TREND_TEMPERATURE, &slope))
 		return INVALID_RATE;
-	}
+	
+	return RoundRate(slope);
 }
 
 long GetPressureTrend1()
 {
-	// get pressure 60 minutes ago
-	const uint8_t window = 60; // max window size is SAMPLES_PER_GRAPH-1
-	uint8_t index = GetTimescaleNextSampleIndex(0); // get next sample index from the 1-minute timescale
-	index--; // index of most recent sample
-	index -= window;
-	if (index > SAMPLES_PER_GRAPH)
-		index += SAMPLES_PER_GRAPH;
-	Sample* pPastSample = GetSample(0, index);
-			
-	long ratePerHour = 0;
-	if (pPastSample->pressure)
-	{	
-		long pastPressure = 50L * SAMPLE_TO_PRESSURE(pPastSample->pressure); // put in units of mb * 100
-				
-		// compute rate of change
-		long pressure = last_pressure; // units of mb*100
-		ratePerHour = 60 * (pressure - pastPressure) / window;
-		return ratePerHour;
-	}
-	else
-	{
+	// slope of the pressure over the last hour, in units of 0.5 mb per hour
+	float slope;
+	if (!TrendGetSlope(TREND_PRESSURE_1, &slope))
 		return INVALID_RATE;
-	}
+	
+	// mb * 100 per hour
+	return RoundRate(slope * 50);
 }
 
-// TODO: save memory by combining this with GetPressureTrend1()
 long GetPressureTrend5()
 {
-	// get pressure 300 minutes ago
-	const uint8_t window = 75; // max window size is SAMPLES_PER_GRAPH-1
-	uint8_t index = GetTimescaleNextSampleIndex(1); // get next sample index from the 4-minute timescale
-	index--; // index of most recent sample
-	index -= window;
-	if (index > SAMPLES_PER_GRAPH)
-		index += SAMPLES_PER_GRAPH;
-	Sample* pPastSample = GetSample(1, index);
-			
-	long ratePerHour = 0;
-	if (pPastSample->pressure)
-	{	
-		long pastPressure = 50L * SAMPLE_TO_PRESSURE(pPastSample->pressure); // put in units of mb * 100
-				
-		// compute rate of change
-		long pressure = last_pressure; // units of mb*100
-		ratePerHour = 60 * (pressure - pastPressure) / (window * 4);
-		return ratePerHour;
-	}
-	else
-	{
+	// slope of the pressure over the last 5 hours, in units of 0.5 mb per hour
+	float slope;
+	if (!TrendGetSlope(TREND_PRESSURE_5, &slope))
 		return INVALID_RATE;
-	}
+	
+	// mb * 100 per hour
+	return RoundRate(slope * 50);
 }
 
 uint8_t GetPressureChangeType(long mbX100PerHour)
@@ -1431,6 +1479,17 @@ uint8_t GetPressureChangeType(long mbX100PerHour)
 	return pressureChange;
 }
 
+// total ascent or descent can be more than an int16_t number of feet, so it doesn't use MakeAltitudeString
+void AppendTripDistanceString(char* str, uint32_t feet)
+{
+	if (!useImperialUnits)
+	{
+		feet = (feet * 100) / 328;
+	}
+	ultoa(feet, &str[strlen(str)], 10);
+	AppendSampleUnitsString(str, GRAPH_ALTITUDE);
+}
+
 void MakeDataString(char* str, uint8_t dataType)
 {
 	switch (dataType)
@@ -1530,12 +1589,17 @@ void MakeDataString(char* str, uint8_t dataType)
 		
 		case MENU_DATA_TIME_TO_DESTINATION:
 		{
-			long ratePerMinute = GetRateOfAscent();
-			
 			strcpy_P(str, PSTR("Time to Dest "));	
-							
-			long timeToGoal = ((altitudeDestination - (long)(last_altitude)) + ratePerMinute/2) / ratePerMinute;
-			if (ratePerMinute == INVALID_RATE || altitudeDestination == INVALID_SAMPLE || timeToGoal < 0 || timeToGoal > 24*99 + 59)
+			
+			// minutes to reach the destination at the filtered vertical speed, which is in 1/16 ft per minute
+			int32_t velocity;
+			long timeToGoal = -1;
+			if (TrendGetVerticalSpeed(&velocity) && velocity != 0)
+			{
+				timeToGoal = ((altitudeDestination * 16L - TrendGetAltitude()) + velocity/2) / velocity;
+			}
+			
+			if (altitudeDestination == INVALID_SAMPLE || timeToGoal < 0 || timeToGoal > 24*99 + 59)
 			{
 				strcat_P(str, PSTR("-----"));
 			}			
@@ -1734,7 +1798,64 @@ void MakeDataString(char* str, uint8_t dataType)
 				strcat_P(str, PSTR("+"));
 			}
 			break;
+			
+		case MENU_DATA_TRIP_MOVING_TIME:
+		{
+			strcpy_P(str, PSTR("Moving Time "));
+			
+			uint16_t movingTime = TripGetStats()->movingMinutes;
+			itoa(movingTime / 60, &str[strlen(str)], 10);
+			strcat_P(str, PSTR(":"));
+			AppendTwoDigitNumber(str, movingTime % 60);
+			break;
+		}
 #endif
+
+		case MENU_DATA_TRIP_ASCENT:
+			strcpy_P(str, PSTR("Ascent "));
+			AppendTripDistanceString(str, TripGetStats()->ascent);
+			break;
+			
+		case MENU_DATA_TRIP_DESCENT:
+			strcpy_P(str, PSTR("Descent "));
+			AppendTripDistanceString(str, TripGetStats()->descent);
+			break;
+			
+		case MENU_DATA_TRIP_HIGHLOW:
+		{
+			TripStats* pTrip = TripGetStats();
+			
+			// trip altitudes are at most 5 characters, so the longest is "Hi/Lo 30000/-9999 ft"
+			strcpy_P(str, PSTR("Hi/Lo "));
+			if (pTrip->maxAltitude < pTrip->minAltitude)
+			{
+				strcat_P(str, PSTR("-----"));
+			}
+			else
+			{
+				MakeSampleValueString(&str[strlen(str)], GRAPH_ALTITUDE, pTrip->maxAltitude);
+				strcat_P(str, PSTR("/"));
+				MakeSampleValueAndUnitsString(&str[strlen(str)], GRAPH_ALTITUDE, pTrip->minAltitude);
+			}
+			break;
+		}
+		
+		case MENU_DATA_TRIP_AVERAGE_ASCENT:
+		{
+			strcpy_P(str, PSTR("Avg Climb "));
+			
+			int16_t feetPerHour;
+			if (TripGetAverageAscentRate(&feetPerHour))
+			{
+				MakeSampleValueAndUnitsString(&str[strlen(str)], GRAPH_ALTITUDE, feetPerHour);
+				strcat_P(str, PSTR("/hr"));
+			}
+			else
+			{
+				strcat_P(str, PSTR("-----"));
+			}
+			break;
+		}
 							
 		default:
 			strcpy_P(str, PSTR("Unimplemented"));
@@ -1775,10 +1896,11 @@ void MakeSnapshotValueString(char* str, Sample* pSample)
 void DrawSnapshotList()
 {
 	int newestIndex = GetNewestSnapshotIndex();
+	Snapshot* pSnapshot;
 	
-	Snapshot* pSnapshot = GetSnapshot(newestIndex);
-	
-	if (pSnapshot->packedYearMonthDayHourMin == 0)
+	// checked without reading the newest snapshot, which is usually scrolled out of view and would take a 
+	// cache slot from one of the rows that are shown
+	if (GetNumSnapshots() == 0)
 	{	
 		LcdGoto(0, 2);
 		LcdTinyString("List Is Empty", TEXT_NORMAL);
@@ -1813,8 +1935,10 @@ void DrawSnapshotList()
 		LcdWrite(LCD_DATA, topMenuItemIndex+i == selectedMenuItemIndex ? 0x7F : 0x00);
 		MakeSnapshotDateString(str, packedTime);
 		LcdTinyString(str, topMenuItemIndex+i == selectedMenuItemIndex ? TEXT_INVERSE : TEXT_NORMAL);		
+		LcdDataBegin();
 		for (uint8_t x=4+(numLen+strlen(str))*4; x<LCD_WIDTH; x++)
-			LcdWrite(LCD_DATA, topMenuItemIndex+i == selectedMenuItemIndex ? 0x7F : 0x00);
+			LcdData(topMenuItemIndex+i == selectedMenuItemIndex ? 0x7F : 0x00);
+		LcdDataEnd();
 		
 		// show up/down arrows
 		if (i == 0 && topMenuItemIndex != 0)
@@ -1846,8 +1970,10 @@ void DrawSnapshotList()
 	MakeSnapshotValueString(str, pSample);
 	LcdTinyStringFramed(str);
 	
+	LcdDataBegin();
 	for (uint8_t x=1+strlen(str)*4; x<LCD_WIDTH; x++)
-		LcdWrite(LCD_DATA, 0x01);	
+		LcdData(0x01);	
+	LcdDataEnd();
 }
 
 void HandleSnapshotsPrevNext(uint8_t step)
@@ -1885,26 +2011,83 @@ void HandleSnapshotsSelect()
 void LcdUtil_ClearLine( uint8_t row, uint8_t ch )
 {
 	LcdGoto(0,row);
+	LcdDataBegin();
 	for (uint8_t j=0; j<LCD_WIDTH; j++)
 	{
-		LcdWrite(LCD_DATA, ch );
+		LcdData( ch );
 	}	
+	LcdDataEnd();
+}
+void LcdUtil_DrawText( char* str, uint8_t tiny )
+{
+	if( tiny )
+	{
+		LcdTinyString( str, TEXT_NORMAL );		
+	}else
+	{
+		LcdString(str);		
+	}
 }
+
+/*
+ * Show a data value on one line. If the same text was drawn there 
+ * before, nothing is sent to the display.
+ */
 void LcdUtil_ShowMainScreenData( uint8_t row, uint8_t type, uint8_t line_len, uint8_t half_char, uint8_t tiny )
 {
 	char str[32] = {0};
 	
 	MakeDataString(str, type);
-	LcdUtil_ClearLine( row, 0x00 );
+	uint8_t len = strlen(str);
+	uint8_t x = len < line_len ? half_char * (line_len-len) : 0;
 	
-	LcdGoto(half_char * (line_len-strlen(str)), row);
-	if( tiny )
+	if (row >= SCREEN_LINE_COUNT || x >= LCD_WIDTH)
 	{
-		LcdTinyString( str, TEXT_NORMAL );		
-	}else
+		// not a line that's remembered, so draw the whole line
+		LcdUtil_ClearLine( row, 0x00 );
+		LcdGoto(x, row);
+		LcdUtil_DrawText(str, tiny);
+		return;
+	}
+	
+	uint16_t crc = 0xFFFF;
+	for (uint8_t i=0; i<len; i++)
 	{
-		LcdString(str);		
+		crc = _crc16_update(crc, str[i]);
+	}
+	
+	ScreenLine* pLine = &screenLines[row];
+	if ((screenLinesValid & (1<<row)) && pLine->crc == crc && pLine->len == len && pLine->x == x && pLine->tiny == tiny)
+		return;
+	
+	// blank the columns before and after the text, instead of clearing the whole line first
+	LcdGoto(0, row);
+	LcdDataBegin();
+	for (uint8_t i=0; i<x; i++)
+	{
+		LcdData(0x00);
 	}
+	LcdDataEnd();
+	
+	LcdUtil_DrawText(str, tiny);
+	
+	uint8_t end = x;
+	for (uint8_t i=0; i<len; i++)
+	{
+		end += LcdCharWidth(str[i], tiny);
+	}
+	LcdDataBegin();
+	for (; end < LCD_WIDTH; end++)
+	{
+		LcdData(0x00);
+	}
+	LcdDataEnd();
+	
+	pLine->crc = crc;
+	pLine->len = len;
+	pLine->x = x;
+	pLine->tiny = tiny;
+	screenLinesValid |= (1<<row);
 }
 
 #if LOCKSCREEN_DATA_DISPLAY
@@ -1967,10 +2150,12 @@ void LogoLockScreen()
 #endif
 
 	LcdGoto(0,0);
+	LcdDataBegin();
 	for (int i=0; i<logoBytes; i++)
 	{
-		LcdWrite(LCD_DATA, pgm_read_byte(&logo[i]));
+		LcdData(pgm_read_byte(&logo[i]));
 	}
+	LcdDataEnd();
 		
 	LcdGoto(0,topRow);
 	strcpy_P(str, PSTR(" hold PREV and NEXT"));
@@ -1981,10 +2166,38 @@ void LogoLockScreen()
 };
 
 
+// the date and time line of the system screen, which is redrawn by itself every second
+void DrawSystemClock()
+{
+	char str[22];
+	
+	MakeDateString(str, clock_day, clock_month);		
+	LcdGoto(0, 5);
+	LcdTinyString(str, TEXT_NORMAL);	
+	strcpy_P(str, PSTR(" "));
+	itoa(2000+clock_year, &str[strlen(str)], 10);
+	LcdTinyString(str, TEXT_NORMAL);	
+	MakeTimeString(str, clock_hour, clock_minute, clock_second);
+	uint8_t len = strlen(str);
+#ifdef NOKIA_LCD			
+	LcdGoto(LCD_WIDTH-(len<<2),5);		
+#endif
+#ifdef SSD1306_LCD
+	LcdGoto(LCD_WIDTH-len*6,5);	
+#endif
+	LcdTinyString(str, TEXT_NORMAL);
+}
+
 void DrawModeScreen()
 {
 	char str[22];
 	
+	// only the main screen draws its lines with LcdUtil_ShowMainScreenData alone
+	if (unlockState != 0 || mode != MODE_CURRENT_DATA || menuLevel != 0)
+	{
+		screenLinesValid = 0;
+	}
+	
 	if (unlockState != 0)
 	{
 		// jjlash@gmail.com, 12/7/2011
@@ -2053,11 +2266,11 @@ void DrawModeScreen()
 			strcpy_P(str, versionStr);
 			LcdTinyString(str, TEXT_NORMAL);
 					
-			long avrVcc = readVcc();
+			uint16_t avrVcc = BatteryGetMillivolts();
 			avrVcc = (avrVcc + 5) / 10; // round to hundredths of a volt
 			//sprintf(str, "Battery: %ld.%02ldV ", avrVcc/100, avrVcc%100);
 			strcpy_P(str, PSTR("Battery "));
-			dtostrf((double)avrVcc/100, 1, 2, &str[strlen(str)]);
+			MakeFixedPointString(&str[strlen(str)], avrVcc, 100, 2);
 			strcat_P(str, PSTR("V"));
 			
 			LcdGoto(0, 2);
@@ -2087,21 +2300,7 @@ void DrawModeScreen()
 			}
 			LcdTinyString(str, TEXT_NORMAL);
 				
-			MakeDateString(str, clock_day, clock_month);		
-			LcdGoto(0, 5);
-			LcdTinyString(str, TEXT_NORMAL);	
-			strcpy_P(str, PSTR(" "));
-			itoa(2000+clock_year, &str[strlen(str)], 10);
-			LcdTinyString(str, TEXT_NORMAL);	
-			MakeTimeString(str, clock_hour, clock_minute, clock_second);
-			uint8_t len = strlen(str);
-#ifdef NOKIA_LCD			
-			LcdGoto(LCD_WIDTH-(len<<2),5);		
-#endif
-#ifdef SSD1306_LCD
-			LcdGoto(LCD_WIDTH-len*6,5);	
-#endif
-			LcdTinyString(str, TEXT_NORMAL);
+			DrawSystemClock();
 		}	
 		else
 		{
@@ -2150,15 +2349,15 @@ void DrawModeScreen()
 	}
 	else if (mode == MODE_TEMP_GRAPH)
 	{			
-		LcdDrawGraph2(submode, GRAPH_TEMPERATURE, graphCursor, exploringGraph);
+		LcdDrawGraph2(exploringGraph ? graphZoom : submode, GRAPH_TEMPERATURE, graphCursor, exploringGraph, graphMinutesAgo);
 	}				
 	else if (mode == MODE_PRESSURE_GRAPH)
 	{
-		LcdDrawGraph2(submode, GRAPH_PRESSURE, graphCursor, exploringGraph);
+		LcdDrawGraph2(exploringGraph ? graphZoom : submode, GRAPH_PRESSURE, graphCursor, exploringGraph, graphMinutesAgo);
 	}
 	else if (mode == MODE_ALTITUDE_GRAPH)
 	{
-		LcdDrawGraph2(submode, GRAPH_ALTITUDE, graphCursor, exploringGraph);
+		LcdDrawGraph2(exploringGraph ? graphZoom : submode, GRAPH_ALTITUDE, graphCursor, exploringGraph, graphMinutesAgo);
 	}		
 	else if (mode == MODE_SET_TIME)
 	{
@@ -2436,8 +2635,11 @@ void HandlePrevNext(uint8_t step)
 {		
 	if (exploringGraph)
 	{
-		graphCursor += step;
-		graphCursor = UINT_MOD(graphCursor, LCD_WIDTH);
+		uint8_t cursor = graphCursor;
+		uint16_t minutesAgo = graphMinutesAgo;
+		GraphExplorerPan(graphZoom, &minutesAgo, &cursor, step);
+		graphCursor = cursor;
+		graphMinutesAgo = minutesAgo;
 	}
 	else if ((mode < MODE_TOP_LEVEL_COUNT || mode == MODE_DATA_TYPE || mode == MODE_GRAPH) && menuLevel == 1)
 	{
@@ -2496,6 +2698,30 @@ void HandlePrevNext(uint8_t step)
 	}			
 }
 
+void HandleGraphZoom(uint8_t newZoom)
+{
+	uint8_t cursor = graphCursor;
+	uint16_t minutesAgo = graphMinutesAgo;
+	GraphExplorerZoom(graphZoom, newZoom, &minutesAgo, &cursor);
+	graphZoom = newZoom;
+	graphCursor = cursor;
+	graphMinutesAgo = minutesAgo;
+}
+
+// zoom the graph explorer out one timescale (step 1) or in one (step 0xFF), if it isn't already at the end
+void HandleGraphZoomStep(uint8_t step)
+{
+	uint8_t newZoom = graphZoom + step;
+	if (newZoom >= NUM_TIME_SCALES)
+	{
+		SpeakerBeep(BEEP_ERROR);
+		return;
+	}
+	
+	SpeakerBeep(step == 1 ? BEEP_EXIT : BEEP_ENTER);
+	HandleGraphZoom(newZoom);
+}
+
 void HandleSelect()
 {
 	if (mode == MODE_PRESSURE_GRAPH || mode == MODE_TEMP_GRAPH || mode == MODE_ALTITUDE_GRAPH)
@@ -2598,7 +2824,12 @@ ISR(TIMER2_OVF_vect)
 		// new second
 		if (!hibernating && mode == MODE_SYSTEM && menuLevel == 0) 
 		{
-			screenUpdateNeeded = 1; // update when seconds change
+			clockUpdateNeeded = 1; // update the clock when seconds change
+		}
+		
+		if (SerialStreamTick())
+		{
+			streamRecordNeeded = 1;
 		}
 		
 		// new minute?
@@ -2618,8 +2849,9 @@ ISR(TIMER2_OVF_vect)
 		uint32_t now = (clock_elapsedQuarterSeconds<<8) | TCNT2;
 		uint32_t delaySinceLastButtonDown = now - lastButtonDownTime;
 		
-		// NEXT/PREV repeat?
-		if (unlockState == 0 && delaySinceLastButtonDown > 500 && (bit_is_clear(PINB, BUTTON_NEXT) || bit_is_clear(PINB, BUTTON_PREV)))
+		// NEXT/PREV repeat? Not while SELECT is held in the graph explorer, where NEXT and PREV zoom instead.
+		if (unlockState == 0 && delaySinceLastButtonDown > 500 && (bit_is_clear(PINB, BUTTON_NEXT) || bit_is_clear(PINB, BUTTON_PREV)) &&
+			!(exploringGraph && bit_is_clear(PINB, BUTTON_SELECT)))
 		{
 			// set default step size
 			uint8_t nextStep = 4, prevStep = 0xFC;
@@ -2648,6 +2880,14 @@ ISR(TIMER2_OVF_vect)
 			screenUpdateNeeded = 1;
 		}
 		
+		// holding SELECT while exploring a graph zooms out
+		if (selectPending && delaySinceLastButtonDown > 1024 && bit_is_clear(PINB, BUTTON_SELECT))
+		{
+			selectPending = 0;
+			HandleGraphZoomStep(1);
+			screenUpdateNeeded = 1;
+		}
+		
 		if (!anyButtonDown && now - lastButtonUpTime > 1024L*sleepDelay)
 		{
 			// enter hibernation
@@ -2712,6 +2952,13 @@ ISR(PCINT0_vect)
 	{
 		lcdResetNeeded = 1;
 	}
+	else if (selectPending && (bit_is_clear(PINB, BUTTON_NEXT) || bit_is_clear(PINB, BUTTON_PREV)))
+	{
+		// NEXT or PREV while SELECT is held in the graph explorer zooms in or out around the cursor
+		selectPending = 0;
+		HandleGraphZoomStep(bit_is_clear(PINB, BUTTON_NEXT) ? 0xFF : 1);
+		screenUpdateNeeded = 1;
+	}
 	else if (anyButtonDownNew && !anyButtonDown)
 	{
 		uint32_t delaySinceLastButtonUp = now - lastButtonUpTime;
@@ -2723,8 +2970,16 @@ ISR(PCINT0_vect)
 		}	
 		else if (bit_is_clear(PINB, BUTTON_SELECT) && (delaySinceLastButtonUp > DEBOUNCE_TIME))
 		{
-			HandleSelect();
-			screenUpdateNeeded = 1;	
+			if (exploringGraph && mode < MODE_TOP_LEVEL_COUNT)
+			{
+				// wait to see if SELECT is released to leave, held to zoom out, or held with NEXT or PREV to zoom
+				selectPending = 1;
+			}
+			else
+			{
+				HandleSelect();
+				screenUpdateNeeded = 1;	
+			}
 		}
 		
 		// reset lastButtonDownTime at the first moment any button is down
@@ -2735,6 +2990,13 @@ ISR(PCINT0_vect)
 	if (!anyButtonDownNew && anyButtonDown)
 	{
 		lastButtonUpTime = now;
+		
+		if (selectPending)
+		{
+			selectPending = 0;
+			HandleSelect();
+			screenUpdateNeeded = 1;
+		}
 	}
 
 	anyButtonDown = anyButtonDownNew;
@@ -22,5 +22,6 @@ extern const char versionStr[] PROGMEM;
 
 void InitSettings();
 void DrawModeScreen();
+void DrawSystemClock();
 
 #endif /* HIKEA_H_ */
\ No newline at end of file
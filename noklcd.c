@@ -18,7 +18,6 @@
 // Nokia 5110 monochrome LCD 84x46
 
 #include <avr/pgmspace.h>
-#include <util/atomic.h>
 #include <string.h>
 
 #include "noklcd.h"
@@ -39,11 +38,6 @@ volatile uint8_t lcd_vop;
 volatile uint8_t lcd_bias;
 volatile uint8_t lcd_tempCoef;
 
-volatile int16_t graphCurrentYMin;
-volatile int16_t graphCurrentYMax;
-volatile int16_t graphYMin[GRAPH_COUNT];
-volatile int16_t graphYMax[GRAPH_COUNT];
-volatile uint8_t graphDrawPoints[GRAPH_COUNT];
 
 static const prog_uint8_t tiny_font[][3] = {
 
@@ -234,19 +228,8 @@ static const prog_uint8_t ASCII[][5] = {
 	,{0x44, 0x64, 0x54, 0x4c, 0x44} // 7a z
 };
 
-void LcdWrite(uint8_t dc, uint8_t data)
+static inline void LcdShift(uint8_t data)
 {
-	if (dc)
-	{
-		PORTD |= (1<<LCD_PIN_DC); 
-	}
-	else
-	{
-		PORTD &= ~(1<<LCD_PIN_DC);
-	}
-			
-	PORTD &= ~(1<<LCD_PIN_SCE);
-
 	for (uint8_t i = 0; i < 8; i++)  
 	{						
 		PORTB &= ~(1<<LCD_PIN_SCLK); 	
@@ -260,6 +243,22 @@ void LcdWrite(uint8_t dc, uint8_t data)
 					
 		PORTB |= (1<<LCD_PIN_SCLK); 		
 	}
+}
+
+void LcdWrite(uint8_t dc, uint8_t data)
+{
+	if (dc)
+	{
+		PORTD |= (1<<LCD_PIN_DC); 
+	}
+	else
+	{
+		PORTD &= ~(1<<LCD_PIN_DC);
+	}
+			
+	PORTD &= ~(1<<LCD_PIN_SCE);
+
+	LcdShift(data);
 
 	PORTD |= (1<<LCD_PIN_SCE);
 	
@@ -267,6 +266,27 @@ void LcdWrite(uint8_t dc, uint8_t data)
 	PORTB |= (1<<LCD_PIN_SDIN);
 }
 
+// a run of data bytes is sent between LcdDataBegin and LcdDataEnd with the chip selected once, instead of
+// selecting it again for every byte. Nothing else may be written to the LCD in between.
+void LcdDataBegin(void)
+{
+	PORTD |= (1<<LCD_PIN_DC); 
+	PORTD &= ~(1<<LCD_PIN_SCE);
+}
+
+void LcdData(uint8_t data)
+{
+	LcdShift(data);
+}
+
+void LcdDataEnd(void)
+{
+	PORTD |= (1<<LCD_PIN_SCE);
+	
+	// leave data pin high
+	PORTB |= (1<<LCD_PIN_SDIN);
+}
+
 void LcdGoto(uint8_t x, uint8_t y)
 {
 	LcdWrite(LCD_CMD, 0x80 | x);  
@@ -274,40 +294,50 @@ void LcdGoto(uint8_t x, uint8_t y)
 
 }
 
-void LcdCharacter(char character)
+static void LcdSendCharacter(char character)
 {
 	unsigned short charbase = (character - 0x20) * 5;
 		
 	for (uint8_t index = 0; index < 5; index++)
 	{
-		LcdWrite(LCD_DATA, pgm_read_byte((unsigned char*)ASCII + charbase + index));
+		LcdShift(pgm_read_byte((unsigned char*)ASCII + charbase + index));
 	}
 	
-	LcdWrite(LCD_DATA, 0x00);
+	LcdShift(0x00);
+}
+
+void LcdCharacter(char character)
+{
+	LcdDataBegin();
+	LcdSendCharacter(character);
+	LcdDataEnd();
 }
 
 void LcdString(char *characters)
 {
+	LcdDataBegin();
 	while (*characters)
 	{
-		LcdCharacter(*characters++);
+		LcdSendCharacter(*characters++);
 	}
+	LcdDataEnd();
 }
 
 void LcdTinyString(char *characters, uint8_t inverse)
 {
+	LcdDataBegin();
 	while (*characters)
 	{
 		if (*characters == 'm')
 		{
 			// special case 'm'
 			characters++;
-			LcdWrite(LCD_DATA, inverse ? 0x3c ^ 0x7F : 0x3c);
-			LcdWrite(LCD_DATA, inverse ? 0x04 ^ 0x7F : 0x04);
-			LcdWrite(LCD_DATA, inverse ? 0x18 ^ 0x7F : 0x18);
-			LcdWrite(LCD_DATA, inverse ? 0x04 ^ 0x7F : 0x04);
-			LcdWrite(LCD_DATA, inverse ? 0x38 ^ 0x7F : 0x38);
-			LcdWrite(LCD_DATA, inverse ? 0x7F : 0x00);
+			LcdShift(inverse ? 0x3c ^ 0x7F : 0x3c);
+			LcdShift(inverse ? 0x04 ^ 0x7F : 0x04);
+			LcdShift(inverse ? 0x18 ^ 0x7F : 0x18);
+			LcdShift(inverse ? 0x04 ^ 0x7F : 0x04);
+			LcdShift(inverse ? 0x38 ^ 0x7F : 0x38);
+			LcdShift(inverse ? 0x7F : 0x00);
 		}
 		else
 		{	
@@ -317,28 +347,30 @@ void LcdTinyString(char *characters, uint8_t inverse)
 			{
 				uint8_t pixels = pgm_read_byte((unsigned char*)tiny_font + charbase + index);
 				pixels = pixels << 1;
-				LcdWrite(LCD_DATA, inverse ? pixels ^ 0x7F : pixels);
+				LcdShift(inverse ? pixels ^ 0x7F : pixels);
 			}
 		
-			LcdWrite(LCD_DATA, inverse ? 0x7F : 0x00);
+			LcdShift(inverse ? 0x7F : 0x00);
 		}		
 	}	
+	LcdDataEnd();
 }
 
 void LcdTinyStringFramed(char *characters)
 {
+	LcdDataBegin();
 	while (*characters)
 	{
 		if (*characters == 'm')
 		{
 			// special case 'm'
 			characters++;
-			LcdWrite(LCD_DATA, (0x3c << 1) | 0x01);
-			LcdWrite(LCD_DATA, (0x04 << 1) | 0x01);
-			LcdWrite(LCD_DATA, (0x18 << 1) | 0x01);
-			LcdWrite(LCD_DATA, (0x04 << 1) | 0x01);
-			LcdWrite(LCD_DATA, (0x38 << 1) | 0x01);
-			LcdWrite(LCD_DATA, (0x00 << 1) | 0x01);
+			LcdShift((0x3c << 1) | 0x01);
+			LcdShift((0x04 << 1) | 0x01);
+			LcdShift((0x18 << 1) | 0x01);
+			LcdShift((0x04 << 1) | 0x01);
+			LcdShift((0x38 << 1) | 0x01);
+			LcdShift((0x00 << 1) | 0x01);
 		}
 		else
 		{	
@@ -349,12 +381,13 @@ void LcdTinyStringFramed(char *characters)
 				uint8_t pixels = pgm_read_byte((unsigned char*)tiny_font + charbase + index);
 				pixels = pixels << 2;
 				pixels |= 0x01;
-				LcdWrite(LCD_DATA, pixels);
+				LcdShift(pixels);
 			}
 		
-			LcdWrite(LCD_DATA, 0x01);
+			LcdShift(0x01);
 		}		
 	}	
+	LcdDataEnd();
 }
 
 void LcdSetBacklight(uint8_t on)
@@ -422,277 +455,46 @@ void LcdReset(void)
 	LcdWrite(LCD_CMD, 0x0C); // LCD in normal mode. 0x0d for inverse
 }
 
-void LcdDrawGraph2(uint8_t timescaleNumber, uint8_t type, uint8_t cursorPos, uint8_t showCursor)
+static void LcdWriteGraphColumn(uint8_t x, const uint8_t* pPages)
 {
-	uint8_t xphase = GetTimescaleNextSampleIndex(timescaleNumber);
-	Sample* pSample;
-	
-	// find the min and max values
-	uint16_t rawValue;
-	uint16_t minRawValue = INVALID_RAW_VALUE;
-	uint16_t maxRawValue = 0;
-	uint16_t rawCursorValue = INVALID_RAW_VALUE;
-	short cursorValue;
-	short minValue;
-	short maxValue;
-	
-	for (uint8_t i=0; i<SAMPLES_PER_GRAPH; i++)
-	{
-		pSample = GetSample(timescaleNumber, i);
-		
-		// ignore unfilled samples
-		if (pSample->temperature == 0 && pSample->pressure == 0 && pSample->altitude == 0)
-			continue;
-			
-		if (type == GRAPH_TEMPERATURE)
-		{
-			rawValue = pSample->temperature;
-		}
-		else if (type == GRAPH_PRESSURE)
-		{
-			rawValue = pSample->pressure;
-		}
-		else
-		{
-			rawValue = pSample->altitude;
-		}
-		
-		if (rawValue > maxRawValue)
-			maxRawValue = rawValue;
-		if (rawValue < minRawValue)
-			minRawValue = rawValue;
-			
-		if (i == (cursorPos+xphase)%SAMPLES_PER_GRAPH)
-		{
-			rawCursorValue = rawValue;
-		}
-	}
-	
-	uint8_t customAxes = 0;
-	
-	if (type == GRAPH_TEMPERATURE)
-	{
-		cursorValue = SAMPLE_TO_TEMPERATURE(rawCursorValue);
-		minValue = graphYMin[GRAPH_TEMPERATURE] == INVALID_SAMPLE ? SAMPLE_TO_TEMPERATURE(minRawValue) : graphYMin[GRAPH_TEMPERATURE];
-		maxValue = graphYMax[GRAPH_TEMPERATURE] == INVALID_SAMPLE ? SAMPLE_TO_TEMPERATURE(maxRawValue) : graphYMax[GRAPH_TEMPERATURE];
-		graphCurrentYMin = minValue / 2;
-		graphCurrentYMax = maxValue / 2;
-		customAxes = graphYMin[GRAPH_TEMPERATURE] != INVALID_SAMPLE || graphYMax[GRAPH_TEMPERATURE] != INVALID_SAMPLE;
-	}
-	else if (type == GRAPH_PRESSURE)
-	{
-		cursorValue = SAMPLE_TO_PRESSURE(rawCursorValue);
-		minValue = graphYMin[GRAPH_PRESSURE] == INVALID_SAMPLE ? SAMPLE_TO_PRESSURE(minRawValue) : graphYMin[GRAPH_PRESSURE];  
-		maxValue = graphYMax[GRAPH_PRESSURE] == INVALID_SAMPLE ? SAMPLE_TO_PRESSURE(maxRawValue) : graphYMax[GRAPH_PRESSURE];
-		graphCurrentYMin = minValue / (2*33.86389f);
-		graphCurrentYMax = maxValue / (2*33.86389f);
-		customAxes = graphYMin[GRAPH_PRESSURE] != INVALID_SAMPLE || graphYMax[GRAPH_PRESSURE] != INVALID_SAMPLE;
-	}
-	else
-	{
-		cursorValue = SAMPLE_TO_ALTITUDE(rawCursorValue);
-		minValue = graphYMin[GRAPH_ALTITUDE] == INVALID_SAMPLE ? SAMPLE_TO_ALTITUDE(minRawValue) : graphYMin[GRAPH_ALTITUDE]/2;
-		maxValue = graphYMax[GRAPH_ALTITUDE] == INVALID_SAMPLE ? SAMPLE_TO_ALTITUDE(maxRawValue) : graphYMax[GRAPH_ALTITUDE]/2;
-		graphCurrentYMin = minValue * 2;
-		graphCurrentYMax = maxValue * 2;
-		customAxes = graphYMin[GRAPH_ALTITUDE] != INVALID_SAMPLE || graphYMax[GRAPH_ALTITUDE] != INVALID_SAMPLE;
-	}
+	LcdGoto(x,1);
 	
-	if (rawCursorValue == INVALID_RAW_VALUE)
+	LcdDataBegin();
+	for (uint8_t y=0; y<5; y++)
 	{
-		cursorValue = INVALID_SAMPLE;
+		LcdData(pPages[y]);
 	}
+	LcdDataEnd();
+}
 
-	const int graphLastPixel = 39; // graphHeight - 1
-	const int minGraphSampleRange = (graphLastPixel+1)/2; // don't allow very small vertical ranges, to prevent super-jaggies
-		
-	if (minRawValue == INVALID_RAW_VALUE)
-	{
-		// no filled samples
-		minValue = INVALID_SAMPLE_MIN;
-		maxValue = INVALID_SAMPLE;
-		graphCurrentYMin = graphCurrentYMax = 0;
-	}	
-	else if (maxValue == minValue)
-	{
-		maxValue = minValue + 1;
-	}	
-	else if (maxValue - minValue < minGraphSampleRange)
-	{
-		// require at least 1 sample step per 2 Y pixels
-		short avgValue = (minValue + maxValue) / 2;
-		minValue = avgValue - minGraphSampleRange/2;
-		maxValue = avgValue + minGraphSampleRange/2;
-	}
-	
-	LcdWrite(LCD_CMD, 0x22); // switch to vertical addressing
-	
-	// NOTE: assumption here that SAMPLES_PER_GRAPH equals LCD_WIDTH
-	// start at the right side of the graph	
-	xphase += LCD_WIDTH - 1;
-	xphase %= LCD_WIDTH;	
-	
-	short sampleValue;
-	uint8_t prevysample = 0xFF;
+void LcdDrawGraph2(uint8_t timescaleNumber, uint8_t type, uint8_t cursorPos, uint8_t showCursor, uint16_t minutesAgo)
+{
+	Graph graph;
+	graph.timescaleNumber = timescaleNumber;
+	graph.type = type;
+	graph.cursorPos = cursorPos;
+	graph.showCursor = showCursor;
+	graph.minutesAgo = minutesAgo;
+	graph.numPages = 5;
+	GraphFindRange(&graph);
 	
 	uint8_t yMinLabelBuffer[4*5];
 	uint8_t yMaxLabelBuffer[4*5];
 	
-	uint8_t yMinSize;
-	uint8_t yMaxSize;
+	LcdMakeGraphYAxis(type, graph.minValue, graph.maxValue, yMinLabelBuffer, yMaxLabelBuffer, &graph.yMinSize, &graph.yMaxSize);
+	graph.pYMinLabel = yMinLabelBuffer;
+	graph.pYMaxLabel = yMaxLabelBuffer;
 	
-	LcdMakeGraphYAxis(type, minValue, maxValue, yMinLabelBuffer, yMaxLabelBuffer, &yMinSize, &yMaxSize);
-		
-	for (uint8_t x=LCD_WIDTH-1; x<LCD_WIDTH; x--)
-	{
-		LcdGoto(x,1);
-		
-		uint8_t ormask[5];
-		uint8_t andmask[5];
-		
-		for (uint8_t y=0; y<5; y++)
-		{
-			ormask[y] = (showCursor && (x == cursorPos)) ? 0x55 : 0;	
-			andmask[y] = 0xFF;
-			
-			if (x < yMaxSize && !showCursor)
-			{
-				ormask[0] |= yMaxLabelBuffer[x];
-				andmask[0] = 0xC0;
-			}
-			if (x < yMinSize && !showCursor)
-			{		
-				ormask[4] |= yMinLabelBuffer[x];
-				andmask[4] = 0x03;
-			}
-		}
-			
-		pSample = GetSample(timescaleNumber, xphase);
-		
-		xphase--;
-		if (xphase == 0xFF)
-			xphase = LCD_WIDTH-1;
-		
-		if (type == GRAPH_TEMPERATURE)
-		{
-			sampleValue = SAMPLE_TO_TEMPERATURE(pSample->temperature);
-		}
-		else if (type == GRAPH_PRESSURE)
-		{
-			sampleValue = SAMPLE_TO_PRESSURE(pSample->pressure);
-		}
-		else
-		{
-			sampleValue = SAMPLE_TO_ALTITUDE(pSample->altitude);
-		}
-				
-		uint8_t pixeldata[5];
-		
-		for (uint8_t y=0; y<5; y++)
-		{
-			pixeldata[y] = 0;
-		}			
-		
-		/* this doesn't work right, and doesn't look very good either
-		// show timescale tickmarks for major time boundaries
-		uint8_t samplePeriod = minutesPerSample[timescaleNumber];
-		int16_t sampleHourMin = hourMin - (LCD_WIDTH-1-x)*samplePeriod;
-		
-		if (((samplePeriod < 3) && (sampleHourMin % 30 == 0)) ||
-			((samplePeriod < 8) && (sampleHourMin % 60 == 0)) ||
-			((samplePeriod < 30) && (sampleHourMin % 240 == 0)) ||
-			(sampleHourMin % 1440 == 0))
-		{
-			pixeldata[0] |= 0x03;
-			pixeldata[4] |= 0xC0;
-		}	
-		*/
-		
-		if (sampleValue < minValue || sampleValue > maxValue ||
-			(pSample->temperature == 0 && pSample->pressure == 0 && pSample->altitude == 0))
-		{
-			// sample is out of range or unfilled
-			prevysample = 0xFF;		
-		}
-		else
-		{
-			uint8_t ysample = graphLastPixel - (long) graphLastPixel * (sampleValue - minValue) / (maxValue - minValue);
-			uint8_t yrow = ysample >> 3;
-			uint8_t ybit = ysample & 0x7; // ysample % 8
-			uint8_t pixel = 0x01;
-			
-			while (ybit)
-			{
-				pixel = pixel << 1;
-				ybit--;
-			}		
-			
-			pixeldata[yrow] = pixel;
-			
-			if (ysample != prevysample && prevysample != 0xFF && !graphDrawPoints[type])
-			{
-				// modify the pixel data to extend a line towards the previous pixel
-				if (prevysample < ysample)
-				{
-					// previous sample is above new one
-					while (1)
-					{
-						while (ysample != prevysample && (pixeldata[yrow] & 0x1) == 0)
-						{
-							pixeldata[yrow] = pixeldata[yrow] | (pixeldata[yrow]>>1);
-							prevysample++;
-						}
-						
-						if (ysample == prevysample)
-							break;
-							
-						yrow--;
-						pixeldata[yrow] = 0x80;
-						prevysample++;
-					}															
-				}
-				else
-				{
-					// previous sample is equal or below new one
-					while (1)
-					{
-						while (ysample != prevysample && (pixeldata[yrow] & 0x80) == 0)
-						{
-							pixeldata[yrow] = pixeldata[yrow] | (pixeldata[yrow]<<1);
-							prevysample--;						
-						}
-						
-						if (ysample == prevysample)
-							break;
-							
-						yrow++;
-						pixeldata[yrow] = 0x01;
-						prevysample--;
-					}			
-				}
-			}
-			
-			prevysample = ysample;
-		}	
-		
-		for (uint8_t y=0; y<5; y++)
-		{
-			LcdWrite(LCD_DATA, (pixeldata[y] & andmask[y]) | ormask[y]);				
-		}		
-	}	
+	LcdWrite(LCD_CMD, 0x22); // switch to vertical addressing
+	
+	GraphDrawColumns(&graph, LcdWriteGraphColumn);
 	
 	LcdWrite(LCD_CMD, 0x20); // switch to horizontal addressing
 	
 	char str[21];
 	if (showCursor)
 	{
-		uint16_t minutesOfDay;
-		ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
-		{
-			minutesOfDay = clock_hour * 60 + clock_minute;
-		}
-	
-		MakePastTimeString(str, minutesOfDay % minutesPerSample[timescaleNumber] + (SAMPLES_PER_GRAPH - 1 - cursorPos) * minutesPerSample[timescaleNumber]);
+		MakePastTimeString(str, GraphColumnMinutesAgo(&graph, cursorPos));
 		LcdDrawGraphLeftLegend(str);
 		
 		for (uint8_t xclear = 1+strlen(str)*4; xclear < LCD_WIDTH; xclear++)
@@ -704,9 +506,9 @@ void LcdDrawGraph2(uint8_t timescaleNumber, uint8_t type, uint8_t cursorPos, uin
 		// TODO: harmonize all the units-related functions so this isn't necessary
 		if (type == GRAPH_ALTITUDE)
 		{
-			cursorValue *= 2;
+			graph.cursorValue *= 2;
 		}
-		MakeSampleValueAndUnitsStringForGraph(str, type, cursorValue);
+		MakeSampleValueAndUnitsStringForGraph(str, type, graph.cursorValue);
 		LcdDrawGraphRightLegend(str);
 	}
 	else
@@ -838,33 +640,27 @@ void LcdDrawHeading(char *characters, uint8_t inverse)
 		LcdGoto(3,0);
 		LcdWrite(LCD_DATA, 0x20);
 	}
+	LcdDataBegin();
 	for (uint8_t i=1; i<lpad; i++)
 	{
-		if (inverse)
-			LcdTinyString(" ", TEXT_INVERSE);
-		else
+		for (uint8_t j=0; j<4; j++)
 		{
-			for (uint8_t j=0; j<4; j++)
-			{
-				LcdWrite(LCD_DATA, 0x20);
-			}
+			LcdData(inverse ? 0x7F : 0x20);
 		}
 	}
+	LcdDataEnd();
 	LcdTinyString(" ", inverse);
 	LcdTinyString(characters, inverse);
 	LcdTinyString(" ", inverse);
+	LcdDataBegin();
 	for (uint8_t i=1; i<rpad; i++)
 	{
-		if (inverse)
-			LcdTinyString(" ", TEXT_INVERSE);
-		else
+		for (uint8_t j=0; j<4; j++)
 		{
-			for (uint8_t j=0; j<4; j++)
-			{
-				LcdWrite(LCD_DATA, 0x20);
-			}
+			LcdData(inverse ? 0x7F : 0x20);
 		}
 	}
+	LcdDataEnd();
 	LcdGoto(80,0);	
 	LcdTinyString(inverse ? ">" : "]", inverse);	
 }
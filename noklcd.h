@@ -20,6 +20,7 @@
 
 #include <inttypes.h>
 #include "sampling.h"
+#include "graph.h"
 
 #define LCD_WIDTH 84
 #define LCD_HEIGHT 48
@@ -33,24 +34,25 @@
 extern volatile uint8_t lcd_vop;
 extern volatile uint8_t lcd_bias;
 extern volatile uint8_t lcd_tempCoef;
-extern volatile int16_t graphCurrentYMin;
-extern volatile int16_t graphCurrentYMax;
-extern volatile int16_t graphYMin[GRAPH_COUNT];
-extern volatile int16_t graphYMax[GRAPH_COUNT];
-extern volatile uint8_t graphDrawPoints[GRAPH_COUNT];
+
+// columns drawn for one character by LcdString, or by LcdTinyString if tiny
+#define LcdCharWidth(character, tiny) ((tiny) ? ((character) == 'm' ? 6 : 4) : 6)
 
 void LcdReset(void);
 void LcdClear(void);
 void LcdPowerSave(uint8_t powerSaveOn);
 void LcdGoto(uint8_t x, uint8_t y);
 void LcdWrite(uint8_t dc, uint8_t data);
+void LcdDataBegin(void);
+void LcdData(uint8_t data);
+void LcdDataEnd(void);
 void LcdCharacter(char character);
 void LcdString(char *characters);
 void LcdTinyString(char *characters, uint8_t inverse);
 void LcdTinyStringFramed(char *characters);
 void LcdDrawHeading(char *characters, uint8_t inverse);
 void LcdDrawTitle(uint8_t graphType, uint8_t timescaleNumber, uint8_t inverse);
-void LcdDrawGraph2(uint8_t timescaleNumber, uint8_t type, uint8_t cursorPos, uint8_t showCursor);
+void LcdDrawGraph2(uint8_t timescaleNumber, uint8_t type, uint8_t cursorPos, uint8_t showCursor, uint16_t minutesAgo);
 void LcdMakeGraphYAxis(uint8_t type, int yminlabel, int ymaxlabel, uint8_t* yMinBUffer, uint8_t* yMaxBuffer, uint8_t* yMinSize, uint8_t* yMaxSize);
 void LcdDrawGraphLeftLegend(char *characters);
 void LcdDrawGraphRightLegend(char *characters);
@@ -15,12 +15,16 @@
 
 #include <avr/eeprom.h>
 #include <util/atomic.h>
+#include <util/crc16.h>
 #include <stdlib.h>
 #include "config.h"
 
 #include "sampling.h"
 #include "bmp085.h"
 #include "clock.h"
+#include "fixedpoint.h"
+#include "trend.h"
+#include "trip.h"
 
 #ifdef NOKIA_LCD
 #include "noklcd.h"
@@ -32,19 +36,33 @@
 // EEPROM header format
 // page 0
 // 0-1: version (2 bytes)
-// 2: reserved (1 byte)
-// 3: first timescale next sample index (1 byte)
+// 2: boot counter, incremented whenever the SRAM timescales are reset (1 byte)
+// 3: first EEPROM timescale next sample index (1 byte)
 // page 1
-// 4-5: reserved (3 bytes)
-// 7: second timescale next sample index (1 byte)
+// 4: first EEPROM timescale generation, incremented whenever the EEPROM is cleared (1 byte)
+// 5-7: reserved (3 bytes)
+// page 2
+// 8-11: first EEPROM timescale sample sequence number (4 bytes)
+// page 3
+// 12-15: device ID, chosen at random the first time the Logger starts, and kept when the EEPROM is cleared (4 bytes)
 
 #define EEPROM_HEADER_BASE 0
-#define EEPROM_SIGNATURE 0xBEB3
+// changed whenever the layout changes, so EEPROM written with an older layout is cleared instead of misread. 
+// 0xBEB4 moved the end of the snapshots to make room for the trip statistics.
+#define EEPROM_SIGNATURE 0xBEB4
+
+#define EEPROM_BOOT_COUNT_ADDRESS ((uint8_t*)EEPROM_HEADER_BASE + 2)
+#define EEPROM_GENERATION_ADDRESS ((uint8_t*)EEPROM_HEADER_BASE + 4)
+#define EEPROM_SEQUENCE_ADDRESS ((uint32_t*)EEPROM_HEADER_BASE + 2)
+#define EEPROM_DEVICE_ID_ADDRESS ((uint32_t*)EEPROM_HEADER_BASE + 3)
 
 #define EEPROM_SAMPLES_BASE 16
 
 #define EEPROM_SNAPSHOTS_BASE (EEPROM_SAMPLES_BASE+(NUM_TIME_SCALES-NUM_SRAM_TIME_SCALES)*(SAMPLES_PER_GRAPH*sizeof(Sample)))
-#define EEPROM_SNAPSHOTS_MAX ((1024-EEPROM_SNAPSHOTS_BASE)/sizeof(Snapshot))
+#define EEPROM_SNAPSHOTS_MAX ((EEPROM_TRIP_BASE-EEPROM_SNAPSHOTS_BASE)/sizeof(Snapshot))
+
+// the trip statistics occupy the last bytes of the EEPROM, with their own CRC
+#define EEPROM_TRIP_BASE (1024-sizeof(TripStats))
 
 short last_temperature; // units of 2 * degrees F (halves of a degree)
 long last_pressure; // units of 100 * millibars (hundredths of a millibar)
@@ -54,6 +72,22 @@ volatile uint8_t useImperialUnits = 3;
 
 Sample sampleData[NUM_SRAM_TIME_SCALES][SAMPLES_PER_GRAPH]; 
 uint8_t nextSampleIndex[NUM_SRAM_TIME_SCALES]; 
+uint32_t sampleSequence[NUM_SRAM_TIME_SCALES]; // number of samples stored in each SRAM timescale since the last reset
+uint8_t bootCount;
+uint8_t dataChangeCount; // incremented whenever a sample or snapshot is stored
+
+// the snapshot directory, read from EEPROM once by SamplingInit and kept up to date by StoreSnapshot
+#define SNAPSHOT_CACHE_SIZE 4 // a power of 2, at least the number of snapshots shown at once
+#define SNAPSHOT_CACHE_EMPTY 0xFF
+uint8_t snapshotNewestIndex;
+uint8_t snapshotCount;
+// recently read snapshots, each kept in the slot given by its position counting back from the newest
+Snapshot snapshotCache[SNAPSHOT_CACHE_SIZE];
+uint8_t snapshotCacheIndex[SNAPSHOT_CACHE_SIZE];
+uint32_t deviceId;
+
+// not cleared at startup. SRAM contents at power-on are random enough to tell a few dozen Loggers apart.
+uint8_t powerOnNoise[16] __attribute__ ((section (".noinit")));
 
 #ifdef LOGGER_CLASSIC
 // classic: 90m, 8h, 1.75d
@@ -120,6 +154,53 @@ uint8_t GetTimescaleNextSampleIndex(uint8_t timescaleNumber)
 	}	
 }
 
+// the sequence number that will be assigned to the next sample stored in a timescale.
+// the sequence number of the sample at GetTimescaleNextSampleIndex()-1 is one less than this.
+uint32_t GetTimescaleSequence(uint8_t timescaleNumber)
+{
+	if (timescaleNumber < NUM_SRAM_TIME_SCALES)
+		return sampleSequence[timescaleNumber];
+	else
+		return eeprom_read_dword(EEPROM_SEQUENCE_ADDRESS + (timescaleNumber-NUM_SRAM_TIME_SCALES));
+}
+
+// sequence numbers are only comparable while the generation is unchanged.
+// SRAM timescales restart at every boot, EEPROM timescales restart when the EEPROM is cleared.
+uint8_t GetTimescaleGeneration(uint8_t timescaleNumber)
+{
+	if (timescaleNumber < NUM_SRAM_TIME_SCALES)
+		return bootCount;
+	else
+		return eeprom_read_byte(EEPROM_GENERATION_ADDRESS + (timescaleNumber-NUM_SRAM_TIME_SCALES)*4);
+}
+
+// identifies the current contents of all the graphs and snapshots. 
+// a host can compare this before and after a series of commands, to check that the data didn't change in between.
+uint16_t GetDataGeneration()
+{
+	return ((uint16_t)bootCount << 8) | dataChangeCount;
+}
+
+// identifies this Logger, so a host syncing several of them can keep their data apart
+uint32_t GetDeviceId()
+{
+	return deviceId;
+}
+
+uint32_t MakeDeviceId()
+{
+	// two CRCs of the power-on SRAM contents, and the crystal timer's position when the CPU got here
+	uint16_t crcLow = TCNT2;
+	uint16_t crcHigh = 0xFFFF;
+	for (uint8_t i=0; i<sizeof(powerOnNoise); i++)
+	{
+		crcLow = _crc_xmodem_update(crcLow, powerOnNoise[i]);
+		crcHigh = _crc16_update(crcHigh, powerOnNoise[i]);
+	}
+	
+	return ((uint32_t)crcHigh << 16) | crcLow;
+}
+
 uint32_t sample_eeprom_dword;
 
 Sample* GetSample(uint8_t timescaleNumber, uint8_t index)
@@ -168,6 +249,7 @@ void FillSample(Sample* pSample, short temperatureRaw, long pressureRaw)
 	// altitude (FT) 
 	last_altitude = 3.28f * bmp085GetAltitude((float)pressureRaw); 
 	long altitudeSample = (long) (last_altitude + 0.5f);	
+	TrendAltitudeUpdate(altitudeSample);
 	if (altitudeSample < ALTITUDE_MIN)
 	{
 		altitudeSample = ALTITUDE_MIN;			 // cap at min value
@@ -262,11 +344,16 @@ void StoreSample(short temperatureRaw, long pressureRaw)
 	Sample newSample;
 	
 	FillSample(&newSample, temperatureRaw, pressureRaw);
+	
+	// FillSample just fed the altitude filter, so its estimate is current
+	TripUpdate((TrendGetAltitude() + 8) >> 4);
 
 	#if TRACK_DAILYHIGHLOW
 	_UpdateHighLow( &newSample );
 	#endif
 	
+	dataChangeCount++;
+	
 	for (uint8_t i=0; i<NUM_TIME_SCALES; i++)
 	{
 		if (i == 0 || (((int)clock_hour * 60 + clock_minute) % minutesPerSample[i]) == 0)
@@ -278,9 +365,12 @@ void StoreSample(short temperatureRaw, long pressureRaw)
 			
 				*pSample = newSample;
 			
+				TrendSampleStored(i, index);
+				
 				index++;
 				index %= SAMPLES_PER_GRAPH;
 				nextSampleIndex[i] = index;
+				sampleSequence[i]++;
 			}		
 			else
 			{
@@ -294,43 +384,77 @@ void StoreSample(short temperatureRaw, long pressureRaw)
 				index++;
 				index %= SAMPLES_PER_GRAPH;			
 				eeprom_update_byte(eepromIndexAddress, index);					
+				
+				uint32_t* eepromSequenceAddress = EEPROM_SEQUENCE_ADDRESS + (i-NUM_SRAM_TIME_SCALES);
+				eeprom_update_dword(eepromSequenceAddress, eeprom_read_dword(eepromSequenceAddress) + 1);
 			}	
 		}
 	}
 }
 
+// consecutive snapshots are at consecutive positions, so up to SNAPSHOT_CACHE_SIZE of them shown together 
+// use different slots, even where the list wraps around from the last index to the first
+static uint8_t SnapshotCacheSlot(uint8_t index)
+{
+	uint8_t position = snapshotNewestIndex - index;
+	if (index > snapshotNewestIndex)
+	{
+		position += EEPROM_SNAPSHOTS_MAX;
+	}
+	return position & (SNAPSHOT_CACHE_SIZE-1);
+}
+
 void StoreSnapshot(short temperatureRaw, long pressureRaw, uint32_t packedYearMonthDayHourMin)
 {
 	Sample newSample;
 	
 	FillSample(&newSample, temperatureRaw, pressureRaw);
 	
-	// find the oldest snapshot
-	uint8_t oldestIndex = 0;
-	uint32_t oldestTime = 0xFFFFFFFF;
-	for (uint8_t i=0; i<EEPROM_SNAPSHOTS_MAX; i++)
+	dataChangeCount++;
+	
+	// overwrite the oldest snapshot, which follows the newest one once the list is full
+	uint8_t oldestIndex = snapshotCount;
+	if (snapshotCount == EEPROM_SNAPSHOTS_MAX)
 	{
-		uint32_t* eepromAddress = (uint32_t*)(EEPROM_SNAPSHOTS_BASE + i*sizeof(Snapshot));
-		uint32_t time = eeprom_read_dword(eepromAddress);
-		if (time < oldestTime)
-		{
-			oldestTime = time;
-			oldestIndex = i;
-		}
+		oldestIndex = snapshotNewestIndex + 1;
+		if (oldestIndex == EEPROM_SNAPSHOTS_MAX)
+			oldestIndex = 0;
+	}
+	else
+	{
+		snapshotCount++;
 	}
 	
-	// overwrite the oldest snapshot
 	uint32_t* eepromAddress = (uint32_t*)(EEPROM_SNAPSHOTS_BASE + oldestIndex*sizeof(Snapshot));
 	eeprom_update_dword(eepromAddress, packedYearMonthDayHourMin);
 	uint32_t* pDword = (uint32_t*)&newSample; // treat sample as a generic dword
 	eeprom_update_dword(eepromAddress+1, *pDword);
+	
+	snapshotNewestIndex = oldestIndex;
+	
+	// every position just moved by one, so the other entries will miss once. the old copy of the overwritten 
+	// snapshot must go, or a later position could land on its slot and find it.
+	for (uint8_t i=0; i<SNAPSHOT_CACHE_SIZE; i++)
+	{
+		if (snapshotCacheIndex[i] == oldestIndex)
+		{
+			snapshotCacheIndex[i] = SNAPSHOT_CACHE_EMPTY;
+		}
+	}
+	
+	uint8_t slot = SnapshotCacheSlot(oldestIndex);
+	snapshotCacheIndex[slot] = oldestIndex;
+	snapshotCache[slot].packedYearMonthDayHourMin = packedYearMonthDayHourMin;
+	snapshotCache[slot].sample = newSample;
 }
 
-uint8_t GetNewestSnapshotIndex()
+// scan the snapshots in EEPROM for the newest one and the number in use
+static void LoadSnapshotDirectory()
 {
-	// find the newest snapshot
-	uint8_t newestIndex = 0;
 	uint32_t newestTime = 0;
+	snapshotNewestIndex = 0;
+	snapshotCount = 0;
+	
 	for (uint8_t i=0; i<EEPROM_SNAPSHOTS_MAX; i++)
 	{
 		uint32_t* eepromAddress = (uint32_t*)(EEPROM_SNAPSHOTS_BASE + i*sizeof(Snapshot));
@@ -338,27 +462,47 @@ uint8_t GetNewestSnapshotIndex()
 		if (time >= newestTime)
 		{
 			newestTime = time;
-			newestIndex = i;
+			snapshotNewestIndex = i;
+		}
+		
+		// snapshots are stored in order from the first one, so the used ones come before any empty one
+		if (time != 0 && snapshotCount == i)
+		{
+			snapshotCount++;
 		}
 	}
 	
-	return newestIndex;
+	for (uint8_t i=0; i<SNAPSHOT_CACHE_SIZE; i++)
+	{
+		snapshotCacheIndex[i] = SNAPSHOT_CACHE_EMPTY;
+	}
 }
 
-Snapshot eepromSnapshot;
+uint8_t GetNewestSnapshotIndex()
+{
+	return snapshotNewestIndex;
+}
 
 Snapshot* GetSnapshot(uint8_t index)
 {
-	uint32_t* eepromAddress = (uint32_t*)(EEPROM_SNAPSHOTS_BASE + index*sizeof(Snapshot));
-	uint32_t packedTime = eeprom_read_dword(eepromAddress);
+	uint8_t slot = SnapshotCacheSlot(index);
+	Snapshot* pSnapshot = &snapshotCache[slot];
 	
-	eepromSnapshot.packedYearMonthDayHourMin = packedTime;
-	
-	uint32_t sampleDword = eeprom_read_dword(eepromAddress+1);
-	Sample* pSample = (Sample*)&sampleDword;
-	eepromSnapshot.sample = *pSample;
+	if (snapshotCacheIndex[slot] != index)
+	{
+		uint32_t* eepromAddress = (uint32_t*)(EEPROM_SNAPSHOTS_BASE + index*sizeof(Snapshot));
+		uint32_t packedTime = eeprom_read_dword(eepromAddress);
+		
+		pSnapshot->packedYearMonthDayHourMin = packedTime;
+		
+		uint32_t sampleDword = eeprom_read_dword(eepromAddress+1);
+		Sample* pSample = (Sample*)&sampleDword;
+		pSnapshot->sample = *pSample;
+		
+		snapshotCacheIndex[slot] = index;
+	}
 	
-	return &eepromSnapshot;
+	return pSnapshot;
 }
 
 uint8_t GetMaxSnapshots()
@@ -368,19 +512,7 @@ uint8_t GetMaxSnapshots()
 
 uint8_t GetNumSnapshots()
 {
-	uint8_t count = 0;
-	
-	for (uint8_t i=0; i<EEPROM_SNAPSHOTS_MAX; i++)
-	{
-		uint32_t* eepromAddress = (uint32_t*)(EEPROM_SNAPSHOTS_BASE + i*sizeof(Snapshot));
-		uint32_t time = eeprom_read_dword(eepromAddress);
-		if (time == 0)
-			break;
-		
-		count++;
-	}
-	
-	return count;	
+	return snapshotCount;	
 }
 
 void SamplingInit(uint8_t forceEEpromClear)
@@ -390,6 +522,7 @@ void SamplingInit(uint8_t forceEEpromClear)
 	for (uint8_t i=0; i<NUM_SRAM_TIME_SCALES; i++)
 	{
 		nextSampleIndex[i] = 0;
+		sampleSequence[i] = 0;
 		
 		for (uint8_t j=0; j<SAMPLES_PER_GRAPH; j++)
 		{
@@ -400,9 +533,12 @@ void SamplingInit(uint8_t forceEEpromClear)
 		}
 	}
 	
+	TrendInit();
+	
 	// check EEPROM signature
 	uint16_t signature = eeprom_read_word((uint16_t*)EEPROM_HEADER_BASE);
-	if (signature == EEPROM_SIGNATURE && !forceEEpromClear)
+	uint8_t eepromClear = (signature != EEPROM_SIGNATURE || forceEEpromClear);
+	if (!eepromClear)
 	{
 		//LcdString("EEPROM sig OK");
 	}
@@ -410,9 +546,12 @@ void SamplingInit(uint8_t forceEEpromClear)
 	{	
 		LcdString("EEPROM init...");
 		
-		// write the header
-		eeprom_update_dword((uint32_t*)EEPROM_HEADER_BASE, EEPROM_SIGNATURE); // signature, and first timescale index	
-		eeprom_update_dword((uint32_t*)EEPROM_HEADER_BASE + 1, 0);
+		// write the header, keeping the boot counter and advancing the generation so old sequence numbers are invalidated
+		uint8_t generation = eeprom_read_byte(EEPROM_GENERATION_ADDRESS) + 1;
+		eeprom_update_word((uint16_t*)EEPROM_HEADER_BASE, EEPROM_SIGNATURE);
+		eeprom_update_byte((uint8_t*)EEPROM_HEADER_BASE + 3, 0); // first timescale index	
+		eeprom_update_dword((uint32_t*)EEPROM_HEADER_BASE + 1, generation);
+		eeprom_update_dword(EEPROM_SEQUENCE_ADDRESS, 0);
 		
 		// clear all the samples
 		for (uint8_t scale=NUM_SRAM_TIME_SCALES; scale < NUM_TIME_SCALES; scale++)
@@ -431,28 +570,48 @@ void SamplingInit(uint8_t forceEEpromClear)
 			eeprom_update_dword(eepromAddress+1, 0);
 		}
 	}		
+	
+	// the SRAM timescales were just cleared, so start a new generation for them
+	bootCount = eeprom_read_byte(EEPROM_BOOT_COUNT_ADDRESS) + 1;
+	eeprom_update_byte(EEPROM_BOOT_COUNT_ADDRESS, bootCount);
+	
+	// choose a device ID the first time, or if the EEPROM was never written
+	deviceId = eeprom_read_dword(EEPROM_DEVICE_ID_ADDRESS);
+	if (deviceId == 0 || deviceId == 0xFFFFFFFF)
+	{
+		deviceId = MakeDeviceId();
+		eeprom_update_dword(EEPROM_DEVICE_ID_ADDRESS, deviceId);
+	}
+	
+	LoadSnapshotDirectory();
+	TripInit((TripStats*)EEPROM_TRIP_BASE, eepromClear);
 }
 
 void MakeTemperatureString(char* str, int16_t val)
 {
 	// val is temperature in units of 2 * degrees F
-	double fVal = val;
-	if (!useImperialUnits)
+	if (useImperialUnits)
+	{
+		MakeFixedPointString(str, val, 2, 1);
+	}
+	else
 	{
-		fVal = ((fVal - 64) * 5) / 9;
+		// (val/2 - 32) * 5/9 degrees C
+		MakeFixedPointString(str, ((int32_t)val - 64) * 5, 18, 1);
 	}
-	dtostrf(fVal/2, 1, 1, str);	
 }
 	
 void MakeTemperatureDifferenceString(char* str, int16_t val)
 {
 	// val is temperature difference in units of 2 * degrees F (half degree per unit)
-	double fVal = val;
-	if (!useImperialUnits)
+	if (useImperialUnits)
+	{
+		MakeFixedPointString(str, val, 2, 1);
+	}
+	else
 	{
-		fVal = (fVal * 5) / 9;
+		MakeFixedPointString(str, (int32_t)val * 5, 18, 1);
 	}
-	dtostrf(fVal/2, 1, 1, str);	
 }
 	
 void MakePressureString(char* str, int16_t val)
@@ -464,7 +623,7 @@ void MakePressureString(char* str, int16_t val)
 		longValue = 2953L * val; // 100000 * 0.0295301
 		val = longValue / 100000;
 	}			
-	dtostrf((double)val/2, 1, useImperialUnits?2:0, str);	
+	MakeFixedPointString(str, val, 2, useImperialUnits?2:0);	
 }	
 
 void MakeAltitudeString(char* str, int16_t val)		
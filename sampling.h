@@ -87,8 +87,13 @@ typedef struct
 } Snapshot;
 
 void SamplingInit(uint8_t forceEEpromClear);
+void FillSample(Sample* pSample, short temperatureRaw, long pressureRaw);
 void StoreSample(short temperatureRaw, long pressureRaw);
 uint8_t GetTimescaleNextSampleIndex(uint8_t timescaleNumber);
+uint32_t GetTimescaleSequence(uint8_t timescaleNumber);
+uint8_t GetTimescaleGeneration(uint8_t timescaleNumber);
+uint16_t GetDataGeneration();
+uint32_t GetDeviceId();
 Sample* GetSample(uint8_t timescaleNumber, uint8_t index);
 void MakePressureString(char* str, int16_t val);
 void MakeTemperatureString(char* str, int16_t val);	
@@ -22,11 +22,15 @@
 #include <avr/io.h>
 #include <avr/interrupt.h>
 #include <util/delay.h>
+#include <util/crc16.h>
+#include <util/atomic.h>
+#include <stddef.h>
 #include "serial.h"
 #include "speaker.h"
 #include "sampling.h"
 #include "clock.h"
 #include "hikea.h"
+#include "trip.h"
 
 #define SERIAL_IN PB4
 #define SERIAL_OUT PB3
@@ -34,6 +38,47 @@
 #define CMD_VERSION '1'
 #define CMD_GETGRAPHS '2'
 #define CMD_GETSNAPSHOTS '3'
+#define CMD_GETSAMPLESSINCE '4'
+#define CMD_GETID '5'
+#define CMD_GETTRIP '6'
+
+#define CMD_STREAM 'S'
+#define CMD_CALIBRATE 'C'
+
+// CMD_GETSAMPLESSINCE arguments: timescale, generation, sequence number (4 bytes, LSB first)
+#define SAMPLES_SINCE_ARGS 6
+// CMD_STREAM arguments: seconds between records (0 to stop streaming), minutes until streaming stops unless renewed
+#define STREAM_ARGS 2
+// CMD_GETGRAPHS argument: highest graphs version the host understands. Only sent with framed commands, because
+// hosts that don't know about framing also don't know about any graphs version but 1.
+#define GRAPHS_ARGS 1
+#define MAX_ARGS SAMPLES_SINCE_ARGS
+
+// stream record format: STREAM_SYNC, record sequence number (2 bytes, LSB first), packed year/month/day/hour/minute 
+// (4 bytes, LSB first), second, Sample (4 bytes), CRC16 (xmodem, 2 bytes, LSB first) of everything before it.
+#define STREAM_SYNC 0xA5
+
+// CMD_CALIBRATE: the host follows the command with CALIBRATE_BYTES bytes of 0x7F, which the Logger times with its 
+// own clock instead of receiving. 0x7F has one falling edge at the start bit and another at bit 7, exactly 
+// CALIBRATE_BITS bit times later, no matter how far apart the host sends the bytes. Reply: calibration version, 
+// number of bytes timed, total clock cycles they took (4 bytes, LSB first), clock cycles per bit the Logger sends 
+// at (2 bytes, LSB first). The host works out the Logger's actual bit rate from that.
+#define CALIBRATE_BYTES 8
+#define CALIBRATE_BITS 8
+
+// framed commands: CMD_FRAMED is followed by another command and its arguments, and the result is sent as
+// a series of blocks each with its own CRC. CMD_RETRANSMIT is the same, plus a block index (2 bytes, LSB first),
+// and sends only that one block of the result.
+#define CMD_FRAMED 'F'
+#define CMD_RETRANSMIT 'R'
+
+// framed response format: "LOG", frame version, block size, data generation (2 bytes, LSB first), then blocks.
+// each block is: block index (2 bytes, LSB first), length (1 byte), FRAME_BLOCK_SIZE data bytes padded with zeroes,
+// CRC16 (xmodem, 2 bytes, LSB first) of everything before it in the block. 
+// the last block is the first one whose length is less than FRAME_BLOCK_SIZE, and may be empty.
+#define FRAME_VERSION 1
+#define FRAME_BLOCK_SIZE 32
+#define FRAME_ALL_BLOCKS 0xFFFF
 
 // determine how many clock cycles in one 26 microsecond bit time at 38400 bps
 #ifdef LOGGER_CLASSIC	
@@ -45,15 +90,32 @@
 	my particular ATmega chip and battery voltage, and it will be too fast for someone else's Logger?
 */
 #define BIT_TIME 24
+
+// the timer wraps every 65536 cycles, or 65 ms, during calibration. Give up after about half a second.
+#define CALIBRATE_TIMEOUT 8
 #endif
 
 #ifdef LOGGER_MINI	
 // 8000000 MHz / 38400 bps = 208 cycles per bit. Select a timer compare value of 207 to get a 208 cycle period.
 #define BIT_TIME 207
+
+// the timer wraps every 65536 cycles, or 8 ms, during calibration. Give up after about half a second.
+#define CALIBRATE_TIMEOUT 64
 #endif	
 
 uint8_t checksum;
 
+uint8_t framing;
+uint8_t frameBuffer[FRAME_BLOCK_SIZE];
+uint8_t frameLength;
+uint16_t frameIndex;
+uint16_t frameSelected;
+
+volatile uint8_t streamInterval;
+volatile uint8_t streamCountdown;
+volatile uint8_t streamMinutesLeft;
+uint16_t streamSequence;
+
 void SerialInit()
 {
 	// enable the internal pull-up for serial in
@@ -65,6 +127,11 @@ void SerialBegin()
 	// turn off the speaker beeps, so we can use the timers without interference
 	SpeakerOff();
 	
+	SerialStartTimer();
+}
+
+void SerialStartTimer()
+{
 	// configure the timer for use with serial communication
 	// setup timer 1 for note length of approximately 100 ms
 	PRR &= ~(1<<PRTIM1); // turn on the timer hardware
@@ -128,11 +195,66 @@ void SerialDoCommand()
 
 void SerialDispatchCommand(uint8_t cmd)
 {
+	uint8_t framedCmd = cmd;
+	if (cmd == CMD_FRAMED || cmd == CMD_RETRANSMIT)
+	{
+		cmd = SerialReceiveByte();
+	}
+	
+	// receive any command arguments before replying
+	uint8_t args[MAX_ARGS];
+	uint8_t numArgs = 0;
+	if (cmd == CMD_GETSAMPLESSINCE)
+	{
+		numArgs = SAMPLES_SINCE_ARGS;
+	}
+	else if (cmd == CMD_STREAM)
+	{
+		numArgs = STREAM_ARGS;
+	}
+	else if (cmd == CMD_GETGRAPHS && framedCmd != cmd)
+	{
+		numArgs = GRAPHS_ARGS;
+	}
+	
+	for (uint8_t i=0; i<numArgs; i++)
+	{
+		args[i] = SerialReceiveByte();
+	}
+	
+	// time the calibration bytes before replying, instead of receiving them
+	uint32_t calibrateCycles = 0;
+	uint8_t calibrateCount = 0;
+	if (cmd == CMD_CALIBRATE)
+	{
+		calibrateCount = SerialMeasureBitTime(&calibrateCycles);
+	}
+	
+	frameSelected = FRAME_ALL_BLOCKS;
+	if (framedCmd == CMD_RETRANSMIT)
+	{
+		frameSelected = SerialReceiveByte();
+		frameSelected |= (uint16_t)SerialReceiveByte() << 8;
+	}
+	
 	// send "LOG" prefix
 	SerialSendByte('L');
 	SerialSendByte('O');
 	SerialSendByte('G');
 	
+	if (framedCmd == CMD_FRAMED || framedCmd == CMD_RETRANSMIT)
+	{
+		uint16_t generation = GetDataGeneration();
+		SerialTransmitByte(FRAME_VERSION);
+		SerialTransmitByte(FRAME_BLOCK_SIZE);
+		SerialTransmitByte(generation & 0xFF);
+		SerialTransmitByte(generation >> 8);
+		
+		framing = 1;
+		frameIndex = 0;
+		frameLength = 0;
+	}
+	
 	// send the result of the command
 	checksum = 0;
 	switch (cmd)
@@ -146,26 +268,99 @@ void SerialDispatchCommand(uint8_t cmd)
 			break;
 		
 		case CMD_GETGRAPHS:
-			SerialSendGraphs();
+			SerialSendGraphs(numArgs ? args[0] : 1);
 			break;
 				
 		case CMD_GETSNAPSHOTS:
 			SerialSendSnapshots();
 			break;
 			
+		case CMD_GETSAMPLESSINCE:
+			SerialSendSamplesSince(args[0], args[1], *(uint32_t*)&args[2]);
+			break;
+			
+		case CMD_STREAM:
+			SerialStartStream(args[0], args[1]);
+			break;
+			
+		case CMD_GETID:
+			SerialSendDeviceId();
+			break;
+			
+		case CMD_GETTRIP:
+			SerialSendTripStats();
+			break;
+			
+		case CMD_CALIBRATE:
+			SerialSendCalibration(calibrateCount, calibrateCycles);
+			break;
+			
 		default:
 			// unrecognized command- do nothing
 			break;
 	}	
 	
-	// send the checksum
-	SerialSendByte(checksum);
+	if (framing)
+	{
+		// send the last, partially filled block
+		SerialFlushFrame();
+		
+		// if a retransmitted block is past the end of the result, send it as an empty last block
+		if (frameSelected != FRAME_ALL_BLOCKS && frameSelected >= frameIndex)
+		{
+			frameIndex = frameSelected;
+			SerialFlushFrame();
+		}
+		
+		framing = 0;
+	}
+	else
+	{
+		// send the checksum
+		SerialSendByte(checksum);
+	}
 }
 
-void SerialSendGraphs()
+void SerialFlushFrame()
+{
+	if (frameSelected == FRAME_ALL_BLOCKS || frameSelected == frameIndex)
+	{
+		uint16_t crc = 0;
+		uint8_t header[3] = { frameIndex & 0xFF, frameIndex >> 8, frameLength };
+		
+		for (uint8_t i=0; i<sizeof(header); i++)
+		{
+			crc = _crc_xmodem_update(crc, header[i]);
+			SerialTransmitByte(header[i]);
+		}
+		
+		for (uint8_t i=0; i<FRAME_BLOCK_SIZE; i++)
+		{
+			uint8_t c = (i < frameLength) ? frameBuffer[i] : 0;
+			crc = _crc_xmodem_update(crc, c);
+			SerialTransmitByte(c);
+		}
+		
+		SerialTransmitByte(crc & 0xFF);
+		SerialTransmitByte(crc >> 8);
+	}
+	
+	frameIndex++;
+	frameLength = 0;
+}
+
+void SerialSendGraphs(uint8_t version)
 {	
-	// graphs version number
-	SerialSendByte(1);
+	// graphs version number: 1 sends raw samples, 2 sends delta encoded samples
+	if (version > 2)
+	{
+		version = 2;
+	}
+	else if (version < 1)
+	{
+		version = 1;
+	}
+	SerialSendByte(version);
 	
 	// number of graphs
 	SerialSendByte(NUM_TIME_SCALES);
@@ -188,6 +383,12 @@ void SerialSendGraphs()
 		SerialSendByte(minutesPerSample[g] >> 8); // hi byte - TODO: should be big or little endian?
 		SerialSendByte(minutesPerSample[g] & 0xFF); // low byte
 		
+		if (version == 2)
+		{
+			SerialSendEncodedGraph(g);
+			continue;
+		}
+		
 		uint8_t index = GetTimescaleNextSampleIndex(g); 
 		for (uint8_t s=0; s<SAMPLES_PER_GRAPH; s++)
 		{
@@ -206,6 +407,241 @@ void SerialSendGraphs()
 	}				
 }
 
+// zigzag varint: 7 bits per byte LSB first, high bit set on all but the last byte
+void SerialSendVarint(int16_t value)
+{
+	uint16_t z = ((uint16_t)value << 1) ^ (uint16_t)(value >> 15);
+	while (z >= 0x80)
+	{
+		SerialSendByte(z | 0x80);
+		z >>= 7;
+	}
+	SerialSendByte(z);
+}
+
+/* graphs version 2 sample encoding. each sample is the difference from the previous one, in temperature, 
+	pressure, and altitude sample units, starting from an all-zero sample. each token is one of:
+	0ttppaaa: small differences t in -2..1, p in -2..1, a in -4..3 (two's complement)
+	10nnnnnn: the previous sample repeated n+1 times
+	11000000: followed by zigzag varints for the temperature, pressure, and altitude differences
+*/
+void SerialSendEncodedGraph(uint8_t g)
+{
+	uint8_t index = GetTimescaleNextSampleIndex(g); 
+	Sample prev = { 0, 0, 0 };
+	uint8_t repeats = 0;
+	
+	for (uint8_t s=0; s<SAMPLES_PER_GRAPH; s++)
+	{
+		Sample* pSample = GetSample(g, index);
+		index++;
+		if (index == SAMPLES_PER_GRAPH)
+		{
+			index = 0;
+		}
+		
+		int16_t dt = (int16_t)pSample->temperature - prev.temperature;
+		int16_t dp = (int16_t)pSample->pressure - prev.pressure;
+		int16_t da = (int16_t)pSample->altitude - prev.altitude;
+		prev = *pSample;
+		
+		if (dt == 0 && dp == 0 && da == 0)
+		{
+			repeats++;
+			if (repeats == 64)
+			{
+				SerialSendByte(0x80 | 63);
+				repeats = 0;
+			}
+			continue;
+		}
+		
+		if (repeats)
+		{
+			SerialSendByte(0x80 | (repeats-1));
+			repeats = 0;
+		}
+		
+		if (dt >= -2 && dt <= 1 && dp >= -2 && dp <= 1 && da >= -4 && da <= 3)
+		{
+			SerialSendByte(((dt & 0x3) << 5) | ((dp & 0x3) << 3) | (da & 0x7));
+		}
+		else
+		{
+			SerialSendByte(0xC0);
+			SerialSendVarint(dt);
+			SerialSendVarint(dp);
+			SerialSendVarint(da);
+		}
+	}
+	
+	if (repeats)
+	{
+		SerialSendByte(0x80 | (repeats-1));
+	}
+}
+
+void SerialSendSamplesSince(uint8_t timescale, uint8_t generation, uint32_t sequence)
+{
+	// samples version number
+	SerialSendByte(1);
+	
+	if (timescale >= NUM_TIME_SCALES)
+	{
+		timescale = 0;
+	}
+	SerialSendByte(timescale);
+	
+	uint8_t currentGeneration = GetTimescaleGeneration(timescale);
+	SerialSendByte(currentGeneration);
+	
+	// "now" time reference: the newest sample is the most recent time when minutes since midnight was a multiple of minutesPerSample
+	SerialSendByte(clock_second);
+	SerialSendByte(clock_minute);
+	SerialSendByte(clock_hour);
+	SerialSendByte(clock_day);
+	SerialSendByte(clock_month);
+	SerialSendByte(clock_year); // year - 2000
+	
+	SerialSendByte(minutesPerSample[timescale] >> 8); // hi byte
+	SerialSendByte(minutesPerSample[timescale] & 0xFF); // low byte
+	
+	// send everything still in the graph if the host's sequence number is from another generation, or is too old
+	uint32_t nextSequence = GetTimescaleSequence(timescale);
+	uint8_t retained = nextSequence < SAMPLES_PER_GRAPH ? nextSequence : SAMPLES_PER_GRAPH;
+	if (generation != currentGeneration || sequence > nextSequence || nextSequence - sequence > retained)
+	{
+		sequence = nextSequence - retained;
+	}
+	uint8_t count = nextSequence - sequence;
+	
+	// sequence number of the first sample sent, LSB first
+	for (uint8_t i=0; i<sizeof(uint32_t); i++)
+	{
+		SerialSendByte(*((uint8_t*)&sequence + i));
+	}
+	SerialSendByte(count);
+	
+	uint8_t index = GetTimescaleNextSampleIndex(timescale) + SAMPLES_PER_GRAPH - count;
+	if (index >= SAMPLES_PER_GRAPH)
+	{
+		index -= SAMPLES_PER_GRAPH;
+	}
+	
+	for (uint8_t s=0; s<count; s++)
+	{
+		Sample* pSample = GetSample(timescale, index);
+		index++;
+		if (index == SAMPLES_PER_GRAPH)
+		{
+			index = 0;
+		}
+		
+		for (uint8_t i=0; i<sizeof(Sample); i++)
+		{
+			SerialSendByte(*((uint8_t*)pSample + i));
+		}
+	}
+}
+
+void SerialStartStream(uint8_t interval, uint8_t minutes)
+{
+	if (minutes == 0)
+	{
+		interval = 0;
+	}
+	
+	streamMinutesLeft = minutes;
+	streamCountdown = 1;
+	streamInterval = interval;
+
+	// stream version number
+	SerialSendByte(1);
+	SerialSendByte(interval);
+	SerialSendByte(minutes);
+}
+
+// called once per second from the timer interrupt. returns non-zero when a stream record should be sent.
+uint8_t SerialStreamTick()
+{
+	if (streamInterval == 0)
+		return 0;
+		
+	// stop streaming if the host hasn't renewed it in time
+	if (clock_second == 0 && --streamMinutesLeft == 0)
+	{
+		streamInterval = 0;
+		return 0;
+	}
+	
+	if (--streamCountdown == 0)
+	{
+		streamCountdown = streamInterval;
+		return 1;
+	}
+	
+	return 0;
+}
+
+void SerialSendStreamRecord(Sample* pSample)
+{
+	uint8_t record[12];
+	
+	record[0] = STREAM_SYNC;
+	record[1] = streamSequence & 0xFF;
+	record[2] = streamSequence >> 8;
+	
+	uint32_t packedTime = ClockGetPackedTime();
+	for (uint8_t i=0; i<sizeof(uint32_t); i++)
+	{
+		record[3+i] = *((uint8_t*)&packedTime + i);
+	}
+	record[7] = clock_second;
+	
+	for (uint8_t i=0; i<sizeof(Sample); i++)
+	{
+		record[8+i] = *((uint8_t*)pSample + i);
+	}
+	
+	uint16_t crc = 0;
+	for (uint8_t i=0; i<sizeof(record); i++)
+	{
+		crc = _crc_xmodem_update(crc, record[i]);
+	}
+	
+	// the bit timing must not be disturbed by other interrupts. A beep that's playing keeps its tone on timer 0, and
+	// gets timer 1 back afterwards to time the rest of the note, so streaming doesn't cut it off.
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		uint8_t beeping = speaker_in_use;
+		uint8_t noteControl = TCCR1B;
+		uint16_t noteLength = OCR1A;
+		uint16_t noteTime = TCNT1;
+		
+		SerialStartTimer();
+		for (uint8_t i=0; i<sizeof(record); i++)
+		{
+			SerialTransmitByte(record[i]);
+		}
+		SerialTransmitByte(crc & 0xFF);
+		SerialTransmitByte(crc >> 8);
+		
+		if (beeping)
+		{
+			TCCR1B = noteControl;
+			OCR1A = noteLength;
+			TCNT1 = noteTime;
+			TIFR1 = (1 << OCF1A); // the serial timing set the compare match flag, which isn't the end of the note
+		}
+		else
+		{
+			SerialEnd();
+		}
+	}
+	
+	streamSequence++;
+}
+
 void SerialSendSnapshots()
 {	
 	// snapshot version number
@@ -237,10 +673,128 @@ void SerialSendSnapshots()
 	}				
 }
 
-void SerialSendByte(uint8_t c)
+// trip statistics version 1: total ascent and descent in feet (4 bytes each), highest and lowest altitude in feet
+// (2 bytes each, signed, highest less than lowest if there are none yet), elapsed and moving minutes (2 bytes 
+// each), all LSB first
+void SerialSendTripStats()
+{
+	SerialSendByte(1);
+	
+	TripStats* pTrip = TripGetStats();
+	for (uint8_t i=0; i<offsetof(TripStats, crc); i++)
+	{
+		SerialSendByte(*((uint8_t*)pTrip + i));
+	}
+}
+
+void SerialSendDeviceId()
+{
+	// device ID version number
+	SerialSendByte(1);
+	
+	// device ID, LSB first
+	uint32_t id = GetDeviceId();
+	for (uint8_t i=0; i<4; i++)
+	{
+		SerialSendByte(id & 0xFF);
+		id >>= 8;
+	}
+}
+
+void SerialSendCalibration(uint8_t count, uint32_t cycles)
+{
+	// calibration version number
+	SerialSendByte(1);
+	
+	SerialSendByte(count);
+	for (uint8_t i=0; i<4; i++)
+	{
+		SerialSendByte(cycles & 0xFF);
+		cycles >>= 8;
+	}
+	
+	SerialSendByte((BIT_TIME+1) & 0xFF);
+	SerialSendByte((BIT_TIME+1) >> 8);
+}
+
+// wait for the serial input to be high or low, up to the calibration timeout. wraps counts timer periods so far.
+uint8_t SerialWaitForLevel(uint8_t high, uint8_t* pWraps)
+{
+	uint8_t level = high ? (1<<SERIAL_IN) : 0;
+	while ((PINB & (1<<SERIAL_IN)) != level)
+	{
+		// timer compare match flag is set?
+		if (bit_is_set(TIFR1, OCF1A))
+		{
+			TIFR1 = (1 << OCF1A); // clear the compare match flag
+			(*pWraps)++;
+			if (*pWraps == CALIBRATE_TIMEOUT)
+				return 0;
+		}
+	}
+	
+	return 1;
+}
+
+// time the falling edges of the host's calibration bytes. Returns the number of bytes timed, and their total clock 
+// cycles in pCycles. Interrupts are already off, since this runs from the serial pin change interrupt.
+uint8_t SerialMeasureBitTime(uint32_t* pCycles)
 {
-	checksum ^= c;
+	// let the timer count through its whole range, so a byte can be timed without it resetting
+	OCR1AH = 0xFF;
+	OCR1AL = 0xFF;
+	TIFR1 = (1 << OCF1A); // clear the compare match flag
+	
+	uint8_t count = 0;
+	uint8_t wraps = 0;
+	*pCycles = 0;
+	while (count < CALIBRATE_BYTES)
+	{
+		// wait for a mark followed by a start bit
+		if (!SerialWaitForLevel(1, &wraps) || !SerialWaitForLevel(0, &wraps))
+			break;
+		uint16_t start = TCNT1;
 		
+		// bits 0 to 6 are ones, then bit 7 is a zero
+		if (!SerialWaitForLevel(1, &wraps) || !SerialWaitForLevel(0, &wraps))
+			break;
+		uint16_t end = TCNT1;
+		
+		// unsigned subtraction is correct even if the timer wrapped in between
+		*pCycles += (uint16_t)(end - start);
+		count++;
+	}
+	
+	// back to the bit time, for sending the reply
+	OCR1AH = 0;
+	OCR1AL = BIT_TIME;
+	TCNT1H = 0;
+	TCNT1L = 0;
+	TIFR1 = (1 << OCF1A); // clear the compare match flag
+	
+	return count;
+}
+
+// send one byte of a command result, either directly or as part of a block
+void SerialSendByte(uint8_t c)
+{
+	if (framing)
+	{
+		frameBuffer[frameLength++] = c;
+		if (frameLength == FRAME_BLOCK_SIZE)
+		{
+			SerialFlushFrame();
+		}
+	}
+	else
+	{
+		checksum ^= c;
+		SerialTransmitByte(c);
+	}
+}
+
+void SerialTransmitByte(uint8_t c)
+{
 	// mark
 	PORTB |= (1<<SERIAL_OUT);
 	TIFR1 = (1 << OCF1A); // clear the compare match flag
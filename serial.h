@@ -17,14 +17,30 @@
 #ifndef SERIAL_H_
 #define SERIAL_H_
 
+#include "sampling.h"
+
 void SerialInit();
 void SerialBegin();
+void SerialStartTimer();
 void SerialEnd();
 void SerialDoCommand();
 void SerialDispatchCommand(uint8_t cmd);
-void SerialSendGraphs();
+void SerialSendGraphs(uint8_t version);
+void SerialSendVarint(int16_t value);
+void SerialSendEncodedGraph(uint8_t g);
 void SerialSendSnapshots();
+void SerialSendDeviceId();
+void SerialSendTripStats();
+void SerialSendCalibration(uint8_t count, uint32_t cycles);
+uint8_t SerialWaitForLevel(uint8_t high, uint8_t* pWraps);
+uint8_t SerialMeasureBitTime(uint32_t* pCycles);
+void SerialSendSamplesSince(uint8_t timescale, uint8_t generation, uint32_t sequence);
+void SerialStartStream(uint8_t interval, uint8_t minutes);
+uint8_t SerialStreamTick();
+void SerialSendStreamRecord(Sample* pSample);
 void SerialSendByte(uint8_t c);
+void SerialTransmitByte(uint8_t c);
+void SerialFlushFrame();
 uint8_t SerialReceiveByte();
 
 
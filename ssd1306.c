@@ -16,28 +16,15 @@
 #ifdef SSD1306_LCD
 
 #include <string.h>
-#include <util/atomic.h>
 #include <util/delay.h>
 #include "ssd1306.h"
 #include "glcdfont.c"
 #include "clock.h"
 
 volatile uint8_t lcd_contrast;
-volatile int16_t graphCurrentYMin;
-volatile int16_t graphCurrentYMax;
-volatile int16_t graphYMin[GRAPH_COUNT];
-volatile int16_t graphYMax[GRAPH_COUNT];
-volatile uint8_t graphDrawPoints[GRAPH_COUNT];
 
-inline void ssd1306_write(uint8_t dc, uint8_t c) 
-{  	
-	if (dc)
-		OLED_CONTROL_PORT |= (1<<OLED_DC);
-	else
-		OLED_CONTROL_PORT &= ~(1<<OLED_DC);
-		
-	OLED_CONTROL_PORT &= ~(1<<OLED_CS);
-  		  
+static inline void ssd1306_shift(uint8_t c)
+{
 	for (uint8_t i = 0; i < 8; i++)  
 	{						
 		OLED_DATA_PORT &= ~(1<<OLED_CLK); 
@@ -51,6 +38,18 @@ inline void ssd1306_write(uint8_t dc, uint8_t c)
 					
 		OLED_DATA_PORT |= (1<<OLED_CLK); 			
 	}
+}
+
+inline void ssd1306_write(uint8_t dc, uint8_t c) 
+{  	
+	if (dc)
+		OLED_CONTROL_PORT |= (1<<OLED_DC);
+	else
+		OLED_CONTROL_PORT &= ~(1<<OLED_DC);
+		
+	OLED_CONTROL_PORT &= ~(1<<OLED_CS);
+  		  
+	ssd1306_shift(c);
 		
 	OLED_CONTROL_PORT |= (1<<OLED_CS);
 	
@@ -58,6 +57,27 @@ inline void ssd1306_write(uint8_t dc, uint8_t c)
 	OLED_DATA_PORT |= (1<<OLED_MOSI);
 }
 
+// a run of data bytes is sent between ssd1306_data_begin and ssd1306_data_end with the chip selected once,
+// instead of selecting it again for every byte. Nothing else may be written to the display in between.
+void ssd1306_data_begin()
+{
+	OLED_CONTROL_PORT |= (1<<OLED_DC);
+	OLED_CONTROL_PORT &= ~(1<<OLED_CS);
+}
+
+void ssd1306_data(uint8_t c)
+{
+	ssd1306_shift(c);
+}
+
+void ssd1306_data_end()
+{
+	OLED_CONTROL_PORT |= (1<<OLED_CS);
+	
+	// leave data pin high
+	OLED_DATA_PORT |= (1<<OLED_MOSI);
+}
+
 void ssd1306_init() 
 {
 	// set pin directions
@@ -124,26 +144,35 @@ void ssd1306_init()
 	ssd1306_write(OLED_CMD, SSD1306_DISPLAYON);//--turn on oled panel
 }
 
-void ssd1306_char(uint8_t c, uint8_t inverse) 
+static void ssd1306_send_char(uint8_t c, uint8_t inverse) 
 {
 	prog_uint8_t* pChar = font + ((c - 32) * 5);
 	
 	for (uint8_t i=0; i<5; i++ ) 
 	{
 		uint8_t pixels = pgm_read_byte(pChar);
-		ssd1306_write(OLED_DATA, inverse ? pixels ^ 0x7F : pixels);
+		ssd1306_shift(inverse ? pixels ^ 0x7F : pixels);
 		pChar++;
 	}
-	ssd1306_write(OLED_DATA, inverse ? 0x7F : 0x00);
+	ssd1306_shift(inverse ? 0x7F : 0x00);
+}
+
+void ssd1306_char(uint8_t c, uint8_t inverse) 
+{
+	ssd1306_data_begin();
+	ssd1306_send_char(c, inverse);
+	ssd1306_data_end();
 }
 
 void ssd1306_string(char *c, uint8_t inverse) 
 {
+	ssd1306_data_begin();
 	while (*c != 0) 
 	{
-		ssd1306_char(*c, inverse);
+		ssd1306_send_char(*c, inverse);
 		c++;
 	}
+	ssd1306_data_end();
 }
 
 void ssd1306_clear()
@@ -224,297 +253,67 @@ void LcdDrawHeading(char *characters, uint8_t inverse)
 		LcdGoto(6,0);
 		LcdWrite(LCD_DATA, 0x40);
 	}
+	LcdDataBegin();
 	for (uint8_t i=1; i<lpad; i++)
 	{
-		if (inverse)
-			LcdTinyString(" ", TEXT_INVERSE);
-		else
+		for (uint8_t j=0; j<6; j++)
 		{
-			for (uint8_t j=0; j<6; j++)
-			{
-				LcdWrite(LCD_DATA, 0x40);
-			}
+			LcdData(inverse ? 0x7F : 0x40);
 		}
 	}
+	LcdDataEnd();
 	LcdTinyString(" ", inverse);
 	LcdTinyString(characters, inverse);
 	LcdTinyString(" ", inverse);
+	LcdDataBegin();
 	for (uint8_t i=1; i<rpad; i++)
 	{
-		if (inverse)
-			LcdTinyString(" ", TEXT_INVERSE);
-		else
+		for (uint8_t j=0; j<6; j++)
 		{
-			for (uint8_t j=0; j<6; j++)
-			{
-				LcdWrite(LCD_DATA, 0x40);
-			}
+			LcdData(inverse ? 0x7F : 0x40);
 		}
 	}
+	LcdDataEnd();
 	LcdWrite(LCD_DATA, inverse ? 0x7F : 0x40);
 	LcdGoto(128-6,0);	
 	LcdTinyString(inverse ? ">" : "]", inverse);	
 	
 }
 
-void LcdDrawGraph2(uint8_t timescaleNumber, uint8_t type, uint8_t cursorPos, uint8_t showCursor)
+static void LcdWriteGraphColumn(uint8_t x, const uint8_t* pPages)
 {
-	uint8_t xphase = GetTimescaleNextSampleIndex(timescaleNumber);
-	Sample* pSample;
-	
-	// find the min and max values
-	uint16_t rawValue;
-	uint16_t minRawValue = INVALID_RAW_VALUE;
-	uint16_t maxRawValue = 0;
-	uint16_t rawCursorValue = INVALID_RAW_VALUE;
-	short cursorValue;
-	short minValue;
-	short maxValue;
-	
-	for (uint8_t i=0; i<SAMPLES_PER_GRAPH; i++)
-	{
-		pSample = GetSample(timescaleNumber, i);
-		
-		// ignore unfilled samples
-		if (pSample->temperature == 0 && pSample->pressure == 0 && pSample->altitude == 0)
-			continue;
-			
-		if (type == GRAPH_TEMPERATURE)
-		{
-			rawValue = pSample->temperature;
-		}
-		else if (type == GRAPH_PRESSURE)
-		{
-			rawValue = pSample->pressure;
-		}
-		else
-		{
-			rawValue = pSample->altitude;
-		}
-		
-		if (rawValue > maxRawValue)
-			maxRawValue = rawValue;
-		if (rawValue < minRawValue)
-			minRawValue = rawValue;
-			
-		if (i == (cursorPos+xphase)%SAMPLES_PER_GRAPH)
-		{
-			rawCursorValue = rawValue;
-		}
-	}
-	
-	uint8_t customAxes = 0;
-	
-	if (type == GRAPH_TEMPERATURE)
-	{
-		cursorValue = SAMPLE_TO_TEMPERATURE(rawCursorValue);
-		minValue = graphYMin[GRAPH_TEMPERATURE] == INVALID_SAMPLE ? SAMPLE_TO_TEMPERATURE(minRawValue) : graphYMin[GRAPH_TEMPERATURE];
-		maxValue = graphYMax[GRAPH_TEMPERATURE] == INVALID_SAMPLE ? SAMPLE_TO_TEMPERATURE(maxRawValue) : graphYMax[GRAPH_TEMPERATURE];
-		graphCurrentYMin = minValue / 2;
-		graphCurrentYMax = maxValue / 2;
-		customAxes = graphYMin[GRAPH_TEMPERATURE] != INVALID_SAMPLE || graphYMax[GRAPH_TEMPERATURE] != INVALID_SAMPLE;
-	}
-	else if (type == GRAPH_PRESSURE)
-	{
-		cursorValue = SAMPLE_TO_PRESSURE(rawCursorValue);
-		minValue = graphYMin[GRAPH_PRESSURE] == INVALID_SAMPLE ? SAMPLE_TO_PRESSURE(minRawValue) : graphYMin[GRAPH_PRESSURE];  
-		maxValue = graphYMax[GRAPH_PRESSURE] == INVALID_SAMPLE ? SAMPLE_TO_PRESSURE(maxRawValue) : graphYMax[GRAPH_PRESSURE];
-		graphCurrentYMin = minValue / (2*33.86389f);
-		graphCurrentYMax = maxValue / (2*33.86389f);
-		customAxes = graphYMin[GRAPH_PRESSURE] != INVALID_SAMPLE || graphYMax[GRAPH_PRESSURE] != INVALID_SAMPLE;
-	}
-	else
-	{
-		cursorValue = SAMPLE_TO_ALTITUDE(rawCursorValue);
-		minValue = graphYMin[GRAPH_ALTITUDE] == INVALID_SAMPLE ? SAMPLE_TO_ALTITUDE(minRawValue) : graphYMin[GRAPH_ALTITUDE]/2;
-		maxValue = graphYMax[GRAPH_ALTITUDE] == INVALID_SAMPLE ? SAMPLE_TO_ALTITUDE(maxRawValue) : graphYMax[GRAPH_ALTITUDE]/2;
-		graphCurrentYMin = minValue * 2;
-		graphCurrentYMax = maxValue * 2;
-		customAxes = graphYMin[GRAPH_ALTITUDE] != INVALID_SAMPLE || graphYMax[GRAPH_ALTITUDE] != INVALID_SAMPLE;
-	}
+	LcdGoto(x,1);
 	
-	if (rawCursorValue == INVALID_RAW_VALUE)
+	LcdDataBegin();
+	for (uint8_t y=0; y<7; y++)
 	{
-		cursorValue = INVALID_SAMPLE;
+		LcdData(pPages[y]);
 	}
+	LcdDataEnd();
+}
 
-	const int graphLastPixel = 55; // graphHeight - 1
-	const int minGraphSampleRange = (graphLastPixel+1)/2; // don't allow very small vertical ranges, to prevent super-jaggies
-		
-	if (minRawValue == INVALID_RAW_VALUE)
-	{
-		// no filled samples
-		minValue = INVALID_SAMPLE_MIN;
-		maxValue = INVALID_SAMPLE;
-		graphCurrentYMin = graphCurrentYMax = 0;
-	}	
-	else if (maxValue == minValue)
-	{
-		maxValue = minValue + 1;
-	}	
-	else if (maxValue - minValue < minGraphSampleRange)
-	{
-		// require at least 1 sample step per 2 Y pixels
-		short avgValue = (minValue + maxValue) / 2;
-		minValue = avgValue - minGraphSampleRange/2;
-		maxValue = avgValue + minGraphSampleRange/2;
-	}
-	
-	ssd1306_write(OLED_CMD, SSD1306_MEMORYMODE); // 0x20
-	ssd1306_write(OLED_CMD, 0x01); // vertical
-	
-	// start at the right side of the graph	
-	xphase += SAMPLES_PER_GRAPH - 1;
-	xphase %= SAMPLES_PER_GRAPH;	
-	
-	short sampleValue;
-	uint8_t prevysample = 0xFF;
+void LcdDrawGraph2(uint8_t timescaleNumber, uint8_t type, uint8_t cursorPos, uint8_t showCursor, uint16_t minutesAgo)
+{
+	Graph graph;
+	graph.timescaleNumber = timescaleNumber;
+	graph.type = type;
+	graph.cursorPos = cursorPos;
+	graph.showCursor = showCursor;
+	graph.minutesAgo = minutesAgo;
+	graph.numPages = 7;
+	GraphFindRange(&graph);
 	
 	uint8_t yMinLabelBuffer[6*5];
 	uint8_t yMaxLabelBuffer[6*5];
 	
-	uint8_t yMinSize;
-	uint8_t yMaxSize;
+	LcdMakeGraphYAxis(type, graph.minValue, graph.maxValue, yMinLabelBuffer, yMaxLabelBuffer, &graph.yMinSize, &graph.yMaxSize);
+	graph.pYMinLabel = yMinLabelBuffer;
+	graph.pYMaxLabel = yMaxLabelBuffer;
 	
-	LcdMakeGraphYAxis(type, minValue, maxValue, yMinLabelBuffer, yMaxLabelBuffer, &yMinSize, &yMaxSize);
-		
-	for (uint8_t x=SAMPLES_PER_GRAPH-1; x<SAMPLES_PER_GRAPH; x--)
-	{
-		LcdGoto(x,1);
-		
-		uint8_t ormask[7];
-		uint8_t andmask[7];
-		
-		for (uint8_t y=0; y<7; y++)
-		{
-			ormask[y] = (showCursor && (x == cursorPos)) ? 0x55 : 0;	
-			andmask[y] = 0xFF;
-			
-			if (x < yMaxSize && !showCursor)
-			{
-				ormask[0] |= yMaxLabelBuffer[x];
-				andmask[0] = 0xC0;
-			}
-			if (x < yMinSize && !showCursor)
-			{		
-				ormask[6] |= yMinLabelBuffer[x];
-				andmask[6] = 0x03;
-			}
-		}
-			
-		pSample = GetSample(timescaleNumber, xphase);
-		
-		xphase--;
-		if (xphase == 0xFF)
-			xphase = SAMPLES_PER_GRAPH-1;
-		
-		if (type == GRAPH_TEMPERATURE)
-		{
-			sampleValue = SAMPLE_TO_TEMPERATURE(pSample->temperature);
-		}
-		else if (type == GRAPH_PRESSURE)
-		{
-			sampleValue = SAMPLE_TO_PRESSURE(pSample->pressure);
-		}
-		else
-		{
-			sampleValue = SAMPLE_TO_ALTITUDE(pSample->altitude);
-		}
-				
-		uint8_t pixeldata[7];
-		
-		for (uint8_t y=0; y<7; y++)
-		{
-			pixeldata[y] = 0;
-		}			
-		
-		/* this doesn't work right, and doesn't look very good either
-		// show timescale tickmarks for major time boundaries
-		uint8_t samplePeriod = minutesPerSample[timescaleNumber];
-		int16_t sampleHourMin = hourMin - (LCD_WIDTH-1-x)*samplePeriod;
-		
-		if (((samplePeriod < 3) && (sampleHourMin % 30 == 0)) ||
-			((samplePeriod < 8) && (sampleHourMin % 60 == 0)) ||
-			((samplePeriod < 30) && (sampleHourMin % 240 == 0)) ||
-			(sampleHourMin % 1440 == 0))
-		{
-			pixeldata[0] |= 0x03;
-			pixeldata[4] |= 0xC0;
-		}	
-		*/
-		
-		if (sampleValue < minValue || sampleValue > maxValue ||
-			(pSample->temperature == 0 && pSample->pressure == 0 && pSample->altitude == 0))
-		{
-			// sample is out of range or unfilled
-			prevysample = 0xFF;		
-		}
-		else
-		{
-			uint8_t ysample = graphLastPixel - (long) graphLastPixel * (sampleValue - minValue) / (maxValue - minValue);
-			uint8_t yrow = ysample >> 3;
-			uint8_t ybit = ysample & 0x7; // ysample % 8
-			uint8_t pixel = 0x01;
-			
-			while (ybit)
-			{
-				pixel = pixel << 1;
-				ybit--;
-			}		
-			
-			pixeldata[yrow] = pixel;
-			
-			if (ysample != prevysample && prevysample != 0xFF && !graphDrawPoints[type])
-			{
-				// modify the pixel data to extend a line towards the previous pixel
-				if (prevysample < ysample)
-				{
-					// previous sample is above new one
-					while (1)
-					{
-						while (ysample != prevysample && (pixeldata[yrow] & 0x1) == 0)
-						{
-							pixeldata[yrow] = pixeldata[yrow] | (pixeldata[yrow]>>1);
-							prevysample++;
-						}
-						
-						if (ysample == prevysample)
-							break;
-							
-						yrow--;
-						pixeldata[yrow] = 0x80;
-						prevysample++;
-					}															
-				}
-				else
-				{
-					// previous sample is equal or below new one
-					while (1)
-					{
-						while (ysample != prevysample && (pixeldata[yrow] & 0x80) == 0)
-						{
-							pixeldata[yrow] = pixeldata[yrow] | (pixeldata[yrow]<<1);
-							prevysample--;						
-						}
-						
-						if (ysample == prevysample)
-							break;
-							
-						yrow++;
-						pixeldata[yrow] = 0x01;
-						prevysample--;
-					}			
-				}
-			}
-			
-			prevysample = ysample;
-		}	
-		
-		for (uint8_t y=0; y<7; y++)
-		{
-			LcdWrite(LCD_DATA, (pixeldata[y] & andmask[y]) | ormask[y]);				
-		}		
-	}	
+	ssd1306_write(OLED_CMD, SSD1306_MEMORYMODE); // 0x20
+	ssd1306_write(OLED_CMD, 0x01); // vertical
+	
+	GraphDrawColumns(&graph, LcdWriteGraphColumn);
 	
 	ssd1306_write(OLED_CMD, SSD1306_MEMORYMODE); // 0x20
 	ssd1306_write(OLED_CMD, 0x00); // horizontal
@@ -522,13 +321,7 @@ void LcdDrawGraph2(uint8_t timescaleNumber, uint8_t type, uint8_t cursorPos, uin
 	char str[21];
 	if (showCursor)
 	{
-		uint16_t minutesOfDay;
-		ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
-		{
-			minutesOfDay = clock_hour * 60 + clock_minute;
-		}
-	
-		MakePastTimeString(str, minutesOfDay % minutesPerSample[timescaleNumber] + (SAMPLES_PER_GRAPH - 1 - cursorPos) * minutesPerSample[timescaleNumber]);
+		MakePastTimeString(str, GraphColumnMinutesAgo(&graph, cursorPos));
 		LcdDrawGraphLeftLegend(str);
 		
 		for (uint8_t xclear = 1+strlen(str)*6; xclear < LCD_WIDTH; xclear++)
@@ -540,9 +333,9 @@ void LcdDrawGraph2(uint8_t timescaleNumber, uint8_t type, uint8_t cursorPos, uin
 		// TODO: harmonize all the units-related functions so this isn't necessary
 		if (type == GRAPH_ALTITUDE)
 		{
-			cursorValue *= 2;
+			graph.cursorValue *= 2;
 		}		
-		MakeSampleValueAndUnitsStringForGraph(str, type, cursorValue);
+		MakeSampleValueAndUnitsStringForGraph(str, type, graph.cursorValue);
 		LcdDrawGraphRightLegend(str);
 	}
 	else
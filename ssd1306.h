@@ -20,6 +20,7 @@
 
 #include <avr/io.h>
 #include "sampling.h"
+#include "graph.h"
 
 #define OLED_CONTROL_PORT PORTD
 #define OLED_CONTROL_DDR DDRD
@@ -71,31 +72,35 @@
 #define TEXT_INVERSE 1
 
 extern volatile uint8_t lcd_contrast;
-extern volatile int16_t graphCurrentYMin;
-extern volatile int16_t graphCurrentYMax;
-extern volatile int16_t graphYMin[GRAPH_COUNT];
-extern volatile int16_t graphYMax[GRAPH_COUNT];
-extern volatile uint8_t graphDrawPoints[GRAPH_COUNT];
 
 void ssd1306_init();
 void ssd1306_clear();
 void ssd1306_goto(uint8_t x, uint8_t y);
 void ssd1306_write(uint8_t dc, uint8_t c);
+void ssd1306_data_begin();
+void ssd1306_data(uint8_t c);
+void ssd1306_data_end();
 void ssd1306_string(char *c, uint8_t inverse); 
 void ssd1306_char(uint8_t c, uint8_t inverse);
  
+// columns drawn for one character by LcdString or LcdTinyString
+#define LcdCharWidth(character, tiny) 6
+
 void LcdReset(void);
 void LcdClear(void);
 void LcdPowerSave(uint8_t powerSaveOn);
 #define LcdGoto(x, y) ssd1306_goto(x, y)
 #define LcdWrite(dc, data) ssd1306_write(dc, data)
+#define LcdDataBegin() ssd1306_data_begin()
+#define LcdData(data) ssd1306_data(data)
+#define LcdDataEnd() ssd1306_data_end()
 #define LcdCharacter(character, inverse) ssd1306_char(character, inverse)
 #define LcdString(characters) ssd1306_string(characters, TEXT_NORMAL)
 #define LcdTinyString(characters, inverse) ssd1306_string(characters, inverse)
 #define LcdTinyStringFramed(characters) ssd1306_string(characters, TEXT_NORMAL)
 void LcdDrawHeading(char *characters, uint8_t inverse);
 void LcdDrawTitle(uint8_t graphType, uint8_t timescaleNumber, uint8_t inverse);
-void LcdDrawGraph2(uint8_t timescaleNumber, uint8_t type, uint8_t cursorPos, uint8_t showCursor);
+void LcdDrawGraph2(uint8_t timescaleNumber, uint8_t type, uint8_t cursorPos, uint8_t showCursor, uint16_t minutesAgo);
 void LcdMakeGraphYAxis(uint8_t type, int yminlabel, int ymaxlabel, uint8_t* yMinBUffer, uint8_t* yMaxBuffer, uint8_t* yMinSize, uint8_t* yMaxSize);
 void LcdDrawGraphLeftLegend(char *characters);
 void LcdDrawGraphRightLegend(char *characters); 
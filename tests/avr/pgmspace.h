@@ -0,0 +1,12 @@
+// Host stand-in for avr-libc's <avr/pgmspace.h>, for the host tests. Program memory is ordinary memory here.
+
+#ifndef PGMSPACE_H_
+#define PGMSPACE_H_
+
+#include <inttypes.h>
+
+#define PROGMEM
+#define pgm_read_byte(p) (*(const uint8_t*)(p))
+#define pgm_read_word(p) (*(const uint16_t*)(p))
+
+#endif /* PGMSPACE_H_ */
@@ -0,0 +1,195 @@
+/* 
+  Copyright (c) 2011 Steve Chamberlin
+  Permission is hereby granted, free of charge, to any person obtaining a copy of this hardware, software, and associated documentation 
+  files (the "Product"), to deal in the Product without restriction, including without limitation the rights to use, copy, modify, merge, 
+  publish, distribute, sublicense, and/or sell copies of the Product, and to permit persons to whom the Product is furnished to do so, 
+  subject to the following conditions: 
+
+  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Product. 
+
+  THE PRODUCT IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF 
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+  ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH 
+  THE PRODUCT OR THE USE OR OTHER DEALINGS IN THE PRODUCT.
+*/
+
+// Host test of MakeFixedPointString, built with the host's C compiler by tests/Makefile. Each call site's
+// arguments are checked against the dtostrf output they replaced, for every value the site can be given.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// avr-libc's ultoa, which the host library doesn't have. Only base 10 is used.
+static char* ultoa(unsigned long value, char* str, int radix)
+{
+	sprintf(str, "%lu", value);
+	return str;
+}
+
+#include "../fixedpoint.c"
+
+static int failures = 0;
+
+// the old output: avr-libc's dtostrf(value, 1, places, str), where doubles are 32 bit floats. dtostrf works from
+// the float's first 7 significant digits, then rounds the magnitude half away from zero, and a negative value
+// keeps its minus sign even if it rounds to zero. So 0.005f, which is 0.0049999999, still rounds to 0.01.
+static void OldDtostrf(float value, uint8_t places, char* str)
+{
+	char digits[20];
+	int exponent;
+	long long mantissa = 0;
+	
+	// value = mantissa * 10^(exponent - 6), with 7 digits in the mantissa
+	sprintf(digits, "%.6e", fabs((double)value));
+	for (char* p=digits; *p && *p != 'e'; p++)
+	{
+		if (*p != '.')
+		{
+			mantissa = mantissa * 10 + (*p - '0');
+		}
+	}
+	exponent = atoi(strchr(digits, 'e') + 1);
+	
+	long long scaled = mantissa;
+	int shift = exponent - 6 + places;
+	for (; shift > 0; shift--)
+	{
+		scaled *= 10;
+	}
+	if (shift < -7)
+	{
+		scaled = 0;
+	}
+	else if (shift < 0)
+	{
+		long long divisor = 1;
+		for (; shift < 0; shift++)
+		{
+			divisor *= 10;
+		}
+		scaled = (scaled + divisor / 2) / divisor;
+	}
+	
+	long long scale = powersOfTen[places];
+	str += sprintf(str, "%s%lld", value < 0 ? "-" : "", scaled / scale);
+	if (places != 0)
+	{
+		sprintf(str, ".%0*lld", places, scaled % scale);
+	}
+}
+
+static void Check(const char* site, long val, float oldValue, int32_t numerator, uint16_t denominator, uint8_t places)
+{
+	char expected[20];
+	char actual[20];
+	OldDtostrf(oldValue, places, expected);
+	char* end = MakeFixedPointString(actual, numerator, denominator, places);
+	
+	if (strcmp(expected, actual) != 0 || end != actual + strlen(actual))
+	{
+		if (failures < 20)
+		{
+			printf("%s(%ld): expected \"%s\", got \"%s\"\n", site, val, expected, actual);
+		}
+		failures++;
+	}
+}
+
+// MakeTemperatureString and MakeTemperatureDifferenceString, for every int16 value, which covers every
+// temperature code and every difference between two codes. The float expressions are the ones the old
+// code used.
+static void TestTemperature()
+{
+	for (long val=-32768; val<=32767; val++)
+	{
+		float fVal = val;
+		Check("temperature F", val, fVal/2, val, 2, 1);
+		
+		fVal = val;
+		fVal = ((fVal - 64) * 5) / 9;
+		Check("temperature C", val, fVal/2, (val - 64) * 5, 18, 1);
+		
+		fVal = val;
+		fVal = (fVal * 5) / 9;
+		Check("temperature difference C", val, fVal/2, val * 5, 18, 1);
+	}
+}
+
+// MakePressureString, for every int16 value, which covers every pressure code. An odd number of half
+// millibars is a tie when rounded to whole millibars.
+static void TestPressure()
+{
+	for (long val=-32768; val<=32767; val++)
+	{
+		Check("pressure mb", val, (float)val/2, val, 2, 0);
+		
+		int16_t inches = (int32_t)(2953L * val) / 100000;
+		Check("pressure inHg", val, (float)inches/2, inches, 2, 2);
+	}
+}
+
+// the System screen's battery line, for every voltage in hundredths of a volt that fits the uint16_t
+static void TestBattery()
+{
+	for (long val=0; val<=65535; val++)
+	{
+		Check("battery", val, (float)val/100, val, 100, 2);
+	}
+}
+
+// negative values halfway between two results round away from zero, and ones that round to zero keep the sign
+static void TestNegativeHalves()
+{
+	static const struct
+	{
+		int32_t numerator;
+		uint16_t denominator;
+		uint8_t places;
+		const char* expected;
+	} cases[] = {
+		{ 1, 2, 0, "1" },
+		{ -1, 2, 0, "-1" },
+		{ -3, 2, 0, "-2" },
+		{ -2001, 2, 0, "-1001" },
+		{ -1, 20, 1, "-0.1" },
+		{ -3, 20, 1, "-0.2" },
+		{ -1, 200, 2, "-0.01" },
+		{ -1, 2000, 3, "-0.001" },
+		{ -1, 3, 0, "-0" },
+		{ -1, 30, 1, "-0.0" },
+		{ 0, 2, 1, "0.0" },
+	};
+	
+	for (uint8_t i=0; i<sizeof(cases)/sizeof(cases[0]); i++)
+	{
+		char str[20];
+		char expected[20];
+		MakeFixedPointString(str, cases[i].numerator, cases[i].denominator, cases[i].places);
+		OldDtostrf((float)cases[i].numerator / cases[i].denominator, cases[i].places, expected);
+		
+		if (strcmp(str, cases[i].expected) != 0 || strcmp(expected, cases[i].expected) != 0)
+		{
+			printf("%ld/%u: expected \"%s\", got \"%s\", old \"%s\"\n", (long)cases[i].numerator, cases[i].denominator,
+				cases[i].expected, str, expected);
+			failures++;
+		}
+	}
+}
+
+int main()
+{
+	TestNegativeHalves();
+	TestTemperature();
+	TestPressure();
+	TestBattery();
+	
+	if (failures)
+	{
+		printf("fixedpoint: %d checks failed\n", failures);
+		return 1;
+	}
+	printf("fixedpoint: all checks passed\n");
+	return 0;
+}
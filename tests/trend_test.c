@@ -0,0 +1,435 @@
+/*
+  Copyright (c) 2011 Steve Chamberlin
+  Permission is hereby granted, free of charge, to any person obtaining a copy of this hardware, software, and associated documentation
+  files (the "Product"), to deal in the Product without restriction, including without limitation the rights to use, copy, modify, merge,
+  publish, distribute, sublicense, and/or sell copies of the Product, and to permit persons to whom the Product is furnished to do so,
+  subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Product.
+
+  THE PRODUCT IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+  ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH
+  THE PRODUCT OR THE USE OR OTHER DEALINGS IN THE PRODUCT.
+*/
+
+// Host test of the trends, built with the host's C compiler by tests/Makefile. The running-sum slopes are
+// checked against a least-squares fit computed from scratch over the same window, after every sample of long
+// random runs with gaps, partly filled windows and cleared timescales. The integer altitude filter is checked
+// against the same filter in floating point, and for how it settles after steps and climbs.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "../trend.c"
+
+static int failures = 0;
+
+// stand-ins for the SRAM timescales in sampling.c
+Sample sampleData[NUM_SRAM_TIME_SCALES][SAMPLES_PER_GRAPH];
+uint8_t nextSampleIndex[NUM_SRAM_TIME_SCALES];
+uint16_t minutesPerSample[NUM_TIME_SCALES] = {1, 5, 30};
+uint16_t minuteCount;
+volatile uint32_t clock_elapsedQuarterSeconds;
+
+Sample* GetSample(uint8_t timescaleNumber, uint8_t index)
+{
+	return &sampleData[timescaleNumber][index];
+}
+
+// as SamplingInit does when the timescales are cleared
+static void ClearSamples()
+{
+	memset(sampleData, 0, sizeof(sampleData));
+	memset(nextSampleIndex, 0, sizeof(nextSampleIndex));
+	minuteCount = 0;
+	TrendInit();
+}
+
+// as StoreSample does each minute. An all zero sample is an unfilled one.
+static void StoreTestSample(Sample* pSample)
+{
+	for (uint8_t i=0; i<NUM_SRAM_TIME_SCALES; i++)
+	{
+		if (minuteCount % minutesPerSample[i] == 0)
+		{
+			uint8_t index = nextSampleIndex[i];
+			sampleData[i][index] = *pSample;
+			TrendSampleStored(i, index);
+			nextSampleIndex[i] = (index + 1) % SAMPLES_PER_GRAPH;
+		}
+	}
+	minuteCount++;
+}
+
+static void RandomSample(Sample* pSample, int gapPercent)
+{
+	memset(pSample, 0, sizeof(Sample));
+	if (rand() % 100 < gapPercent)
+		return;
+
+	pSample->temperature = rand() % (1 << TEMPERATURE_BITS);
+	pSample->pressure = rand() % (1 << PRESSURE_BITS);
+	pSample->altitude = rand() % (1 << ALTITUDE_BITS);
+	if (pSample->temperature == 0 && pSample->pressure == 0 && pSample->altitude == 0)
+	{
+		pSample->altitude = 1;
+	}
+}
+
+// the least-squares slope in raw units per hour, from every sample in the window, or 0 if the trend should
+// be invalid. hikea.c shows an invalid trend as INVALID_RATE.
+static uint8_t ReferenceSlope(uint8_t trendNumber, double* pSlopePerHour)
+{
+	Trend* pTrend = &trends[trendNumber];
+	uint8_t timescaleNumber = pTrend->timescaleNumber;
+	uint8_t newest = (nextSampleIndex[timescaleNumber] + SAMPLES_PER_GRAPH - 1) % SAMPLES_PER_GRAPH;
+	double n = 0, sumX = 0, sumXX = 0, sumY = 0, sumXY = 0;
+
+	for (uint8_t x=0; x<pTrend->windowSize; x++)
+	{
+		uint8_t index = (newest + SAMPLES_PER_GRAPH - (pTrend->windowSize - 1) + x) % SAMPLES_PER_GRAPH;
+		Sample* pSample = &sampleData[timescaleNumber][index];
+		if (pSample->temperature == 0 && pSample->pressure == 0 && pSample->altitude == 0)
+			continue;
+
+		double y = TrendRawValue(pSample, pTrend->type);
+		n++;
+		sumX += x;
+		sumXX += (double)x * x;
+		sumY += y;
+		sumXY += x * y;
+	}
+
+	if (n < 2 || n * 2 < pTrend->windowSize)
+		return 0;
+
+	*pSlopePerHour = (n * sumXY - sumX * sumY) / (n * sumXX - sumX * sumX) * 60 / minutesPerSample[timescaleNumber];
+	return 1;
+}
+
+static void CheckTrends(const char* run, long step)
+{
+	for (uint8_t i=0; i<TREND_COUNT; i++)
+	{
+		double expected = 0;
+		float actual = 0;
+		uint8_t expectedValid = ReferenceSlope(i, &expected);
+		uint8_t actualValid = TrendGetSlope(i, &actual);
+
+		if (expectedValid != actualValid || (expectedValid && fabs(actual - expected) > 1e-5 * (1 + fabs(expected))))
+		{
+			if (failures < 20)
+			{
+				printf("%s, step %ld, trend %u: expected %s%g, got %s%g\n", run, step, i,
+					expectedValid ? "" : "invalid ", expected, actualValid ? "" : "invalid ", actual);
+			}
+			failures++;
+		}
+	}
+}
+
+// random values over the raw sample's whole range, with gapPercent of the samples unfilled, checked after
+// every sample. The timescales are cleared now and then, so windows refill from empty at every position in
+// the ring.
+static void TestRandom(const char* run, int gapPercent, long steps)
+{
+	Sample sample;
+
+	ClearSamples();
+	for (long step=0; step<steps; step++)
+	{
+		if (rand() % 2000 == 0)
+		{
+			ClearSamples();
+		}
+		RandomSample(&sample, gapPercent);
+		StoreTestSample(&sample);
+		CheckTrends(run, step);
+	}
+}
+
+// long runs of unfilled samples, as when the Logger was switched off, so windows empty and refill
+static void TestLongGaps(long steps)
+{
+	Sample sample;
+
+	ClearSamples();
+	for (long step=0; step<steps; )
+	{
+		int gap = rand() % 3 == 0;
+		int length = 1 + rand() % 400;
+		for (int i=0; i<length && step<steps; i++, step++)
+		{
+			RandomSample(&sample, gap ? 100 : 5);
+			StoreTestSample(&sample);
+			CheckTrends("long gaps", step);
+		}
+	}
+}
+
+// a ramp of one raw unit a minute has a slope of 60 units per hour over either timescale, a constant has a
+// slope of 0, and a trend stays invalid until half of its window is filled
+static void TestRampAndThreshold()
+{
+	Sample sample;
+	memset(&sample, 0, sizeof(sample));
+	static const uint8_t trendNumbers[] = {TREND_TEMPERATURE, TREND_PRESSURE_1, TREND_PRESSURE_5};
+	static const float expectedSlopes[] = {0, 60, 60};
+
+	ClearSamples();
+	for (uint16_t step=0; step<SAMPLES_PER_GRAPH * minutesPerSample[1]; step++)
+	{
+		sample.temperature = 100;
+		sample.pressure = 100 + step;
+		StoreTestSample(&sample);
+
+		for (uint8_t i=0; i<TREND_COUNT; i++)
+		{
+			Trend* pTrend = &trends[trendNumbers[i]];
+			uint16_t stored = step / minutesPerSample[pTrend->timescaleNumber] + 1;
+			float slope;
+			uint8_t valid = TrendGetSlope(trendNumbers[i], &slope);
+
+			if (valid != (stored >= 2 && stored * 2 >= pTrend->windowSize))
+			{
+				printf("ramp, step %u, trend %u: %s\n", step, i, valid ? "valid too soon" : "still invalid");
+				failures++;
+			}
+			else if (valid && fabs(slope - expectedSlopes[i]) > 1e-4)
+			{
+				printf("ramp, step %u, trend %u: slope %g, expected %g\n", step, i, slope, expectedSlopes[i]);
+				failures++;
+			}
+		}
+	}
+}
+
+// the altitude filter in floating point, in feet and feet per minute
+typedef struct
+{
+	double altitude;
+	double velocity;
+	uint32_t time;
+	uint8_t updates;
+} ReferenceFilter;
+
+static ReferenceFilter reference;
+
+static void ReferenceFilterUpdate(int32_t measured)
+{
+	uint32_t dt = clock_elapsedQuarterSeconds - reference.time;
+	
+	if (reference.updates == 0 || dt > ALTITUDE_FILTER_MAX_GAP)
+	{
+		reference.altitude = measured;
+		reference.velocity = 0;
+		reference.time = clock_elapsedQuarterSeconds;
+		reference.updates = 1;
+		return;
+	}
+	if (dt == 0)
+		return;
+	
+	double alpha = ALTITUDE_FILTER_ALPHA / 256.0;
+	double beta = ALTITUDE_FILTER_BETA / 256.0;
+	double minutes = (double)dt / QUARTER_SECONDS_PER_MINUTE;
+	
+	reference.time = clock_elapsedQuarterSeconds;
+	reference.altitude += reference.velocity * minutes;
+	double residual = measured - reference.altitude;
+	if (minutes < 1)
+	{
+		reference.altitude += alpha * minutes * residual;
+		reference.velocity += beta * minutes * residual;
+	}
+	else
+	{
+		reference.altitude += alpha * residual;
+		reference.velocity += beta * residual / minutes;
+	}
+	if (reference.updates != 255)
+	{
+		reference.updates++;
+	}
+}
+
+static void ResetFilters()
+{
+	TrendAltitudeReset();
+	reference.updates = 0;
+}
+
+// feeds both filters a measurement dt quarter seconds after the last one, and checks the integer filter's
+// altitude in 1/16 ft and vertical speed in 1/16 ft per minute against the reference
+static void FeedFilters(const char* run, long step, uint32_t dt, int32_t measured)
+{
+	clock_elapsedQuarterSeconds += dt;
+	TrendAltitudeUpdate(measured);
+	ReferenceFilterUpdate(measured);
+	
+	double altitude = TrendGetAltitude() / 16.0;
+	int32_t velocity = 0;
+	uint8_t velocityValid = TrendGetVerticalSpeed(&velocity);
+	
+	if (fabs(altitude - reference.altitude) > 0.375 || velocityValid != (reference.updates >= 3) ||
+		(velocityValid && fabs(velocity / 16.0 - reference.velocity) > 0.25))
+	{
+		if (failures < 20)
+		{
+			printf("%s, step %ld: expected %.3f ft, %.3f ft/min%s, got %.3f ft, %.3f ft/min%s\n", run, step,
+				reference.altitude, reference.velocity, reference.updates >= 3 ? "" : " (invalid)",
+				altitude, velocity / 16.0, velocityValid ? "" : " (invalid)");
+		}
+		failures++;
+	}
+}
+
+static void CheckSettled(const char* run, double expectedAltitude, double expectedVelocity)
+{
+	int32_t velocity = 0;
+	uint8_t velocityValid = TrendGetVerticalSpeed(&velocity);
+	if (fabs(TrendGetAltitude() / 16.0 - expectedAltitude) > 1 || !velocityValid ||
+		fabs(velocity / 16.0 - expectedVelocity) > 0.5)
+	{
+		printf("%s: settled at %.3f ft, %.3f ft/min, expected %.3f ft, %.3f ft/min\n", run,
+			TrendGetAltitude() / 16.0, velocity / 16.0, expectedAltitude, expectedVelocity);
+		failures++;
+	}
+}
+
+// a step in altitude, with measurements a minute apart and a second apart. The filter overshoots and then
+// settles at the new altitude with no vertical speed.
+static void TestFilterStep()
+{
+	static const uint32_t intervals[] = {QUARTER_SECONDS_PER_MINUTE, 4, 1};
+	
+	for (uint8_t i=0; i<sizeof(intervals)/sizeof(intervals[0]); i++)
+	{
+		uint32_t dt = intervals[i];
+		long steps = 60L * QUARTER_SECONDS_PER_MINUTE / dt;
+		
+		ResetFilters();
+		for (long step=0; step<steps; step++)
+		{
+			FeedFilters("step", step, dt, 1000);
+		}
+		CheckSettled("step, before", 1000, 0);
+		for (long step=0; step<steps; step++)
+		{
+			FeedFilters("step", step, dt, 1250);
+		}
+		CheckSettled("step, after", 1250, 0);
+	}
+}
+
+// a steady climb and descent, with measurements a minute apart and a second apart. The vertical speed
+// settles at the rate, and the altitude lags the measurements by nothing once it has.
+static void TestFilterClimb()
+{
+	static const uint32_t intervals[] = {QUARTER_SECONDS_PER_MINUTE, 4};
+	static const int32_t rates[] = {30, -45, 2};
+	
+	for (uint8_t i=0; i<sizeof(intervals)/sizeof(intervals[0]); i++)
+	{
+		for (uint8_t j=0; j<sizeof(rates)/sizeof(rates[0]); j++)
+		{
+			uint32_t dt = intervals[i];
+			long steps = 90L * QUARTER_SECONDS_PER_MINUTE / dt;
+			int32_t measured = 0;
+			
+			ResetFilters();
+			for (long step=0; step<steps; step++)
+			{
+				measured = 5000 + (int32_t)(rates[j] * (step * (double)dt / QUARTER_SECONDS_PER_MINUTE));
+				FeedFilters("climb", step, dt, measured);
+			}
+			CheckSettled("climb", measured, rates[j]);
+		}
+	}
+}
+
+// noisy measurements at random intervals, some closer than a minute and some further apart, with repeats at
+// the same time and gaps long enough to restart the filter
+static void TestFilterRandom()
+{
+	int32_t altitude = 3000;
+	
+	ResetFilters();
+	for (long step=0; step<200000; step++)
+	{
+		uint32_t dt;
+		int r = rand() % 100;
+		if (r < 5)
+			dt = 0;
+		else if (r < 50)
+			dt = 1 + rand() % (QUARTER_SECONDS_PER_MINUTE - 1);
+		else if (r < 99)
+			dt = QUARTER_SECONDS_PER_MINUTE + rand() % (4 * QUARTER_SECONDS_PER_MINUTE);
+		else
+			dt = ALTITUDE_FILTER_MAX_GAP - 2 + rand() % 4;
+			
+		altitude += rand() % 41 - 20;
+		if (altitude < -1000 || altitude > 14000)
+		{
+			altitude = 3000;
+		}
+		FeedFilters("random", step, dt, altitude + rand() % 11 - 5);
+	}
+}
+
+// the vertical speed is invalid until the third measurement after a reset, and a gap over the limit starts over
+// from the next measurement
+static void TestFilterRestart()
+{
+	int32_t velocity;
+	
+	ResetFilters();
+	for (uint8_t i=0; i<3; i++)
+	{
+		if (TrendGetVerticalSpeed(&velocity))
+		{
+			printf("restart: vertical speed valid after %u measurements\n", i);
+			failures++;
+		}
+		FeedFilters("restart", i, QUARTER_SECONDS_PER_MINUTE, 2000 + 10 * i);
+	}
+	if (!TrendGetVerticalSpeed(&velocity))
+	{
+		printf("restart: vertical speed invalid after 3 measurements\n");
+		failures++;
+	}
+	
+	FeedFilters("restart", 3, ALTITUDE_FILTER_MAX_GAP + 1, 4000);
+	if (TrendGetAltitude() != 4000 * 16 || TrendGetVerticalSpeed(&velocity))
+	{
+		printf("restart: after a long gap, got %.3f ft, expected 4000 ft with no vertical speed\n",
+			TrendGetAltitude() / 16.0);
+		failures++;
+	}
+}
+
+int main()
+{
+	srand(1);
+
+	TestRampAndThreshold();
+	TestRandom("no gaps", 0, 20000);
+	TestRandom("some gaps", 10, 20000);
+	TestRandom("mostly gaps", 60, 20000);
+	TestLongGaps(50000);
+	TestFilterRestart();
+	TestFilterStep();
+	TestFilterClimb();
+	TestFilterRandom();
+
+	if (failures)
+	{
+		printf("trend: %d checks failed\n", failures);
+		return 1;
+	}
+	printf("trend: all checks passed\n");
+	return 0;
+}
@@ -0,0 +1,10 @@
+// Host stand-in for avr-libc's <util/atomic.h>, for the host tests. There are no interrupts, so the block just
+// runs once.
+
+#ifndef ATOMIC_H_
+#define ATOMIC_H_
+
+#define ATOMIC_RESTORESTATE
+#define ATOMIC_BLOCK(type) for (int atomicOnce = 1; atomicOnce; atomicOnce = 0)
+
+#endif /* ATOMIC_H_ */
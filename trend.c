@@ -0,0 +1,233 @@
+/* 
+  Copyright (c) 2011 Steve Chamberlin
+  Permission is hereby granted, free of charge, to any person obtaining a copy of this hardware, software, and associated documentation 
+  files (the "Product"), to deal in the Product without restriction, including without limitation the rights to use, copy, modify, merge, 
+  publish, distribute, sublicense, and/or sell copies of the Product, and to permit persons to whom the Product is furnished to do so, 
+  subject to the following conditions: 
+
+  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Product. 
+
+  THE PRODUCT IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF 
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+  ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH 
+  THE PRODUCT OR THE USE OR OTHER DEALINGS IN THE PRODUCT.
+*/
+
+// Least-squares trends over sliding windows of the SRAM timescales. Each window keeps running sums of x, x^2,
+// y and xy, where x is the sample's position in the window (0 is the oldest) and y is its raw value. The sums
+// are updated as each sample enters and leaves the window, so the regression slope never needs a scan.
+// Unfilled samples are left out of the sums, so gaps and a partly filled window are handled too.
+//
+// Altitude and vertical speed come from an alpha-beta filter instead, which is fed every pressure conversion
+// (the per-minute sample, snapshots and streamed records) and uses only integer math.
+
+#include <util/atomic.h>
+
+#include "trend.h"
+#include "sampling.h"
+#include "clock.h"
+
+// filter gains for measurements a minute apart, in 256ths
+#define ALTITUDE_FILTER_ALPHA 128
+#define ALTITUDE_FILTER_BETA 40
+// restart the filter after a gap this long, in quarter seconds
+#define ALTITUDE_FILTER_MAX_GAP (15 * 60 * 4)
+#define QUARTER_SECONDS_PER_MINUTE 240
+
+typedef struct
+{
+	uint8_t timescaleNumber;
+	uint8_t type;
+	uint8_t windowSize; // samples, less than SAMPLES_PER_GRAPH
+	uint8_t count; // filled samples in the window
+	int32_t sumX;
+	int32_t sumXX;
+	int32_t sumY;
+	int32_t sumXY;
+} Trend;
+
+Trend trends[TREND_COUNT];
+
+// finer than the 1/16 ft and 1/16 ft per minute that are reported, so the small corrections made between
+// streamed records aren't lost to rounding. Residuals up to about 8000 ft fit in the 32 bit products.
+int32_t filterAltitude; // 1/1024 ft
+int32_t filterVelocity; // 1/4096 ft per minute
+uint32_t filterTime; // clock_elapsedQuarterSeconds of the last update
+uint8_t filterUpdates; // saturates at 255
+
+static uint16_t TrendRawValue(Sample* pSample, uint8_t type)
+{
+	if (type == GRAPH_TEMPERATURE)
+		return pSample->temperature;
+	else if (type == GRAPH_PRESSURE)
+		return pSample->pressure;
+	else
+		return pSample->altitude;
+}
+
+// numerator / denominator, rounded half away from zero. The denominator must be positive.
+static int32_t TrendDivideRounded(int32_t numerator, int32_t denominator)
+{
+	if (numerator < 0)
+		return -((denominator / 2 - numerator) / denominator);
+	else
+		return (numerator + denominator / 2) / denominator;
+}
+
+static void TrendSetup(Trend* pTrend, uint8_t timescaleNumber, uint8_t type, uint8_t windowSize)
+{
+	pTrend->timescaleNumber = timescaleNumber;
+	pTrend->type = type;
+	pTrend->windowSize = windowSize;
+	pTrend->count = 0;
+	pTrend->sumX = 0;
+	pTrend->sumXX = 0;
+	pTrend->sumY = 0;
+	pTrend->sumXY = 0;
+}
+
+// call whenever the SRAM timescales are cleared
+void TrendInit()
+{
+	TrendSetup(&trends[TREND_TEMPERATURE], 0, GRAPH_TEMPERATURE, 60);
+	TrendSetup(&trends[TREND_PRESSURE_1], 0, GRAPH_PRESSURE, 60);
+	TrendSetup(&trends[TREND_PRESSURE_5], 1, GRAPH_PRESSURE, 300 / minutesPerSample[1]);
+	
+	TrendAltitudeReset();
+}
+
+// call after a new sample is written at index in one of the SRAM timescales
+void TrendSampleStored(uint8_t timescaleNumber, uint8_t index)
+{
+	for (uint8_t i=0; i<TREND_COUNT; i++)
+	{
+		Trend* pTrend = &trends[i];
+		if (pTrend->timescaleNumber != timescaleNumber)
+			continue;
+			
+		uint8_t lastX = pTrend->windowSize - 1;
+		
+		// the sample leaving the window was at x = 0, so it only counts in sumY
+		uint8_t oldIndex = index + SAMPLES_PER_GRAPH - pTrend->windowSize;
+		if (oldIndex >= SAMPLES_PER_GRAPH)
+			oldIndex -= SAMPLES_PER_GRAPH;
+		Sample* pSample = GetSample(timescaleNumber, oldIndex);
+		if (pSample->temperature != 0 || pSample->pressure != 0 || pSample->altitude != 0)
+		{
+			pTrend->count--;
+			pTrend->sumY -= TrendRawValue(pSample, pTrend->type);
+		}
+		
+		// every remaining sample moves one place towards the start of the window
+		pTrend->sumXX += pTrend->count - 2 * pTrend->sumX;
+		pTrend->sumX -= pTrend->count;
+		pTrend->sumXY -= pTrend->sumY;
+		
+		// the new sample goes at the end
+		pSample = GetSample(timescaleNumber, index);
+		if (pSample->temperature != 0 || pSample->pressure != 0 || pSample->altitude != 0)
+		{
+			uint16_t y = TrendRawValue(pSample, pTrend->type);
+			pTrend->count++;
+			pTrend->sumX += lastX;
+			pTrend->sumXX += lastX * lastX;
+			pTrend->sumY += y;
+			pTrend->sumXY += (int32_t)lastX * y;
+		}
+	}
+}
+
+// the least-squares slope of the trend's raw sample values, in raw units per hour. Returns 0 if less than half
+// of the window is filled.
+uint8_t TrendGetSlope(uint8_t trendNumber, float* pSlopePerHour)
+{
+	Trend* pTrend = &trends[trendNumber];
+	
+	if (pTrend->count < 2 || pTrend->count * 2 < pTrend->windowSize)
+		return 0;
+		
+	int32_t numerator = pTrend->count * pTrend->sumXY - pTrend->sumX * pTrend->sumY;
+	int32_t denominator = pTrend->count * pTrend->sumXX - pTrend->sumX * pTrend->sumX;
+	
+	*pSlopePerHour = (float)numerator * 60 / ((float)denominator * minutesPerSample[pTrend->timescaleNumber]);
+	return 1;
+}
+
+// call when the altitude jumps for a reason other than moving, such as a new calibration
+void TrendAltitudeReset()
+{
+	filterUpdates = 0;
+	filterVelocity = 0;
+}
+
+// feed the filter a new altitude measurement, in feet
+void TrendAltitudeUpdate(int32_t altitude)
+{
+	uint32_t now;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		now = clock_elapsedQuarterSeconds;
+	}
+	
+	int32_t measured = altitude * 1024;
+	uint32_t dt = now - filterTime;
+	
+	if (filterUpdates == 0 || dt > ALTITUDE_FILTER_MAX_GAP)
+	{
+		// start over from this measurement
+		filterAltitude = measured;
+		filterVelocity = 0;
+		filterTime = now;
+		filterUpdates = 1;
+		return;
+	}
+	
+	// a sample, snapshot and stream record taken together are one measurement
+	if (dt == 0)
+		return;
+		
+	filterTime = now;
+	
+	// predict, then correct the altitude and velocity by a fraction of the error. The gains are for measurements
+	// a minute apart, and shrink in proportion for closer ones so streaming doesn't make the filter noisier.
+	// The constant divisors assume the gains divide them evenly.
+	int32_t residual;
+	if (dt < QUARTER_SECONDS_PER_MINUTE)
+	{
+		// these steps are small, so they're rounded rather than truncated, which would pull towards zero
+		filterAltitude += TrendDivideRounded(filterVelocity / 4 * (int16_t)dt, QUARTER_SECONDS_PER_MINUTE);
+		residual = measured - filterAltitude;
+		filterAltitude += TrendDivideRounded(residual * (int16_t)dt,
+			256L * QUARTER_SECONDS_PER_MINUTE / ALTITUDE_FILTER_ALPHA);
+		filterVelocity += TrendDivideRounded(residual * (int16_t)dt,
+			256L * QUARTER_SECONDS_PER_MINUTE / (4 * ALTITUDE_FILTER_BETA));
+	}
+	else
+	{
+		filterAltitude += filterVelocity / 64 * (int32_t)dt / (QUARTER_SECONDS_PER_MINUTE / 16);
+		residual = measured - filterAltitude;
+		filterAltitude += residual * ALTITUDE_FILTER_ALPHA / 256;
+		filterVelocity += residual * (4 * ALTITUDE_FILTER_BETA * QUARTER_SECONDS_PER_MINUTE / 256) / (int32_t)dt;
+	}
+	
+	if (filterUpdates != 255)
+	{
+		filterUpdates++;
+	}
+}
+
+// the filtered altitude, in 1/16 ft
+int32_t TrendGetAltitude()
+{
+	return filterAltitude >> 6;
+}
+
+// the filtered vertical speed, in 1/16 ft per minute. Returns 0 until the filter has had a few measurements.
+uint8_t TrendGetVerticalSpeed(int32_t* pVelocity)
+{
+	if (filterUpdates < 3)
+		return 0;
+		
+	*pVelocity = filterVelocity / 256;
+	return 1;
+}
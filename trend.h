@@ -0,0 +1,36 @@
+/* 
+  Copyright (c) 2011 Steve Chamberlin
+  Permission is hereby granted, free of charge, to any person obtaining a copy of this hardware, software, and associated documentation 
+  files (the "Product"), to deal in the Product without restriction, including without limitation the rights to use, copy, modify, merge, 
+  publish, distribute, sublicense, and/or sell copies of the Product, and to permit persons to whom the Product is furnished to do so, 
+  subject to the following conditions: 
+
+  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Product. 
+
+  THE PRODUCT IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF 
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+  ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH 
+  THE PRODUCT OR THE USE OR OTHER DEALINGS IN THE PRODUCT.
+*/
+
+#ifndef TREND_H_
+#define TREND_H_
+
+#include <inttypes.h>
+
+enum {
+	TREND_TEMPERATURE = 0, // temperature over the last hour
+	TREND_PRESSURE_1, // pressure over the last hour
+	TREND_PRESSURE_5, // pressure over the last 5 hours
+	TREND_COUNT
+};
+
+void TrendInit();
+void TrendSampleStored(uint8_t timescaleNumber, uint8_t index);
+uint8_t TrendGetSlope(uint8_t trendNumber, float* pSlopePerHour);
+void TrendAltitudeReset();
+void TrendAltitudeUpdate(int32_t altitude);
+int32_t TrendGetAltitude();
+uint8_t TrendGetVerticalSpeed(int32_t* pVelocity);
+
+#endif /* TREND_H_ */
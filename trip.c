@@ -0,0 +1,239 @@
+/* 
+  Copyright (c) 2011 Steve Chamberlin
+  Permission is hereby granted, free of charge, to any person obtaining a copy of this hardware, software, and associated documentation 
+  files (the "Product"), to deal in the Product without restriction, including without limitation the rights to use, copy, modify, merge, 
+  publish, distribute, sublicense, and/or sell copies of the Product, and to permit persons to whom the Product is furnished to do so, 
+  subject to the following conditions: 
+
+  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Product. 
+
+  THE PRODUCT IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF 
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+  ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH 
+  THE PRODUCT OR THE USE OR OTHER DEALINGS IN THE PRODUCT.
+*/
+
+// Trip statistics: total ascent and descent, highest and lowest altitude, and elapsed and moving time since
+// the trip was last reset. They're updated once per sample in constant time. Small altitude changes are
+// ignored by a hysteresis band: climbing is counted as it happens, but after a climb the altitude must drop
+// more than TRIP_HYSTERESIS feet below the high point before any descent is counted, and likewise the
+// other way. Barometric noise and weather drift then don't add up to thousands of phantom feet.
+
+#include <avr/eeprom.h>
+#include <util/crc16.h>
+#include <stddef.h>
+
+#include "trip.h"
+#ifdef SHAKE_SENSOR
+#include "shake.h"
+#endif
+
+#define TRIP_HYSTERESIS 15
+// altitudes are kept to at most 5 characters, so the high/low line fits the screen
+#define TRIP_ALTITUDE_MIN -9999
+#define TRIP_ALTITUDE_MAX 30000
+// how often the statistics are written to EEPROM, in minutes. Changes other than the elapsed time are written
+// at most hourly, or sooner when the Logger stops moving, and the elapsed time alone once a day. Each write also
+// rewrites the times and the CRC, so writing every few minutes would wear out those EEPROM cells within a few
+// years. Time that passes after the last write is lost when the power is switched off.
+#define TRIP_SAVE_MINUTES 60
+#define TRIP_STOP_SAVE_MINUTES 15
+#define TRIP_IDLE_SAVE_MINUTES (24 * 60)
+
+TripStats trip;
+TripStats* tripEepromAddress;
+uint16_t tripMinutesSinceSave;
+uint8_t tripChanged; // something other than the elapsed time changed since the last write
+// the altitude where the current climb or descent was last counted, and its direction. Kept in SRAM only,
+// so the first update after power-up starts a new anchor instead of counting whatever happened while off.
+int16_t tripAnchorAltitude;
+uint8_t tripAnchorValid;
+int8_t tripDirection; // 1 climbing, -1 descending, 0 not known yet
+#ifdef SHAKE_SENSOR
+uint8_t tripWasMoving;
+uint16_t tripShakeMinutes;
+#endif
+
+static int16_t TripClampAltitude(int32_t altitude)
+{
+	if (altitude < TRIP_ALTITUDE_MIN)
+		return TRIP_ALTITUDE_MIN;
+	if (altitude > TRIP_ALTITUDE_MAX)
+		return TRIP_ALTITUDE_MAX;
+	return altitude;
+}
+
+static uint16_t TripCrc()
+{
+	uint16_t crc = 0xFFFF;
+	for (uint8_t i=0; i<offsetof(TripStats, crc); i++)
+	{
+		crc = _crc16_update(crc, *((uint8_t*)&trip + i));
+	}
+	return crc;
+}
+
+static void TripSave()
+{
+	trip.crc = TripCrc();
+	eeprom_update_block(&trip, tripEepromAddress, sizeof(TripStats));
+	tripMinutesSinceSave = 0;
+	tripChanged = 0;
+}
+
+// load the statistics from EEPROM, starting a new trip if they're missing or damaged
+void TripInit(TripStats* eepromAddress, uint8_t forceReset)
+{
+	tripEepromAddress = eepromAddress;
+	tripAnchorValid = 0;
+#ifdef SHAKE_SENSOR
+	tripWasMoving = 0;
+#endif
+
+	eeprom_read_block(&trip, tripEepromAddress, sizeof(TripStats));
+	if (forceReset || trip.crc != TripCrc())
+	{
+		TripReset();
+	}
+	else
+	{
+		tripMinutesSinceSave = 0;
+		tripChanged = 0;
+	}
+}
+
+void TripReset()
+{
+	trip.ascent = 0;
+	trip.descent = 0;
+	trip.maxAltitude = INT16_MIN;
+	trip.minAltitude = INT16_MAX;
+	trip.elapsedMinutes = 0;
+	trip.movingMinutes = 0;
+	tripAnchorValid = 0;
+	TripSave();
+}
+
+// call once per minute with the current altitude
+void TripUpdate(int32_t newAltitude)
+{
+	int16_t altitude = TripClampAltitude(newAltitude);
+	uint8_t stopped = 0;
+	
+	if (trip.elapsedMinutes != 0xFFFF)
+	{
+		trip.elapsedMinutes++;
+	}
+	
+#ifdef SHAKE_SENSOR
+	// the shake sensor's trip timer restarts each time movement begins, and already includes the minutes it took 
+	// to decide the Logger was moving
+	uint16_t shakeMinutes = ShakeGetTripTime();
+	if (ShakeIsMoving())
+	{
+		uint16_t moved = tripWasMoving ? shakeMinutes - tripShakeMinutes : shakeMinutes;
+		if (trip.movingMinutes <= 0xFFFF - moved)
+		{
+			trip.movingMinutes += moved;
+		}
+		else
+		{
+			trip.movingMinutes = 0xFFFF;
+		}
+		if (moved != 0)
+		{
+			tripChanged = 1;
+		}
+	}
+	else
+	{
+		stopped = tripWasMoving;
+	}
+	tripWasMoving = ShakeIsMoving();
+	tripShakeMinutes = shakeMinutes;
+#endif
+
+	if (altitude > trip.maxAltitude)
+	{
+		trip.maxAltitude = altitude;
+		tripChanged = 1;
+	}
+	if (altitude < trip.minAltitude)
+	{
+		trip.minAltitude = altitude;
+		tripChanged = 1;
+	}
+	
+	if (!tripAnchorValid)
+	{
+		tripAnchorAltitude = altitude;
+		tripAnchorValid = 1;
+		tripDirection = 0;
+	}
+	else if (altitude > tripAnchorAltitude)
+	{
+		if (tripDirection > 0 || altitude - tripAnchorAltitude > TRIP_HYSTERESIS)
+		{
+			trip.ascent += altitude - tripAnchorAltitude;
+			tripAnchorAltitude = altitude;
+			tripDirection = 1;
+			tripChanged = 1;
+		}
+	}
+	else if (altitude < tripAnchorAltitude)
+	{
+		if (tripDirection < 0 || tripAnchorAltitude - altitude > TRIP_HYSTERESIS)
+		{
+			trip.descent += tripAnchorAltitude - altitude;
+			tripAnchorAltitude = altitude;
+			tripDirection = -1;
+			tripChanged = 1;
+		}
+	}
+	
+	uint16_t saveMinutes = TRIP_IDLE_SAVE_MINUTES;
+	if (tripChanged)
+	{
+		saveMinutes = stopped ? TRIP_STOP_SAVE_MINUTES : TRIP_SAVE_MINUTES;
+	}
+	tripMinutesSinceSave++;
+	if (tripMinutesSinceSave >= saveMinutes)
+	{
+		TripSave();
+	}
+}
+
+// call when recalibration moves every altitude reading by delta feet, so the jump isn't counted as a climb
+// or descent, and the extremes stay comparable with new readings
+void TripAltitudeShifted(int16_t delta)
+{
+	if (trip.maxAltitude >= trip.minAltitude)
+	{
+		trip.maxAltitude = TripClampAltitude((int32_t)trip.maxAltitude + delta);
+		trip.minAltitude = TripClampAltitude((int32_t)trip.minAltitude + delta);
+		tripChanged = 1;
+	}
+	tripAnchorAltitude = TripClampAltitude((int32_t)tripAnchorAltitude + delta);
+}
+
+TripStats* TripGetStats()
+{
+	return &trip;
+}
+
+// total ascent divided by the time spent moving, or by the whole trip without a shake sensor. 
+// returns 0 if no time has passed yet.
+uint8_t TripGetAverageAscentRate(int16_t* pFeetPerHour)
+{
+#ifdef SHAKE_SENSOR
+	uint16_t minutes = trip.movingMinutes;
+#else
+	uint16_t minutes = trip.elapsedMinutes;
+#endif
+	if (minutes == 0)
+		return 0;
+		
+	uint32_t rate = (trip.ascent * 60 + minutes/2) / minutes;
+	*pFeetPerHour = rate > INT16_MAX ? INT16_MAX : rate;
+	return 1;
+}
@@ -0,0 +1,42 @@
+/* 
+  Copyright (c) 2011 Steve Chamberlin
+  Permission is hereby granted, free of charge, to any person obtaining a copy of this hardware, software, and associated documentation 
+  files (the "Product"), to deal in the Product without restriction, including without limitation the rights to use, copy, modify, merge, 
+  publish, distribute, sublicense, and/or sell copies of the Product, and to permit persons to whom the Product is furnished to do so, 
+  subject to the following conditions: 
+
+  The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Product. 
+
+  THE PRODUCT IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF 
+  MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR 
+  ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH 
+  THE PRODUCT OR THE USE OR OTHER DEALINGS IN THE PRODUCT.
+*/
+
+
+#ifndef TRIP_H_
+#define TRIP_H_
+
+#include <inttypes.h>
+
+// trip statistics, kept in EEPROM so they survive power cycles, though the time since they were last written
+// there is lost (see trip.c). Altitudes are in feet, times in minutes.
+typedef struct
+{
+	uint32_t ascent;
+	uint32_t descent;
+	int16_t maxAltitude; // less than minAltitude until the first update
+	int16_t minAltitude;
+	uint16_t elapsedMinutes; // saturates at 0xFFFF
+	uint16_t movingMinutes; // saturates at 0xFFFF
+	uint16_t crc;
+} TripStats;
+
+void TripInit(TripStats* eepromAddress, uint8_t forceReset);
+void TripReset();
+void TripUpdate(int32_t altitude);
+void TripAltitudeShifted(int16_t delta);
+TripStats* TripGetStats();
+uint8_t TripGetAverageAscentRate(int16_t* pFeetPerHour);
+
+#endif /* TRIP_H_ */